@@ -48,6 +48,11 @@ BYTE bFskDev;
 BYTE xdata abFrameArray[bMaxFrameSize_c];
 BYTE bFrameLen;
 
+// Result of commands sent with CMD_FLAG_NO_RESPONSE, reported by CMD_SYNC
+BYTE bSyncStatus;
+BYTE bSyncId;
+WORD wSyncCnt;
+
 //-----------------------------------------------------------------------------
 //-- ISR
 //-----------------------------------------------------------------------------
@@ -74,6 +79,39 @@ void vIsr_Dmd(void) interrupt INTERRUPT_DMD using 2
 			ser_putc(B); \
 	} while (0)
 
+/**
+ * Calculate next CRC-8 state
+ *
+ * Bit-wise instead of table driven, to save code space. This is fast enough
+ * to run while receiving at 9600 baud.
+ */
+BYTE crc8(BYTE crc, BYTE b)
+{
+	BYTE i;
+
+	crc ^= b;
+	for (i = 0; i < 8; i++) {
+		if (crc & 0x80) {
+			crc = (crc << 1) ^ CRC8_POLY;
+		} else {
+			crc <<= 1;
+		}
+	}
+
+	return crc;
+}
+
+BYTE bResCrc;
+
+/**
+ * Send response byte, byte stuffed and added to response CRC
+ */
+void res_putc(BYTE b)
+{
+	bResCrc = crc8(bResCrc, b);
+	byte_stuff_putc(b);
+}
+
 //-----------------------------------------------------------------------------
 //-- Radio helpers
 //-----------------------------------------------------------------------------
@@ -116,7 +154,7 @@ void rf_init()
 	vSys_BandGapLdo(0);
 }
 
-void rf_transmit_frame(float freq, BYTE fdev, BYTE xdata *pbFrameHead, BYTE bLen, BYTE cnt)
+void rf_transmit_begin(float freq, BYTE fdev)
 {
 	// Enable the Bandgap and LDO
 	vSys_BandGapLdo(1);
@@ -130,16 +168,110 @@ void rf_transmit_frame(float freq, BYTE fdev, BYTE xdata *pbFrameHead, BYTE bLen
 	while ( 0 == bDmdTs_GetSamplesTaken() ) {}
 	vPa_Tune( iDmdTs_GetLatestTemp() );
 
-	// Run a single TX loop 
 	vStl_PreLoop();
+}
+
+void rf_transmit_end()
+{
+	vStl_PostLoop();
+
+	// Disable Bandgap and LDO to save power
+	vSys_BandGapLdo(0);
+}
+
+void rf_transmit_frame(float freq, BYTE fdev, BYTE xdata *pbFrameHead, BYTE bLen, BYTE cnt)
+{
+	rf_transmit_begin(freq, fdev);
+
+	// Run a single TX loop 
 	while (cnt != 0) {
 		vStl_SingleTxLoop(pbFrameHead, bLen);
 		cnt--;
 	}
-	vStl_PostLoop();
 
-	// Disable Bandgap and LDO to save power
-	vSys_BandGapLdo(0);
+	rf_transmit_end();
+}
+
+/**
+ * Repeat frame until a byte is received on the serial port
+ *
+ * The serial port is checked between frames. The max. frame count acts as
+ * watchdog in case the host goes away.
+ *
+ * @returns	Number of frames sent
+ */
+WORD rf_transmit_until_rx(float freq, BYTE fdev, BYTE xdata *pbFrameHead, BYTE bLen, WORD wMaxCnt)
+{
+	WORD wCnt = 0;
+
+	rf_transmit_begin(freq, fdev);
+
+	while (wCnt != wMaxCnt && !ser_rx_ready()) {
+		vStl_SingleTxLoop(pbFrameHead, bLen);
+		wCnt++;
+	}
+
+	rf_transmit_end();
+
+	return wCnt;
+}
+
+/**
+ * Send frame on a series of frequencies, see CMD_RF_SWEEP
+ *
+ * The radio stays on between frequencies; only the frequency casting and PA
+ * are retuned. Like rf_transmit_until_rx(), a received byte stops the sweep.
+ *
+ * @returns	Number of frequencies completed
+ */
+WORD rf_transmit_sweep(BYTE bMode, BYTE xdata *pbFreqs, BYTE bHops, BYTE bDwell)
+{
+	float fStart, fStop, fStep, freq;
+	WORD wCnt = 0;
+	BYTE bCnt;
+
+	if (bMode == SWEEP_MODE_RANGE) {
+		memcpy(&fStart, &pbFreqs[0], sizeof(float));
+		memcpy(&fStop, &pbFreqs[sizeof(float)], sizeof(float));
+		memcpy(&fStep, &pbFreqs[2 * sizeof(float)], sizeof(float));
+	}
+
+	// Count limit acts as watchdog, like in rf_transmit_until_rx()
+	while (wCnt != 0xffff && !ser_rx_ready()) {
+		if (bMode == SWEEP_MODE_RANGE) {
+			// Multiply instead of add, so rounding errors don't accumulate
+			freq = fStart + wCnt * fStep;
+			if (freq >= fStop) {
+				break;
+			}
+		} else {
+			if (wCnt == bHops) {
+				break;
+			}
+			memcpy(&freq, &pbFreqs[wCnt * sizeof(float)], sizeof(float));
+		}
+
+		if (wCnt == 0) {
+			rf_transmit_begin(freq, bFskDev);
+		} else {
+			vStl_PostLoop();
+			vFCast_Tune(freq);
+			vFCast_FskAdj(bFskDev);
+			vPa_Tune( iDmdTs_GetLatestTemp() );
+			vStl_PreLoop();
+		}
+
+		for (bCnt = bDwell; bCnt != 0; bCnt--) {
+			vStl_SingleTxLoop(abFrameArray, bFrameLen);
+		}
+		wCnt++;
+	}
+
+	if (wCnt != 0) {
+		rf_transmit_end();
+	}
+
+	return wCnt;
 }
 
 //-----------------------------------------------------------------------------
@@ -148,10 +280,13 @@ void rf_transmit_frame(float freq, BYTE fdev, BYTE xdata *pbFrameHead, BYTE bLen
 void main()
 {
 	BYTE xdata cmd[256];
-	BYTE cmd_len;
+	WORD cmd_len;
 	BYTE c;
 	bool comm_error;
 	bool stuff_first;
+	bool has_crc;
+	BYTE crc;
+	bool no_res;
 	BYTE res;
 	BYTE xdata res_buf[256];
 	BYTE res_len;
@@ -183,6 +318,9 @@ void main()
 	fFreq = 433.9e6;
 	bFskDev = 104;
 
+	bSyncStatus = STATUS_OK;
+	wSyncCnt = 0;
+
 	// Init various components
 	ser_init();
 	rf_init();
@@ -195,6 +333,8 @@ void main()
 			cmd_len = 0;
 			comm_error = false;
 			stuff_first = false;
+			has_crc = false;
+			crc = 0;
 
 			while (true) {
 				c = ser_getc();
@@ -204,6 +344,9 @@ void main()
 					stuff_first = false;
 					if (c == STUFF_BYTE2) {
 						break;
+					} else if (c == STUFF_BYTE2_CRC) {
+						has_crc = true;
+						break;
 					} else if (c != STUFF_BYTE1) {
 						comm_error = true;
 						continue;
@@ -222,14 +365,28 @@ void main()
 
 				cmd[cmd_len] = c;
 				cmd_len++;
+				crc = crc8(crc, c);
 			}
-		} while (comm_error);
+			// Empty frames are used to stop CMD_RF_SEND_START, and are
+			// silently ignored.
+		} while (comm_error || cmd_len == 0);
 
 
 		// Parse and execute command
 		res_len = 0;
 		res = STATUS_LOGIC_ERROR;
-		if (cmd_len < 2) {
+		if (has_crc) {
+			// CRC over data and trailer is zero
+			cmd_len--;
+		}
+		no_res = false;
+		if (cmd_len >= 2 && (cmd[CMD_OPCODE] & CMD_FLAG_NO_RESPONSE)) {
+			no_res = true;
+			cmd[CMD_OPCODE] &= ~CMD_FLAG_NO_RESPONSE;
+		}
+		if (has_crc && crc != 0) {
+			res = STATUS_CRC_ERROR;
+		} else if (cmd_len < 2) {
 			res = STATUS_INVALID_FRAME_LEN;
 		} else {
 			switch (cmd[CMD_OPCODE]) {
@@ -250,6 +407,52 @@ void main()
 
 				res = STATUS_OK;
 				break;
+			case CMD_SYNC:
+				res_len = SYNC_RES_LEN;
+				res_buf[SYNC_STATUS] = bSyncStatus;
+				res_buf[SYNC_ID] = bSyncId;
+				res_buf[SYNC_CNT] = wSyncCnt >> 8;
+				res_buf[SYNC_CNT + 1] = wSyncCnt & 0xff;
+				bSyncStatus = STATUS_OK;
+				bSyncId = 0;
+				wSyncCnt = 0;
+
+				res = STATUS_OK;
+				break;
+			case CMD_GET_ALL:
+				res_len = ALL_RES_LEN;
+				res_buf[ALL_DEV_TYPE] = SER4010_DEV_TYPE >> 8;
+				res_buf[ALL_DEV_TYPE + 1] = SER4010_DEV_TYPE & 0xff;
+				res_buf[ALL_DEV_REV] = SER4010_DEV_REV >> 8;
+				res_buf[ALL_DEV_REV + 1] = SER4010_DEV_REV & 0xff;
+				res_buf[ALL_CFG + CFG_VERSION] = CFG_BLOCK_VERSION;
+				res_buf[ALL_CFG + CFG_LEN] = CFG_BLOCK_LEN;
+				memcpy(&res_buf[ALL_CFG + CFG_ODS], &rOdsSetup, sizeof(rOdsSetup));
+				memcpy(&res_buf[ALL_CFG + CFG_PA], &rPaSetup, sizeof(rPaSetup));
+				memcpy(&res_buf[ALL_CFG + CFG_FREQ], &fFreq, sizeof(fFreq));
+				res_buf[ALL_CFG + CFG_FDEV] = bFskDev;
+				res_buf[ALL_CFG + CFG_ENC] = bEnc;
+
+				res = STATUS_OK;
+				break;
+			case CMD_SET_ALL:
+				// Validate everything first; the block is applied as a whole or not at all
+				if (cmd_len - CMD_PAYLOAD != CFG_BLOCK_LEN) {
+					res = STATUS_INVALID_FRAME_LEN;
+				} else if (cmd[CMD_PAYLOAD + CFG_VERSION] != CFG_BLOCK_VERSION ||
+				           cmd[CMD_PAYLOAD + CFG_LEN] != CFG_BLOCK_LEN ||
+				           cmd[CMD_PAYLOAD + CFG_ENC] > 2) {
+					res = STATUS_INVALID_ARGUMENT;
+				} else {
+					memcpy(&rOdsSetup, &cmd[CMD_PAYLOAD + CFG_ODS], sizeof(rOdsSetup));
+					memcpy(&rPaSetup, &cmd[CMD_PAYLOAD + CFG_PA], sizeof(rPaSetup));
+					memcpy(&fFreq, &cmd[CMD_PAYLOAD + CFG_FREQ], sizeof(fFreq));
+					bFskDev = cmd[CMD_PAYLOAD + CFG_FDEV];
+					bEnc = cmd[CMD_PAYLOAD + CFG_ENC];
+
+					res = STATUS_OK;
+				}
+				break;
 			case CMD_GET_ODS:
 				res_len = sizeof(rOdsSetup);
 				memcpy(res_buf, &rOdsSetup, res_len);
@@ -341,6 +544,17 @@ void main()
 					res = STATUS_OK;
 				}
 				break;
+			case CMD_PATCH_FRAME:
+				// Payload: [offset][data...]
+				if (cmd_len - CMD_PAYLOAD < 1) {
+					res = STATUS_INVALID_FRAME_LEN;
+				} else if ((WORD) cmd[CMD_PAYLOAD] + (cmd_len - CMD_PAYLOAD - 1) > bFrameLen) {
+					res = STATUS_INVALID_ARGUMENT;
+				} else {
+					memcpy(&abFrameArray[cmd[CMD_PAYLOAD]], &cmd[CMD_PAYLOAD + 1], cmd_len - CMD_PAYLOAD - 1);
+					res = STATUS_OK;
+				}
+				break;
 			case CMD_RF_SEND:
 				if (cmd_len - CMD_PAYLOAD != 5) {
 					res = STATUS_INVALID_FRAME_LEN;
@@ -355,19 +569,105 @@ void main()
 					res = STATUS_OK;
 				}
 				break;
+			case CMD_RF_SEND_START:
+				if (cmd_len - CMD_PAYLOAD != 6) {
+					res = STATUS_INVALID_FRAME_LEN;
+				} else if ( cmd[CMD_PAYLOAD + 0] != SEND_COOKIE_0 ||
+							cmd[CMD_PAYLOAD + 1] != SEND_COOKIE_1 ||
+							cmd[CMD_PAYLOAD + 2] != SEND_COOKIE_2 ||
+							cmd[CMD_PAYLOAD + 3] != SEND_COOKIE_3)
+				{
+					res = STATUS_INVALID_SEND_COOKIE;
+				} else {
+					WORD wCnt;
+					wCnt = ((WORD) cmd[CMD_PAYLOAD + 4] << 8) | cmd[CMD_PAYLOAD + 5];
+					if (wCnt == 0) {
+						res = STATUS_INVALID_ARGUMENT;
+						break;
+					}
+					wCnt = rf_transmit_until_rx(fFreq, bFskDev, abFrameArray, bFrameLen, wCnt);
+					res_buf[0] = wCnt >> 8;
+					res_buf[1] = wCnt & 0xff;
+					res_len = 2;
+					res = STATUS_OK;
+				}
+				break;
+			case CMD_RF_SWEEP:
+				if (cmd_len - CMD_PAYLOAD < SWEEP_FREQS + sizeof(float)) {
+					res = STATUS_INVALID_FRAME_LEN;
+				} else if ( cmd[CMD_PAYLOAD + 0] != SEND_COOKIE_0 ||
+							cmd[CMD_PAYLOAD + 1] != SEND_COOKIE_1 ||
+							cmd[CMD_PAYLOAD + 2] != SEND_COOKIE_2 ||
+							cmd[CMD_PAYLOAD + 3] != SEND_COOKIE_3)
+				{
+					res = STATUS_INVALID_SEND_COOKIE;
+				} else {
+					BYTE bMode = cmd[CMD_PAYLOAD + SWEEP_MODE];
+					BYTE bFreqsLen = cmd_len - CMD_PAYLOAD - SWEEP_FREQS;
+					float fStep;
+					WORD wCnt;
+
+					res = STATUS_OK;
+					if (bMode == SWEEP_MODE_RANGE) {
+						memcpy(&fStep, &cmd[CMD_PAYLOAD + SWEEP_FREQS + 2 * sizeof(float)], sizeof(float));
+						if (bFreqsLen != 3 * sizeof(float)) {
+							res = STATUS_INVALID_FRAME_LEN;
+						} else if (fStep <= 0) {
+							res = STATUS_INVALID_ARGUMENT;
+						}
+					} else if (bMode == SWEEP_MODE_LIST) {
+						if (bFreqsLen % sizeof(float) != 0 ||
+						    bFreqsLen > SWEEP_MAX_HOPS * sizeof(float)) {
+							res = STATUS_INVALID_FRAME_LEN;
+						}
+					} else {
+						res = STATUS_INVALID_ARGUMENT;
+					}
+					if (cmd[CMD_PAYLOAD + SWEEP_DWELL] == 0) {
+						res = STATUS_INVALID_ARGUMENT;
+					}
+					if (res != STATUS_OK) {
+						break;
+					}
+
+					wCnt = rf_transmit_sweep(bMode, &cmd[CMD_PAYLOAD + SWEEP_FREQS],
+							bFreqsLen / sizeof(float),
+							cmd[CMD_PAYLOAD + SWEEP_DWELL]);
+					res_buf[0] = wCnt >> 8;
+					res_buf[1] = wCnt & 0xff;
+					res_len = SWEEP_RES_LEN;
+				}
+				break;
 			default:
 				res = STATUS_UNKNOWN_CMD;
 				break;
 			}
 		}
 
+		if (no_res) {
+			// Keep first error for CMD_SYNC
+			wSyncCnt++;
+			if (res != STATUS_OK && bSyncStatus == STATUS_OK) {
+				bSyncStatus = res;
+				bSyncId = cmd[CMD_ID];
+			}
+			continue;
+		}
+
 		// Send Response
-		byte_stuff_putc(cmd[CMD_ID]);
-		byte_stuff_putc(res);
+		bResCrc = 0;
+		res_putc(cmd[CMD_ID]);
+		res_putc(res);
 		for (i=0; i < res_len; i++) {
-			byte_stuff_putc(res_buf[i]);
+			res_putc(res_buf[i]);
+		}
+		if (has_crc) {
+			byte_stuff_putc(bResCrc);
+			ser_putc(STUFF_BYTE1);
+			ser_putc(STUFF_BYTE2_CRC);
+		} else {
+			ser_putc(STUFF_BYTE1);
+			ser_putc(STUFF_BYTE2);
 		}
-		ser_putc(STUFF_BYTE1);
-		ser_putc(STUFF_BYTE2);
 	}
 }
@@ -54,4 +54,11 @@ void ser_putc(char b);
  */
 char ser_getc();
 
+/**
+ * Check if the receive FIFO contains data
+ *
+ * @returns	non-zero if ser_getc() won't block
+ */
+char ser_rx_ready();
+
 #endif //_SOFT_UART_H_
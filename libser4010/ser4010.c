@@ -27,7 +27,18 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "ser4010.h"
+#include "serco_probes.h"
 #include <endian.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+// Time to transfer one byte over the serial port, 10 bits at 9600 baud
+#define BYTE_US (10 * 1000000.0 / 9600)
+
+// NOP round trips used to measure the host overhead on the first
+// ser4010_send_at() call
+#define HOST_CAL_ROUNDS 4
 
 /**
  * Byte swap IEEE-754 'single' floating point number
@@ -61,13 +72,97 @@ static inline float htobefloat(float x)
 }
 ///@}
 
+/**
+ * Convert configuration structures between host and device byte order
+ */
+///@{
+static void _ods_htobe(tOds_Setup *dst, const tOds_Setup *src)
+{
+	*dst = *src;
+	dst->wBitRate = htobe16(src->wBitRate);
+}
+
+static void _ods_betoh(tOds_Setup *dst, const tOds_Setup *src)
+{
+	*dst = *src;
+	dst->wBitRate = be16toh(src->wBitRate);
+}
+
+static void _pa_htobe(tPa_Setup *dst, const tPa_Setup *src)
+{
+	dst->fAlpha = htobefloat(src->fAlpha);
+	dst->fBeta = htobefloat(src->fBeta);
+	dst->bLevel = src->bLevel;
+	dst->bMaxDrv = src->bMaxDrv;
+	dst->wNominalCap = htobe16(src->wNominalCap);
+}
+
+static void _pa_betoh(tPa_Setup *dst, const tPa_Setup *src)
+{
+	dst->fAlpha = befloattoh(src->fAlpha);
+	dst->fBeta = befloattoh(src->fBeta);
+	dst->bLevel = src->bLevel;
+	dst->bMaxDrv = src->bMaxDrv;
+	dst->wNominalCap = be16toh(src->wNominalCap);
+}
+///@}
+
+/**
+ * Send command, with tracepoints identifying the API function
+ */
+static int _command(struct serco *sdev, const char *func, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			void *res_buf, size_t *res_len)
+{
+	int ret;
+
+	(void) func;	// Only used by tracepoints
+	SERCO_PROBE3(api__entry, func, opcode, payload_len);
+	ret = serco_send_command(sdev, opcode, payload, payload_len,
+					res_buf, res_len);
+	SERCO_PROBE5(api__return, func, opcode, sdev->last_id, ret,
+			(res_len != NULL) ? *res_len : 0);
+
+	return ret;
+}
+
+static int _command_nr(struct serco *sdev, const char *func, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			unsigned long busy_us)
+{
+	int ret;
+
+	(void) func;	// Only used by tracepoints
+	SERCO_PROBE3(api__entry, func, opcode, payload_len);
+	ret = serco_send_command_nr(sdev, opcode, payload, payload_len,
+					busy_us);
+	SERCO_PROBE5(api__return, func, opcode, sdev->last_id, ret, 0);
+
+	return ret;
+}
+
+/**
+ * Keep copy of device configuration block up to date after a SET_* command
+ */
+static void _cfg_update(struct serco *sdev, int ret, unsigned int field,
+			size_t offset, const void *data, size_t len)
+{
+	if (ret == STATUS_OK) {
+		memcpy(&sdev->cfg[offset], data, len);
+		sdev->cfg_set |= field;
+	} else {
+		sdev->cfg_valid = false;
+		sdev->cfg_set &= ~field;
+	}
+}
+
 int ser4010_get_dev_type(struct serco *sdev, uint16_t *dev_type)
 {
 	int ret;
 	size_t res_len;
 
 	res_len = sizeof(uint16_t);
-	ret = serco_send_command(sdev, CMD_DEV_TYPE, NULL, 0, dev_type, &res_len);
+	ret = _command(sdev, __func__, CMD_DEV_TYPE, NULL, 0, dev_type, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -87,7 +182,7 @@ int ser4010_get_dev_rev(struct serco *sdev, uint16_t *dev_rev)
 	size_t res_len;
 
 	res_len = sizeof(uint16_t);
-	ret = serco_send_command(sdev, CMD_DEV_REV, NULL, 0, dev_rev, &res_len);
+	ret = _command(sdev, __func__, CMD_DEV_REV, NULL, 0, dev_rev, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -104,17 +199,15 @@ int ser4010_get_dev_rev(struct serco *sdev, uint16_t *dev_rev)
 int ser4010_set_ods(struct serco *sdev, const tOds_Setup *ods_config)
 {
 	tOds_Setup l_ods_config;
+	int ret;
 
-	l_ods_config.bModulationType = ods_config->bModulationType;
-	l_ods_config.bClkDiv = ods_config->bClkDiv;
-	l_ods_config.bEdgeRate = ods_config->bEdgeRate;
-	l_ods_config.bGroupWidth = ods_config->bGroupWidth;
-	l_ods_config.wBitRate = htobe16(ods_config->wBitRate);
-	l_ods_config.bLcWarmInt = ods_config->bLcWarmInt;
-	l_ods_config.bDivWarmInt = ods_config->bDivWarmInt;
-	l_ods_config.bPaWarmInt = ods_config->bPaWarmInt;
+	_ods_htobe(&l_ods_config, ods_config);
 
-	return serco_send_command(sdev, CMD_SET_ODS, &l_ods_config, sizeof(tOds_Setup), NULL, 0);
+	ret = _command(sdev, __func__, CMD_SET_ODS, &l_ods_config, sizeof(tOds_Setup), NULL, 0);
+	_cfg_update(sdev, ret, SER4010_CFG_ODS, CFG_ODS, &l_ods_config,
+			sizeof(tOds_Setup));
+
+	return ret;
 }
 
 int ser4010_get_ods(struct serco *sdev, tOds_Setup *ods_config)
@@ -123,7 +216,7 @@ int ser4010_get_ods(struct serco *sdev, tOds_Setup *ods_config)
 	size_t res_len;
 
 	res_len = sizeof(tOds_Setup);
-	ret = serco_send_command(sdev, CMD_GET_ODS, NULL, 0, ods_config, &res_len);
+	ret = _command(sdev, __func__, CMD_GET_ODS, NULL, 0, ods_config, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -132,7 +225,7 @@ int ser4010_get_ods(struct serco *sdev, tOds_Setup *ods_config)
 	}
 
 	// Fix endianness
-	ods_config->wBitRate = be16toh(ods_config->wBitRate);
+	_ods_betoh(ods_config, ods_config);
 
 	return 0;
 }
@@ -140,15 +233,16 @@ int ser4010_get_ods(struct serco *sdev, tOds_Setup *ods_config)
 int ser4010_set_pa(struct serco *sdev, const tPa_Setup *pa_config)
 {
 	tPa_Setup l_pa_config;
+	int ret;
 
 	// Fix endianness
-	l_pa_config.fAlpha = htobefloat(pa_config->fAlpha);
-	l_pa_config.fBeta = htobefloat(pa_config->fBeta);
-	l_pa_config.bLevel = pa_config->bLevel;
-	l_pa_config.bMaxDrv = pa_config->bMaxDrv;
-	l_pa_config.wNominalCap = htobe16(pa_config->wNominalCap);
+	_pa_htobe(&l_pa_config, pa_config);
+
+	ret = _command(sdev, __func__, CMD_SET_PA, &l_pa_config, sizeof(tPa_Setup), NULL, 0);
+	_cfg_update(sdev, ret, SER4010_CFG_PA, CFG_PA, &l_pa_config,
+			sizeof(tPa_Setup));
 
-	return serco_send_command(sdev, CMD_SET_PA, &l_pa_config, sizeof(tPa_Setup), NULL, 0);
+	return ret;
 }
 
 int ser4010_get_pa(struct serco *sdev, tPa_Setup *pa_config)
@@ -157,7 +251,7 @@ int ser4010_get_pa(struct serco *sdev, tPa_Setup *pa_config)
 	size_t res_len;
 
 	res_len = sizeof(tPa_Setup);
-	ret = serco_send_command(sdev, CMD_GET_PA, NULL, 0, pa_config, &res_len);
+	ret = _command(sdev, __func__, CMD_GET_PA, NULL, 0, pa_config, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -166,19 +260,23 @@ int ser4010_get_pa(struct serco *sdev, tPa_Setup *pa_config)
 	}
 
 	// Fix endianness
-	pa_config->fAlpha = befloattoh(pa_config->fAlpha);
-	pa_config->fBeta = befloattoh(pa_config->fBeta);
-	pa_config->wNominalCap = be16toh(pa_config->wNominalCap);
+	_pa_betoh(pa_config, pa_config);
 
 	return 0;
 }
 
 int ser4010_set_freq(struct serco *sdev, float freq)
 {
+	int ret;
+
 	// Fix endianness
 	freq = htobefloat(freq);
 
-	return serco_send_command(sdev, CMD_SET_FREQ, &freq, sizeof(float), NULL, 0);
+	ret = _command(sdev, __func__, CMD_SET_FREQ, &freq, sizeof(float), NULL, 0);
+	_cfg_update(sdev, ret, SER4010_CFG_FREQ, CFG_FREQ, &freq,
+			sizeof(float));
+
+	return ret;
 }
 
 int ser4010_get_freq(struct serco *sdev, float *freq)
@@ -187,7 +285,7 @@ int ser4010_get_freq(struct serco *sdev, float *freq)
 	size_t res_len;
 
 	res_len = sizeof(float);
-	ret = serco_send_command(sdev, CMD_GET_FREQ, NULL, 0, freq, &res_len);
+	ret = _command(sdev, __func__, CMD_GET_FREQ, NULL, 0, freq, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -203,7 +301,13 @@ int ser4010_get_freq(struct serco *sdev, float *freq)
 
 int ser4010_set_fdev(struct serco *sdev, uint8_t fdev)
 {
-	return serco_send_command(sdev, CMD_SET_FDEV, &fdev, sizeof(uint8_t), NULL, 0);
+	int ret;
+
+	ret = _command(sdev, __func__, CMD_SET_FDEV, &fdev, sizeof(uint8_t), NULL, 0);
+	_cfg_update(sdev, ret, SER4010_CFG_FDEV, CFG_FDEV, &fdev,
+			sizeof(uint8_t));
+
+	return ret;
 }
 
 int ser4010_get_fdev(struct serco *sdev, uint8_t *fdev)
@@ -212,7 +316,7 @@ int ser4010_get_fdev(struct serco *sdev, uint8_t *fdev)
 	size_t res_len;
 
 	res_len = sizeof(uint8_t);
-	ret = serco_send_command(sdev, CMD_GET_FDEV, NULL, 0, fdev, &res_len);
+	ret = _command(sdev, __func__, CMD_GET_FDEV, NULL, 0, fdev, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -226,8 +330,13 @@ int ser4010_get_fdev(struct serco *sdev, uint8_t *fdev)
 int ser4010_set_enc(struct serco *sdev, enum Ser4010Encoding enc)
 {
 	uint8_t bEnc = enc;
+	int ret;
+
+	ret = _command(sdev, __func__, CMD_SET_ENC, &bEnc, sizeof(uint8_t), NULL, 0);
+	_cfg_update(sdev, ret, SER4010_CFG_ENC, CFG_ENC, &bEnc,
+			sizeof(uint8_t));
 
-	return serco_send_command(sdev, CMD_SET_ENC, &bEnc, sizeof(uint8_t), NULL, 0);
+	return ret;
 }
 
 int ser4010_get_enc(struct serco *sdev, enum Ser4010Encoding *enc)
@@ -237,7 +346,7 @@ int ser4010_get_enc(struct serco *sdev, enum Ser4010Encoding *enc)
 	uint8_t bEnc;
 
 	res_len = sizeof(uint8_t);
-	ret = serco_send_command(sdev, CMD_GET_ENC, NULL, 0, &bEnc, &res_len);
+	ret = _command(sdev, __func__, CMD_GET_ENC, NULL, 0, &bEnc, &res_len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -250,9 +359,310 @@ int ser4010_get_enc(struct serco *sdev, enum Ser4010Encoding *enc)
 	return 0;
 }
 
+/**
+ * Check if CMD_GET_ALL and CMD_SET_ALL can be used
+ */
+static bool _has_all(struct serco *sdev)
+{
+	// dev_rev is 0 if the device wasn't probed; then just try
+	return !sdev->no_all && (sdev->dev_rev == 0 || sdev->dev_rev >= 8);
+}
+
+/**
+ * Decode configuration block in device byte order
+ */
+static void _cfg_decode(struct ser4010_dev_config *cfg, const uint8_t *block)
+{
+	tOds_Setup ods;
+	tPa_Setup pa;
+	float freq;
+
+	memcpy(&ods, &block[CFG_ODS], sizeof(ods));
+	_ods_betoh(&cfg->ods, &ods);
+	memcpy(&pa, &block[CFG_PA], sizeof(pa));
+	_pa_betoh(&cfg->pa, &pa);
+	memcpy(&freq, &block[CFG_FREQ], sizeof(freq));
+	cfg->freq = befloattoh(freq);
+	cfg->fdev = block[CFG_FDEV];
+	cfg->enc = block[CFG_ENC];
+}
+
+/**
+ * Encode fields of configuration into block in device byte order
+ */
+static void _cfg_encode(uint8_t *block, const struct ser4010_dev_config *cfg,
+			unsigned int fields)
+{
+	tOds_Setup ods;
+	tPa_Setup pa;
+	float freq;
+
+	block[CFG_VERSION] = CFG_BLOCK_VERSION;
+	block[CFG_LEN] = CFG_BLOCK_LEN;
+	if (fields & SER4010_CFG_ODS) {
+		_ods_htobe(&ods, &cfg->ods);
+		memcpy(&block[CFG_ODS], &ods, sizeof(ods));
+	}
+	if (fields & SER4010_CFG_PA) {
+		_pa_htobe(&pa, &cfg->pa);
+		memcpy(&block[CFG_PA], &pa, sizeof(pa));
+	}
+	if (fields & SER4010_CFG_FREQ) {
+		freq = htobefloat(cfg->freq);
+		memcpy(&block[CFG_FREQ], &freq, sizeof(freq));
+	}
+	if (fields & SER4010_CFG_FDEV) {
+		block[CFG_FDEV] = cfg->fdev;
+	}
+	if (fields & SER4010_CFG_ENC) {
+		block[CFG_ENC] = cfg->enc;
+	}
+}
+
+/**
+ * Get complete configuration with the individual commands
+ */
+static int _get_all_separate(struct serco *sdev,
+				struct ser4010_dev_config *cfg)
+{
+	int ret;
+
+	if ((ret = ser4010_get_dev_type(sdev, &cfg->dev_type)) != 0 ||
+	    (ret = ser4010_get_dev_rev(sdev, &cfg->dev_rev)) != 0 ||
+	    (ret = ser4010_get_ods(sdev, &cfg->ods)) != 0 ||
+	    (ret = ser4010_get_pa(sdev, &cfg->pa)) != 0 ||
+	    (ret = ser4010_get_freq(sdev, &cfg->freq)) != 0 ||
+	    (ret = ser4010_get_fdev(sdev, &cfg->fdev)) != 0 ||
+	    (ret = ser4010_get_enc(sdev, &cfg->enc)) != 0) {
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * Set configuration fields with the individual commands
+ */
+static int _set_fields_separate(struct serco *sdev,
+				const struct ser4010_dev_config *cfg,
+				unsigned int fields)
+{
+	int ret = 0;
+
+	if (ret == 0 && (fields & SER4010_CFG_ODS)) {
+		ret = ser4010_set_ods(sdev, &cfg->ods);
+	}
+	if (ret == 0 && (fields & SER4010_CFG_PA)) {
+		ret = ser4010_set_pa(sdev, &cfg->pa);
+	}
+	if (ret == 0 && (fields & SER4010_CFG_FREQ)) {
+		ret = ser4010_set_freq(sdev, cfg->freq);
+	}
+	if (ret == 0 && (fields & SER4010_CFG_FDEV)) {
+		ret = ser4010_set_fdev(sdev, cfg->fdev);
+	}
+	if (ret == 0 && (fields & SER4010_CFG_ENC)) {
+		ret = ser4010_set_enc(sdev, cfg->enc);
+	}
+
+	return ret;
+}
+
+int ser4010_get_all(struct serco *sdev, struct ser4010_dev_config *cfg)
+{
+	uint8_t res[256];
+	size_t res_len;
+	int ret;
+
+	if (!_has_all(sdev)) {
+		return _get_all_separate(sdev, cfg);
+	}
+
+	res_len = sizeof(res);
+	ret = _command(sdev, __func__, CMD_GET_ALL, NULL, 0, res, &res_len);
+	if (ret == STATUS_UNKNOWN_CMD) {
+		// Firmware before rev. 8
+		sdev->no_all = true;
+		return _get_all_separate(sdev, cfg);
+	} else if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	// Newer block versions append fields, so only check the minimum length
+	if (res_len < ALL_RES_LEN ||
+	    res[ALL_CFG + CFG_VERSION] < CFG_BLOCK_VERSION ||
+	    res[ALL_CFG + CFG_LEN] < CFG_BLOCK_LEN ||
+	    res_len < ALL_CFG + (size_t) res[ALL_CFG + CFG_LEN]) {
+		return -1000;
+	}
+
+	cfg->dev_type = (res[ALL_DEV_TYPE] << 8) | res[ALL_DEV_TYPE + 1];
+	cfg->dev_rev = (res[ALL_DEV_REV] << 8) | res[ALL_DEV_REV + 1];
+	_cfg_decode(cfg, &res[ALL_CFG]);
+
+	memcpy(sdev->cfg, &res[ALL_CFG], CFG_BLOCK_LEN);
+	sdev->cfg_valid = true;
+
+	// A newer block can't be written back, use the individual commands
+	if (res[ALL_CFG + CFG_VERSION] != CFG_BLOCK_VERSION) {
+		sdev->no_all = true;
+	}
+
+	return 0;
+}
+
+int ser4010_set_all(struct serco *sdev, const struct ser4010_dev_config *cfg)
+{
+	return ser4010_set_fields(sdev, cfg, SER4010_CFG_ALL);
+}
+
+int ser4010_set_fields(struct serco *sdev,
+			const struct ser4010_dev_config *cfg,
+			unsigned int fields)
+{
+	uint8_t block[CFG_BLOCK_LEN];
+	struct ser4010_dev_config cur;
+	int ret;
+
+	if (!_has_all(sdev)) {
+		return _set_fields_separate(sdev, cfg, fields);
+	}
+
+	// Fields not set are filled in from the device. For a single field
+	// the individual command is one round trip too.
+	if ((fields & SER4010_CFG_ALL) != SER4010_CFG_ALL && !sdev->cfg_valid) {
+		if ((fields & (fields - 1)) == 0) {
+			return _set_fields_separate(sdev, cfg, fields);
+		}
+
+		ret = ser4010_get_all(sdev, &cur);
+		if (ret != 0) {
+			return ret;
+		}
+		if (sdev->no_all) {
+			return _set_fields_separate(sdev, cfg, fields);
+		}
+	}
+
+	memcpy(block, sdev->cfg, sizeof(block));
+	_cfg_encode(block, cfg, fields);
+
+	ret = _command(sdev, __func__, CMD_SET_ALL, block, sizeof(block),
+			NULL, 0);
+	if (ret == STATUS_UNKNOWN_CMD) {
+		// Firmware before rev. 8
+		sdev->no_all = true;
+		return _set_fields_separate(sdev, cfg, fields);
+	} else if (ret != STATUS_OK) {
+		sdev->cfg_valid = false;
+		sdev->cfg_set &= ~fields;
+		return ret;
+	}
+
+	memcpy(sdev->cfg, block, sizeof(block));
+	sdev->cfg_valid = true;
+	sdev->cfg_set |= fields & SER4010_CFG_ALL;
+
+	return 0;
+}
+
 int ser4010_load_frame(struct serco *sdev, uint8_t *data, size_t len)
 {
-	return serco_send_command(sdev, CMD_LOAD_FRAME, data, len, NULL, 0);
+	int ret;
+
+	ret = _command(sdev, __func__, CMD_LOAD_FRAME, data, len, NULL, 0);
+	if (ret != STATUS_OK || len > sizeof(sdev->frame)) {
+		sdev->frame_len = -1;
+		return ret;
+	}
+
+	memcpy(sdev->frame, data, len);
+	sdev->frame_len = len;
+
+	return ret;
+}
+
+int ser4010_append_frame(struct serco *sdev, uint8_t *data, size_t len)
+{
+	int ret;
+
+	ret = _command(sdev, __func__, CMD_APPEND_FRAME, data, len, NULL, 0);
+	if (ret != STATUS_OK || sdev->frame_len == -1 ||
+			sdev->frame_len + len > sizeof(sdev->frame)) {
+		sdev->frame_len = -1;
+		return ret;
+	}
+
+	memcpy(&sdev->frame[sdev->frame_len], data, len);
+	sdev->frame_len += len;
+
+	return ret;
+}
+
+int ser4010_patch_frame(struct serco *sdev, uint8_t offset, uint8_t *data,
+			size_t len)
+{
+	uint8_t buf[256];
+	int ret;
+
+	if (len > sizeof(buf) - 1) {
+		return EINVAL;
+	}
+
+	buf[0] = offset;
+	memcpy(&buf[1], data, len);
+
+	ret = _command(sdev, __func__, CMD_PATCH_FRAME, buf, len + 1, NULL, 0);
+	if (ret != STATUS_OK) {
+		if (ret != STATUS_UNKNOWN_CMD) {
+			sdev->frame_len = -1;
+		}
+		return ret;
+	}
+
+	if (sdev->frame_len != -1 && offset + len <= (size_t) sdev->frame_len) {
+		memcpy(&sdev->frame[offset], data, len);
+	} else {
+		sdev->frame_len = -1;
+	}
+
+	return ret;
+}
+
+int ser4010_load_frame_diff(struct serco *sdev, uint8_t *data, size_t len)
+{
+	size_t first, last;
+	int ret;
+
+	if (sdev->frame_len != (int) len || sdev->no_patch) {
+		return ser4010_load_frame(sdev, data, len);
+	}
+
+	// Find span of changed bytes
+	for (first = 0; first < len && data[first] == sdev->frame[first]; first++)
+		;
+	if (first == len) {
+		return STATUS_OK;
+	}
+	for (last = len - 1; data[last] == sdev->frame[last]; last--)
+		;
+
+	// Offset byte makes a patch one byte larger than its data
+	if (last - first + 2 >= len) {
+		return ser4010_load_frame(sdev, data, len);
+	}
+
+	ret = ser4010_patch_frame(sdev, first, &data[first], last - first + 1);
+	if (ret == STATUS_UNKNOWN_CMD) {
+		// Firmware before rev. 5
+		sdev->no_patch = true;
+		return ser4010_load_frame(sdev, data, len);
+	} else if (ret == STATUS_INVALID_ARGUMENT) {
+		// Device frame got shorter than expected, eg. after a reset
+		return ser4010_load_frame(sdev, data, len);
+	}
+
+	return ret;
 }
 
 int ser4010_send(struct serco *sdev, unsigned int cnt)
@@ -265,5 +675,446 @@ int ser4010_send(struct serco *sdev, unsigned int cnt)
 	buf[3] = SEND_COOKIE_3;
 	buf[4] = cnt;
 
-	return serco_send_command(sdev, CMD_RF_SEND, buf, 5, NULL, 0);
+	return _command(sdev, __func__, CMD_RF_SEND, buf, 5, NULL, 0);
+}
+
+int ser4010_send_start(struct serco *sdev, unsigned int max_cnt)
+{
+	uint8_t buf[6];
+	uint8_t frame_id;
+	int ret;
+
+	if (sdev->hold_id != -1 || max_cnt == 0 || max_cnt > 0xffff) {
+		return EINVAL;
+	}
+
+	buf[0] = SEND_COOKIE_0;
+	buf[1] = SEND_COOKIE_1;
+	buf[2] = SEND_COOKIE_2;
+	buf[3] = SEND_COOKIE_3;
+	buf[4] = max_cnt >> 8;
+	buf[5] = max_cnt & 0xff;
+
+	SERCO_PROBE3(api__entry, __func__, CMD_RF_SEND_START, sizeof(buf));
+	ret = serco_write_command(sdev, CMD_RF_SEND_START, buf, sizeof(buf),
+					&frame_id);
+	SERCO_PROBE5(api__return, __func__, CMD_RF_SEND_START, sdev->last_id,
+			ret, 0);
+	if (ret != 0) {
+		return ret;
+	}
+	sdev->hold_id = frame_id;
+
+	return STATUS_OK;
+}
+
+int ser4010_send_stop(struct serco *sdev, unsigned int *cnt)
+{
+	const uint8_t stop[CMD_RF_SEND_STOP_LEN] = { STUFF_BYTE1, STUFF_BYTE2 };
+	uint8_t frame_id;
+	uint16_t wCnt;
+	size_t res_len;
+	int ret;
+
+	if (sdev->hold_id == -1) {
+		return EINVAL;
+	}
+	frame_id = sdev->hold_id;
+	sdev->hold_id = -1;
+
+	SERCO_PROBE3(api__entry, __func__, CMD_RF_SEND_START, 0);
+	ret = serco_write(sdev, stop, sizeof(stop));
+	if (ret != 0) {
+		return ret;
+	}
+
+	res_len = sizeof(wCnt);
+	ret = serco_read_response(sdev, frame_id, &wCnt, &res_len);
+	SERCO_PROBE5(api__return, __func__, CMD_RF_SEND_START, frame_id, ret,
+			res_len);
+	if (ret == STATUS_UNKNOWN_CMD) {
+		// Firmware before DEV_REV 4 also responds to the empty stop
+		// frame, using the ID of the previous command.
+		serco_read_response(sdev, frame_id, NULL, NULL);
+		return ret;
+	}
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+	if (res_len != sizeof(wCnt)) {
+		return -1000;
+	}
+
+	if (cnt != NULL) {
+		*cnt = be16toh(wCnt);
+	}
+
+	return STATUS_OK;
+}
+
+int ser4010_send_for(struct serco *sdev, unsigned int duration_ms,
+			unsigned int max_cnt, unsigned int *cnt)
+{
+	struct timespec end;
+	int ret;
+
+	ret = ser4010_send_start(sdev, max_cnt);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	// Measure from the moment the command left the serial port
+	tcdrain(sdev->fd);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += duration_ms / 1000;
+	end.tv_nsec += (duration_ms % 1000) * 1000000L;
+	if (end.tv_nsec >= 1000000000L) {
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000L;
+	}
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end,
+				NULL) == EINTR)
+		;
+
+	return ser4010_send_stop(sdev, cnt);
+}
+
+unsigned long ser4010_frame_duration_us(const tOds_Setup *ods,
+					enum Ser4010Encoding enc, size_t len)
+{
+	unsigned int clk_div = (ods->bClkDiv & 0x7) + 1;
+	unsigned int width = (ods->bGroupWidth & 0x7) + 1;
+	unsigned int bit_rate = ods->wBitRate & 0x7fff;
+	double symbols = (double) len * width;
+
+	if (enc == bEnc_Manchester_c) {
+		symbols *= 2;
+	} else if (enc == bEnc_4b5b_c) {
+		symbols = symbols * 5 / 4;
+	}
+
+	return symbols * bit_rate * clk_div / 24.0 + 0.5;
+}
+
+int ser4010_set_freq_nr(struct serco *sdev, float freq)
+{
+	int ret;
+
+	// Fix endianness
+	freq = htobefloat(freq);
+
+	ret = _command_nr(sdev, __func__, CMD_SET_FREQ, &freq, sizeof(float),
+					0);
+	// Errors are only reported at the next sync, but the frequency is
+	// still the one to restore after reconnecting
+	sdev->cfg_valid = false;
+	memcpy(&sdev->cfg[CFG_FREQ], &freq, sizeof(float));
+	sdev->cfg_set |= SER4010_CFG_FREQ;
+
+	return ret;
+}
+
+int ser4010_send_nr(struct serco *sdev, unsigned int cnt,
+			unsigned long frame_us)
+{
+	uint8_t buf[5];
+
+	buf[0] = SEND_COOKIE_0;
+	buf[1] = SEND_COOKIE_1;
+	buf[2] = SEND_COOKIE_2;
+	buf[3] = SEND_COOKIE_3;
+	buf[4] = cnt;
+
+	return _command_nr(sdev, __func__, CMD_RF_SEND, buf, 5,
+					cnt * frame_us + SER4010_TX_SETUP_US);
+}
+
+/**
+ * Microseconds from a to b
+ */
+static long _us_between(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000L +
+		(b->tv_nsec - a->tv_nsec) / 1000;
+}
+
+static void _add_us(struct timespec *t, long us)
+{
+	t->tv_sec += us / 1000000;
+	t->tv_nsec += (us % 1000000) * 1000;
+	if (t->tv_nsec >= 1000000000L) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000L;
+	} else if (t->tv_nsec < 0) {
+		t->tv_sec--;
+		t->tv_nsec += 1000000000L;
+	}
+}
+
+/**
+ * Update running average and mean deviation with a new sample
+ *
+ * Uses the same weights as the TCP round trip time estimator.
+ */
+static void _calibrate(long *avg, long *dev, long sample)
+{
+	long diff;
+
+	if (*avg < 0) {
+		*avg = sample;
+		*dev = sample / 2;
+		return;
+	}
+
+	diff = sample - *avg;
+	*avg += diff / 8;
+	*dev += (labs(diff) - *dev) / 4;
+}
+
+/**
+ * Measure host serial port overhead using a NOP round trip
+ */
+static int _calibrate_host(struct serco *sdev)
+{
+	struct timespec start, end;
+	long sample;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = _command(sdev, __func__, CMD_NOP, NULL, 0, NULL, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	sample = _us_between(&start, &end) -
+		(sdev->tx_frame_len + sdev->rx_frame_len) * BYTE_US;
+	if (sample < 0) {
+		sample = 0;
+	}
+	_calibrate(&sdev->host_us, &sdev->host_dev_us, sample);
+
+	return STATUS_OK;
+}
+
+int ser4010_send_at(struct serco *sdev, const struct timespec *when,
+			unsigned int cnt, unsigned long frame_us,
+			struct ser4010_send_timing *timing)
+{
+	uint8_t buf[5];
+	struct timespec now, write_at, start, end;
+	size_t cmd_len;
+	long setup_us, latency_us, rtt_us, sample;
+	int i;
+	int ret;
+
+	if (cnt == 0 || cnt > 0xff) {
+		return EINVAL;
+	}
+
+	buf[0] = SEND_COOKIE_0;
+	buf[1] = SEND_COOKIE_1;
+	buf[2] = SEND_COOKIE_2;
+	buf[3] = SEND_COOKIE_3;
+	buf[4] = cnt;
+
+	// Commands without response keep the device busy for an unknown time
+	if (sdev->nr_pending != 0) {
+		ret = serco_sync(sdev);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+	}
+
+	if (sdev->host_us < 0) {
+		for (i = 0; i < HOST_CAL_ROUNDS; i++) {
+			ret = _calibrate_host(sdev);
+			if (ret != STATUS_OK) {
+				return ret;
+			}
+		}
+	}
+
+	// ID and opcode, payload and end of frame. The CRC is only stuffed
+	// in 1 of 256 frames, so ignore that.
+	cmd_len = CMD_PAYLOAD + sizeof(buf) + 2 + (sdev->crc ? 1 : 0);
+	setup_us = (sdev->setup_us < 0) ? SER4010_TX_SETUP_US : sdev->setup_us;
+	latency_us = sdev->host_us / 2 + cmd_len * BYTE_US + setup_us;
+
+	write_at = *when;
+	_add_us(&write_at, -latency_us);
+
+	// Refresh host overhead if a NOP fits well before the deadline
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (_us_between(&now, &write_at) > 2 * (sdev->host_us +
+				sdev->host_dev_us + 2 * cmd_len * BYTE_US)) {
+		ret = _calibrate_host(sdev);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+		clock_gettime(CLOCK_REALTIME, &now);
+	}
+	if (_us_between(&now, &write_at) < 0) {
+		return ETIMEDOUT;
+	}
+
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &write_at,
+				NULL) == EINTR)
+		;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = _command(sdev, __func__, CMD_RF_SEND, buf, sizeof(buf), NULL, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	// Start-up time of this transmission
+	rtt_us = _us_between(&start, &end);
+	sample = rtt_us - sdev->host_us - cnt * frame_us -
+		(sdev->tx_frame_len + sdev->rx_frame_len) * BYTE_US;
+	if (sample < 0) {
+		sample = 0;
+	}
+	_calibrate(&sdev->setup_us, &sdev->setup_dev_us, sample);
+
+	if (timing != NULL) {
+		// Command was actually written at 'now'
+		timing->error_us = _us_between(when, &now) +
+			sdev->host_us / 2 + sdev->tx_frame_len * BYTE_US +
+			sample;
+		timing->latency_us = latency_us;
+		timing->jitter_us = sdev->host_dev_us / 2 + sdev->setup_dev_us;
+	}
+
+	return STATUS_OK;
+}
+
+/**
+ * Run CMD_RF_SWEEP
+ *
+ * @param hops	Number of frequencies the sweep covers
+ */
+static int _sweep(struct serco *sdev, const char *func, const uint8_t *buf,
+			size_t len, unsigned int hops, unsigned int dwell,
+			unsigned long frame_us, unsigned int *cnt)
+{
+	uint8_t res[SWEEP_RES_LEN];
+	size_t res_len;
+	int ret;
+
+	if ((double) hops * (dwell * frame_us + SER4010_TX_RETUNE_US) +
+			SER4010_TX_SETUP_US > SER4010_SWEEP_MAX_US) {
+		return ERANGE;
+	}
+
+	res_len = sizeof(res);
+	ret = _command(sdev, func, CMD_RF_SWEEP, buf, len, res, &res_len);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+	if (res_len != sizeof(res)) {
+		return -1000;
+	}
+
+	if (cnt != NULL) {
+		*cnt = (res[0] << 8) | res[1];
+	}
+
+	return 0;
+}
+
+static void _sweep_header(uint8_t *buf, uint8_t mode, unsigned int dwell)
+{
+	buf[0] = SEND_COOKIE_0;
+	buf[1] = SEND_COOKIE_1;
+	buf[2] = SEND_COOKIE_2;
+	buf[3] = SEND_COOKIE_3;
+	buf[SWEEP_MODE] = mode;
+	buf[SWEEP_DWELL] = dwell;
+}
+
+int ser4010_send_sweep(struct serco *sdev, float start, float stop,
+			float step, unsigned int dwell,
+			unsigned long frame_us, unsigned int *cnt)
+{
+	uint8_t buf[SWEEP_FREQS + 3 * sizeof(float)];
+	float freqs[3];
+	unsigned int hops;
+
+	if (!(step > 0) || dwell < 1 || dwell > 255) {
+		return EINVAL;
+	}
+
+	// Same computation as the firmware
+	for (hops = 0; hops < 0xffff && start + hops * step < stop; hops++)
+		;
+
+	_sweep_header(buf, SWEEP_MODE_RANGE, dwell);
+	freqs[0] = htobefloat(start);
+	freqs[1] = htobefloat(stop);
+	freqs[2] = htobefloat(step);
+	memcpy(&buf[SWEEP_FREQS], freqs, sizeof(freqs));
+
+	return _sweep(sdev, __func__, buf, sizeof(buf), hops, dwell, frame_us,
+			cnt);
+}
+
+int ser4010_send_hops(struct serco *sdev, const float *freqs, size_t len,
+			unsigned int dwell, unsigned long frame_us,
+			unsigned int *cnt)
+{
+	uint8_t buf[SWEEP_FREQS + SWEEP_MAX_HOPS * sizeof(float)];
+	float freq;
+	size_t i;
+
+	if (len < 1 || len > SWEEP_MAX_HOPS || dwell < 1 || dwell > 255) {
+		return EINVAL;
+	}
+
+	_sweep_header(buf, SWEEP_MODE_LIST, dwell);
+	for (i = 0; i < len; i++) {
+		freq = htobefloat(freqs[i]);
+		memcpy(&buf[SWEEP_FREQS + i * sizeof(float)], &freq,
+			sizeof(float));
+	}
+
+	return _sweep(sdev, __func__, buf, SWEEP_FREQS + len * sizeof(float),
+			len, dwell, frame_us, cnt);
+}
+
+/**
+ * Restore configuration and frame after reconnecting to a lost device
+ */
+static int _replay(struct serco *sdev)
+{
+	struct ser4010_dev_config cfg;
+	uint8_t frame[sizeof(sdev->frame)];
+	int frame_len = sdev->frame_len;
+	int ret;
+
+	if (sdev->cfg_set != 0) {
+		_cfg_decode(&cfg, sdev->cfg);
+		ret = ser4010_set_fields(sdev, &cfg, sdev->cfg_set);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	if (frame_len > 0) {
+		memcpy(frame, sdev->frame, frame_len);
+		ret = ser4010_load_frame(sdev, frame, frame_len);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+void ser4010_set_reconnect(struct serco *sdev, unsigned int timeout_ms)
+{
+	serco_set_reconnect(sdev, timeout_ms, _replay);
 }
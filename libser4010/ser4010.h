@@ -200,6 +200,98 @@ int ser4010_config(struct serco *sdev,
 			int modulation, enum Ser4010Encoding encoding,
 			double data_rate_kbps, int bits_per_byte);
 
+/**
+ * Output Data Serializer setup, as computed by ser4010_solve_ods()
+ *
+ * Contains no pointers, so it can be stored and reused for the same
+ * arguments.
+ */
+struct ser4010_ods_solution {
+	tOds_Setup ods;			/**< Output Data Serializer setup */
+	double sym_rate_ksym_sec;	/**< Achieved symbol rate */
+	double rate_error;		/**< Relative error of the achieved
+					  * symbol rate, positive is fast */
+	float ramp_us;			/**< Achieved PA ramp time */
+	float ramp_error;		/**< Relative error of the ramp time,
+					  * compared to the calculator value */
+};
+
+/**
+ * Compute Output Data Serializer setup
+ *
+ * Searches all clock divider, edge rate and bit rate combinations for the
+ * smallest combined symbol rate and ramp time error. The symbol rate error
+ * weighs 100 times more than the ramp time error. The target ramp time comes
+ * from the Si4010 calculator spreadsheet. See ser4010_config() for the
+ * arguments.
+ *
+ * @param sol		Returns the setup and achieved timing
+ *
+ * @returns		0 on success, EINVAL or ERANGE on invalid arguments
+ */
+int ser4010_solve_ods(struct ser4010_ods_solution *sol,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte);
+
+/**
+ * Radio configuration, as computed by ser4010_calc_config()
+ */
+struct ser4010_radio_config {
+	tOds_Setup ods;			/**< Output Data Serializer setup */
+	float freq;			/**< Carrier frequency in Hz */
+	enum Ser4010Encoding enc;	/**< Data encoding */
+	uint8_t fdev;			/**< FSK frequency deviation, see
+					  * ser4010_set_fdev(). Only used for
+					  * FSK modulation. */
+	double sym_rate_ksym_sec;	/**< Achieved symbol rate */
+	double rate_error;		/**< Relative error of the achieved
+					  * symbol rate, positive is fast */
+};
+
+/**
+ * Compute radio configuration without configuring the device
+ *
+ * Computes the same configuration as ser4010_config(), see there for the
+ * arguments. Use ser4010_apply_config() to configure the device.
+ *
+ * @param cfg		Returns the configuration
+ *
+ * @returns		0 on success, EINVAL or ERANGE on invalid arguments
+ */
+int ser4010_calc_config(struct ser4010_radio_config *cfg,
+			float freq_mhz, float fdev_khz,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte);
+
+/**
+ * Compute radio configurations for a series of frequencies
+ *
+ * Like calling ser4010_calc_config() for every frequency, but the parts that
+ * don't depend on the frequency are only computed once. Useful for frequency
+ * sweeps and hopping.
+ *
+ * @param cfgs		Array of 'cnt' configurations to return
+ * @param freq_mhz	Array of 'cnt' carrier frequencies in MHz
+ * @param cnt		Number of configurations to compute
+ *
+ * @returns		0 on success, EINVAL or ERANGE on invalid arguments
+ */
+int ser4010_calc_configs(struct ser4010_radio_config *cfgs,
+			const float *freq_mhz, size_t cnt, float fdev_khz,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte);
+
+/**
+ * Configure the device with a computed radio configuration
+ *
+ * @param sdev		Serial Communication handle
+ * @param cfg		Configuration from ser4010_calc_config()
+ *
+ * @returns		0 on success else an error occurred
+ */
+int ser4010_apply_config(struct serco *sdev,
+			const struct ser4010_radio_config *cfg);
+
 /**
  * Get device type
  *
@@ -348,6 +440,78 @@ int ser4010_set_enc(struct serco *sdev, enum Ser4010Encoding enc);
  */
 int ser4010_get_enc(struct serco *sdev, enum Ser4010Encoding *enc);
 
+/**
+ * Complete device configuration, see ser4010_get_all()
+ */
+struct ser4010_dev_config {
+	uint16_t dev_type;		/**< Device type, not used when setting */
+	uint16_t dev_rev;		/**< Firmware revision, not used when
+					  * setting */
+	tOds_Setup ods;			/**< Output Data Serializer setup */
+	tPa_Setup pa;			/**< Power Amplifier setup */
+	float freq;			/**< Carrier frequency in Hz */
+	uint8_t fdev;			/**< FSK frequency deviation, see
+					  * ser4010_set_fdev() */
+	enum Ser4010Encoding enc;	/**< Data encoding */
+};
+
+/**
+ * Field flags for ser4010_set_fields()
+ */
+///@{
+#define SER4010_CFG_ODS		0x01
+#define SER4010_CFG_PA		0x02
+#define SER4010_CFG_FREQ	0x04
+#define SER4010_CFG_FDEV	0x08
+#define SER4010_CFG_ENC		0x10
+#define SER4010_CFG_ALL		0x1f
+///@}
+
+/**
+ * Get device info and complete configuration
+ *
+ * Uses a single CMD_GET_ALL round trip. Falls back to the individual
+ * commands for firmware before revision 8.
+ *
+ * @param sdev	Serial Communication handle
+ * @param cfg	Structure to return configuration in
+ *
+ * @returns	0 on success else an error occurred
+ */
+int ser4010_get_all(struct serco *sdev, struct ser4010_dev_config *cfg);
+
+/**
+ * Set complete configuration
+ *
+ * Uses a single CMD_SET_ALL round trip, which the device applies as a whole
+ * or not at all. Falls back to the individual commands for firmware before
+ * revision 8.
+ *
+ * @param sdev	Serial Communication handle
+ * @param cfg	New configuration
+ *
+ * @returns	0 on success else an error occurred
+ */
+int ser4010_set_all(struct serco *sdev, const struct ser4010_dev_config *cfg);
+
+/**
+ * Set part of the configuration
+ *
+ * Like ser4010_set_all(), but the fields not selected keep their value. The
+ * library remembers the configuration last read or written with
+ * CMD_GET_ALL/CMD_SET_ALL, so normally this is a single round trip too. If the
+ * configuration isn't known yet, a single field is set with its own command.
+ *
+ * @param sdev		Serial Communication handle
+ * @param cfg		New configuration
+ * @param fields	Fields of cfg to set, SER4010_CFG_* flags
+ *
+ * @returns		0 on success else an error occurred
+ */
+int ser4010_set_fields(struct serco *sdev,
+			const struct ser4010_dev_config *cfg,
+			unsigned int fields);
+
 /**
  * Load frame data
  *
@@ -363,6 +527,52 @@ int ser4010_get_enc(struct serco *sdev, enum Ser4010Encoding *enc);
  */
 int ser4010_load_frame(struct serco *sdev, uint8_t *data, size_t len);
 
+/**
+ * Append frame data
+ *
+ * Append data to the currently loaded frame. The total frame length is
+ * limited to 255 bytes.
+ *
+ * @param sdev	Serial Communication handle
+ * @param data	Frame data
+ * @param len	Frame data length in bytes
+ *
+ * @returns	0 on success else an error occurred (TODO: spec)
+ */
+int ser4010_append_frame(struct serco *sdev, uint8_t *data, size_t len);
+
+/**
+ * Overwrite part of the loaded frame
+ *
+ * The range to overwrite must be within the currently loaded frame.
+ * Requires firmware revision 5 or newer.
+ *
+ * @param sdev		Serial Communication handle
+ * @param offset	Offset in frame of first byte to overwrite
+ * @param data		New frame data
+ * @param len		Length of data in bytes
+ *
+ * @returns	0 on success else an error occurred (TODO: spec)
+ */
+int ser4010_patch_frame(struct serco *sdev, uint8_t offset, uint8_t *data,
+			size_t len);
+
+/**
+ * Load frame data, only sending changes
+ *
+ * Compares the frame with the last frame uploaded over this connection, and
+ * only sends the changed bytes using a patch frame command. Falls back to a
+ * full load if the device frame content is unknown, the length differs, the
+ * patch wouldn't be smaller, or the firmware doesn't support patching.
+ *
+ * @param sdev	Serial Communication handle
+ * @param data	Frame data
+ * @param len	Frame data length in bytes (<= 254)
+ *
+ * @returns	0 on success else an error occurred (TODO: spec)
+ */
+int ser4010_load_frame_diff(struct serco *sdev, uint8_t *data, size_t len);
+
 /**
  * Send a frame
  *
@@ -375,4 +585,208 @@ int ser4010_load_frame(struct serco *sdev, uint8_t *data, size_t len);
  */
 int ser4010_send(struct serco *sdev, unsigned int cnt);
 
+/**
+ * Start sending a frame until stopped
+ *
+ * Start repeating the currently loaded frame until ser4010_send_stop() is
+ * called. This call doesn't wait for the transmission to end. No other
+ * commands may be sent until the transmission is stopped. As watchdog, in
+ * case the host goes away, the device stops after 'max_cnt' frames.
+ *
+ * Requires firmware revision 4 or newer.
+ *
+ * @param sdev		Serial Communication handle
+ * @param max_cnt	Max. number of frames to send (range: 1-65535)
+ *
+ * @returns	0 on success, -1 on communication error, or EINVAL if a
+ *		transmission is already running or max_cnt is out of range.
+ */
+int ser4010_send_start(struct serco *sdev, unsigned int max_cnt);
+
+/**
+ * Stop sending a frame
+ *
+ * Stops a transmission started with ser4010_send_start(). The frame
+ * currently being sent is finished first. Returns after the device
+ * stopped.
+ *
+ * @param sdev	Serial Communication handle
+ * @param cnt	If not NULL, the number of frames sent is returned here
+ *
+ * @returns	0 on success, >0 device status code, -1 on communication
+ *		error, or EINVAL if no transmission is running.
+ */
+int ser4010_send_stop(struct serco *sdev, unsigned int *cnt);
+
+/**
+ * Send a frame for a certain duration
+ *
+ * Repeats the currently loaded frame for 'duration_ms' milliseconds, rounded
+ * up to a whole frame. The duration is measured from the moment the start
+ * command was written to the serial port.
+ *
+ * @param sdev		Serial Communication handle
+ * @param duration_ms	Time to send in milliseconds
+ * @param max_cnt	Max. number of frames to send (range: 1-65535)
+ * @param cnt		If not NULL, the number of frames sent is returned here
+ *
+ * @returns	see ser4010_send_stop()
+ */
+int ser4010_send_for(struct serco *sdev, unsigned int duration_ms,
+			unsigned int max_cnt, unsigned int *cnt);
+
+/** Estimated time the device needs to start and stop a transmission */
+#define SER4010_TX_SETUP_US	10000
+
+/** Estimated time the device needs to retune between sweep frequencies */
+#define SER4010_TX_RETUNE_US	2000
+
+/**
+ * Max. estimated duration of a ser4010_send_sweep() or ser4010_send_hops()
+ * command. Stays below the response time-out of serco.
+ */
+#define SER4010_SWEEP_MAX_US	20000000
+
+/**
+ * Calculate the air time of a frame
+ *
+ * @param ods	Output Data Serializer configuration
+ * @param enc	Data encoding
+ * @param len	Frame length in bytes
+ *
+ * @returns	Time to send the frame once in microseconds
+ */
+unsigned long ser4010_frame_duration_us(const tOds_Setup *ods,
+					enum Ser4010Encoding enc, size_t len);
+
+/**
+ * Set frequency without waiting for a response
+ *
+ * See serco_send_command_nr() for error reporting.
+ *
+ * @param sdev	Serial Communication handle
+ * @param freq	Frequency in Hz
+ *
+ * @returns	see serco_send_command_nr()
+ */
+int ser4010_set_freq_nr(struct serco *sdev, float freq);
+
+/**
+ * Send a frame without waiting for a response
+ *
+ * The next command is delayed until the transmission is expected to be done.
+ * See serco_send_command_nr() for error reporting.
+ *
+ * @param sdev		Serial Communication handle
+ * @param cnt		Number of times to send the frame. (range: 0-255)
+ * @param frame_us	Air time of the loaded frame, see
+ *			ser4010_frame_duration_us()
+ *
+ * @returns	see serco_send_command_nr()
+ */
+int ser4010_send_nr(struct serco *sdev, unsigned int cnt,
+			unsigned long frame_us);
+
+/**
+ * Timing of a ser4010_send_at() transmission
+ */
+struct ser4010_send_timing {
+	long error_us;		/**< Predicted time of the first bit relative
+				  * to the requested time, positive is late */
+	unsigned long latency_us;
+				/**< Latency from writing the command to the
+				  * first bit, that was compensated for */
+	unsigned long jitter_us;
+				/**< Mean deviation of the latency, after
+				  * this transmission */
+};
+
+/**
+ * Send the loaded frame at an absolute time
+ *
+ * Sleeps until the RF_SEND command must be written for the first bit to be
+ * transmitted at 'when', and sends the frame. The latency from writing the
+ * command to the first bit consists of the host serial port overhead, the
+ * command wire time at 9600 baud, and the device start-up time (tuning and
+ * temperature measurement). It is calibrated on every call:
+ *  - A NOP round trip, minus wire time, measures the host overhead. Half of
+ *    it is assumed to be on the transmit side. This is skipped if there is
+ *    not enough time left before 'when'.
+ *  - The RF_SEND round trip, minus host overhead, wire time and the frame
+ *    air time, measures the device start-up time. This includes the short
+ *    time to stop the transmitter.
+ * Both are averaged over calls on the same connection. The first call uses
+ * SER4010_TX_SETUP_US as start-up time, so is less accurate.
+ *
+ * @param sdev		Serial Communication handle
+ * @param when		Time of the first bit, using CLOCK_REALTIME
+ * @param cnt		Number of times to send the frame. (range: 1-255)
+ * @param frame_us	Air time of the loaded frame, see
+ *			ser4010_frame_duration_us()
+ * @param timing	If not NULL, the predicted error is returned here
+ *
+ * @returns	0 on success, EINVAL if cnt is out of range, ETIMEDOUT if
+ *		'when' is too close to make it, else see ser4010_send()
+ */
+int ser4010_send_at(struct serco *sdev, const struct timespec *when,
+			unsigned int cnt, unsigned long frame_us,
+			struct ser4010_send_timing *timing);
+
+/**
+ * Send the loaded frame on a range of frequencies
+ *
+ * The device sends the frame 'dwell' times on every frequency start + i *
+ * step below stop, retuning in between. The whole sweep runs on the device,
+ * so step timing doesn't depend on the host. The configured frequency is not
+ * changed. Requires firmware revision 9 or later.
+ *
+ * @param sdev		Serial Communication handle
+ * @param start		First frequency in Hz
+ * @param stop		Frequency in Hz to stop at, not included
+ * @param step		Frequency step in Hz, must be positive
+ * @param dwell		Number of times to send the frame on every frequency
+ *			(range: 1-255)
+ * @param frame_us	Air time of the loaded frame, see
+ *			ser4010_frame_duration_us()
+ * @param cnt		If not NULL, the number of frequencies completed is
+ *			returned here
+ *
+ * @returns	0 on success, EINVAL on invalid arguments, ERANGE if the
+ *		sweep is estimated to take longer than SER4010_SWEEP_MAX_US,
+ *		else an error occurred. STATUS_UNKNOWN_CMD means the firmware
+ *		is too old.
+ */
+int ser4010_send_sweep(struct serco *sdev, float start, float stop,
+			float step, unsigned int dwell,
+			unsigned long frame_us, unsigned int *cnt);
+
+/**
+ * Send the loaded frame on a list of frequencies
+ *
+ * Like ser4010_send_sweep(), but for an explicit hop list.
+ *
+ * @param freqs		Array of 'len' frequencies in Hz
+ * @param len		Number of frequencies (range: 1-SWEEP_MAX_HOPS)
+ *
+ * @returns	see ser4010_send_sweep()
+ */
+int ser4010_send_hops(struct serco *sdev, const float *freqs, size_t len,
+			unsigned int dwell, unsigned long frame_us,
+			unsigned int *cnt);
+
+/**
+ * Reconnect automatically after the device was lost
+ *
+ * If the USB serial adapter is reset or replugged, the next command waits up
+ * to timeout_ms for it to return, and then reopens and resynchronizes. The
+ * configuration set with the ser4010_set_*() functions and the loaded frame
+ * are restored, and an idempotent command interrupted by the loss is retried.
+ * Other interrupted commands, like ser4010_send(), return -1. See
+ * serco_set_reconnect().
+ *
+ * @param sdev		Serial Communication handle
+ * @param timeout_ms	Time to wait for the device to return, 0 to disable
+ */
+void ser4010_set_reconnect(struct serco *sdev, unsigned int timeout_ms);
+
 #endif // __SER4010_H__
@@ -0,0 +1,103 @@
+/**
+ * ser4010_burst.c - Send frames of multiple remotes in a single upload
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ser4010_burst.h"
+
+#include <string.h>
+#include <errno.h>
+
+#include "ser4010.h"
+
+void ser4010_burst_init(struct ser4010_burst *burst)
+{
+	burst->len = 0;
+	burst->frame_cnt = 0;
+}
+
+int ser4010_burst_add(struct ser4010_burst *burst, const uint8_t *frame,
+			size_t len)
+{
+	if (len > sizeof(burst->frame) - burst->len) {
+		return E2BIG;
+	}
+
+	memcpy(&burst->frame[burst->len], frame, len);
+	burst->len += len;
+	burst->frame_cnt++;
+
+	return 0;
+}
+
+int ser4010_burst_send(struct serco *sdev, const struct ser4010_burst *burst,
+			unsigned int cnt, unsigned int *saved)
+{
+	unsigned int round_trips = 0;
+	size_t len;
+	int ret;
+
+	if (burst->frame_cnt == 0 || cnt == 0 || cnt > 255) {
+		return EINVAL;
+	}
+
+	len = burst->len;
+	if (len > SER4010_MAX_LOAD_SIZE) {
+		len = SER4010_MAX_LOAD_SIZE;
+	}
+	ret = ser4010_load_frame(sdev, (uint8_t *) burst->frame, len);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+	round_trips++;
+
+	if (len < burst->len) {
+		ret = ser4010_append_frame(sdev,
+				(uint8_t *) &burst->frame[len],
+				burst->len - len);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+		round_trips++;
+	}
+
+	ret = ser4010_send(sdev, cnt);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+	round_trips++;
+
+	if (saved != NULL) {
+		// Separately every frame costs a load and a send
+		if (burst->frame_cnt * 2 > round_trips) {
+			*saved = burst->frame_cnt * 2 - round_trips;
+		} else {
+			*saved = 0;
+		}
+	}
+
+	return STATUS_OK;
+}
@@ -0,0 +1,103 @@
+/**
+ * ser4010_burst.h - Send frames of multiple remotes in a single upload
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_BURST_H__
+#define __SER4010_BURST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "serco.h"
+
+/** Max. frame size the device can hold, frame length is a single byte */
+#define SER4010_MAX_FRAME_SIZE	255
+/**
+ * Max. payload of a single load/append frame command
+ *
+ * Firmware before DEV_REV 6 keeps the received command length in a byte, so
+ * ID + opcode + payload must not exceed 255 bytes.
+ */
+#define SER4010_MAX_LOAD_SIZE	253
+
+/**
+ * Burst of concatenated frames
+ *
+ * Frames using the same ODS/PA/frequency configuration are concatenated into
+ * a single device frame, which is then sent multiple times. Every frame must
+ * contain its own preamble and inter-frame gap. The device sends the frames
+ * interleaved, ie. A B C A B C..., so every receiver still sees the requested
+ * number of repeats of its frame.
+ */
+struct ser4010_burst {
+	uint8_t frame[SER4010_MAX_FRAME_SIZE];
+	size_t len;
+	unsigned int frame_cnt;		/**< Number of frames in burst */
+};
+
+/**
+ * Initialize empty burst
+ *
+ * @param burst		Burst to initialize
+ */
+void ser4010_burst_init(struct ser4010_burst *burst);
+
+/**
+ * Add encoded frame to burst
+ *
+ * If the frame doesn't fit the burst should first be sent, and a new burst
+ * started.
+ *
+ * @param burst		Burst to add frame to
+ * @param frame		Encoded frame, including preamble and gap
+ * @param len		Length of frame in bytes
+ *
+ * @returns	0 on success, E2BIG if the frame doesn't fit in the burst
+ */
+int ser4010_burst_add(struct ser4010_burst *burst, const uint8_t *frame,
+			size_t len);
+
+/**
+ * Upload and send burst
+ *
+ * The burst is uploaded using a load frame command, and if needed an append
+ * frame command, and then sent 'cnt' times.
+ *
+ * @param sdev		Serial Communication handle
+ * @param burst		Burst to send
+ * @param cnt		Number of times to send the burst. (range: 1-255)
+ * @param saved		If not NULL, the number of command round trips saved
+ *			compared to loading and sending every frame
+ *			separately is returned here.
+ *
+ * @returns	0 on success, >0 device status code, -1 on communication
+ *		error, or EINVAL if the burst is empty or cnt out of range.
+ */
+int ser4010_burst_send(struct serco *sdev, const struct ser4010_burst *burst,
+			unsigned int cnt, unsigned int *saved);
+
+#endif // __SER4010_BURST_H__
@@ -33,48 +33,138 @@
 #include <math.h>
 #include <errno.h>
 #include <assert.h>
+#include <string.h>
 
 #include "si4010_tables.h"
+#include "si4010_index.h"
 
-static float lookup_float_by_float(const float table[][2], float key)
+// Weight of the relative ramp time error, compared to the relative symbol
+// rate error, when choosing the ODS timing. A ramp time that is off by 100%
+// weighs as much as a 1% symbol rate error.
+#define RAMP_ERROR_WEIGHT 0.01
+
+/**
+ * Look up value of the last row with a key less than or equal to 'key'
+ *
+ * Uses a binary search, the keys must be ascending.
+ *
+ * @param table	Table of key/value rows
+ * @param len	Number of rows in table
+ * @param key	Key to look up
+ *
+ * @returns	Value of the row, or 0 if key is smaller than the first key
+ */
+static float lookup_float_by_float(const float table[][2], size_t len,
+					float key)
 {
-	const float (*row)[2] = NULL;
-	float last_val = 0;
+	size_t lo = 0;
+	size_t hi = len;
+	size_t mid;
 
-	for (row=&(table[0]); !isnan((*row)[0]); row++) {
-		if ((*row)[0] > key) {
-			return last_val;
+	// Find the first row with a key greater than 'key'
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (table[mid][0] > key) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
 		}
-		last_val = (*row)[1];
 	}
 
-	return last_val;
+	if (lo == 0) {
+		return 0;
+	}
+
+	return table[lo - 1][1];
 }
 
-static void calc_best_ramp_param(float ramp_time, uint8_t *clk_div,
-				uint8_t *edge_rate)
+/**
+ * Evaluate an ODS timing candidate
+ *
+ * The error is the relative symbol rate error, plus RAMP_ERROR_WEIGHT times
+ * the relative ramp time error.
+ */
+static void score_timing(struct ser4010_ods_solution *best, double *best_score,
+			double sym_rate_ksym_sec, float want_ramp_time,
+			unsigned int clk_div, unsigned int edge_rate,
+			unsigned long bit_rate)
 {
-	uint8_t i;
-	uint8_t j;
-	float best_ramp_diff = INFINITY;
-	for (i = 1; i < 5; i++) {
-		for (j = 1; j < 9; j++) {
-			float diff = fabs(ramp_time - (i * j * 8.0 / 24));
-			if (diff < best_ramp_diff) {
-				best_ramp_diff = diff;
-				*clk_div = j - 1;
-				*edge_rate = i - 1;
-			}
-		}
+	double rate;
+	double rate_error;
+	float ramp;
+	float ramp_error;
+	double score;
+
+	if (bit_rate < 1 || bit_rate > 0x7fff) {
+		return;
+	}
+
+	rate = 24000.0 / (bit_rate * (clk_div + 1));
+	rate_error = (rate - sym_rate_ksym_sec) / sym_rate_ksym_sec;
+	ramp = (clk_div + 1) * (edge_rate + 1) * 8.0 / 24;
+	ramp_error = (ramp - want_ramp_time) / want_ramp_time;
+
+	score = fabs(rate_error) + RAMP_ERROR_WEIGHT * fabsf(ramp_error);
+	if (score < *best_score) {
+		*best_score = score;
+		best->ods.bClkDiv = clk_div;
+		best->ods.bEdgeRate = edge_rate;
+		best->ods.wBitRate = bit_rate;
+		best->sym_rate_ksym_sec = rate;
+		best->rate_error = rate_error;
+		best->ramp_us = ramp;
+		best->ramp_error = ramp_error;
 	}
 }
 
+/**
+ * Find the clock divider, edge rate and bit rate with the smallest error
+ *
+ * Searches all clock divider and edge rate combinations. For a clock divider
+ * the symbol rate error only grows moving away from the ideal bit rate
+ * value, and the ramp time doesn't depend on it. So only the bit rate values
+ * just below and above the ideal value need to be tried, which gives the
+ * same result as trying every value.
+ *
+ * @returns	0 on success, ERANGE if no combination can reach the rate
+ */
+static int solve_timing(struct ser4010_ods_solution *sol,
+			double sym_rate_ksym_sec, float want_ramp_time)
+{
+	unsigned int clk_div;
+	unsigned int edge_rate;
+	double ideal;
+	double best_score = INFINITY;
+
+	for (clk_div = 0; clk_div < 8; clk_div++) {
+		ideal = 24000.0 / (sym_rate_ksym_sec * (clk_div + 1));
+		if (ideal > 0x8000) {
+			continue;
+		}
+		for (edge_rate = 0; edge_rate < 4; edge_rate++) {
+			score_timing(sol, &best_score, sym_rate_ksym_sec,
+					want_ramp_time, clk_div, edge_rate,
+					floor(ideal));
+			score_timing(sol, &best_score, sym_rate_ksym_sec,
+					want_ramp_time, clk_div, edge_rate,
+					ceil(ideal));
+		}
+	}
+
+	if (isinf(best_score)) {
+		return ERANGE;
+	}
+
+	return 0;
+}
 
-static int config_ods(tOds_Setup *ods_config,
+int ser4010_solve_ods(struct ser4010_ods_solution *sol,
 			int modulation, enum Ser4010Encoding encoding,
 			double data_rate_kbps, int bits_per_byte)
 {
+	tOds_Setup *ods_config = &sol->ods;
 	double sym_rate_ksym_sec;
+	int err;
 
 	// Determine symbol rate
 	switch (encoding) {
@@ -114,10 +204,12 @@ static int config_ods(tOds_Setup *ods_config,
 		if (encoding == bEnc_Manchester_c) {
 			want_ramp_time = lookup_float_by_float(
 						ramp_data_manchester,
+						RAMP_DATA_MANCHESTER_LEN,
 						sym_rate_ksym_sec/2);
 		} else {
 			want_ramp_time = lookup_float_by_float(
 						ramp_data_nrz,
+						RAMP_DATA_NRZ_LEN,
 						sym_rate_ksym_sec);
 		}
 	} else if (modulation == ODS_MODULATION_TYPE_FSK) {
@@ -132,15 +224,13 @@ static int config_ods(tOds_Setup *ods_config,
 	}
 
 	// Setup the ODS
+	memset(sol, 0, sizeof(*sol));
 	ods_config->bModulationType = modulation;
-	calc_best_ramp_param(want_ramp_time,
-				&ods_config->bClkDiv, &ods_config->bEdgeRate);
-	ods_config->bGroupWidth    = bits_per_byte - 1;
-	ods_config->wBitRate       = 24000.0 / (sym_rate_ksym_sec *
-						(ods_config->bClkDiv+1));
-	if (ods_config->wBitRate > 0x7fff) {
-		return ERANGE;
+	err = solve_timing(sol, sym_rate_ksym_sec, want_ramp_time);
+	if (err != 0) {
+		return err;
 	}
+	ods_config->bGroupWidth    = bits_per_byte - 1;
 	if (ods_config->wBitRate == 0 ||
 		10 * (24000 / (ods_config->wBitRate * (ods_config->bClkDiv+1)))
 		>= 76)
@@ -158,71 +248,125 @@ static int config_ods(tOds_Setup *ods_config,
 	return 0;
 }
 
+/**
+ * Find the FSK deviation setting with the closest frequency shift
+ *
+ * Does a binary search in the settings sorted by shift. On a tie the lowest
+ * setting is used.
+ */
 static uint8_t lookup_fdev(float freq_mhz, float fdev_khz)
 {
 	float wanted_shift;
-	size_t min_div_idx;
-	float min_div;
-	size_t i;
+	size_t lo = 0;
+	size_t hi = FDEV_MAX + 1;
+	size_t mid;
+	uint8_t below, above;
 
 	wanted_shift = (fdev_khz * 2000.0 / freq_mhz);
 
-	min_div_idx = 0;
-	min_div = abs(wanted_shift - ppm_shift[0]);
-	for (i=1; i < sizeof(ppm_shift)/sizeof(ppm_shift[0]); i++) {
-		double div = abs(wanted_shift - ppm_shift[i]);
-		if (div < min_div) {
-			min_div_idx = i;
-			min_div = div;
+	// Find the first setting with a shift not less than wanted
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ppm_shift[ppm_shift_order[mid]] < wanted_shift) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
 	}
 
-	if (min_div_idx > 104) {
-		min_div_idx = 104;
+	if (lo == 0) {
+		return ppm_shift_order[0];
+	} else if (lo == FDEV_MAX + 1) {
+		return ppm_shift_order[FDEV_MAX];
+	}
+
+	below = ppm_shift_order[lo - 1];
+	above = ppm_shift_order[lo];
+	if (wanted_shift - ppm_shift[below] < ppm_shift[above] - wanted_shift) {
+		return below;
+	} else if (wanted_shift - ppm_shift[below] >
+			ppm_shift[above] - wanted_shift) {
+		return above;
 	}
-	
-	return min_div_idx;
+
+	return (below < above) ? below : above;
 }
 
-int ser4010_config(struct serco *sdev,
+int ser4010_calc_config(struct ser4010_radio_config *cfg,
 			float freq_mhz, float fdev_khz,
 			int modulation, enum Ser4010Encoding encoding,
-			double data_rate_ksym_sec, int bits_per_byte)
+			double data_rate_kbps, int bits_per_byte)
+{
+	return ser4010_calc_configs(cfg, &freq_mhz, 1, fdev_khz, modulation,
+					encoding, data_rate_kbps,
+					bits_per_byte);
+}
+
+int ser4010_calc_configs(struct ser4010_radio_config *cfgs,
+			const float *freq_mhz, size_t cnt, float fdev_khz,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte)
 {
 	int err;
-	tOds_Setup ods_config;
+	struct ser4010_ods_solution sol;
+	size_t i;
 
-	err = config_ods(&ods_config, modulation, encoding, data_rate_ksym_sec,
-			bits_per_byte);
+	// The ODS configuration doesn't depend on the frequency
+	err = ser4010_solve_ods(&sol, modulation, encoding, data_rate_kbps,
+				bits_per_byte);
 	if (err != 0) {
 		return err;
 	}
 
-	err = ser4010_set_ods(sdev, &ods_config);
-	if (err != 0) {
-		return err;
+	for (i = 0; i < cnt; i++) {
+		cfgs[i].ods = sol.ods;
+		cfgs[i].sym_rate_ksym_sec = sol.sym_rate_ksym_sec;
+		cfgs[i].rate_error = sol.rate_error;
+		cfgs[i].freq = freq_mhz[i] * 1e6;
+		cfgs[i].enc = encoding;
+		if (modulation == ODS_MODULATION_TYPE_FSK) {
+			cfgs[i].fdev = lookup_fdev(freq_mhz[i], fdev_khz);
+		} else {
+			cfgs[i].fdev = 0;
+		}
 	}
 
-	err = ser4010_set_freq(sdev, freq_mhz * 1e6);
-	if (err != 0) {
-		return err;
-	}
+	return 0;
+}
 
-	err = ser4010_set_enc(sdev, encoding);
-	if (err != 0) {
-		return err;
+int ser4010_apply_config(struct serco *sdev,
+			const struct ser4010_radio_config *cfg)
+{
+	struct ser4010_dev_config dev_cfg;
+	unsigned int fields;
+
+	dev_cfg.ods = cfg->ods;
+	dev_cfg.freq = cfg->freq;
+	dev_cfg.enc = cfg->enc;
+	dev_cfg.fdev = cfg->fdev;
+
+	fields = SER4010_CFG_ODS | SER4010_CFG_FREQ | SER4010_CFG_ENC;
+	if (cfg->ods.bModulationType == ODS_MODULATION_TYPE_FSK) {
+		fields |= SER4010_CFG_FDEV;
 	}
 
-	if (modulation == ODS_MODULATION_TYPE_FSK) {
-		uint8_t fdev;
+	return ser4010_set_fields(sdev, &dev_cfg, fields);
+}
 
-		fdev = lookup_fdev(freq_mhz, fdev_khz);
+int ser4010_config(struct serco *sdev,
+			float freq_mhz, float fdev_khz,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte)
+{
+	int err;
+	struct ser4010_radio_config cfg;
 
-		err = ser4010_set_fdev(sdev, fdev);
-		if (err != 0) {
-			return err;
-		}
+	err = ser4010_calc_config(&cfg, freq_mhz, fdev_khz, modulation,
+					encoding, data_rate_kbps,
+					bits_per_byte);
+	if (err != 0) {
+		return err;
 	}
 
-	return 0;
+	return ser4010_apply_config(sdev, &cfg);
 }
@@ -0,0 +1,678 @@
+/**
+ * ser4010_discover.c - Find SER4010 modules on serial ports
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+#include "ser4010_discover.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <glob.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "serco_defines.h"
+
+#define MAX_PORTS	64
+
+// Frame ID of first probe command. IDs don't need stuffing.
+#define PROBE_ID	0x50
+
+// Seconds a port without SER4010 stays in the cache
+#define NEGATIVE_CACHE_SEC	60
+
+static const char * const default_ports[] = {
+	"/dev/ttyUSB*",
+	"/dev/ttyACM*",
+	NULL
+};
+
+// Commands sent to every port, in order
+static const uint8_t probe_ops[] = { CMD_NOP, CMD_DEV_TYPE, CMD_DEV_REV };
+#define PROBE_STEPS (sizeof(probe_ops) / sizeof(probe_ops[0]))
+
+struct port {
+	struct ser4010_module mod;
+	int iface;		// USB interface number, -1 if unknown
+	bool known;		// mod.dev_type/dev_rev are valid
+	time_t expires;		// Time cached result expires, 0 if never
+
+	// Probe state
+	int fd;			// -1 if not probing
+	struct termios oldtio;
+	unsigned int step;	// Index in probe_ops
+	struct timespec deadline;
+	uint8_t frame[8];	// Response frame being received
+	size_t frame_len;
+	bool stuff_first;
+	bool frame_bad;		// Drop frame, wait for end-of-frame
+};
+
+/**
+ * Get USB serial number and interface a tty belongs to
+ *
+ * Walks up the sysfs device tree of the tty to the first device with a
+ * serial number. Whitespace is replaced, so it can be used in the cache.
+ * Multi-port adapters, like the FT2232 and CP2105, have one serial number for
+ * all ports, so the USB interface is needed to tell the ports apart.
+ *
+ * @param serial	Returns serial number, empty if not found
+ * @param iface		Returns interface number, -1 if not found
+ */
+static void _usb_serial(const char *path, char *serial, size_t len,
+			int *iface)
+{
+	char dev[PATH_MAX];
+	char dir[PATH_MAX];
+	char sys[PATH_MAX + 32];
+	char *p;
+	FILE *fp;
+
+	serial[0] = '\0';
+	*iface = -1;
+	if (realpath(path, dev) == NULL) {
+		return;
+	}
+	snprintf(sys, sizeof(sys), "/sys/class/tty/%s/device",
+			strrchr(dev, '/') + 1);
+	if (realpath(sys, dir) == NULL) {
+		return;
+	}
+
+	while (strcmp(dir, "/sys/devices") != 0 &&
+			(p = strrchr(dir, '/')) != NULL && p != dir) {
+		snprintf(sys, sizeof(sys), "%s/bInterfaceNumber", dir);
+		if (*iface == -1 && (fp = fopen(sys, "r")) != NULL) {
+			if (fscanf(fp, "%x", iface) != 1) {
+				*iface = -1;
+			}
+			fclose(fp);
+		}
+
+		snprintf(sys, sizeof(sys), "%s/serial", dir);
+		if ((fp = fopen(sys, "r")) != NULL) {
+			if (fgets(serial, len, fp) == NULL) {
+				serial[0] = '\0';
+			}
+			fclose(fp);
+			serial[strcspn(serial, "\r\n")] = '\0';
+			for (p = serial; *p != '\0'; p++) {
+				if (*p == ' ' || *p == '\t') {
+					*p = '_';
+				}
+			}
+			return;
+		}
+		*p = '\0';
+	}
+}
+
+/**
+ * Add candidate ports matching glob patterns
+ *
+ * @returns	Number of ports
+ */
+static size_t _find_ports(struct port *ports, size_t max_ports,
+			const char * const *patterns)
+{
+	glob_t g;
+	size_t cnt = 0;
+	size_t i;
+	int flags = 0;
+
+	for (i = 0; patterns[i] != NULL; i++) {
+		glob(patterns[i], flags | GLOB_NOCHECK, NULL, &g);
+		flags = GLOB_APPEND;
+	}
+	if (flags == 0) {
+		return 0;
+	}
+
+	for (i = 0; i < g.gl_pathc && cnt < max_ports; i++) {
+		struct port *p = &ports[cnt];
+
+		// Unmatched patterns are returned as is
+		if (access(g.gl_pathv[i], F_OK) != 0 ||
+				strlen(g.gl_pathv[i]) >= sizeof(p->mod.path)) {
+			continue;
+		}
+		memset(p, 0, sizeof(*p));
+		strcpy(p->mod.path, g.gl_pathv[i]);
+		_usb_serial(p->mod.path, p->mod.serial,
+				sizeof(p->mod.serial), &p->iface);
+		p->fd = -1;
+		cnt++;
+	}
+	globfree(&g);
+
+	return cnt;
+}
+
+/**
+ * Get cache key of a port
+ *
+ * The key is the USB serial number, followed by the interface number if
+ * known. Ports without serial number have key "-", and are matched by path.
+ */
+static void _cache_key(const struct port *p, char *key, size_t len)
+{
+	if (p->mod.serial[0] == '\0') {
+		snprintf(key, len, "-");
+	} else if (p->iface == -1) {
+		snprintf(key, len, "%s", p->mod.serial);
+	} else {
+		snprintf(key, len, "%s:%02x", p->mod.serial, p->iface);
+	}
+}
+
+/**
+ * Fill in results of ports found in cache
+ *
+ * Results without SER4010 have an expiry time, expired results are ignored.
+ */
+static void _cache_read(const char *path, struct port *ports, size_t cnt)
+{
+	char line[256];
+	char key[SER4010_DISCOVER_SERIAL_LEN + 4];
+	char port_key[SER4010_DISCOVER_SERIAL_LEN + 4];
+	char dev_path[SER4010_DISCOVER_PATH_LEN];
+	unsigned int dev_type, dev_rev;
+	long long expires;
+	time_t now = time(NULL);
+	FILE *fp;
+	size_t i;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		expires = 0;
+		if (sscanf(line, "%67s %63s %x %u %lld", key, dev_path,
+					&dev_type, &dev_rev, &expires) < 4) {
+			continue;
+		}
+		if (expires != 0 && expires <= now) {
+			continue;
+		}
+		for (i = 0; i < cnt; i++) {
+			struct port *p = &ports[i];
+
+			_cache_key(p, port_key, sizeof(port_key));
+			if (strcmp(port_key, key) != 0) {
+				continue;
+			}
+			if (p->mod.serial[0] == '\0' &&
+					strcmp(p->mod.path, dev_path) != 0) {
+				continue;
+			}
+			p->mod.dev_type = dev_type;
+			p->mod.dev_rev = dev_rev;
+			p->mod.cached = true;
+			p->known = true;
+			p->expires = expires;
+		}
+	}
+
+	fclose(fp);
+}
+
+/**
+ * Replace cache with results of known ports
+ *
+ * @returns	0 on success, -1 on error with errno set
+ */
+static int _cache_write(const char *path, const struct port *ports,
+			size_t cnt)
+{
+	char key[SER4010_DISCOVER_SERIAL_LEN + 4];
+	char *tmp_path;
+	char *p;
+	FILE *fp;
+	int fd;
+	size_t i;
+	int saved_errno;
+
+	tmp_path = malloc(strlen(path) + 8);
+	if (tmp_path == NULL) {
+		return -1;
+	}
+
+	// Create directory, /run is a tmpfs
+	strcpy(tmp_path, path);
+	if ((p = strrchr(tmp_path, '/')) != NULL && p != tmp_path) {
+		*p = '\0';
+		mkdir(tmp_path, 0755);
+	}
+
+	sprintf(tmp_path, "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp_path)) == -1) {
+		goto bad_free;
+	}
+	fchmod(fd, 0644);
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		goto bad_unlink;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		if (!ports[i].known) {
+			continue;
+		}
+		_cache_key(&ports[i], key, sizeof(key));
+		fprintf(fp, "%s %s 0x%04x %u", key,
+				ports[i].mod.path, ports[i].mod.dev_type,
+				ports[i].mod.dev_rev);
+		if (ports[i].expires != 0) {
+			fprintf(fp, " %lld", (long long) ports[i].expires);
+		}
+		fputc('\n', fp);
+	}
+	if (fclose(fp) != 0) {
+		goto bad_unlink;
+	}
+	if (rename(tmp_path, path) != 0) {
+		goto bad_unlink;
+	}
+
+	free(tmp_path);
+	return 0;
+
+bad_unlink:
+	saved_errno = errno;
+	unlink(tmp_path);
+	errno = saved_errno;
+bad_free:
+	saved_errno = errno;
+	free(tmp_path);
+	errno = saved_errno;
+	return -1;
+}
+
+static void _deadline_in(struct timespec *t, unsigned int ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, t);
+	t->tv_sec += ms / 1000;
+	t->tv_nsec += (ms % 1000) * 1000000L;
+	if (t->tv_nsec >= 1000000000L) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000L;
+	}
+}
+
+static long _ms_until(const struct timespec *t)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (t->tv_sec - now.tv_sec) * 1000 +
+		(t->tv_nsec - now.tv_nsec + 999999) / 1000000;
+}
+
+/**
+ * Write next probe command
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int _probe_send(struct port *p, unsigned int timeout_ms)
+{
+	uint8_t buf[6];
+	size_t len = 0;
+
+	if (p->step == 0) {
+		// Bare end-of-frame marker first, ends any partial frame
+		buf[len++] = STUFF_BYTE1;
+		buf[len++] = STUFF_BYTE2;
+	}
+	buf[len++] = PROBE_ID + p->step;
+	buf[len++] = probe_ops[p->step];
+	buf[len++] = STUFF_BYTE1;
+	buf[len++] = STUFF_BYTE2;
+
+	_deadline_in(&p->deadline, timeout_ms);
+	p->frame_len = 0;
+	p->frame_bad = false;
+
+	return (write(p->fd, buf, len) == (ssize_t) len) ? 0 : -1;
+}
+
+static void _probe_close(struct port *p)
+{
+	tcsetattr(p->fd, TCSANOW, &p->oldtio);
+	close(p->fd);
+	p->fd = -1;
+}
+
+/**
+ * Open port and send first probe command
+ *
+ * Ports locked by other processes are skipped.
+ *
+ * @returns	0 on success, -1 if the port can't be probed
+ */
+static int _probe_start(struct port *p, unsigned int timeout_ms)
+{
+	struct termios newtio;
+	struct flock fl;
+
+	p->fd = open(p->mod.path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (p->fd == -1) {
+		return -1;
+	}
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	if (fcntl(p->fd, F_SETLK, &fl) == -1 ||
+			tcgetattr(p->fd, &p->oldtio) != 0) {
+		close(p->fd);
+		p->fd = -1;
+		return -1;
+	}
+
+	memset(&newtio, 0, sizeof(newtio));
+	newtio.c_cflag = B9600 | CS8 | CLOCAL | CREAD;
+	newtio.c_iflag = IGNPAR;
+	newtio.c_cc[VTIME] = 0;
+	newtio.c_cc[VMIN] = 0;
+	if (tcflush(p->fd, TCIFLUSH) != 0 ||
+			tcsetattr(p->fd, TCSANOW, &newtio) != 0 ||
+			_probe_send(p, timeout_ms) != 0) {
+		_probe_close(p);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Handle a complete response frame
+ *
+ * @returns	true if probing is done
+ */
+static bool _probe_response(struct port *p, unsigned int timeout_ms)
+{
+	const uint8_t *f = p->frame;
+
+	if (p->frame_len < 2 || f[RES_ID] != PROBE_ID + p->step) {
+		// Not for us, eg. a response to a previous user
+		return false;
+	}
+
+	p->known = true;
+	if (f[RES_STATUS] != STATUS_OK) {
+		return true;
+	}
+
+	switch (probe_ops[p->step]) {
+	case CMD_DEV_TYPE:
+		if (p->frame_len != RES_PAYLOAD + 2) {
+			return true;
+		}
+		p->mod.dev_type = (f[RES_PAYLOAD] << 8) | f[RES_PAYLOAD + 1];
+		if (p->mod.dev_type != SER4010_DEV_TYPE) {
+			return true;
+		}
+		break;
+	case CMD_DEV_REV:
+		if (p->frame_len != RES_PAYLOAD + 2) {
+			p->mod.dev_type = 0;
+			return true;
+		}
+		p->mod.dev_rev = (f[RES_PAYLOAD] << 8) | f[RES_PAYLOAD + 1];
+		break;
+	}
+
+	p->step++;
+	if (p->step == PROBE_STEPS) {
+		return true;
+	}
+	if (_probe_send(p, timeout_ms) != 0) {
+		p->mod.dev_type = 0;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Process received bytes
+ *
+ * @returns	true if probing is done
+ */
+static bool _probe_input(struct port *p, unsigned int timeout_ms)
+{
+	uint8_t buf[64];
+	ssize_t len;
+	ssize_t i;
+	uint8_t c;
+
+	len = read(p->fd, buf, sizeof(buf));
+	if (len <= 0) {
+		return (len == 0 || (errno != EAGAIN && errno != EINTR));
+	}
+
+	for (i = 0; i < len; i++) {
+		c = buf[i];
+		if (p->stuff_first) {
+			p->stuff_first = false;
+			if (c == STUFF_BYTE2 || c == STUFF_BYTE2_CRC) {
+				if (!p->frame_bad &&
+						_probe_response(p, timeout_ms)) {
+					return true;
+				}
+				p->frame_len = 0;
+				p->frame_bad = false;
+				continue;
+			} else if (c != STUFF_BYTE1) {
+				p->frame_bad = true;
+				continue;
+			}
+		} else if (c == STUFF_BYTE1) {
+			p->stuff_first = true;
+			continue;
+		}
+
+		if (p->frame_len == sizeof(p->frame)) {
+			p->frame_bad = true;
+		}
+		if (!p->frame_bad) {
+			p->frame[p->frame_len++] = c;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Probe ports without result in parallel
+ *
+ * @returns	Number of ports probed
+ */
+static size_t _probe_all(struct port *ports, size_t cnt,
+			unsigned int timeout_ms)
+{
+	struct pollfd pfds[MAX_PORTS];
+	struct port *active[MAX_PORTS];
+	size_t nactive = 0;
+	size_t probed = 0;
+	long wait_ms, ms;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		if (!ports[i].known && _probe_start(&ports[i], timeout_ms) == 0) {
+			active[nactive++] = &ports[i];
+			probed++;
+		}
+	}
+
+	while (nactive > 0) {
+		wait_ms = timeout_ms;
+		for (i = 0; i < nactive; i++) {
+			pfds[i].fd = active[i]->fd;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+			ms = _ms_until(&active[i]->deadline);
+			if (ms < wait_ms) {
+				wait_ms = (ms > 0) ? ms : 0;
+			}
+		}
+
+		if (poll(pfds, nactive, wait_ms) < 0 && errno != EINTR) {
+			break;
+		}
+
+		for (i = 0; i < nactive; ) {
+			struct port *p = active[i];
+			bool done = false;
+
+			if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				done = true;
+			} else if (pfds[i].revents & POLLIN) {
+				done = _probe_input(p, timeout_ms);
+			}
+			if (!done && _ms_until(&p->deadline) <= 0) {
+				// No SER4010 answered
+				p->known = true;
+				done = true;
+			}
+
+			if (done) {
+				if (p->step != PROBE_STEPS) {
+					p->mod.dev_type = 0;
+					p->mod.dev_rev = 0;
+				}
+				// Module may be flashed or plugged in later
+				p->expires = 0;
+				if (p->mod.dev_type != SER4010_DEV_TYPE) {
+					p->expires = time(NULL) +
+							NEGATIVE_CACHE_SEC;
+				}
+				_probe_close(p);
+				active[i] = active[nactive - 1];
+				pfds[i] = pfds[nactive - 1];
+				nactive--;
+			} else {
+				i++;
+			}
+		}
+	}
+
+	for (i = 0; i < nactive; i++) {
+		_probe_close(active[i]);
+	}
+
+	return probed;
+}
+
+/**
+ * Get path of the discovery cache
+ *
+ * @returns	Value of the SER4010_DISCOVER_CACHE environment variable, or
+ *		else the compile time default
+ */
+const char *ser4010_discover_default_path(void)
+{
+	const char *path = getenv("SER4010_DISCOVER_CACHE");
+
+	if (path == NULL || path[0] == '\0') {
+		path = DEFAULT_DISCOVER_CACHE;
+	}
+
+	return path;
+}
+
+/**
+ * Find SER4010 modules
+ *
+ * Ports in the cache are not probed, unless SER4010_DISCOVER_REFRESH is
+ * given. The cache is updated if any port was probed; failing to write it is
+ * not an error.
+ *
+ * @param mods		Array to return modules in
+ * @param max_mods	Size of mods
+ * @param ports		NULL terminated list of ports or glob patterns, or
+ *			NULL for all USB serial ports
+ * @param cache_path	Cache file, or NULL for
+ *			ser4010_discover_default_path()
+ * @param timeout_ms	Time-out per probe command
+ * @param flags		SER4010_DISCOVER_* flags
+ *
+ * @returns	Number of modules found, -1 on error with errno set
+ */
+int ser4010_discover(struct ser4010_module *mods, size_t max_mods,
+			const char * const *ports, const char *cache_path,
+			unsigned int timeout_ms, unsigned int flags)
+{
+	struct port *cand;
+	size_t cnt;
+	size_t found = 0;
+	size_t i;
+
+	if (cache_path == NULL) {
+		cache_path = ser4010_discover_default_path();
+	}
+	if (ports == NULL) {
+		ports = default_ports;
+	}
+
+	cand = malloc(MAX_PORTS * sizeof(*cand));
+	if (cand == NULL) {
+		return -1;
+	}
+
+	cnt = _find_ports(cand, MAX_PORTS, ports);
+	if (!(flags & (SER4010_DISCOVER_REFRESH | SER4010_DISCOVER_NO_CACHE))) {
+		_cache_read(cache_path, cand, cnt);
+	}
+
+	if (_probe_all(cand, cnt, timeout_ms) > 0 &&
+			!(flags & SER4010_DISCOVER_NO_CACHE)) {
+		_cache_write(cache_path, cand, cnt);
+	}
+
+	for (i = 0; i < cnt && found < max_mods; i++) {
+		if (cand[i].known &&
+				cand[i].mod.dev_type == SER4010_DEV_TYPE) {
+			mods[found++] = cand[i].mod;
+		}
+	}
+
+	free(cand);
+
+	return found;
+}
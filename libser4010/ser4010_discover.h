@@ -0,0 +1,77 @@
+/**
+ * ser4010_discover.h - Find SER4010 modules on serial ports
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_DISCOVER_H__
+#define __SER4010_DISCOVER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Discovery probes candidate serial ports in parallel with NOP, DEV_TYPE and
+ * DEV_REV commands. Results are cached in a text file, one line per port:
+ *
+ *   <usb_serial[:interface]|-> <path> <dev_type> <dev_rev> [<expires>]
+ *
+ * Ports of USB adapters are matched by serial number and interface number, so
+ * a cached result stays valid when the ttyUSB numbering changes, and the ports
+ * of a multi-port adapter are told apart. Other ports are matched by path. A
+ * dev_type of 0 means no SER4010 answered. Results without SER4010 expire
+ * after a minute, given as a Unix time, so a module that is plugged in or
+ * flashed later is found. Only ports that are not in the cache are probed.
+ * The default cache lives under /run, so it is cleared on reboot.
+ *
+ * Ports opened with serco_open() are read-locked. Discovery skips locked
+ * ports, so it doesn't disturb running tools.
+ */
+#define SER4010_DISCOVER_SERIAL_LEN	64
+#define SER4010_DISCOVER_PATH_LEN	64
+
+// Discovery flags
+#define SER4010_DISCOVER_REFRESH	0x01	// Probe all ports, update cache
+#define SER4010_DISCOVER_NO_CACHE	0x02	// Don't read or write the cache
+
+// Default probe time-out per command
+#define SER4010_DISCOVER_TIMEOUT_MS	100
+
+struct ser4010_module {
+	char path[SER4010_DISCOVER_PATH_LEN];	// Device node
+	char serial[SER4010_DISCOVER_SERIAL_LEN];	// USB serial number,
+							// empty if unknown
+	uint16_t dev_type;
+	uint16_t dev_rev;
+	bool cached;		// Result from cache, port not probed
+};
+
+const char *ser4010_discover_default_path(void);
+int ser4010_discover(struct ser4010_module *mods, size_t max_mods,
+			const char * const *ports, const char *cache_path,
+			unsigned int timeout_ms, unsigned int flags);
+
+#endif // __SER4010_DISCOVER_H__
@@ -0,0 +1,133 @@
+/**
+ * ser4010_encode.c - Pack symbol streams into SER4010 frame bytes
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ser4010_encode.h"
+
+#define R2(n) (n), (n) + 2*64, (n) + 1*64, (n) + 3*64
+#define R4(n) R2(n), R2((n) + 2*16), R2((n) + 1*16), R2((n) + 3*16)
+#define R6(n) R4(n), R4((n) + 2*4), R4((n) + 1*4), R4((n) + 3*4)
+static const uint8_t bit_reverse_table[256] = {
+	R6(0), R6(2), R6(1), R6(3)
+};
+#undef R2
+#undef R4
+#undef R6
+
+int ser4010_symbol_map_init(struct ser4010_symbol_map *map,
+			unsigned int symbols_per_bit,
+			uint8_t zero, uint8_t one)
+{
+	unsigned int b;
+	unsigned int i;
+
+	// 8 bits must fit in the 56 bits ser4010_pack_symbols() accepts
+	if (symbols_per_bit < 1 || symbols_per_bit > 7) {
+		return -1;
+	}
+
+	map->symbols_per_bit = symbols_per_bit;
+	zero &= (1 << symbols_per_bit) - 1;
+	one &= (1 << symbols_per_bit) - 1;
+
+	for (b = 0; b < 256; b++) {
+		map->table[b] = 0;
+
+		// MSb is transmitted first, so goes in the LSb's of the table
+		for (i = 0; i < 8; i++) {
+			uint64_t pattern = (b & (0x80 >> i)) ? one : zero;
+
+			map->table[b] |= pattern << (i * symbols_per_bit);
+		}
+	}
+
+	return 0;
+}
+
+void ser4010_packer_init(struct ser4010_packer *p, uint8_t *buf, size_t size,
+			unsigned int group_width)
+{
+	p->buf = buf;
+	p->size = size;
+	p->len = 0;
+	p->width = (group_width & 0x7) + 1;
+	p->acc = 0;
+	p->acc_cnt = 0;
+	p->overflow = false;
+}
+
+void ser4010_pack_symbols(struct ser4010_packer *p, uint64_t symbols,
+			unsigned int cnt)
+{
+	uint8_t mask = (1 << p->width) - 1;
+
+	// acc_cnt < width <= 8 on entry, so 56 new symbols always fit
+	p->acc |= symbols << p->acc_cnt;
+	p->acc_cnt += cnt;
+
+	while (p->acc_cnt >= p->width) {
+		if (p->len < p->size) {
+			p->buf[p->len++] = p->acc & mask;
+		} else {
+			p->overflow = true;
+		}
+		p->acc >>= p->width;
+		p->acc_cnt -= p->width;
+	}
+}
+
+void ser4010_pack_bytes(struct ser4010_packer *p,
+			const struct ser4010_symbol_map *map,
+			const uint8_t *data, size_t len)
+{
+	unsigned int cnt = 8 * map->symbols_per_bit;
+
+	while (len--) {
+		ser4010_pack_symbols(p, map->table[*data++], cnt);
+	}
+}
+
+int ser4010_packer_finish(struct ser4010_packer *p, size_t *len)
+{
+	if (p->acc_cnt > 0) {
+		ser4010_pack_symbols(p, 0, p->width - p->acc_cnt);
+	}
+
+	if (len != NULL) {
+		*len = p->len;
+	}
+
+	return p->overflow ? -1 : 0;
+}
+
+void ser4010_reverse_bytes(uint8_t *buf, size_t len)
+{
+	while (len--) {
+		*buf = bit_reverse_table[*buf];
+		buf++;
+	}
+}
@@ -0,0 +1,146 @@
+/**
+ * ser4010_encode.h - Pack symbol streams into SER4010 frame bytes
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_ENCODE_H__
+#define __SER4010_ENCODE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Symbol patterns for common encodings
+ *
+ * Patterns are in transmission order, ie. the first symbol is in the LSb.
+ */
+///@{
+/** Manchester (IEEE 802.3): 0 = high-low, 1 = low-high */
+#define SER4010_MANCHESTER_ZERO	0x1
+#define SER4010_MANCHESTER_ONE	0x2
+/** KAKU PWM encoding, 7 symbols per bit */
+#define SER4010_KAKU_ZERO	0x05
+#define SER4010_KAKU_ONE	0x21
+///@}
+
+/**
+ * Byte to symbol lookup table
+ *
+ * Maps every input bit to a fixed number of symbols. Input bytes are encoded
+ * MSb first.
+ */
+struct ser4010_symbol_map {
+	unsigned int symbols_per_bit;
+	uint64_t table[256];	/**< Symbols for every byte value, first in LSb */
+};
+
+/**
+ * Frame packer state
+ *
+ * Packs symbols into frame bytes, LSb first, using only the first
+ * (bGroupWidth + 1) bits of every byte as the Output Data Serializer expects.
+ */
+struct ser4010_packer {
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+	unsigned int width;	/**< Symbols per frame byte (bGroupWidth + 1) */
+	uint64_t acc;		/**< Symbols not yet written to 'buf' */
+	unsigned int acc_cnt;	/**< Number of symbols in 'acc' */
+	bool overflow;
+};
+
+/**
+ * Initialize symbol map
+ *
+ * @param map			Map to initialize
+ * @param symbols_per_bit	Number of symbols every bit encodes to (1-7)
+ * @param zero			Symbol pattern for a 0-bit, first symbol in LSb
+ * @param one			Symbol pattern for a 1-bit, first symbol in LSb
+ *
+ * @returns		0 on success, -1 if symbols_per_bit is out of range
+ */
+int ser4010_symbol_map_init(struct ser4010_symbol_map *map,
+			unsigned int symbols_per_bit,
+			uint8_t zero, uint8_t one);
+
+/**
+ * Initialize frame packer
+ *
+ * @param p		Packer to initialize
+ * @param buf		Buffer to write frame bytes to
+ * @param size		Size of 'buf' in bytes
+ * @param group_width	ODS bGroupWidth (0-7)
+ */
+void ser4010_packer_init(struct ser4010_packer *p, uint8_t *buf, size_t size,
+			unsigned int group_width);
+
+/**
+ * Append symbols to frame
+ *
+ * @param p		Frame packer
+ * @param symbols	Symbols to append, first symbol in LSb
+ * @param cnt		Number of symbols in 'symbols' (<= 56)
+ */
+void ser4010_pack_symbols(struct ser4010_packer *p, uint64_t symbols,
+			unsigned int cnt);
+
+/**
+ * Encode bytes and append the symbols to frame
+ *
+ * @param p		Frame packer
+ * @param map		Symbol map to encode with
+ * @param data		Data to encode
+ * @param len		Length of 'data' in bytes
+ */
+void ser4010_pack_bytes(struct ser4010_packer *p,
+			const struct ser4010_symbol_map *map,
+			const uint8_t *data, size_t len);
+
+/**
+ * Write out remaining symbols
+ *
+ * A partially filled last frame byte is padded with 0 symbols.
+ *
+ * @param p		Frame packer
+ * @param len		If not NULL, returns the frame length in bytes
+ *
+ * @returns		0 on success, -1 if the frame didn't fit the buffer
+ */
+int ser4010_packer_finish(struct ser4010_packer *p, size_t *len);
+
+/**
+ * Reverse bit order of every byte in a buffer
+ *
+ * Useful for sending data MSb first, since frames are send LSb first.
+ *
+ * @param buf		Data to reverse, modified in place
+ * @param len		Length of 'buf' in bytes
+ */
+void ser4010_reverse_bytes(uint8_t *buf, size_t len);
+
+#endif // __SER4010_ENCODE_H__
@@ -0,0 +1,329 @@
+/**
+ * ser4010_group.c - Drive a group of SER4010 modules as one transmitter
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ser4010_group.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_sec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void member_mark_dead(struct ser4010_group_member *m)
+{
+	m->alive = false;
+	m->profile_valid = false;
+	m->failures++;
+	m->dead_since = now_sec();
+}
+
+/**
+ * Check if a dead member is back
+ *
+ * @returns	true if member is alive
+ */
+static bool member_revive(struct ser4010_group *group,
+			struct ser4010_group_member *m)
+{
+	if (m->alive) {
+		return true;
+	}
+	if (now_sec() - m->dead_since < group->retry_sec) {
+		return false;
+	}
+
+	if (m->open) {
+		serco_close(&m->sdev);
+		m->open = false;
+	}
+	if (serco_open(&m->sdev, m->path) != 0) {
+		m->dead_since = now_sec();
+		return false;
+	}
+	m->open = true;
+
+	if (serco_send_command(&m->sdev, CMD_NOP, NULL, 0, NULL, 0)
+			!= STATUS_OK) {
+		m->dead_since = now_sec();
+		return false;
+	}
+
+	m->alive = true;
+	return true;
+}
+
+/**
+ * Configure member for profile
+ *
+ * Only the parts of the profile that differ from the last applied profile are
+ * send to the module.
+ */
+static int member_apply_profile(struct ser4010_group_member *m,
+			const struct ser4010_group_profile *p)
+{
+	const struct ser4010_group_profile *cur = NULL;
+	struct ser4010_dev_config cfg;
+	unsigned int fields = 0;
+	int ret;
+
+	if (m->profile_valid) {
+		cur = &m->profile;
+	}
+
+	if (cur == NULL || memcmp(&cur->ods, &p->ods, sizeof(p->ods)) != 0) {
+		fields |= SER4010_CFG_ODS;
+	}
+	if (cur == NULL || memcmp(&cur->pa, &p->pa, sizeof(p->pa)) != 0) {
+		fields |= SER4010_CFG_PA;
+	}
+	if (cur == NULL || cur->freq != p->freq) {
+		fields |= SER4010_CFG_FREQ;
+	}
+	if (cur == NULL || cur->fdev != p->fdev) {
+		fields |= SER4010_CFG_FDEV;
+	}
+	if (cur == NULL || cur->enc != p->enc) {
+		fields |= SER4010_CFG_ENC;
+	}
+	if (fields == 0) {
+		return STATUS_OK;
+	}
+
+	cfg.ods = p->ods;
+	cfg.pa = p->pa;
+	cfg.freq = p->freq;
+	cfg.fdev = p->fdev;
+	cfg.enc = p->enc;
+
+	// Invalidate cached profile until all settings are applied
+	m->profile_valid = false;
+
+	ret = ser4010_set_fields(&m->sdev, &cfg, fields);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	memcpy(&m->profile, p, sizeof(m->profile));
+	m->profile_valid = true;
+	m->reconfigs++;
+
+	return STATUS_OK;
+}
+
+static bool member_has_profile(const struct ser4010_group_member *m,
+			const struct ser4010_group_profile *p)
+{
+	return m->profile_valid &&
+		memcmp(&m->profile, p, sizeof(m->profile)) == 0;
+}
+
+int ser4010_group_open(struct ser4010_group *group,
+			const char * const paths[], size_t cnt)
+{
+	size_t i;
+	size_t open_cnt = 0;
+
+	if (cnt == 0 || cnt > SER4010_GROUP_MAX_MODULES) {
+		return -1;
+	}
+
+	memset(group, 0, sizeof(*group));
+	group->member_cnt = cnt;
+	group->retry_sec = 10;
+	group->open_time = now_sec();
+
+	for (i = 0; i < cnt; i++) {
+		struct ser4010_group_member *m = &group->members[i];
+
+		m->path = strdup(paths[i]);
+		if (m->path == NULL) {
+			perror("strdup() failed");
+			goto bad;
+		}
+
+		if (serco_open(&m->sdev, m->path) != 0) {
+			member_mark_dead(m);
+			continue;
+		}
+		m->open = true;
+		m->alive = true;
+		open_cnt++;
+	}
+
+	if (open_cnt == 0) {
+		goto bad;
+	}
+
+	return 0;
+bad:
+	ser4010_group_close(group);
+	return -1;
+}
+
+void ser4010_group_close(struct ser4010_group *group)
+{
+	size_t i;
+
+	for (i = 0; i < group->member_cnt; i++) {
+		struct ser4010_group_member *m = &group->members[i];
+
+		if (m->open) {
+			serco_close(&m->sdev);
+			m->open = false;
+		}
+		free(m->path);
+		m->path = NULL;
+	}
+	group->member_cnt = 0;
+}
+
+int ser4010_group_send(struct ser4010_group *group,
+			const struct ser4010_group_job *job)
+{
+	bool tried[SER4010_GROUP_MAX_MODULES] = { false };
+	size_t i;
+
+	if (job->cnt == 0 || job->cnt > 255) {
+		return -EINVAL;
+	}
+
+	while (true) {
+		struct ser4010_group_member *m;
+		ssize_t best = -1;
+		double start;
+		int ret;
+
+		// Select module: prefer one that is already configured for
+		// this profile, else the least utilised one.
+		for (i = 0; i < group->member_cnt; i++) {
+			struct ser4010_group_member *c = &group->members[i];
+			struct ser4010_group_member *b;
+
+			if (tried[i] || !member_revive(group, c)) {
+				continue;
+			}
+			if (best == -1) {
+				best = i;
+				continue;
+			}
+
+			b = &group->members[best];
+			if (member_has_profile(c, job->profile) !=
+				member_has_profile(b, job->profile))
+			{
+				if (member_has_profile(c, job->profile)) {
+					best = i;
+				}
+			} else if (c->busy_sec < b->busy_sec) {
+				best = i;
+			}
+		}
+		if (best == -1) {
+			return -1;
+		}
+		tried[best] = true;
+		m = &group->members[best];
+
+		// Perform transmission
+		start = now_sec();
+		ret = STATUS_OK;
+		if (!member_has_profile(m, job->profile)) {
+			ret = member_apply_profile(m, job->profile);
+		}
+		if (ret == STATUS_OK) {
+			ret = ser4010_load_frame(&m->sdev,
+						(uint8_t *) job->frame,
+						job->frame_len);
+		}
+		if (ret < 0) {
+			// Nothing was sent yet, fail over to next module. Only
+			// a communication failure means the module is dead.
+			m->busy_sec += now_sec() - start;
+			if (ret == -1) {
+				member_mark_dead(m);
+			} else {
+				m->profile_valid = false;
+			}
+			continue;
+		}
+		if (ret == STATUS_OK) {
+			ret = ser4010_send(&m->sdev, job->cnt);
+		}
+		m->busy_sec += now_sec() - start;
+
+		if (ret < 0) {
+			// The frame may have been sent, so don't send it again
+			// on another module.
+			m->unknown++;
+			if (ret == -1) {
+				member_mark_dead(m);
+			}
+			return SER4010_GROUP_SEND_UNKNOWN;
+		}
+		if (ret == STATUS_OK) {
+			m->jobs++;
+		}
+
+		return ret;
+	}
+}
+
+size_t ser4010_group_get_stats(struct ser4010_group *group,
+			struct ser4010_group_stats *stats, size_t max_cnt)
+{
+	double elapsed;
+	size_t i;
+
+	elapsed = now_sec() - group->open_time;
+
+	for (i = 0; i < group->member_cnt && i < max_cnt; i++) {
+		struct ser4010_group_member *m = &group->members[i];
+
+		stats[i].path = m->path;
+		stats[i].alive = m->alive;
+		stats[i].jobs = m->jobs;
+		stats[i].reconfigs = m->reconfigs;
+		stats[i].failures = m->failures;
+		stats[i].unknown = m->unknown;
+		stats[i].busy_sec = m->busy_sec;
+		stats[i].utilisation = 0;
+		if (elapsed > 0) {
+			stats[i].utilisation = m->busy_sec / elapsed;
+		}
+	}
+
+	return i;
+}
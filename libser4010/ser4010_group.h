@@ -0,0 +1,168 @@
+/**
+ * ser4010_group.h - Drive a group of SER4010 modules as one transmitter
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_GROUP_H__
+#define __SER4010_GROUP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "serco.h"
+#include "ser4010.h"
+
+#define SER4010_GROUP_MAX_MODULES 8
+
+/**
+ * ser4010_group_send() result if communication failed after the send command
+ * was issued, so it is unknown if the frame was sent
+ */
+#define SER4010_GROUP_SEND_UNKNOWN -2
+
+/**
+ * Radio configuration a transmission requires
+ *
+ * A module that was last configured with an identical profile can send the
+ * frame without any reconfiguration round trips.
+ */
+#pragma pack(1)
+struct ser4010_group_profile {
+	tOds_Setup ods;
+	tPa_Setup pa;
+	float freq;			/**< Frequency in Hz */
+	uint8_t fdev;			/**< See ser4010_set_fdev() */
+	uint8_t enc;			/**< enum Ser4010Encoding */
+};
+#pragma pack()
+
+/**
+ * A single transmission to dispatch to one of the group members
+ */
+struct ser4010_group_job {
+	const struct ser4010_group_profile *profile;
+	const uint8_t *frame;		/**< Frame data, see ser4010_load_frame() */
+	size_t frame_len;
+	unsigned int cnt;		/**< Number of times to send the frame,
+					  * 1 to 255 */
+};
+
+/**
+ * Per module utilisation statistics
+ */
+struct ser4010_group_stats {
+	const char *path;		/**< Serial device path of module */
+	bool alive;			/**< Module is responding */
+	unsigned int jobs;		/**< Transmissions performed */
+	unsigned int reconfigs;		/**< Transmissions requiring reconfig */
+	unsigned int failures;		/**< Communication failures */
+	unsigned int unknown;		/**< Transmissions with unknown result */
+	double busy_sec;		/**< Time spent communicating */
+	double utilisation;		/**< busy_sec / time since group open */
+};
+
+struct ser4010_group_member {
+	struct serco sdev;
+	char *path;
+	bool open;
+	bool alive;
+	bool profile_valid;
+	struct ser4010_group_profile profile;
+	double dead_since;
+	unsigned int jobs;
+	unsigned int reconfigs;
+	unsigned int failures;
+	unsigned int unknown;
+	double busy_sec;
+};
+
+struct ser4010_group {
+	struct ser4010_group_member members[SER4010_GROUP_MAX_MODULES];
+	size_t member_cnt;
+	unsigned int retry_sec;		/**< Seconds before retrying a dead module */
+	double open_time;
+};
+
+/**
+ * Open a group of SER4010 modules
+ *
+ * Opens every serial device in 'paths'. Devices that fail to open are kept in
+ * the group as dead members and are retried later, so the group is usable as
+ * long as at least one module could be opened.
+ *
+ * @param group		Group handle to initialize
+ * @param paths		Serial device paths of the modules
+ * @param cnt		Number of entries in 'paths' (<=
+ *			SER4010_GROUP_MAX_MODULES)
+ *
+ * @returns		0 on success, -1 if no module could be opened
+ */
+int ser4010_group_open(struct ser4010_group *group,
+			const char * const paths[], size_t cnt);
+
+/**
+ * Close all modules in a group
+ *
+ * @param group		Group handle
+ */
+void ser4010_group_close(struct ser4010_group *group);
+
+/**
+ * Transmit a frame on one of the group members
+ *
+ * Dispatches the job to a live module, preferring one already configured with
+ * the job's radio profile, and otherwise the least utilised one. If
+ * configuring the module or loading the frame fails, the job is retried on
+ * the next candidate. A module that stops responding is marked dead. Once the
+ * send command is issued the job is never retried, so a frame is not sent
+ * twice.
+ *
+ * @param group		Group handle
+ * @param job		Transmission to perform
+ *
+ * @returns		0 on success, > 0 the device status code of a failed
+ *			command, -1 when no module was able to send the frame,
+ *			SER4010_GROUP_SEND_UNKNOWN if communication failed
+ *			after the send command was issued, or -EINVAL if
+ *			job->cnt is out of range
+ */
+int ser4010_group_send(struct ser4010_group *group,
+			const struct ser4010_group_job *job);
+
+/**
+ * Get per module utilisation statistics
+ *
+ * @param group		Group handle
+ * @param stats		Array to store statistics in
+ * @param max_cnt	Number of entries available in 'stats'
+ *
+ * @returns		Number of entries written to 'stats'
+ */
+size_t ser4010_group_get_stats(struct ser4010_group *group,
+			struct ser4010_group_stats *stats, size_t max_cnt);
+
+#endif // __SER4010_GROUP_H__
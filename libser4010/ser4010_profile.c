@@ -0,0 +1,381 @@
+/**
+ * ser4010_profile.c - Compiled radio profile cache
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+#include "ser4010_profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static float htobefloat(float x)
+{
+	union {
+		uint32_t i;
+		float	 f;
+	} accessor;
+
+	accessor.f = x;
+	accessor.i = htobe32(accessor.i);
+
+	return accessor.f;
+}
+
+static float befloattoh(float x)
+{
+	union {
+		uint32_t i;
+		float	 f;
+	} accessor;
+
+	accessor.f = x;
+	accessor.i = be32toh(accessor.i);
+
+	return accessor.f;
+}
+
+/**
+ * Compile radio parameters into a profile
+ *
+ * See ser4010_config() for the radio parameters.
+ *
+ * @param profile	Returns the compiled profile
+ * @param name		Profile name, shorter than SER4010_PROFILE_NAME_LEN
+ * @param pa		Power Amplifier setup, or NULL to leave the device
+ *			setup unchanged
+ *
+ * @returns		0 on success, EINVAL or ERANGE on invalid arguments
+ */
+int ser4010_profile_compile(struct ser4010_profile *profile,
+			const char *name, float freq_mhz, float fdev_khz,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte,
+			const tPa_Setup *pa)
+{
+	struct ser4010_radio_config cfg;
+	int err;
+
+	if (name[0] == '\0' || strlen(name) >= SER4010_PROFILE_NAME_LEN) {
+		return EINVAL;
+	}
+
+	err = ser4010_calc_config(&cfg, freq_mhz, fdev_khz, modulation,
+					encoding, data_rate_kbps,
+					bits_per_byte);
+	if (err != 0) {
+		return err;
+	}
+
+	memset(profile, 0, sizeof(*profile));
+	strcpy(profile->name, name);
+
+	profile->ods = cfg.ods;
+	profile->ods.wBitRate = htobe16(cfg.ods.wBitRate);
+	if (pa != NULL) {
+		profile->pa.fAlpha = htobefloat(pa->fAlpha);
+		profile->pa.fBeta = htobefloat(pa->fBeta);
+		profile->pa.bLevel = pa->bLevel;
+		profile->pa.bMaxDrv = pa->bMaxDrv;
+		profile->pa.wNominalCap = htobe16(pa->wNominalCap);
+		profile->flags |= SER4010_PROFILE_PA;
+	}
+	profile->freq = htobefloat(cfg.freq);
+	profile->fdev = cfg.fdev;
+	profile->enc = cfg.enc;
+
+	profile->freq_mhz = freq_mhz;
+	profile->fdev_khz = fdev_khz;
+	profile->rate_kbps = data_rate_kbps;
+	profile->sym_rate_ksym_sec = cfg.sym_rate_ksym_sec;
+	profile->rate_error = cfg.rate_error;
+	profile->modulation = modulation;
+	profile->bits_per_byte = bits_per_byte;
+
+	return 0;
+}
+
+static int profile_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct ser4010_profile *) a)->name,
+			((const struct ser4010_profile *) b)->name);
+}
+
+/**
+ * Write profile cache file
+ *
+ * The profiles are sorted by name. The file is replaced atomically, so
+ * programs that have the old file mapped are not affected.
+ *
+ * @param path		Cache file path
+ * @param profiles	Profiles to store, are sorted in place
+ * @param cnt		Number of profiles
+ *
+ * @returns	0 on success, -1 on error with errno set. errno is EINVAL if
+ *		two profiles have the same name.
+ */
+int ser4010_profile_write(const char *path, struct ser4010_profile *profiles,
+			size_t cnt)
+{
+	struct ser4010_profile_hdr hdr;
+	char *tmp_path;
+	FILE *fp;
+	size_t i;
+	int saved_errno;
+
+	qsort(profiles, cnt, sizeof(profiles[0]), profile_cmp);
+	for (i = 1; i < cnt; i++) {
+		if (profile_cmp(&profiles[i - 1], &profiles[i]) == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SER4010_PROFILE_MAGIC, SER4010_PROFILE_MAGIC_LEN);
+	hdr.version = SER4010_PROFILE_VERSION;
+	hdr.rec_size = sizeof(struct ser4010_profile);
+	hdr.count = cnt;
+
+	tmp_path = malloc(strlen(path) + 5);
+	if (tmp_path == NULL) {
+		return -1;
+	}
+	sprintf(tmp_path, "%s.tmp", path);
+
+	if ((fp = fopen(tmp_path, "w")) == NULL) {
+		goto bad_free;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+			fwrite(profiles, sizeof(profiles[0]), cnt, fp) != cnt ||
+			fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+		saved_errno = errno;
+		fclose(fp);
+		errno = saved_errno;
+		goto bad_unlink;
+	}
+	if (fclose(fp) != 0) {
+		goto bad_unlink;
+	}
+	if (rename(tmp_path, path) != 0) {
+		goto bad_unlink;
+	}
+
+	free(tmp_path);
+	return 0;
+
+bad_unlink:
+	saved_errno = errno;
+	unlink(tmp_path);
+	errno = saved_errno;
+bad_free:
+	saved_errno = errno;
+	free(tmp_path);
+	errno = saved_errno;
+	return -1;
+}
+
+/**
+ * Get path of the profile cache
+ *
+ * @returns	Value of the SER4010_PROFILE_CACHE environment variable, or
+ *		else the compile time default
+ */
+const char *ser4010_profile_default_path(void)
+{
+	const char *path = getenv("SER4010_PROFILE_CACHE");
+
+	if (path == NULL || path[0] == '\0') {
+		path = DEFAULT_PROFILE_CACHE;
+	}
+
+	return path;
+}
+
+/**
+ * Map profile cache file
+ *
+ * @param cache	Cache handle to initialize
+ * @param path	Cache file path, or NULL for ser4010_profile_default_path()
+ *
+ * @returns	0 on success, -1 on error with errno set. errno is EINVAL if
+ *		the file is not a cache of this version.
+ */
+int ser4010_profile_open(struct ser4010_profile_cache *cache,
+			const char *path)
+{
+	struct stat st;
+	int fd;
+	int saved_errno;
+	const struct ser4010_profile_hdr *hdr;
+
+	if (path == NULL) {
+		path = ser4010_profile_default_path();
+	}
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		goto bad;
+	}
+	if ((size_t) st.st_size < sizeof(struct ser4010_profile_hdr)) {
+		errno = EINVAL;
+		goto bad;
+	}
+
+	cache->map_size = st.st_size;
+	cache->map = mmap(NULL, cache->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (cache->map == MAP_FAILED) {
+		goto bad;
+	}
+	close(fd);
+
+	hdr = cache->map;
+	if (memcmp(hdr->magic, SER4010_PROFILE_MAGIC,
+				SER4010_PROFILE_MAGIC_LEN) != 0 ||
+			hdr->version != SER4010_PROFILE_VERSION ||
+			hdr->rec_size != sizeof(struct ser4010_profile) ||
+			cache->map_size != sizeof(*hdr) +
+				(size_t) hdr->count * hdr->rec_size) {
+		munmap(cache->map, cache->map_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	cache->hdr = hdr;
+	cache->profiles = (const struct ser4010_profile *) (hdr + 1);
+
+	return 0;
+bad:
+	saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return -1;
+}
+
+void ser4010_profile_close(struct ser4010_profile_cache *cache)
+{
+	munmap(cache->map, cache->map_size);
+	cache->map = NULL;
+	cache->hdr = NULL;
+	cache->profiles = NULL;
+}
+
+/**
+ * Find profile by name
+ *
+ * @returns	Profile, or NULL if not found
+ */
+const struct ser4010_profile *ser4010_profile_find(
+			const struct ser4010_profile_cache *cache,
+			const char *name)
+{
+	struct ser4010_profile key;
+
+	if (strlen(name) >= SER4010_PROFILE_NAME_LEN) {
+		return NULL;
+	}
+	strcpy(key.name, name);
+
+	return bsearch(&key, cache->profiles, cache->hdr->count,
+			sizeof(struct ser4010_profile), profile_cmp);
+}
+
+/**
+ * Configure device with profile
+ *
+ * Uses a single CMD_SET_ALL when the firmware supports it, see
+ * ser4010_set_fields().
+ *
+ * @returns	0 on success else an error occurred
+ */
+int ser4010_profile_apply(struct serco *sdev,
+			const struct ser4010_profile *profile)
+{
+	struct ser4010_dev_config cfg;
+	unsigned int fields;
+
+	ser4010_profile_get_ods(profile, &cfg.ods);
+	ser4010_profile_get_pa(profile, &cfg.pa);
+	cfg.freq = befloattoh(profile->freq);
+	cfg.fdev = profile->fdev;
+	cfg.enc = profile->enc;
+
+	fields = SER4010_CFG_ODS | SER4010_CFG_FREQ | SER4010_CFG_ENC;
+	if (profile->flags & SER4010_PROFILE_PA) {
+		fields |= SER4010_CFG_PA;
+	}
+	if (profile->modulation == ODS_MODULATION_TYPE_FSK) {
+		fields |= SER4010_CFG_FDEV;
+	}
+
+	return ser4010_set_fields(sdev, &cfg, fields);
+}
+
+/**
+ * Configure device with profile from cache
+ *
+ * @returns	0 on success, EINVAL if there is no profile with that name,
+ *		else see ser4010_profile_apply()
+ */
+int ser4010_apply_profile(struct serco *sdev,
+			const struct ser4010_profile_cache *cache,
+			const char *name)
+{
+	const struct ser4010_profile *profile;
+
+	profile = ser4010_profile_find(cache, name);
+	if (profile == NULL) {
+		return EINVAL;
+	}
+
+	return ser4010_profile_apply(sdev, profile);
+}
+
+void ser4010_profile_get_ods(const struct ser4010_profile *profile,
+			tOds_Setup *ods)
+{
+	*ods = profile->ods;
+	ods->wBitRate = be16toh(profile->ods.wBitRate);
+}
+
+void ser4010_profile_get_pa(const struct ser4010_profile *profile,
+			tPa_Setup *pa)
+{
+	pa->fAlpha = befloattoh(profile->pa.fAlpha);
+	pa->fBeta = befloattoh(profile->pa.fBeta);
+	pa->bLevel = profile->pa.bLevel;
+	pa->bMaxDrv = profile->pa.bMaxDrv;
+	pa->wNominalCap = be16toh(profile->pa.wNominalCap);
+}
@@ -0,0 +1,126 @@
+/**
+ * ser4010_profile.h - Compiled radio profile cache
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_PROFILE_H__
+#define __SER4010_PROFILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ser4010.h"
+
+/*
+ * A radio profile is a named set of radio parameters, compiled into the
+ * command payloads sent to the device. Profiles are stored in a cache file
+ * that is memory mapped, so applying one needs no computation:
+ *
+ *   struct ser4010_profile_hdr
+ *   struct ser4010_profile[count], sorted by name
+ *
+ * The cache uses host byte order for everything but the command payloads,
+ * and is not meant to be copied between machines. Rebuild it with the
+ * ser4010_profile tool after changing profiles or upgrading.
+ */
+#define SER4010_PROFILE_MAGIC		"SER4010P"
+#define SER4010_PROFILE_MAGIC_LEN	8
+#define SER4010_PROFILE_VERSION		1
+#define SER4010_PROFILE_NAME_LEN	32
+
+// Profile flags
+#define SER4010_PROFILE_PA	0x01	// Configure Power Amplifier
+
+struct ser4010_profile_hdr {
+	char magic[SER4010_PROFILE_MAGIC_LEN];	// SER4010_PROFILE_MAGIC
+	uint32_t version;	// SER4010_PROFILE_VERSION
+	uint32_t rec_size;	// sizeof(struct ser4010_profile)
+	uint32_t count;		// Number of profiles
+	uint32_t _pad;
+};
+
+#pragma pack(1)
+struct ser4010_profile {
+	char name[SER4010_PROFILE_NAME_LEN];	// NUL terminated
+
+	// Command payloads, in device byte order
+	tOds_Setup ods;
+	tPa_Setup pa;
+	float freq;		// Carrier frequency in Hz
+	uint8_t fdev;		// FSK deviation setting, FSK only
+	uint8_t enc;		// enum Ser4010Encoding
+	uint8_t flags;		// SER4010_PROFILE_*
+	uint8_t _pad;
+
+	// Source parameters and achieved timing, for inspection
+	float freq_mhz;
+	float fdev_khz;
+	float rate_kbps;
+	float sym_rate_ksym_sec;	// Achieved symbol rate
+	float rate_error;		// Relative symbol rate error
+	uint8_t modulation;		// ODS_MODULATION_TYPE_*
+	uint8_t bits_per_byte;
+	uint8_t _pad2[2];
+};
+#pragma pack()
+
+struct ser4010_profile_cache {
+	void *map;
+	size_t map_size;
+	const struct ser4010_profile_hdr *hdr;
+	const struct ser4010_profile *profiles;
+};
+
+// Building
+int ser4010_profile_compile(struct ser4010_profile *profile,
+			const char *name, float freq_mhz, float fdev_khz,
+			int modulation, enum Ser4010Encoding encoding,
+			double data_rate_kbps, int bits_per_byte,
+			const tPa_Setup *pa);
+int ser4010_profile_write(const char *path, struct ser4010_profile *profiles,
+			size_t cnt);
+
+// Using
+const char *ser4010_profile_default_path(void);
+int ser4010_profile_open(struct ser4010_profile_cache *cache,
+			const char *path);
+const struct ser4010_profile *ser4010_profile_find(
+			const struct ser4010_profile_cache *cache,
+			const char *name);
+int ser4010_profile_apply(struct serco *sdev,
+			const struct ser4010_profile *profile);
+int ser4010_apply_profile(struct serco *sdev,
+			const struct ser4010_profile_cache *cache,
+			const char *name);
+void ser4010_profile_close(struct ser4010_profile_cache *cache);
+
+// Device byte order payloads to host structures
+void ser4010_profile_get_ods(const struct ser4010_profile *profile,
+			tOds_Setup *ods);
+void ser4010_profile_get_pa(const struct ser4010_profile *profile,
+			tPa_Setup *pa);
+
+#endif // __SER4010_PROFILE_H__
@@ -0,0 +1,377 @@
+/**
+ * ser4010_pulse_compile.c - Compile mark/space pulse timings into ODS frames
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ser4010_pulse_compile.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "ser4010_encode.h"
+
+#define ODS_TICKS_PER_USEC	24	// ODS runs from the 24 MHz system clock
+#define MIN_CLK_DIV		4	// bLcWarmInt doesn't fit for faster clocks
+#define MAX_CLK_DIV		8
+#define MAX_BIT_RATE		0x7fff
+#define GROUP_WIDTH		7
+
+/**
+ * Round pulse length to number of symbols
+ */
+static unsigned long pulse_symbols(unsigned int pulse_us, unsigned long period)
+{
+	unsigned long ticks = (unsigned long) pulse_us * ODS_TICKS_PER_USEC;
+
+	return (ticks + period / 2) / period;
+}
+
+/**
+ * Determine squared timing error of pulses for a symbol period
+ *
+ * @param period	Symbol period in ODS clock ticks
+ *
+ * @returns	Sum of squared errors in clock ticks, or a negative value if
+ *		a pulse exceeds the tolerance.
+ */
+static double period_error(const unsigned int *pulses, size_t cnt,
+			unsigned long period, double tolerance)
+{
+	double sq_err = 0;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		double ticks = (double) pulses[i] * ODS_TICKS_PER_USEC;
+		unsigned long k = pulse_symbols(pulses[i], period);
+		double err = fabs(k * (double) period - ticks);
+
+		if (k == 0 || err > tolerance * ticks) {
+			return -1;
+		}
+		sq_err += err * err;
+	}
+
+	return sq_err;
+}
+
+/**
+ * Find clock divider to use for a symbol period
+ *
+ * @returns	Clock divider (bClkDiv + 1), or 0 if period can't be
+ *		represented.
+ */
+static unsigned int period_clk_div(unsigned long period)
+{
+	unsigned int div;
+
+	for (div = MAX_CLK_DIV; div >= MIN_CLK_DIV; div--) {
+		if (period % div == 0 && period / div <= MAX_BIT_RATE) {
+			return div;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Find the shortest repeating unit in the pulse train
+ *
+ * The last space of the last repetition may be missing, since captures often
+ * stop at the last mark.
+ *
+ * @returns	Number of pulses in repeating unit
+ */
+static size_t find_repetition(const unsigned long *symbols, size_t cnt)
+{
+	size_t unit;
+	size_t i;
+
+	for (unit = 2; unit <= cnt / 2; unit += 2) {
+		if (cnt % unit != 0 && (cnt + 1) % unit != 0) {
+			continue;
+		}
+
+		for (i = unit; i < cnt; i++) {
+			if (symbols[i] != symbols[i % unit]) {
+				break;
+			}
+		}
+		if (i == cnt) {
+			return unit;
+		}
+	}
+
+	return cnt;
+}
+
+static void pack_run(struct ser4010_packer *p, bool mark, unsigned long cnt)
+{
+	unsigned int n;
+
+	while (cnt > 0) {
+		n = (cnt > 56) ? 56 : cnt;
+		ser4010_pack_symbols(p, mark ? ((1ULL << n) - 1) : 0, n);
+		cnt -= n;
+	}
+}
+
+/**
+ * Close the current chunk
+ *
+ * @returns	Number of space symbols appended to fill the last byte
+ */
+static size_t finish_chunk(struct ser4010_packer *p,
+			struct ser4010_pulse_frame *frame, size_t cur_symbols)
+{
+	size_t *len = &frame->chunk_len[frame->chunk_cnt];
+
+	ser4010_packer_finish(p, len);
+	frame->chunk_cnt++;
+
+	return *len * (GROUP_WIDTH + 1) - cur_symbols;
+}
+
+int ser4010_pulse_compile(const unsigned int *pulses, size_t cnt,
+			double tolerance, struct ser4010_pulse_frame *frame)
+{
+	unsigned long symbols[1024];
+	unsigned long sent[1024];
+	unsigned long period;
+	unsigned long p, lo, hi;
+	double best_err;
+	unsigned int min_pulse;
+	unsigned int div;
+	double sq_err;
+	size_t unit;
+	size_t i;
+
+	struct ser4010_packer packer;
+	const size_t chunk_symbols = SER4010_PULSE_CHUNK_SIZE *
+						(GROUP_WIDTH + 1);
+	size_t cur_symbols;
+	size_t pad;
+
+	if (cnt == 0 || cnt > sizeof(symbols)/sizeof(symbols[0]) ||
+			tolerance <= 0 || tolerance >= 1) {
+		return EINVAL;
+	}
+
+	min_pulse = pulses[0];
+	for (i = 0; i < cnt; i++) {
+		if (pulses[i] == 0) {
+			return EINVAL;
+		}
+		if (pulses[i] < min_pulse) {
+			min_pulse = pulses[i];
+		}
+	}
+
+	// Prefer a symbol period matching the shortest pulse, picking the one
+	// with the lowest total error. Else search the largest symbol period,
+	// ie. smallest frame, that fits all pulses.
+	period = 0;
+	best_err = -1;
+	hi = min_pulse * ODS_TICKS_PER_USEC * (1 + tolerance);
+	lo = min_pulse * ODS_TICKS_PER_USEC * (1 - tolerance);
+	if (hi > MAX_CLK_DIV * MAX_BIT_RATE) {
+		hi = MAX_CLK_DIV * MAX_BIT_RATE;
+	}
+	for (p = hi; p >= lo && p >= MIN_CLK_DIV; p--) {
+		double err;
+
+		if (period_clk_div(p) == 0) {
+			continue;
+		}
+		err = period_error(pulses, cnt, p, tolerance);
+		if (err >= 0 && (best_err < 0 || err < best_err)) {
+			best_err = err;
+			period = p;
+		}
+	}
+	if (period == 0) {
+		for (p = lo - 1; p >= MIN_CLK_DIV; p--) {
+			if (period_clk_div(p) != 0 &&
+				period_error(pulses, cnt, p, tolerance) >= 0)
+			{
+				period = p;
+				break;
+			}
+		}
+	}
+	if (period == 0) {
+		return ERANGE;
+	}
+	div = period_clk_div(period);
+
+	memset(frame, 0, sizeof(*frame));
+
+	// Setup the ODS, see config_ods() for the warm-up calculations
+	frame->ods.bModulationType = ODS_MODULATION_TYPE_OOK;
+	frame->ods.bClkDiv         = div - 1;
+	frame->ods.bEdgeRate       = 0;
+	frame->ods.bGroupWidth     = GROUP_WIDTH;
+	frame->ods.wBitRate        = period / div;
+	frame->ods.bLcWarmInt      = ceil(24.0*125 / (div*64));
+	frame->ods.bDivWarmInt     = ceil(24.0*5 / (div*4));
+	frame->ods.bPaWarmInt      = ceil(24.0 / div);
+	frame->symbol_us = (double) period / ODS_TICKS_PER_USEC;
+
+	for (i = 0; i < cnt; i++) {
+		symbols[i] = pulse_symbols(pulses[i], period);
+	}
+
+	unit = find_repetition(symbols, cnt);
+	if (unit == cnt) {
+		frame->repeats = 1;
+	} else {
+		frame->repeats = (cnt + 1) / unit;
+	}
+
+	// Pack symbols into chunks. A mark never straddles two chunks, a space
+	// that doesn't fit is continued in the next chunk. The space symbols
+	// filling the last byte of a chunk lengthen the preceding space.
+	frame->chunk_cnt = 0;
+	cur_symbols = 0;
+	ser4010_packer_init(&packer, frame->chunk[0],
+				SER4010_PULSE_CHUNK_SIZE, GROUP_WIDTH);
+	for (i = 0; i < unit; i++) {
+		bool mark = ((i & 1) == 0);
+		unsigned long k = symbols[i];
+
+		sent[i] = k;
+		while (cur_symbols + k > chunk_symbols) {
+			if (mark) {
+				if (k > chunk_symbols) {
+					return E2BIG;
+				}
+				pad = finish_chunk(&packer, frame,
+							cur_symbols);
+				sent[i - 1] += pad;
+			} else {
+				unsigned long n = chunk_symbols - cur_symbols;
+
+				pack_run(&packer, false, n);
+				cur_symbols += n;
+				k -= n;
+				pad = finish_chunk(&packer, frame,
+							cur_symbols);
+			}
+			if (frame->chunk_cnt == SER4010_PULSE_MAX_CHUNKS) {
+				return E2BIG;
+			}
+			ser4010_packer_init(&packer,
+				frame->chunk[frame->chunk_cnt],
+				SER4010_PULSE_CHUNK_SIZE, GROUP_WIDTH);
+			cur_symbols = 0;
+		}
+
+		pack_run(&packer, mark, k);
+		cur_symbols += k;
+	}
+	// The fill of the last chunk only matters between repetitions
+	pad = finish_chunk(&packer, frame, cur_symbols);
+	if (frame->repeats > 1) {
+		sent[unit - 1] += pad;
+	}
+
+	// Determine error of the symbols actually send
+	sq_err = 0;
+	for (i = 0; i < cnt; i++) {
+		double err;
+
+		err = fabs(sent[i % unit] * frame->symbol_us - pulses[i]);
+		sq_err += err * err;
+		if (err / pulses[i] > frame->max_error) {
+			frame->max_error = err / pulses[i];
+		}
+	}
+	frame->rms_error_us = sqrt(sq_err / cnt);
+
+	for (i = 0; i < frame->chunk_cnt; i++) {
+		frame->upload_bytes += frame->chunk_len[i];
+		frame->symbol_cnt += frame->chunk_len[i] * (GROUP_WIDTH + 1);
+	}
+	if (frame->chunk_cnt > 1) {
+		frame->upload_bytes *= frame->repeats;
+	}
+
+	return 0;
+}
+
+int ser4010_pulse_send(struct serco *sdev,
+			const struct ser4010_pulse_frame *frame)
+{
+	struct ser4010_dev_config cfg;
+	unsigned int remaining;
+	unsigned int r;
+	size_t i;
+	int ret;
+
+	cfg.ods = frame->ods;
+	ret = ser4010_set_fields(sdev, &cfg, SER4010_CFG_ODS);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	if (frame->chunk_cnt == 1) {
+		ret = ser4010_load_frame(sdev, (uint8_t *) frame->chunk[0],
+					frame->chunk_len[0]);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+
+		remaining = frame->repeats;
+		while (remaining > 0) {
+			unsigned int n = (remaining > 255) ? 255 : remaining;
+
+			ret = ser4010_send(sdev, n);
+			if (ret != STATUS_OK) {
+				return ret;
+			}
+			remaining -= n;
+		}
+	} else {
+		for (r = 0; r < frame->repeats; r++) {
+			for (i = 0; i < frame->chunk_cnt; i++) {
+				ret = ser4010_load_frame(sdev,
+						(uint8_t *) frame->chunk[i],
+						frame->chunk_len[i]);
+				if (ret != STATUS_OK) {
+					return ret;
+				}
+
+				ret = ser4010_send(sdev, 1);
+				if (ret != STATUS_OK) {
+					return ret;
+				}
+			}
+		}
+	}
+
+	return STATUS_OK;
+}
@@ -0,0 +1,109 @@
+/**
+ * ser4010_pulse_compile.h - Compile mark/space pulse timings into ODS frames
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_PULSE_COMPILE_H__
+#define __SER4010_PULSE_COMPILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "serco.h"
+#include "ser4010.h"
+
+/**
+ * Max. frame length the device accepts in one upload
+ *
+ * The 256 byte command buffer of the device also holds the ID, opcode and CRC.
+ */
+#define SER4010_PULSE_CHUNK_SIZE	253
+/**
+ * Max. number of uploads one frame can be split into
+ */
+#define SER4010_PULSE_MAX_CHUNKS	16
+
+/**
+ * Compiled pulse train
+ *
+ * The pulse train is send by sending every chunk once, 'repeats' times.
+ */
+struct ser4010_pulse_frame {
+	tOds_Setup ods;
+	double symbol_us;		/**< Symbol period in microseconds */
+	double max_error;		/**< Max. relative timing error of a pulse */
+	double rms_error_us;		/**< RMS timing error in microseconds */
+	unsigned int repeats;		/**< Times to send the chunks */
+	size_t symbol_cnt;		/**< Number of symbols in all chunks */
+	size_t chunk_cnt;
+	size_t chunk_len[SER4010_PULSE_MAX_CHUNKS];
+	uint8_t chunk[SER4010_PULSE_MAX_CHUNKS][SER4010_PULSE_CHUNK_SIZE];
+	size_t upload_bytes;		/**< Frame bytes uploaded for one send */
+};
+
+/**
+ * Compile pulse timings into an OOK frame
+ *
+ * Searches the ODS clock divider and bit rate for a symbol period that can
+ * represent every pulse within the timing tolerance. Among the periods within
+ * the tolerance of the shortest pulse the one with the lowest total timing
+ * error is used. If none fits, the largest period below that range that fits
+ * all pulses is used. A pulse train consisting of identical repetitions is
+ * compiled to a single repetition that is send multiple times. Frames that
+ * don't fit in a single upload are split into multiple chunks. A long space
+ * may be continued in the next chunk, but a mark never is. The upload between
+ * chunks lengthens the space at the chunk boundary.
+ *
+ * @param pulses	Pulse durations in microseconds. Alternating mark and
+ *			space, starting with a mark.
+ * @param cnt		Number of entries in 'pulses'
+ * @param tolerance	Max. allowed relative timing error of a pulse, eg. 0.1
+ *			for 10%
+ * @param frame		Returns the compiled frame
+ *
+ * @returns		0 on success, EINVAL if the pulse list is invalid,
+ *			ERANGE if no symbol period matches all pulses, or
+ *			E2BIG if the frame doesn't fit in
+ *			SER4010_PULSE_MAX_CHUNKS uploads.
+ */
+int ser4010_pulse_compile(const unsigned int *pulses, size_t cnt,
+			double tolerance, struct ser4010_pulse_frame *frame);
+
+/**
+ * Send a compiled pulse train
+ *
+ * Configures the ODS and sends the frame. The carrier frequency and PA are
+ * not changed.
+ *
+ * @param sdev		Serial Communication handle
+ * @param frame		Frame compiled with ser4010_pulse_compile()
+ *
+ * @returns		0 on success else an error occurred
+ */
+int ser4010_pulse_send(struct serco *sdev,
+			const struct ser4010_pulse_frame *frame);
+
+#endif // __SER4010_PULSE_COMPILE_H__
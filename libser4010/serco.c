@@ -5,29 +5,336 @@
 #include <unistd.h>
 #include <assert.h>
 #include <time.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/inotify.h>
 
 #include "serco.h"
+#include "serco_probes.h"
+#include "serco_trace.h"
 
 #define BAUDRATE B9600
 #define TIMEOUT_SEC 25 
 
-ssize_t _read_frame(int fd, uint8_t *buf, size_t max_len)
+// Resync NOP time-out, doubled every attempt up to the max. Resync gives up
+// after TIMEOUT_SEC, which covers the longest transmission the device can be
+// busy with.
+#define RESYNC_TIMEOUT_MS 100
+#define RESYNC_MAX_TIMEOUT_MS 1000
+
+// Number of most recently issued frame IDs of which responses are tracked.
+// Must be less then the 255 usable IDs, so the state of an ID is cleared
+// before it is reused.
+#define ID_WINDOW 128
+
+// Retries of idempotent commands after a communication failure
+#define MAX_RETRIES 2
+
+// Sync points for commands without response. Errors are reported after at
+// most SYNC_EVERY commands, or SYNC_MS after the first unsynced command.
+#define SYNC_EVERY 32
+#define SYNC_MS 500
+
+// Interval at which a lost device is looked for, in addition to waiting for
+// inotify events. Covers directories that are removed together with the
+// device, like /dev/serial/by-id.
+#define RECONNECT_POLL_MS 250
+
+// Added to the busy time of commands without response. Covers the time
+// between the last byte leaving the host and the device starting execution.
+#define BUSY_MARGIN_US 2000
+
+// CRC-8 lookup table for CRC8_POLY
+static const uint8_t crc8_tab[256] = {
+	0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
+	0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+	0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65,
+	0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+	0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5,
+	0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+	0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85,
+	0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+	0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2,
+	0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+	0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2,
+	0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+	0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32,
+	0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+	0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42,
+	0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+	0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c,
+	0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+	0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec,
+	0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+	0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c,
+	0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+	0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c,
+	0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+	0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b,
+	0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+	0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b,
+	0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+	0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb,
+	0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+	0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb,
+	0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+};
+
+// Update a counter of dev->stats, see serco_get_stats()
+#define STAT_ADD(counter, n) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#define STAT_INC(counter) STAT_ADD(counter, 1)
+
+// Frame ID states
+#define ID_FREE		0	// Not issued in current window
+#define ID_IN_FLIGHT	1	// Command sent, no response yet
+#define ID_DONE		2	// Response received
+
+/**
+ * Record serial traffic if capturing, see serco_capture_start()
+ */
+static void _capture(struct serco *dev, uint8_t type,
+			const void *buf, size_t len)
+{
+	if (dev->capture == NULL) {
+		return;
+	}
+	if (serco_trace_write(dev->capture, type, buf, len) != 0) {
+		perror("WARNING: Writing capture failed");
+		serco_capture_stop(dev);
+	}
+}
+
+/**
+ * Check if a system error means the device node went away
+ *
+ * USB serial adapters return these after being unplugged or reset.
+ */
+static bool _is_loss(int err)
+{
+	return (err == EIO || err == ENXIO || err == ENODEV);
+}
+
+/**
+ * Read a byte from the serial port
+ *
+ * @param deadline	CLOCK_MONOTONIC time after which to give up
+ *
+ * @returns	1 on success, 0 on time-out, -1 on system error
+ */
+static int _read_byte(struct serco *dev, uint8_t *c,
+			const struct timespec *deadline)
+{
+	struct pollfd pfd;
+	struct timespec now;
+	long timeout_ms;
+	ssize_t ret;
+
+	if (dev->fd == -1) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	while (dev->rbuf_pos >= dev->rbuf_len) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout_ms = (deadline->tv_sec - now.tv_sec) * 1000 +
+				(deadline->tv_nsec - now.tv_nsec) / 1000000;
+		if (timeout_ms <= 0) {
+			return 0;
+		}
+
+		pfd.fd = dev->fd;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		} else if (ret == 0) {
+			return 0;
+		}
+
+		ret = read(dev->fd, dev->rbuf, sizeof(dev->rbuf));
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+			if (_is_loss(errno)) {
+				dev->lost = true;
+			}
+			return -1;
+		} else if (ret == 0 && (pfd.revents & (POLLHUP | POLLERR))) {
+			// Hung up terminal, would keep returning end-of-file
+			dev->lost = true;
+			errno = EIO;
+			return -1;
+		}
+		dev->rbuf_pos = 0;
+		dev->rbuf_len = ret;
+		STAT_ADD(dev->stats.rx_bytes, ret);
+		_capture(dev, SERCO_TRACE_RX, dev->rbuf, ret);
+	}
+
+	*c = dev->rbuf[dev->rbuf_pos++];
+
+	return 1;
+}
+
+/**
+ * Read raw bytes from the serial port
+ *
+ * @param deadline	CLOCK_MONOTONIC time after which to give up
+ *
+ * @returns	Number of bytes read before the deadline, -1 on system error
+ */
+ssize_t serco_read(struct serco *dev, uint8_t *buf, size_t len,
+			const struct timespec *deadline)
+{
+	size_t rlen;
+	int ret;
+
+	for (rlen = 0; rlen < len; rlen++) {
+		ret = _read_byte(dev, &buf[rlen], deadline);
+		if (ret < 0) {
+			return -1;
+		} else if (ret == 0) {
+			break;
+		}
+	}
+
+	return rlen;
+}
+
+static uint8_t _crc8(uint8_t crc, const uint8_t *buf, size_t len)
+{
+	while (len--) {
+		crc = crc8_tab[crc ^ *buf++];
+	}
+
+	return crc;
+}
+
+static void _deadline_in(struct timespec *deadline, long ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += ms / 1000;
+	deadline->tv_nsec += (ms % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+static long _ms_since(const struct timespec *t)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - t->tv_sec) * 1000 +
+		(now.tv_nsec - t->tv_nsec) / 1000000;
+}
+
+static uint64_t _now_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Histogram bucket of a latency, see serco_stats.h
+ */
+static unsigned int _hist_bucket(uint32_t us)
+{
+	unsigned int exp = 0;
+	unsigned int idx;
+
+	if (us < SERCO_HIST_SUB) {
+		return us;
+	}
+	while ((us >> exp) >= 2 * SERCO_HIST_SUB) {
+		exp++;
+	}
+	idx = (exp + 1) * SERCO_HIST_SUB + (us >> exp) - SERCO_HIST_SUB;
+
+	return (idx < SERCO_HIST_BUCKETS) ? idx : SERCO_HIST_BUCKETS - 1;
+}
+
+/**
+ * Account for the outcome of the command with the given frame ID
+ *
+ * @param status	Response status, or -1 if no valid response was received
+ */
+static void _stat_response(struct serco *dev, uint8_t frame_id, int status)
+{
+	struct serco_op_stats *os = &dev->stats.ops[dev->id_op[frame_id]];
+	uint64_t lat;
+	uint32_t lat32, max;
+
+	if (status < 0) {
+		STAT_INC(os->failures);
+		return;
+	}
+
+	lat = _now_us() - dev->id_sent_us[frame_id];
+	lat32 = (lat > UINT32_MAX) ? UINT32_MAX : lat;
+
+	STAT_INC(os->responses);
+	if (status != STATUS_OK) {
+		STAT_INC(os->errors);
+	}
+	STAT_ADD(os->rx_bytes, dev->rx_frame_len);
+	STAT_ADD(os->sum_us, lat);
+	STAT_INC(os->hist[_hist_bucket(lat32)]);
+	max = __atomic_load_n(&os->max_us, __ATOMIC_RELAXED);
+	while (lat32 > max && !__atomic_compare_exchange_n(&os->max_us, &max,
+				lat32, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * Wait until the device is done executing commands without response
+ */
+static void _wait_busy(struct serco *dev)
+{
+	uint64_t start;
+
+	if (dev->busy_until.tv_sec == 0 && dev->busy_until.tv_nsec == 0) {
+		return;
+	}
+
+	start = _now_us();
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				&dev->busy_until, NULL) == EINTR)
+		;
+	STAT_ADD(dev->stats.busy_wait_us, _now_us() - start);
+	dev->busy_until.tv_sec = 0;
+	dev->busy_until.tv_nsec = 0;
+}
+
+ssize_t _read_frame(struct serco *dev, uint8_t *buf, size_t max_len,
+			const struct timespec *deadline)
 {
 	bool comm_error;
 	bool stuff_first;
+	bool has_crc = false;
 	size_t len;
-	ssize_t ret;
+	int ret;
 	uint8_t c;
 
 	len = 0;
 	comm_error = false;
 	stuff_first = false;
+	dev->rx_frame_len = 0;
 
 	while (true) {
-		ret = read(fd, &c, 1); 
+		ret = _read_byte(dev, &c, deadline);
 		if (ret < 0) {
 			return -1; // System Error
 		} else if (ret == 0) {
@@ -37,6 +344,7 @@ ssize_t _read_frame(int fd, uint8_t *buf, size_t max_len)
 				return -3; // Time-out
 			}
 		}
+		dev->rx_frame_len++;
 
 		// Remove Byte stuffing and detect end-of-record
 		if (stuff_first) {
@@ -44,6 +352,9 @@ ssize_t _read_frame(int fd, uint8_t *buf, size_t max_len)
 
 			if (c == STUFF_BYTE2) {
 				break;
+			} else if (c == STUFF_BYTE2_CRC) {
+				has_crc = true;
+				break;
 			} else if (c != STUFF_BYTE1) {
 				comm_error = true;
 				continue;
@@ -64,28 +375,48 @@ ssize_t _read_frame(int fd, uint8_t *buf, size_t max_len)
 		len++;
 	}
 	
+	STAT_INC(dev->stats.rx_frames);
+	SERCO_PROBE3(frame__complete, dev->rx_frame_len, len, has_crc);
 	if (comm_error) {
 		return -2; // Comm. Error
+	} else if (has_crc) {
+		// CRC over data and CRC trailer is zero
+		if (len < 1 || _crc8(0, buf, len) != 0) {
+			return -4; // CRC Error
+		}
+		return len - 1;
 	} else {
 		return len;
 	}
 }
 
-int serco_open(struct serco *dev, const char *path)
+/**
+ * Open and configure serial port
+ *
+ * Only sets dev->fd and dev->oldtio, so it is also used to reconnect.
+ *
+ * @returns	0 on success, -1 on error with errno set
+ */
+static int _open_port(struct serco *dev, const char *path)
 {
 	int fd;
+	int err;
 	struct termios newtio;
-
-	srandom(time(NULL) | getpid());
+	struct flock fl;
 
 	fd = open(path, O_RDWR | O_NOCTTY ); 
 	if (fd == -1) {
-		perror(path);
 		return -1;
 	}
 
+	// Makes ser4010_discover() skip the port while in use. Failing is
+	// harmless.
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_RDLCK;
+	fl.l_whence = SEEK_SET;
+	fcntl(fd, F_SETLK, &fl);
+
 	if (tcgetattr(fd, &(dev->oldtio)) != 0) {
-		perror("tcgetattr() failed");
 		goto bad;
 	}
 
@@ -98,48 +429,414 @@ int serco_open(struct serco *dev, const char *path)
 	newtio.c_cc[VMIN]  = 0;   // return immediatly when a byte is available
 
 	if (tcflush(fd, TCIFLUSH) != 0) {
-		perror("tcflush() failed");
 		goto bad;
 	}
 	if (tcsetattr(fd, TCSANOW, &newtio) != 0) {
-		perror("tcsetattr() failed");
 		goto bad;
 	}
 
 	dev->fd = fd;
-//TODO: send some NOP command to sync comm. Because Initial read sometimes fails.
 
 	return 0;
 bad:
+	err = errno;
 	close(fd);
+	errno = err;
 	return -1;
 }
 
+/**
+ * Open serial port without synchronizing with the device
+ *
+ * For tools that handle the protocol themselves. Traffic is captured to the
+ * file named by the SER4010_CAPTURE environment variable, if set.
+ */
+int serco_open_raw(struct serco *dev, const char *path)
+{
+	struct timespec now;
+	const char *capture;
+
+	if (_open_port(dev, path) != 0) {
+		perror(path);
+		return -1;
+	}
+
+	dev->path = strdup(path);
+	if (dev->path == NULL) {
+		perror("strdup() failed");
+		close(dev->fd);
+		return -1;
+	}
+	dev->hold_id = -1;
+	dev->frame_len = -1;
+	dev->no_patch = false;
+	dev->cfg_valid = false;
+	dev->cfg_set = 0;
+	dev->no_all = false;
+	memset(&dev->stats, 0, sizeof(dev->stats));
+	memset(dev->id_op, 0, sizeof(dev->id_op));
+	dev->rx_frame_len = 0;
+	dev->tx_frame_len = 0;
+	dev->rbuf_pos = 0;
+	dev->rbuf_len = 0;
+	dev->resync_attempts = 0;
+	dev->resync_us = 0;
+	dev->in_sync = false;
+	dev->reconnect_ms = 0;
+	dev->replay = NULL;
+	dev->lost = false;
+	dev->reconnecting = false;
+
+	// Start with a different ID every connection, so responses to a
+	// previous connection are unlikely to match.
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	dev->next_id = (now.tv_nsec ^ getpid()) % STUFF_BYTE1;
+	dev->last_id = dev->next_id;
+	memset(dev->id_state, ID_FREE, sizeof(dev->id_state));
+	dev->crc = false;
+	dev->dev_rev = 0;
+	dev->nr_pending = 0;
+	dev->nr_status = STATUS_OK;
+	dev->nr_failed_id = 0;
+	dev->busy_until.tv_sec = 0;
+	dev->busy_until.tv_nsec = 0;
+	dev->capture = NULL;
+	dev->host_us = -1;
+	dev->host_dev_us = 0;
+	dev->setup_us = -1;
+	dev->setup_dev_us = 0;
+
+	capture = getenv("SER4010_CAPTURE");
+	if (capture != NULL && serco_capture_start(dev, capture) != 0) {
+		perror(capture);
+	}
+
+	return 0;
+}
+
+int serco_open(struct serco *dev, const char *path)
+{
+	if (serco_open_raw(dev, path) != 0) {
+		return -1;
+	}
+
+	// Garbage may have been received by the device before we opened the
+	// port, e.g. the Raspberry Pi boot messages.
+	if (serco_resync(dev) != 0) {
+		fprintf(stderr, "%s: Unable to synchronize with device\n", path);
+		serco_capture_stop(dev);
+		tcsetattr(dev->fd, TCSANOW, &(dev->oldtio));
+		close(dev->fd);
+		free(dev->path);
+		return -1;
+	}
+
+	serco_probe(dev);
+
+	return 0;
+}
+
+/**
+ * Determine optional protocol features of the firmware
+ *
+ * Enables the CRC trailer, unless the SER4010_NO_CRC environment variable is
+ * set, and clears results of commands without response left by a previous
+ * connection. The DEV_REV probe itself is unprotected, so it is repeated if
+ * the response looks damaged.
+ *
+ * @returns	0 on success, -1 if the revision couldn't be determined
+ */
+int serco_probe(struct serco *dev)
+{
+	uint8_t rev[2];
+	size_t rev_len;
+	unsigned int tries;
+	int ret;
+
+	dev->crc = false;
+	dev->dev_rev = 0;
+	for (tries = 0; tries <= MAX_RETRIES; tries++) {
+		rev_len = sizeof(rev);
+		ret = serco_send_command(dev, CMD_DEV_REV, NULL, 0,
+						rev, &rev_len);
+		if (ret == STATUS_OK && rev_len == sizeof(rev)) {
+			dev->dev_rev = (rev[0] << 8) | rev[1];
+			break;
+		}
+		if (ret == -1 && !dev->in_sync) {
+			break;
+		}
+	}
+	if (dev->dev_rev == 0) {
+		return -1;
+	}
+
+	dev->crc = (dev->dev_rev >= 6 && getenv("SER4010_NO_CRC") == NULL);
+
+	if (dev->dev_rev >= 7) {
+		uint8_t res[SYNC_RES_LEN];
+		size_t res_len = sizeof(res);
+
+		serco_send_command(dev, CMD_SYNC, NULL, 0, res, &res_len);
+	}
+
+	return 0;
+}
+
 void serco_close(struct serco *dev)
 {
-	tcsetattr(dev->fd, TCSANOW, &(dev->oldtio));
-	close(dev->fd);
+	int ret;
+
+	// Don't wait for a lost device to return just to sync
+	if (!dev->lost &&
+	    (dev->nr_pending > 0 || dev->nr_status != STATUS_OK)) {
+		ret = serco_sync(dev);
+		if (ret != STATUS_OK) {
+			fprintf(stderr, "WARNING: Command without response failed: %d\n", ret);
+		}
+	}
+
+	serco_capture_stop(dev);
+	if (dev->fd != -1) {
+		tcsetattr(dev->fd, TCSANOW, &(dev->oldtio));
+		close(dev->fd);
+	}
+	free(dev->path);
 }
 
-int serco_send_command(struct serco *dev, uint8_t opcode,
-			const void *payload, size_t payload_len,
-			void *res_buf, size_t *res_len)
+#define STAT_LOAD(dst, src, field) \
+	(dst)->field = __atomic_load_n(&(src)->field, __ATOMIC_RELAXED)
+
+/**
+ * Get a copy of the performance counters
+ *
+ * Can be called from another thread while the connection is in use. The
+ * counters are copied one by one, so they may be slightly inconsistent.
+ */
+void serco_get_stats(struct serco *dev, struct serco_stats *stats)
+{
+	const struct serco_stats *src = &dev->stats;
+	const struct serco_op_stats *so;
+	struct serco_op_stats *os;
+	unsigned int op, i;
+
+	STAT_LOAD(stats, src, tx_bytes);
+	STAT_LOAD(stats, src, rx_bytes);
+	STAT_LOAD(stats, src, tx_frames);
+	STAT_LOAD(stats, src, rx_frames);
+	STAT_LOAD(stats, src, stuff_bytes);
+	STAT_LOAD(stats, src, encode_us);
+	STAT_LOAD(stats, src, write_us);
+	STAT_LOAD(stats, src, busy_wait_us);
+	STAT_LOAD(stats, src, timeouts);
+	STAT_LOAD(stats, src, comm_errors);
+	STAT_LOAD(stats, src, crc_errors);
+	STAT_LOAD(stats, src, crc_naks);
+	STAT_LOAD(stats, src, retries);
+	STAT_LOAD(stats, src, resyncs);
+	STAT_LOAD(stats, src, reconnects);
+	STAT_LOAD(stats, src, stale);
+	STAT_LOAD(stats, src, duplicates);
+	STAT_LOAD(stats, src, out_of_sync);
+	STAT_LOAD(stats, src, nr_cmds);
+	STAT_LOAD(stats, src, syncs);
+
+	for (op = 0; op < SERCO_STATS_OPS; op++) {
+		so = &src->ops[op];
+		os = &stats->ops[op];
+		STAT_LOAD(os, so, sent);
+		STAT_LOAD(os, so, responses);
+		STAT_LOAD(os, so, errors);
+		STAT_LOAD(os, so, failures);
+		STAT_LOAD(os, so, tx_bytes);
+		STAT_LOAD(os, so, rx_bytes);
+		STAT_LOAD(os, so, sum_us);
+		STAT_LOAD(os, so, max_us);
+		for (i = 0; i < SERCO_HIST_BUCKETS; i++) {
+			STAT_LOAD(os, so, hist[i]);
+		}
+	}
+}
+
+/**
+ * Clear the performance counters
+ *
+ * Must not be called while another thread uses the connection.
+ */
+void serco_reset_stats(struct serco *dev)
+{
+	memset(&dev->stats, 0, sizeof(dev->stats));
+}
+
+/**
+ * Start capturing serial traffic
+ *
+ * All bytes written to and read from the serial port are recorded with
+ * their time and direction, see serco_trace.h for the format. The capture is
+ * appended to the file if it already exists. Timestamps are taken when the
+ * data is passed to or received from the kernel, so transmit records precede
+ * the data leaving the wire by up to the UART buffer drain time.
+ *
+ * @returns	0 on success, -1 on error with errno set
+ */
+int serco_capture_start(struct serco *dev, const char *path)
+{
+	struct serco_trace *tr;
+
+	serco_capture_stop(dev);
+
+	tr = malloc(sizeof(*tr));
+	if (tr == NULL) {
+		return -1;
+	}
+	if (serco_trace_create(tr, path) != 0) {
+		free(tr);
+		return -1;
+	}
+	dev->capture = tr;
+
+	return 0;
+}
+
+void serco_capture_stop(struct serco *dev)
+{
+	if (dev->capture != NULL) {
+		serco_trace_close(dev->capture);
+		free(dev->capture);
+		dev->capture = NULL;
+	}
+}
+
+/**
+ * Write raw bytes to serial port
+ */
+int serco_write(struct serco *dev, const uint8_t *buf, size_t len)
 {
-	size_t i;
 	size_t wlen;
+	uint64_t start;
+
+	if (dev->fd == -1) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	start = _now_us();
+	wlen = 0;
+	while (wlen < len) {
+		ssize_t ret;
+		ret = write(dev->fd, &buf[wlen], len - wlen);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (_is_loss(errno)) {
+				dev->lost = true;
+			}
+			perror("write() failed");
+			return -1;
+		}
+		if (wlen == 0) {
+			SERCO_PROBE2(write__first, ret, len);
+		}
+		wlen += ret;
+	}
+	SERCO_PROBE1(write__last, len);
+	STAT_ADD(dev->stats.write_us, _now_us() - start);
+	STAT_ADD(dev->stats.tx_bytes, len);
+	_capture(dev, SERCO_TRACE_TX, buf, len);
+
+	return 0;
+}
+
+/**
+ * Allocate the next frame ID
+ *
+ * IDs increment by one, skipping STUFF_BYTE1. The ID issued ID_WINDOW
+ * commands ago leaves the tracking window.
+ */
+static uint8_t _next_id(struct serco *dev)
+{
+	uint8_t id = dev->next_id;
+
+	dev->next_id = (id + 1) % STUFF_BYTE1;
+	dev->id_state[(id + STUFF_BYTE1 - ID_WINDOW) % STUFF_BYTE1] = ID_FREE;
+	dev->id_state[id] = ID_IN_FLIGHT;
+
+	return id;
+}
+
+/**
+ * Account for a response that doesn't match the expected frame ID
+ */
+static void _discard_response(struct serco *dev, uint8_t id)
+{
+	switch (dev->id_state[id]) {
+	case ID_IN_FLIGHT:
+		// Late response to a failed command, expected after time-outs
+		dev->id_state[id] = ID_DONE;
+		STAT_INC(dev->stats.stale);
+		break;
+	case ID_DONE:
+		// Harmless, but a sign of line problems
+		STAT_INC(dev->stats.duplicates);
+		break;
+	default:
+		SERCO_PROBE1(out__of__sync, id);
+		fprintf(stderr, "WARNING: Communication out-of-sync\n");
+		STAT_INC(dev->stats.out_of_sync);
+		break;
+	}
+}
+
+/**
+ * Check if a command can be executed twice without side effects
+ */
+static bool _is_idempotent(uint8_t opcode)
+{
+	switch (opcode) {
+	case CMD_NOP:
+	case CMD_DEV_TYPE:
+	case CMD_DEV_REV:
+	case CMD_GET_ODS:
+	case CMD_SET_ODS:
+	case CMD_GET_PA:
+	case CMD_SET_PA:
+	case CMD_GET_FREQ:
+	case CMD_SET_FREQ:
+	case CMD_GET_FDEV:
+	case CMD_SET_FDEV:
+	case CMD_GET_ENC:
+	case CMD_SET_ENC:
+	case CMD_LOAD_FRAME:
+	case CMD_PATCH_FRAME:
+	case CMD_GET_ALL:
+	case CMD_SET_ALL:
+		return true;
+	default:
+		// Appending or sending again is visible
+		return false;
+	}
+}
+
+static int _write_frame(struct serco *dev, uint8_t frame_id, uint8_t opcode,
+			const void *payload, size_t payload_len, bool crc)
+{
+	size_t i;
 	uint8_t buf[1024];
-	uint8_t frame_id;
 	size_t buf_len;
-	ssize_t rlen;
 	uint8_t *payload_p = (uint8_t *) payload;
+	uint8_t hdr[2];
+	struct serco_op_stats *os;
+	uint64_t start;
 
 	assert(payload_len + 1 < 512);
 	assert(opcode != STUFF_BYTE1);
+	assert(frame_id != STUFF_BYTE1);
 
-	do {
-		frame_id = random() & 0xff;
-	} while (frame_id == STUFF_BYTE1);
+	_wait_busy(dev);
+	SERCO_PROBE4(command__submit, frame_id, opcode, payload_len, crc);
 
+	start = _now_us();
 	buf[CMD_ID] = frame_id;
 	buf[CMD_OPCODE] = opcode;
 
@@ -150,47 +847,125 @@ int serco_send_command(struct serco *dev, uint8_t opcode,
 		}
 		buf[buf_len++] = payload_p[i];
 	}
-	buf[buf_len++] = STUFF_BYTE1;
-	buf[buf_len++] = STUFF_BYTE2;
 
-	wlen = 0;
-	while (wlen < buf_len) {
-		ssize_t ret;
-		ret = write(dev->fd, &buf[wlen], buf_len - wlen);
-		if (ret < 0) {
-			perror("write() failed");
-			return -1;
+	if (crc) {
+		uint8_t fcs;
+
+		hdr[CMD_ID] = frame_id;
+		hdr[CMD_OPCODE] = opcode;
+		fcs = _crc8(_crc8(0, hdr, sizeof(hdr)), payload_p, payload_len);
+		if (fcs == STUFF_BYTE1) {
+			buf[buf_len++] = STUFF_BYTE1;
 		}
-		wlen += ret;
+		buf[buf_len++] = fcs;
+		buf[buf_len++] = STUFF_BYTE1;
+		buf[buf_len++] = STUFF_BYTE2_CRC;
+	} else {
+		buf[buf_len++] = STUFF_BYTE1;
+		buf[buf_len++] = STUFF_BYTE2;
 	}
+	STAT_ADD(dev->stats.encode_us, _now_us() - start);
+
+	if (serco_write(dev, buf, buf_len) != 0) {
+		return -1;
+	}
+
+	dev->last_id = frame_id;
+	dev->tx_frame_len = buf_len;
+	dev->id_op[frame_id] = opcode % SERCO_STATS_OPS;
+	dev->id_sent_us[frame_id] = _now_us();
+	os = &dev->stats.ops[dev->id_op[frame_id]];
+	STAT_INC(os->sent);
+	STAT_ADD(os->tx_bytes, buf_len);
+	STAT_INC(dev->stats.tx_frames);
+	STAT_ADD(dev->stats.stuff_bytes, buf_len - CMD_PAYLOAD - payload_len);
+
+	return 0;
+}
+
+/**
+ * Write command frame with the given frame ID
+ *
+ * A CRC trailer is added if enabled for the connection.
+ */
+int serco_write_raw_command(struct serco *dev, uint8_t frame_id,
+			uint8_t opcode, const void *payload, size_t payload_len)
+{
+	return _write_frame(dev, frame_id, opcode, payload, payload_len,
+				dev->crc);
+}
+
+int serco_write_command(struct serco *dev, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			uint8_t *frame_id)
+{
+	*frame_id = _next_id(dev);
+
+	return serco_write_raw_command(dev, *frame_id, opcode,
+					payload, payload_len);
+}
+
+int serco_read_response(struct serco *dev, uint8_t frame_id,
+			void *res_buf, size_t *res_len)
+{
+	uint8_t buf[1024];
+	ssize_t rlen;
+	struct timespec deadline;
+
+	_deadline_in(&deadline, TIMEOUT_SEC * 1000);
 
 	do {
-		rlen = _read_frame(dev->fd, buf, sizeof(buf));
+		rlen = _read_frame(dev, buf, sizeof(buf), &deadline);
 		if (rlen < 0) {
+			_stat_response(dev, frame_id, -1);
 			switch (rlen) {
 			case -1:
 				perror("read_frame() failed");
-				break;
+				return -1;
 			case -2:
 				fprintf(stderr, "read_frame() failed: Error in byte stuffing\n");
+				STAT_INC(dev->stats.comm_errors);
 				break;
 			case -3:
+				SERCO_PROBE1(timeout, frame_id);
 				fprintf(stderr, "read_frame() failed: Timeout\n");
+				STAT_INC(dev->stats.timeouts);
 				break;
+			case -4:
+				SERCO_PROBE1(crc__error, frame_id);
+				// Framing is intact, no need to resync
+				STAT_INC(dev->stats.crc_errors);
+				return -1;
 			default:
 				fprintf(stderr, "read_frame() failed: Unknown Error\n");
 				break;
 			}
+			serco_resync(dev);
 			return -1;
 		}
 		if (rlen < 2) {
 			fprintf(stderr, "Result frame too short\n");
+			_stat_response(dev, frame_id, -1);
+			STAT_INC(dev->stats.comm_errors);
+			serco_resync(dev);
 			return -1;
 		}
+		if (buf[RES_STATUS] == STATUS_CRC_ERROR) {
+			// The ID may be what was corrupted. Only one command is
+			// outstanding, so this is about ours.
+			dev->id_state[frame_id] = ID_DONE;
+			_stat_response(dev, frame_id, STATUS_CRC_ERROR);
+			STAT_INC(dev->stats.crc_naks);
+			return STATUS_CRC_ERROR;
+		}
 		if (buf[RES_ID] != frame_id) {
-			fprintf(stderr, "WARNING: Communication out-of-sync\n");
+			// Our response may still follow
+			_discard_response(dev, buf[RES_ID]);
 		}
 	} while (buf[RES_ID] != frame_id);
+	dev->id_state[frame_id] = ID_DONE;
+	_stat_response(dev, frame_id, buf[RES_STATUS]);
+	SERCO_PROBE3(response, frame_id, buf[RES_STATUS], rlen - RES_PAYLOAD);
 
 	if (res_buf != NULL) {
 		if ((size_t) rlen - 2 < *res_len) {
@@ -201,3 +976,461 @@ int serco_send_command(struct serco *dev, uint8_t opcode,
 
 	return buf[RES_STATUS];
 }
+
+/**
+ * Synchronize communication with the device
+ *
+ * Discards all pending data and sends NOP commands with distinct frame IDs
+ * until a response with the ID of the last NOP is received. Because the
+ * device handles commands in order, all stale responses have been consumed at
+ * that point.
+ *
+ * Every NOP is preceded by two end-of-frame markers. This terminates any
+ * partial frame in the device, even if it ends in a stuffing byte, and stops
+ * a running CMD_RF_SEND_START. Empty frames are ignored by the device. The
+ * NOPs are sent without CRC, so this works with every firmware revision. If
+ * supported, CMD_SYNC is used instead of CMD_NOP to also clear results of
+ * commands without response.
+ *
+ * @returns	0 on success, -1 if the device didn't respond in time
+ */
+int serco_resync(struct serco *dev)
+{
+	uint8_t buf[1024];
+	struct timespec start, now, deadline, end;
+	unsigned int attempt;
+	long timeout_ms;
+	uint8_t frame_id;
+	ssize_t rlen;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	_deadline_in(&end, TIMEOUT_SEC * 1000);
+	STAT_INC(dev->stats.resyncs);
+	SERCO_PROBE(resync__start);
+	dev->hold_id = -1;
+	dev->frame_len = -1;
+	dev->cfg_valid = false;
+	dev->busy_until.tv_sec = 0;
+	dev->busy_until.tv_nsec = 0;
+	if (dev->nr_pending > 0) {
+		// The sync below clears their results
+		dev->nr_pending = 0;
+		if (dev->nr_status == STATUS_OK) {
+			dev->nr_status = -1;
+		}
+	}
+
+	tcflush(dev->fd, TCIOFLUSH);
+	_capture(dev, SERCO_TRACE_FLUSH, NULL, 0);
+	dev->rbuf_pos = 0;
+	dev->rbuf_len = 0;
+
+	timeout_ms = RESYNC_TIMEOUT_MS;
+	ret = -1;
+	for (attempt = 0; ret != 0; attempt++) {
+		const uint8_t eof[4] = {
+			STUFF_BYTE1, STUFF_BYTE2, STUFF_BYTE1, STUFF_BYTE2
+		};
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > end.tv_sec ||
+		    (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec)) {
+			break;
+		}
+
+		frame_id = _next_id(dev);
+		if (serco_write(dev, eof, sizeof(eof)) != 0 ||
+		    _write_frame(dev, frame_id,
+				(dev->dev_rev >= 7) ? CMD_SYNC : CMD_NOP,
+				NULL, 0, false) != 0) {
+			return -1;
+		}
+
+		_deadline_in(&deadline, timeout_ms);
+		do {
+			rlen = _read_frame(dev, buf, sizeof(buf), &deadline);
+			if (rlen == -1) {
+				perror("read_frame() failed");
+				return -1;
+			}
+			if (rlen >= 2) {
+				if (buf[RES_ID] == frame_id) {
+					dev->id_state[frame_id] = ID_DONE;
+					_stat_response(dev, frame_id,
+							buf[RES_STATUS]);
+					ret = 0;
+				} else if (dev->id_state[buf[RES_ID]] == ID_IN_FLIGHT) {
+					dev->id_state[buf[RES_ID]] = ID_DONE;
+					STAT_INC(dev->stats.stale);
+				}
+			}
+		} while (rlen != -3 && ret != 0);
+		if (ret != 0) {
+			_stat_response(dev, frame_id, -1);
+		}
+
+		if (timeout_ms < RESYNC_MAX_TIMEOUT_MS) {
+			timeout_ms *= 2;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	dev->resync_attempts = attempt;
+	dev->resync_us = (now.tv_sec - start.tv_sec) * 1000000 +
+				(now.tv_nsec - start.tv_nsec) / 1000;
+	dev->in_sync = (ret == 0);
+	SERCO_PROBE3(resync__done, ret, attempt, dev->resync_us);
+
+	return ret;
+}
+
+/**
+ * Wait for the device node to return and open it
+ *
+ * Changes to the directory containing the node are watched with inotify. The
+ * node is also tried every RECONNECT_POLL_MS, because the directory itself
+ * may disappear.
+ *
+ * @returns	0 on success, -1 if the device didn't return in time
+ */
+static int _wait_port(struct serco *dev, const struct timespec *deadline)
+{
+	char dir[256];
+	char *slash;
+	char ev_buf[4096];
+	struct pollfd pfd;
+	struct timespec now;
+	long timeout_ms;
+	int ret = -1;
+
+	strncpy(dir, dev->path, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	slash = strrchr(dir, '/');
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else if (slash == dir) {
+		slash[1] = '\0';
+	} else {
+		*slash = '\0';
+	}
+
+	pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	pfd.events = POLLIN;
+	if (pfd.fd != -1 && inotify_add_watch(pfd.fd, dir,
+				IN_CREATE | IN_ATTRIB | IN_MOVED_TO) == -1) {
+		close(pfd.fd);
+		pfd.fd = -1;
+	}
+
+	while (_open_port(dev, dev->path) != 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout_ms = (deadline->tv_sec - now.tv_sec) * 1000 +
+				(deadline->tv_nsec - now.tv_nsec) / 1000000;
+		if (timeout_ms <= 0) {
+			goto out;
+		}
+		if (timeout_ms > RECONNECT_POLL_MS) {
+			timeout_ms = RECONNECT_POLL_MS;
+		}
+
+		// Without inotify this just sleeps
+		if (poll(&pfd, (pfd.fd != -1) ? 1 : 0, timeout_ms) > 0) {
+			while (read(pfd.fd, ev_buf, sizeof(ev_buf)) > 0)
+				;
+		}
+	}
+	ret = 0;
+out:
+	if (pfd.fd != -1) {
+		close(pfd.fd);
+	}
+
+	return ret;
+}
+
+/**
+ * Reopen a lost device and restore its state
+ *
+ * After resynchronizing the replay callback is called, with frame_len and
+ * the frame copy as they were before the device was lost. On failure the
+ * device stays lost, and the next command tries again.
+ *
+ * @returns	0 on success, -1 on failure
+ */
+static int _reconnect(struct serco *dev)
+{
+	struct timespec deadline;
+	int frame_len = dev->frame_len;
+#ifdef WITH_USDT
+	struct timespec start;
+#endif
+	int ret;
+
+	if (dev->reconnect_ms == 0 || dev->reconnecting) {
+		return -1;
+	}
+	dev->reconnecting = true;
+
+#ifdef WITH_USDT
+	// Only needed for the reconnect__done tracepoint
+	clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+	_deadline_in(&deadline, dev->reconnect_ms);
+	STAT_INC(dev->stats.reconnects);
+	SERCO_PROBE(reconnect__start);
+	fprintf(stderr, "WARNING: Device %s lost, reconnecting\n", dev->path);
+
+	if (dev->fd != -1) {
+		close(dev->fd);
+		dev->fd = -1;
+	}
+	dev->rbuf_pos = 0;
+	dev->rbuf_len = 0;
+
+	ret = _wait_port(dev, &deadline);
+	if (ret == 0) {
+		dev->lost = false;
+		ret = serco_resync(dev);
+	}
+	if (ret == 0) {
+		serco_probe(dev);
+		dev->frame_len = frame_len;
+		if (dev->replay != NULL && dev->replay(dev) != 0) {
+			ret = -1;
+		}
+	}
+	if (ret != 0) {
+		fprintf(stderr, "%s: Unable to reconnect to device\n",
+				dev->path);
+		if (dev->fd != -1) {
+			close(dev->fd);
+			dev->fd = -1;
+		}
+		dev->lost = true;
+		dev->in_sync = false;
+		dev->frame_len = frame_len;
+	}
+
+	dev->reconnecting = false;
+	SERCO_PROBE2(reconnect__done, ret, _ms_since(&start));
+
+	return ret;
+}
+
+/**
+ * Reconnect automatically when the device is lost
+ *
+ * USB serial adapters disappear when reset or replugged, and usually return
+ * under the same name. If a read or write fails because the device node went
+ * away, the next command waits up to timeout_ms for it to return. The device
+ * is then reopened and resynchronized, and replay() is called to restore the
+ * device state. Use a stable path like /dev/serial/by-id/..., as the kernel
+ * may assign another ttyUSB number.
+ *
+ * An idempotent command that failed because of the loss is retried after
+ * reconnecting. Other commands return -1, as it is unknown if the device
+ * executed them. Commands without response sent before the loss are reported
+ * as failed by the next sync.
+ *
+ * @param timeout_ms	Time to wait for the device to return, 0 to disable
+ * @param replay	Called after reconnecting, returns 0 on success. May
+ *			be NULL.
+ */
+void serco_set_reconnect(struct serco *dev, unsigned int timeout_ms,
+			int (*replay)(struct serco *dev))
+{
+	dev->reconnect_ms = timeout_ms;
+	dev->replay = replay;
+}
+
+/**
+ * Send command and wait for response
+ *
+ * Idempotent commands are retried after a communication failure, if
+ * communication could be resynchronized. Every try uses a new frame ID, so a
+ * late response to an earlier try is never mistaken for the response to the
+ * retry. Commands the device rejected with STATUS_CRC_ERROR were not
+ * executed, and are always retried. A lost device is reconnected first, if
+ * enabled with serco_set_reconnect().
+ */
+int serco_send_command(struct serco *dev, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			void *res_buf, size_t *res_len)
+{
+	uint8_t frame_id;
+	unsigned int tries;
+	size_t max_len = (res_len != NULL) ? *res_len : 0;
+	int ret;
+
+	for (tries = 0; ; tries++) {
+		if (dev->lost && dev->reconnect_ms > 0 &&
+		    _reconnect(dev) != 0) {
+			return -1;
+		}
+
+		ret = serco_write_command(dev, opcode, payload, payload_len,
+						&frame_id);
+		if (ret == 0) {
+			if (res_len != NULL) {
+				*res_len = max_len;
+			}
+			ret = serco_read_response(dev, frame_id, res_buf,
+							res_len);
+		} else {
+			// Part of the frame may have been written, only retry
+			// if the device is back in sync
+			dev->in_sync = false;
+			if (!dev->lost) {
+				serco_resync(dev);
+			}
+		}
+
+		if (tries >= MAX_RETRIES) {
+			break;
+		}
+		if (ret == -1 && dev->lost && dev->reconnect_ms > 0 &&
+		    !dev->reconnecting) {
+			// Reconnect, then retry if idempotent
+			if (_reconnect(dev) != 0 || !_is_idempotent(opcode)) {
+				break;
+			}
+		} else if (ret != STATUS_CRC_ERROR && (ret != -1 ||
+				!dev->in_sync || !_is_idempotent(opcode))) {
+			break;
+		}
+		STAT_INC(dev->stats.retries);
+		SERCO_PROBE3(retry, opcode, tries + 1, ret);
+	}
+
+	return ret;
+}
+
+/**
+ * Send command without waiting for a response
+ *
+ * The device executes the command but doesn't respond. Errors are reported
+ * by the next sync point, see serco_sync(). A sync is done automatically
+ * every SYNC_EVERY commands, or if the first unsynced command was sent more
+ * than SYNC_MS ago.
+ *
+ * The device can't receive while executing a command, except for a few bytes.
+ * So the next command is not written before busy_us microseconds after this
+ * command left the serial port.
+ *
+ * Firmware before DEV_REV 7 doesn't support this. There the command is sent
+ * normally, and a failure is reported by the next sync.
+ *
+ * @returns	0 on success, -1 on communication failure, or the result of
+ *		the automatic sync
+ */
+int serco_send_command_nr(struct serco *dev, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			unsigned long busy_us)
+{
+	uint8_t frame_id;
+	bool retried = false;
+	int ret;
+
+	if (dev->lost && dev->reconnect_ms > 0 && _reconnect(dev) != 0) {
+		return -1;
+	}
+
+retry:
+	if (dev->nr_pending == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &dev->nr_since);
+	}
+	dev->nr_pending++;
+	STAT_INC(dev->stats.nr_cmds);
+
+	if (dev->dev_rev < 7) {
+		ret = serco_send_command(dev, opcode, payload, payload_len,
+						NULL, NULL);
+		if (ret != STATUS_OK && dev->nr_status == STATUS_OK) {
+			dev->nr_status = ret;
+		}
+	} else {
+		frame_id = _next_id(dev);
+		dev->id_state[frame_id] = ID_DONE;
+		ret = _write_frame(dev, frame_id,
+				opcode | CMD_FLAG_NO_RESPONSE,
+				payload, payload_len, dev->crc);
+		if (ret != 0) {
+			dev->nr_pending--;
+			if (dev->lost && !retried && !dev->reconnecting &&
+			    _is_idempotent(opcode) && _reconnect(dev) == 0) {
+				retried = true;
+				goto retry;
+			}
+			return -1;
+		}
+
+		if (busy_us > 0) {
+			busy_us += BUSY_MARGIN_US;
+			tcdrain(dev->fd);
+			clock_gettime(CLOCK_MONOTONIC, &dev->busy_until);
+			dev->busy_until.tv_sec += busy_us / 1000000;
+			dev->busy_until.tv_nsec += (busy_us % 1000000) * 1000;
+			if (dev->busy_until.tv_nsec >= 1000000000) {
+				dev->busy_until.tv_sec++;
+				dev->busy_until.tv_nsec -= 1000000000;
+			}
+		}
+	}
+
+	if (dev->nr_pending >= SYNC_EVERY ||
+	    _ms_since(&dev->nr_since) >= SYNC_MS) {
+		return serco_sync(dev);
+	}
+
+	return STATUS_OK;
+}
+
+/**
+ * Check results of commands sent without response
+ *
+ * Asks the device for the first error, and the number of commands it
+ * received, since the previous sync. A lower count than sent means commands
+ * were lost on the line.
+ *
+ * @returns	STATUS_OK if all commands succeeded, status of the first failed
+ *		command (its ID is stored in nr_failed_id), or -1 if commands
+ *		were lost or communication failed
+ */
+int serco_sync(struct serco *dev)
+{
+	uint8_t res[SYNC_RES_LEN];
+	size_t res_len = sizeof(res);
+	unsigned int pending = dev->nr_pending;
+	unsigned int cnt;
+	int ret;
+
+	ret = dev->nr_status;
+	dev->nr_status = STATUS_OK;
+	dev->nr_pending = 0;
+	if (dev->dev_rev < 7 || pending == 0) {
+		return ret;
+	}
+
+	STAT_INC(dev->stats.syncs);
+	if (serco_send_command(dev, CMD_SYNC, NULL, 0, res, &res_len)
+			!= STATUS_OK || res_len != sizeof(res)) {
+		return -1;
+	}
+
+	cnt = (res[SYNC_CNT] << 8) | res[SYNC_CNT + 1];
+	if (res[SYNC_STATUS] != STATUS_OK && ret == STATUS_OK) {
+		dev->nr_failed_id = res[SYNC_ID];
+		ret = res[SYNC_STATUS];
+	}
+	if (cnt != (pending & 0xffff)) {
+		fprintf(stderr, "WARNING: Device received %u of %u commands without response\n",
+				cnt, pending);
+		if (ret == STATUS_OK) {
+			ret = -1;
+		}
+	}
+	SERCO_PROBE3(sync, ret, pending, cnt);
+
+	return ret;
+}
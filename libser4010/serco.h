@@ -31,13 +31,80 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <termios.h>
+#include <time.h>
+#include <sys/types.h>
 
 #include "serco_defines.h"
+#include "serco_stats.h"
+
+struct serco_trace;
 
 struct serco {
-	int fd;
+	int fd;		// -1 while the device is lost
+	char *path;
 	struct termios oldtio;
+	int hold_id;	// Frame ID of running CMD_RF_SEND_START, -1 if none
+
+	// Copy of the frame on the device, for ser4010_load_frame_diff()
+	uint8_t frame[256];
+	int frame_len;	// -1 if device frame content is unknown
+	bool no_patch;	// Device doesn't support CMD_PATCH_FRAME
+
+	// Copy of the device configuration block, see ser4010_set_fields()
+	uint8_t cfg[CFG_BLOCK_LEN];
+	bool cfg_valid;	// False if device configuration is unknown
+	unsigned int cfg_set;	// Fields of cfg set by host, SER4010_CFG_*
+	bool no_all;	// Device doesn't support CMD_GET_ALL/CMD_SET_ALL
+
+	// Performance counters, see serco_get_stats()
+	struct serco_stats stats;
+	uint8_t id_op[256];		// Opcode sent with frame ID
+	uint64_t id_sent_us[256];	// Time command with frame ID was sent
+	size_t rx_frame_len;		// Bytes of last frame read, with framing
+	size_t tx_frame_len;		// Bytes of last frame written, with framing
+
+	// Receive buffer
+	uint8_t rbuf[64];
+	size_t rbuf_pos;
+	size_t rbuf_len;
+
+	// Resynchronization state, see serco_resync()
+	unsigned int resync_attempts;	// NOPs needed by last resync
+	unsigned long resync_us;	// Duration of last resync
+	bool in_sync;			// Last resync succeeded
+
+	// Reconnect after device loss, see serco_set_reconnect()
+	unsigned int reconnect_ms;	// Time to wait for device, 0 to disable
+	int (*replay)(struct serco *dev);	// Restore device state, or NULL
+	bool lost;			// Device node went away
+	bool reconnecting;
+
+	// Frame ID sequencing and response tracking
+	uint8_t next_id;
+	uint8_t last_id;	// ID of last command written
+	uint8_t id_state[256];
+
+	uint16_t dev_rev;	// Firmware revision, 0 if unknown
+
+	// CRC trailer, see serco_probe()
+	bool crc;
+
+	// Commands without response, see serco_send_command_nr()
+	unsigned int nr_pending;	// Sent since last sync
+	struct timespec nr_since;	// Time first pending command was sent
+	int nr_status;			// Error to report at next sync
+	uint8_t nr_failed_id;		// Frame ID of failed command
+	struct timespec busy_until;	// Device busy executing, 0 if not
+
+	struct serco_trace *capture;	// NULL if not capturing
+
+	// Transmit latency calibration, see ser4010_send_at()
+	long host_us;		// Host serial round trip overhead, -1 if unknown
+	long host_dev_us;	// Mean deviation of host_us
+	long setup_us;		// Device start-up time, -1 if unknown
+	long setup_dev_us;	// Mean deviation of setup_us
 };
 
 int serco_open(struct serco *dev, const char *path);
@@ -45,5 +112,37 @@ void serco_close(struct serco *dev);
 int serco_send_command(struct serco *dev, uint8_t opcode,
 			const void *payload, size_t payload_len,
 			void *res_buf, size_t *res_len);
+int serco_resync(struct serco *dev);
+int serco_probe(struct serco *dev);
+void serco_set_reconnect(struct serco *dev, unsigned int timeout_ms,
+			int (*replay)(struct serco *dev));
+
+void serco_get_stats(struct serco *dev, struct serco_stats *stats);
+void serco_reset_stats(struct serco *dev);
+
+// Capture of serial traffic, see serco_trace.h
+int serco_capture_start(struct serco *dev, const char *path);
+void serco_capture_stop(struct serco *dev);
+
+// Raw serial port access, for tools that handle the protocol themselves
+int serco_open_raw(struct serco *dev, const char *path);
+ssize_t serco_read(struct serco *dev, uint8_t *buf, size_t len,
+			const struct timespec *deadline);
+
+// Split command/response handling, for commands that run until stopped
+int serco_write(struct serco *dev, const uint8_t *buf, size_t len);
+int serco_write_command(struct serco *dev, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			uint8_t *frame_id);
+int serco_write_raw_command(struct serco *dev, uint8_t frame_id,
+			uint8_t opcode, const void *payload, size_t payload_len);
+int serco_read_response(struct serco *dev, uint8_t frame_id,
+			void *res_buf, size_t *res_len);
+
+// Commands without response, for streaming
+int serco_send_command_nr(struct serco *dev, uint8_t opcode,
+			const void *payload, size_t payload_len,
+			unsigned long busy_us);
+int serco_sync(struct serco *dev);
 
 #endif // __SERCO_H__
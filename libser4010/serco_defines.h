@@ -31,12 +31,18 @@
 
 // SER4010 firmware version info
 #define SER4010_DEV_TYPE 0x0100
-#define SER4010_DEV_REV  0x0003
+#define SER4010_DEV_REV  0x0009
 
 // Byte stuffing bytes
 #define STUFF_BYTE1 0xFF
 #define STUFF_BYTE2 0xAF
 
+// End-of-frame marker of frames with a CRC-8 trailer, DEV_REV >= 6. The CRC
+// covers the unstuffed frame bytes and uses polynomial X8+X2+X+1, init 0.
+// Responses to frames with CRC have a CRC trailer too.
+#define STUFF_BYTE2_CRC 0xAE
+#define CRC8_POLY 0x07
+
 // Magic send cookie; used to prevent accidental sends
 #define SEND_COOKIE_0 0xca
 #define SEND_COOKIE_1 0x4f
@@ -53,6 +59,10 @@
 #define CMD_NOP          0
 #define CMD_DEV_TYPE     1
 #define CMD_DEV_REV      2
+#define CMD_SYNC         3	// Report errors of no-response commands, DEV_REV >= 7
+
+#define CMD_GET_ALL      8	// Get device info and config block, DEV_REV >= 8
+#define CMD_SET_ALL      9	// Set config block, DEV_REV >= 8
 
 #define CMD_GET_ODS      10
 #define CMD_SET_ODS      11
@@ -67,8 +77,64 @@
 
 #define CMD_LOAD_FRAME   20
 #define CMD_APPEND_FRAME 21
+#define CMD_PATCH_FRAME  22	// Overwrite part of frame, DEV_REV >= 5
 
 #define CMD_RF_SEND      51
+#define CMD_RF_SEND_START 52	// Send until stopped, DEV_REV >= 4
+#define CMD_RF_SWEEP     53	// Send on series of frequencies, DEV_REV >= 9
+
+// Opcode flag to request no response, DEV_REV >= 7. The command is executed as
+// usual. The first error and the number of these commands are kept until
+// reported by CMD_SYNC.
+#define CMD_FLAG_NO_RESPONSE 0x80
+
+// CMD_SYNC response payload. Count is big-endian and wraps.
+#define SYNC_STATUS    0	// Status of first failed command, or STATUS_OK
+#define SYNC_ID        1	// Frame ID of first failed command
+#define SYNC_CNT       2	// Number of no-response commands since last sync
+#define SYNC_RES_LEN   4
+
+// Configuration block, used by CMD_GET_ALL and CMD_SET_ALL. The block starts
+// with a version and the total block length, followed by the raw contents of
+// the individual GET/SET_* commands. Newer versions only append fields, so a
+// host can read the fields it knows from a newer block. CMD_SET_ALL only
+// accepts a block of the version and length the device reports, else the
+// individual SET_* commands must be used.
+#define CFG_VERSION    0
+#define CFG_LEN        1
+#define CFG_ODS        2	// tOds_Setup, 9 bytes
+#define CFG_PA         11	// tPa_Setup, 12 bytes
+#define CFG_FREQ       23	// float, 4 bytes
+#define CFG_FDEV       27
+#define CFG_ENC        28
+#define CFG_BLOCK_LEN  29
+#define CFG_BLOCK_VERSION 1
+
+// CMD_GET_ALL response payload: device type and revision, big-endian,
+// followed by the configuration block.
+#define ALL_DEV_TYPE   0
+#define ALL_DEV_REV    2
+#define ALL_CFG        4
+#define ALL_RES_LEN    (ALL_CFG + CFG_BLOCK_LEN)
+
+// Stopping a CMD_RF_SEND_START is done by sending a bare end-of-frame marker.
+// Any received byte stops the transmission, and the marker doesn't make the
+// firmware's small RX FIFO overflow. Empty frames are not responded to.
+#define CMD_RF_SEND_STOP_LEN 2
+
+// CMD_RF_SWEEP payload, after the send cookie. Frequencies are floats in the
+// same byte order as CMD_SET_FREQ. A range sweeps start + i * step for all i
+// where that is below stop; a list has 1 to SWEEP_MAX_HOPS frequencies. The
+// frame is sent 'dwell' times on every frequency. The configured frequency is
+// not changed. Like CMD_RF_SEND_START, any received byte stops the sweep. The
+// response is the big-endian number of frequencies completed.
+#define SWEEP_MODE     4	// SWEEP_MODE_*
+#define SWEEP_DWELL    5	// Frames per frequency, 1-255
+#define SWEEP_FREQS    6	// Range: start, stop, step. List: frequencies
+#define SWEEP_MODE_RANGE 0
+#define SWEEP_MODE_LIST  1
+#define SWEEP_MAX_HOPS 32
+#define SWEEP_RES_LEN  2
 
 // Response frame bytes
 #define RES_ID      0
@@ -80,6 +146,7 @@
 #define STATUS_RESERVED             STUFF_BYTE1
 #define STATUS_UNKNOWN_CMD          0x01
 #define STATUS_LOGIC_ERROR          0x02
+#define STATUS_CRC_ERROR            0x03	// Command not executed
 #define STATUS_INVALID_FRAME_LEN    0x10
 #define STATUS_INVALID_ARGUMENT     0x11
 #define STATUS_INVALID_SEND_COOKIE  0x50
@@ -0,0 +1,70 @@
+/**
+ * serco_probes.h - USDT tracepoints
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SERCO_PROBES_H__
+#define __SERCO_PROBES_H__
+
+#include "config.h"
+
+/*
+ * Static tracepoints for tools like bpftrace, with provider name "ser4010".
+ * Enabled with the WITH_USDT build option; otherwise they compile to nothing
+ * and their arguments are not evaluated. Arguments must not have side
+ * effects. See tools/bpftrace/ for examples.
+ */
+#ifdef WITH_USDT
+#include <sys/sdt.h>
+
+#define SERCO_PROBE(name) \
+	DTRACE_PROBE(ser4010, name)
+#define SERCO_PROBE1(name, a) \
+	DTRACE_PROBE1(ser4010, name, a)
+#define SERCO_PROBE2(name, a, b) \
+	DTRACE_PROBE2(ser4010, name, a, b)
+#define SERCO_PROBE3(name, a, b, c) \
+	DTRACE_PROBE3(ser4010, name, a, b, c)
+#define SERCO_PROBE4(name, a, b, c, d) \
+	DTRACE_PROBE4(ser4010, name, a, b, c, d)
+#define SERCO_PROBE5(name, a, b, c, d, e) \
+	DTRACE_PROBE5(ser4010, name, a, b, c, d, e)
+#else
+#define SERCO_PROBE(name) \
+	do { } while (0)
+#define SERCO_PROBE1(name, a) \
+	do { } while (0)
+#define SERCO_PROBE2(name, a, b) \
+	do { } while (0)
+#define SERCO_PROBE3(name, a, b, c) \
+	do { } while (0)
+#define SERCO_PROBE4(name, a, b, c, d) \
+	do { } while (0)
+#define SERCO_PROBE5(name, a, b, c, d, e) \
+	do { } while (0)
+#endif
+
+#endif // __SERCO_PROBES_H__
@@ -0,0 +1,202 @@
+/**
+ * serco_stats.c - Communication performance counters
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "serco_stats.h"
+
+#include "serco_defines.h"
+
+// Bit time of the serial port, 10 bits per byte at 9600 baud
+#define BYTE_US (10 * 1000000.0 / 9600)
+
+static const char *op_names[SERCO_STATS_OPS] = {
+	[CMD_NOP] = "NOP",
+	[CMD_DEV_TYPE] = "DEV_TYPE",
+	[CMD_DEV_REV] = "DEV_REV",
+	[CMD_SYNC] = "SYNC",
+	[CMD_GET_ALL] = "GET_ALL",
+	[CMD_SET_ALL] = "SET_ALL",
+	[CMD_GET_ODS] = "GET_ODS",
+	[CMD_SET_ODS] = "SET_ODS",
+	[CMD_GET_PA] = "GET_PA",
+	[CMD_SET_PA] = "SET_PA",
+	[CMD_GET_FREQ] = "GET_FREQ",
+	[CMD_SET_FREQ] = "SET_FREQ",
+	[CMD_GET_FDEV] = "GET_FDEV",
+	[CMD_SET_FDEV] = "SET_FDEV",
+	[CMD_GET_ENC] = "GET_ENC",
+	[CMD_SET_ENC] = "SET_ENC",
+	[CMD_LOAD_FRAME] = "LOAD_FRAME",
+	[CMD_APPEND_FRAME] = "APPEND_FRAME",
+	[CMD_PATCH_FRAME] = "PATCH_FRAME",
+	[CMD_RF_SEND] = "RF_SEND",
+	[CMD_RF_SEND_START] = "RF_SEND_START",
+	[CMD_RF_SWEEP] = "RF_SWEEP",
+};
+
+/**
+ * Get the name of a command opcode
+ *
+ * The CMD_FLAG_NO_RESPONSE flag is ignored.
+ *
+ * @returns	Opcode name without CMD_ prefix, or NULL for unknown opcodes
+ */
+const char *serco_op_name(uint8_t opcode)
+{
+	opcode &= ~CMD_FLAG_NO_RESPONSE;
+	if (opcode >= SERCO_STATS_OPS) {
+		return NULL;
+	}
+
+	return op_names[opcode];
+}
+
+/**
+ * Lower bound of a histogram bucket in microseconds
+ */
+static uint32_t _bucket_low(unsigned int idx)
+{
+	unsigned int exp;
+
+	if (idx < SERCO_HIST_SUB) {
+		return idx;
+	}
+	exp = idx / SERCO_HIST_SUB - 1;
+
+	return (SERCO_HIST_SUB + idx % SERCO_HIST_SUB) << exp;
+}
+
+/**
+ * Estimate a latency percentile from the histogram
+ *
+ * @param q	Fraction of responses, e.g. 0.99
+ *
+ * @returns	Middle of the bucket containing the percentile, capped at the
+ *		maximum latency, in microseconds. 0 if there were no responses.
+ */
+uint32_t serco_stats_percentile(const struct serco_op_stats *os, double q)
+{
+	unsigned long total = 0;
+	unsigned long rank;
+	unsigned int i;
+	uint32_t low, high;
+
+	for (i = 0; i < SERCO_HIST_BUCKETS; i++) {
+		total += os->hist[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	rank = q * total;
+	if (rank >= total) {
+		rank = total - 1;
+	}
+
+	for (i = 0; i < SERCO_HIST_BUCKETS - 1; i++) {
+		if (rank < os->hist[i]) {
+			break;
+		}
+		rank -= os->hist[i];
+	}
+
+	low = _bucket_low(i);
+	high = (i < SERCO_HIST_BUCKETS - 1) ? _bucket_low(i + 1) : os->max_us;
+	if (low + (high - low) / 2 > os->max_us) {
+		return os->max_us;
+	}
+
+	return low + (high - low) / 2;
+}
+
+/**
+ * Print statistics in human readable form
+ *
+ * The wire column is the time needed to transfer the average command and
+ * response at 9600 baud. The remainder of the latency is spent in the device,
+ * or in the serial drivers.
+ */
+void serco_stats_print(FILE *fp, const struct serco_stats *stats)
+{
+	const struct serco_op_stats *os;
+	const char *name;
+	unsigned int op;
+	double wire_us;
+
+	fprintf(fp, "Serial: %lu bytes / %lu frames sent, %lu bytes / %lu frames "
+			"received\n", stats->tx_bytes, stats->tx_frames,
+			stats->rx_bytes, stats->rx_frames);
+	fprintf(fp, "Framing overhead: %lu bytes (%.1f%%)\n", stats->stuff_bytes,
+			stats->tx_bytes ?
+				100.0 * stats->stuff_bytes / stats->tx_bytes : 0);
+	fprintf(fp, "Host time: %.3f ms encoding, %.3f ms in write(), "
+			"%.3f ms waiting for busy device\n",
+			stats->encode_us / 1000.0, stats->write_us / 1000.0,
+			stats->busy_wait_us / 1000.0);
+	fprintf(fp, "Errors: %lu time-outs, %lu framing, %lu CRC, %lu CRC "
+			"rejects\n", stats->timeouts, stats->comm_errors,
+			stats->crc_errors, stats->crc_naks);
+	fprintf(fp, "Recovery: %lu retries, %lu resyncs, %lu reconnects\n",
+			stats->retries, stats->resyncs, stats->reconnects);
+	fprintf(fp, "Discarded responses: %lu stale, %lu duplicate, "
+			"%lu out-of-sync\n", stats->stale, stats->duplicates,
+			stats->out_of_sync);
+	fprintf(fp, "Without response: %lu commands, %lu syncs\n",
+			stats->nr_cmds, stats->syncs);
+
+	fprintf(fp, "\n%-14s %6s %6s %6s %6s %9s %9s %9s %9s %9s\n",
+			"opcode", "sent", "resp", "errors", "failed",
+			"wire(ms)", "avg(ms)", "p50(ms)", "p99(ms)", "max(ms)");
+	for (op = 0; op < SERCO_STATS_OPS; op++) {
+		os = &stats->ops[op];
+		if (os->sent == 0) {
+			continue;
+		}
+
+		name = serco_op_name(op);
+		if (name != NULL) {
+			fprintf(fp, "%-14s", name);
+		} else {
+			fprintf(fp, "OP_%-11u", op);
+		}
+		fprintf(fp, " %6lu %6lu %6lu %6lu", os->sent, os->responses,
+				os->errors, os->failures);
+		if (os->responses == 0) {
+			fprintf(fp, " %9s %9s %9s %9s %9s\n",
+					"-", "-", "-", "-", "-");
+			continue;
+		}
+		wire_us = ((double) os->tx_bytes / os->sent +
+				(double) os->rx_bytes / os->responses) * BYTE_US;
+		fprintf(fp, " %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+				wire_us / 1000,
+				(double) os->sum_us / os->responses / 1000,
+				serco_stats_percentile(os, 0.50) / 1000.0,
+				serco_stats_percentile(os, 0.99) / 1000.0,
+				os->max_us / 1000.0);
+	}
+}
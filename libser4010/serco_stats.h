@@ -0,0 +1,104 @@
+/**
+ * serco_stats.h - Communication performance counters
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SERCO_STATS_H__
+#define __SERCO_STATS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Latency histograms have SERCO_HIST_SUB buckets per power of two
+// microseconds, so bucket widths are at most 1/SERCO_HIST_SUB of their value.
+// Latencies of 2^26 us (67 s) and more are counted in the last bucket.
+#define SERCO_HIST_SUB_BITS	3
+#define SERCO_HIST_SUB		(1 << SERCO_HIST_SUB_BITS)
+#define SERCO_HIST_BUCKETS	((27 - SERCO_HIST_SUB_BITS) * SERCO_HIST_SUB)
+
+// Opcodes with statistics, without CMD_FLAG_NO_RESPONSE. All CMD_* are less.
+#define SERCO_STATS_OPS		64
+
+/**
+ * Statistics of one opcode
+ *
+ * Latency is measured from the command leaving write() until its response is
+ * decoded. It includes the serial transfer of command and response, and the
+ * execution by the device, e.g. RF transmission for CMD_RF_SEND.
+ */
+struct serco_op_stats {
+	unsigned long sent;		// Commands written, including retries
+	unsigned long responses;	// Responses received
+	unsigned long errors;		// Responses with error status
+	unsigned long failures;		// No valid response, e.g. time-out
+	unsigned long tx_bytes;		// Command bytes, including framing
+	unsigned long rx_bytes;		// Response bytes, including framing
+	uint64_t sum_us;		// Sum of latencies
+	uint32_t max_us;
+	uint32_t hist[SERCO_HIST_BUCKETS];
+};
+
+/**
+ * Statistics of a connection, see serco_get_stats()
+ *
+ * Counters are updated with atomic operations, so another thread can read
+ * them while the connection is in use.
+ */
+struct serco_stats {
+	// Serial port
+	unsigned long tx_bytes;		// Bytes written, including framing
+	unsigned long rx_bytes;		// Bytes read, including garbage
+	unsigned long tx_frames;	// Command frames written
+	unsigned long rx_frames;	// Frames read
+	unsigned long stuff_bytes;	// Stuffing, CRC and end-of-frame bytes
+	uint64_t encode_us;		// Time spent building frames
+	uint64_t write_us;		// Time spent in write()
+	uint64_t busy_wait_us;		// Time waiting for a busy device
+
+	// Communication errors and recovery
+	unsigned long timeouts;		// Responses not received in time
+	unsigned long comm_errors;	// Bad stuffing or short frames
+	unsigned long crc_errors;	// Responses with CRC error
+	unsigned long crc_naks;		// Commands rejected with CRC error
+	unsigned long retries;		// Retries of idempotent commands
+	unsigned long resyncs;		// Resyncs, including on open
+	unsigned long reconnects;	// Reopens after device loss
+	unsigned long stale;		// Late responses to failed commands
+	unsigned long duplicates;	// Responses to already answered IDs
+	unsigned long out_of_sync;	// Responses to IDs not issued recently
+
+	// Commands without response
+	unsigned long nr_cmds;
+	unsigned long syncs;
+
+	struct serco_op_stats ops[SERCO_STATS_OPS];
+};
+
+uint32_t serco_stats_percentile(const struct serco_op_stats *os, double q);
+void serco_stats_print(FILE *fp, const struct serco_stats *stats);
+const char *serco_op_name(uint8_t opcode);
+
+#endif // __SERCO_STATS_H__
@@ -0,0 +1,255 @@
+/**
+ * serco_trace.c - Capture file format of serial traffic
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "serco_trace.h"
+
+#include <string.h>
+#include <errno.h>
+
+#define OPEN_DATA_LEN (SERCO_TRACE_MAGIC_LEN + 1 + 8 + 4)
+
+static void _put_le(uint8_t *buf, uint64_t val, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = val & 0xff;
+		val >>= 8;
+	}
+}
+
+static uint64_t _get_le(const uint8_t *buf, size_t len)
+{
+	uint64_t val = 0;
+
+	while (len > 0) {
+		len--;
+		val = (val << 8) | buf[len];
+	}
+
+	return val;
+}
+
+static int _write_rec(struct serco_trace *tr, uint8_t type, uint64_t delta,
+			const void *buf, size_t len)
+{
+	uint8_t hdr[2 + 10];
+	size_t hdr_len;
+
+	hdr[0] = type;
+	hdr[1] = len;
+	hdr_len = 2;
+	do {
+		hdr[hdr_len] = delta & 0x7f;
+		delta >>= 7;
+		if (delta != 0) {
+			hdr[hdr_len] |= 0x80;
+		}
+		hdr_len++;
+	} while (delta != 0);
+
+	if (fwrite(hdr, hdr_len, 1, tr->fp) != 1) {
+		return -1;
+	}
+	if (len > 0 && fwrite(buf, len, 1, tr->fp) != 1) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Start a capture session
+ *
+ * The session is appended to the file if it already exists.
+ *
+ * @returns	0 on success, -1 on error with errno set
+ */
+int serco_trace_create(struct serco_trace *tr, const char *path)
+{
+	uint8_t data[OPEN_DATA_LEN];
+	struct timespec now;
+
+	tr->fp = fopen(path, "ab");
+	if (tr->fp == NULL) {
+		return -1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	memcpy(data, SERCO_TRACE_MAGIC, SERCO_TRACE_MAGIC_LEN);
+	data[SERCO_TRACE_MAGIC_LEN] = SERCO_TRACE_VERSION;
+	_put_le(&data[SERCO_TRACE_MAGIC_LEN + 1], now.tv_sec, 8);
+	_put_le(&data[SERCO_TRACE_MAGIC_LEN + 9], now.tv_nsec / 1000, 4);
+
+	clock_gettime(CLOCK_MONOTONIC, &tr->last);
+	tr->time_us = 0;
+	tr->session = 0;
+
+	if (_write_rec(tr, SERCO_TRACE_OPEN, 0, data, sizeof(data)) != 0 ||
+	    fflush(tr->fp) != 0) {
+		fclose(tr->fp);
+		tr->fp = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Append a record, time stamped with the current time
+ *
+ * Data longer then SERCO_TRACE_MAX_DATA is split over multiple records. The
+ * file is flushed after every call, so a trace of a crashed or killed
+ * program is complete.
+ *
+ * @returns	0 on success, -1 on error with errno set
+ */
+int serco_trace_write(struct serco_trace *tr, uint8_t type,
+			const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	struct timespec now;
+	uint64_t delta;
+	size_t chunk;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	delta = (now.tv_sec - tr->last.tv_sec) * 1000000 +
+		(now.tv_nsec - tr->last.tv_nsec) / 1000;
+	// Keep the sub-microsecond remainder, so rounding errors don't add up
+	tr->last.tv_sec += delta / 1000000;
+	tr->last.tv_nsec += (delta % 1000000) * 1000;
+	if (tr->last.tv_nsec >= 1000000000) {
+		tr->last.tv_sec++;
+		tr->last.tv_nsec -= 1000000000;
+	}
+
+	do {
+		chunk = (len > SERCO_TRACE_MAX_DATA) ? SERCO_TRACE_MAX_DATA : len;
+		if (_write_rec(tr, type, delta, p, chunk) != 0) {
+			return -1;
+		}
+		p += chunk;
+		len -= chunk;
+		delta = 0;
+	} while (len > 0);
+
+	return fflush(tr->fp) == 0 ? 0 : -1;
+}
+
+/**
+ * Open a trace file for reading
+ *
+ * @returns	0 on success, -1 on error with errno set
+ */
+int serco_trace_open(struct serco_trace *tr, const char *path)
+{
+	tr->fp = fopen(path, "rb");
+	if (tr->fp == NULL) {
+		return -1;
+	}
+	tr->time_us = 0;
+	tr->session = 0;
+
+	return 0;
+}
+
+/**
+ * Read the next record
+ *
+ * @returns	1 if a record was read, 0 at end of file, -1 on error. errno is
+ *		set to EINVAL if the file is not a valid trace.
+ */
+int serco_trace_read(struct serco_trace *tr, struct serco_trace_rec *rec)
+{
+	uint64_t delta;
+	unsigned int shift;
+	int c;
+
+	c = getc(tr->fp);
+	if (c == EOF) {
+		return ferror(tr->fp) ? -1 : 0;
+	}
+	rec->type = c;
+
+	if ((c = getc(tr->fp)) == EOF) {
+		goto truncated;
+	}
+	rec->len = c;
+
+	delta = 0;
+	shift = 0;
+	do {
+		if ((c = getc(tr->fp)) == EOF) {
+			goto truncated;
+		}
+		if (shift >= 64) {
+			goto invalid;
+		}
+		delta |= (uint64_t) (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	if (rec->len > 0 && fread(rec->data, rec->len, 1, tr->fp) != 1) {
+		goto truncated;
+	}
+
+	if (rec->type == SERCO_TRACE_OPEN) {
+		if (rec->len < OPEN_DATA_LEN ||
+		    memcmp(rec->data, SERCO_TRACE_MAGIC,
+				SERCO_TRACE_MAGIC_LEN) != 0 ||
+		    rec->data[SERCO_TRACE_MAGIC_LEN] != SERCO_TRACE_VERSION) {
+			goto invalid;
+		}
+		rec->start.tv_sec = _get_le(&rec->data[SERCO_TRACE_MAGIC_LEN + 1], 8);
+		rec->start.tv_nsec = _get_le(&rec->data[SERCO_TRACE_MAGIC_LEN + 9], 4) * 1000;
+		tr->time_us = 0;
+		tr->session++;
+	} else if (tr->session == 0 || rec->type > SERCO_TRACE_FLUSH) {
+		goto invalid;
+	} else {
+		tr->time_us += delta;
+	}
+	rec->time_us = tr->time_us;
+
+	return 1;
+truncated:
+	if (ferror(tr->fp)) {
+		return -1;
+	}
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+void serco_trace_close(struct serco_trace *tr)
+{
+	if (tr->fp != NULL) {
+		fclose(tr->fp);
+		tr->fp = NULL;
+	}
+}
@@ -0,0 +1,87 @@
+/**
+ * serco_trace.h - Capture file format of serial traffic
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SERCO_TRACE_H__
+#define __SERCO_TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * A trace file is a sequence of records:
+ *
+ *   [TYPE][LEN][DELTA][DATA]
+ *
+ * TYPE is one of SERCO_TRACE_*, LEN the length of DATA in bytes. DELTA is
+ * the time in microseconds since the previous record, encoded as an unsigned
+ * LEB128 varint. Every capture session starts with a SERCO_TRACE_OPEN record,
+ * so sessions can be appended to the same file. Its data is the magic string,
+ * the format version and the wall clock start time (little endian 64-bit
+ * seconds and 32-bit microseconds).
+ */
+#define SERCO_TRACE_MAGIC	"SER4010T"
+#define SERCO_TRACE_MAGIC_LEN	8
+#define SERCO_TRACE_VERSION	1
+
+// Record types
+#define SERCO_TRACE_OPEN	0	// Start of capture session
+#define SERCO_TRACE_TX		1	// Bytes written to serial port
+#define SERCO_TRACE_RX		2	// Bytes read from serial port
+#define SERCO_TRACE_FLUSH	3	// Serial port buffers flushed
+
+#define SERCO_TRACE_MAX_DATA	255
+
+struct serco_trace {
+	FILE *fp;
+	struct timespec last;	// CLOCK_MONOTONIC time of last record
+	uint64_t time_us;	// Time since start of session, when reading
+	unsigned int session;	// Number of sessions read
+};
+
+struct serco_trace_rec {
+	uint8_t type;
+	uint64_t time_us;	// Time since start of session
+	struct timespec start;	// Wall clock start time, for SERCO_TRACE_OPEN
+	size_t len;
+	uint8_t data[SERCO_TRACE_MAX_DATA];
+};
+
+// Writing
+int serco_trace_create(struct serco_trace *tr, const char *path);
+int serco_trace_write(struct serco_trace *tr, uint8_t type,
+			const void *buf, size_t len);
+
+// Reading
+int serco_trace_open(struct serco_trace *tr, const char *path);
+int serco_trace_read(struct serco_trace *tr, struct serco_trace_rec *rec);
+
+void serco_trace_close(struct serco_trace *tr);
+
+#endif // __SERCO_TRACE_H__
@@ -0,0 +1,122 @@
+/**
+ * si4010_gentab.c - Generate search indexes for the Si4010 calculator tables
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "si4010_tables.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/**
+ * Count rows of a ramp table, and check the keys are ascending
+ *
+ * The lookup does a binary search on the keys, so they must be sorted.
+ */
+static size_t ramp_table_len(const float table[][2], const char *name)
+{
+	size_t i;
+
+	for (i = 0; !isnan(table[i][0]); i++) {
+		if (i > 0 && !(table[i][0] > table[i - 1][0])) {
+			fprintf(stderr, "%s: row %zu not in ascending order\n",
+					name, i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return i;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t order[FDEV_MAX + 1];
+	FILE *fp;
+	size_t i;
+	size_t j;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <output_file>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	// Insertion sort of the usable FSK deviation settings by shift
+	for (i = 0; i < ARRAY_SIZE(order); i++) {
+		for (j = i; j > 0 && ppm_shift[order[j - 1]] > ppm_shift[i];
+				j--) {
+			order[j] = order[j - 1];
+		}
+		if (j > 0 && ppm_shift[order[j - 1]] == ppm_shift[i]) {
+			fprintf(stderr, "ppm_shift: duplicate value at %zu\n",
+					i);
+			exit(EXIT_FAILURE);
+		}
+		order[j] = i;
+	}
+
+	if ((fp = fopen(argv[1], "w")) == NULL) {
+		perror("Failed to open output file");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(fp, "// Generated by si4010_gentab, do not edit\n");
+	fprintf(fp, "#ifndef __SI4010_INDEX_H__\n");
+	fprintf(fp, "#define __SI4010_INDEX_H__\n\n");
+	fprintf(fp, "#include <stdint.h>\n\n");
+
+	fprintf(fp, "// Rows before the NAN sentinel, keys are ascending\n");
+	fprintf(fp, "#define RAMP_DATA_NRZ_LEN %zu\n",
+			ramp_table_len(ramp_data_nrz, "ramp_data_nrz"));
+	fprintf(fp, "#define RAMP_DATA_MANCHESTER_LEN %zu\n\n",
+			ramp_table_len(ramp_data_manchester,
+					"ramp_data_manchester"));
+
+	fprintf(fp, "// Indexes 0-%d of ppm_shift, by ascending shift\n",
+			FDEV_MAX);
+	fprintf(fp, "static const uint8_t ppm_shift_order[%zu] = {",
+			ARRAY_SIZE(order));
+	for (i = 0; i < ARRAY_SIZE(order); i++) {
+		if (i % 12 == 0) {
+			fprintf(fp, "\n\t");
+		} else {
+			fputc(' ', fp);
+		}
+		fprintf(fp, "%3u,", order[i]);
+	}
+	fprintf(fp, "\n};\n\n");
+	fprintf(fp, "#endif // __SI4010_INDEX_H__\n");
+
+	if (fclose(fp) != 0) {
+		perror("Failed to write output file");
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
@@ -333,6 +333,9 @@ static const float ramp_data_manchester[][2] = {
 	{NAN, NAN}
 };
 
+// Largest usable FSK deviation setting, index in ppm_shift
+#define FDEV_MAX 104
+
 static const float ppm_shift[128] = {
 	0, 5.577, 11.633, 16.811, 21.909, 27.211, 30.953, 35.723,
 	41.079, 45.991, 51.223, 55.799, 60.002, 64.542, 67.894, 72.221,
@@ -0,0 +1,133 @@
+/**
+ * batch_input.c - Read commands line by line from a file, FIFO or stdin
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "batch_input.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "serco.h"
+
+int batch_open(struct batch_input *in, const char *path)
+{
+	struct stat st;
+
+	memset(in, 0, sizeof(*in));
+
+	if (strcmp(path, "-") == 0) {
+		in->fp = stdin;
+		return 0;
+	}
+
+	in->path = strdup(path);
+	if (in->path == NULL) {
+		perror("Failed to allocate memory");
+		return -1;
+	}
+
+	// Opening a FIFO blocks until a writer opens it
+	in->fp = fopen(path, "r");
+	if (in->fp == NULL) {
+		perror("Failed to open batch input");
+		free(in->path);
+		in->path = NULL;
+		return -1;
+	}
+
+	if (fstat(fileno(in->fp), &st) == 0 && S_ISFIFO(st.st_mode)) {
+		in->is_fifo = true;
+	}
+
+	return 0;
+}
+
+char *batch_read_line(struct batch_input *in, char *buf, size_t size)
+{
+	size_t len;
+
+	while (fgets(buf, size, in->fp) == NULL) {
+		if (ferror(in->fp) || !in->is_fifo) {
+			return NULL;
+		}
+
+		// All writers closed the FIFO, wait for the next one
+		fclose(in->fp);
+		in->fp = fopen(in->path, "r");
+		if (in->fp == NULL) {
+			perror("Failed to reopen batch input");
+			return NULL;
+		}
+	}
+	in->line_nr++;
+
+	len = strlen(buf);
+	while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) {
+		buf[--len] = '\0';
+	}
+
+	return buf;
+}
+
+void batch_close(struct batch_input *in)
+{
+	if (in->fp != NULL && in->fp != stdin) {
+		fclose(in->fp);
+	}
+	in->fp = NULL;
+	free(in->path);
+	in->path = NULL;
+}
+
+void batch_timer_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+double batch_timer_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+		(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+void batch_report(const struct batch_input *in, int ret,
+			const struct timespec *start)
+{
+	if (ret == STATUS_OK) {
+		printf("%lu OK %.1f\n", in->line_nr, batch_timer_ms(start));
+	} else {
+		printf("%lu ERR %d %.1f\n", in->line_nr, ret,
+			batch_timer_ms(start));
+	}
+	fflush(stdout);
+}
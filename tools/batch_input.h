@@ -0,0 +1,117 @@
+/**
+ * batch_input.h - Read commands line by line from a file, FIFO or stdin
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __BATCH_INPUT_H__
+#define __BATCH_INPUT_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct batch_input {
+	char *path;		// Path of input, NULL for stdin
+	FILE *fp;
+	bool is_fifo;		// Reopen input when writer closes FIFO
+	unsigned long line_nr;	// Number of last read line
+};
+
+/**
+ * Open batch command input
+ *
+ * If the input is a FIFO, it is reopened every time the last writer closes
+ * it. This allows a daemon to keep the serial port open and configured,
+ * while clients just write commands to the FIFO. Opening a FIFO blocks until
+ * a writer opens it.
+ *
+ * @param in	Batch input handle, initialized by this function
+ * @param path	Path of file or FIFO to read from, or "-" for stdin
+ *
+ * @returns	0 on success, -1 on failure. An error message is printed on
+ *		failure.
+ */
+int batch_open(struct batch_input *in, const char *path);
+
+/**
+ * Read next command line from batch input
+ *
+ * Trailing newline characters are stripped. Lines longer than the buffer are
+ * returned in parts.
+ *
+ * @param in	Batch input handle
+ * @param buf	Caller owned buffer to store line in
+ * @param size	Size of buf in bytes
+ *
+ * @returns	buf, or NULL on end of input or error
+ */
+char *batch_read_line(struct batch_input *in, char *buf, size_t size);
+
+/**
+ * Close batch command input
+ *
+ * Frees all resources of the handle. Stdin is not closed.
+ *
+ * @param in	Batch input handle
+ */
+void batch_close(struct batch_input *in);
+
+/**
+ * Start latency measurement of a command
+ *
+ * @param start	Returns the current time
+ */
+void batch_timer_start(struct timespec *start);
+
+/**
+ * Get milliseconds passed since batch_timer_start()
+ *
+ * @param start	Time set by batch_timer_start()
+ *
+ * @returns	Elapsed time in milliseconds
+ */
+double batch_timer_ms(const struct timespec *start);
+
+/**
+ * Report result of a batch command on stdout
+ *
+ * Prints one line per command in the format:
+ *
+ *     <line number> OK <latency in ms>
+ *     <line number> ERR <error code> <latency in ms>
+ *
+ * Where the error code is the device status code, -1 for a communication
+ * failure, or a negative errno value for an invalid command line. Stdout is
+ * flushed, so a client reading through a pipe sees the result immediately.
+ *
+ * @param in	Batch input handle
+ * @param ret	Result of command, STATUS_OK on success
+ * @param start	Time command processing started
+ */
+void batch_report(const struct batch_input *in, int ret,
+			const struct timespec *start);
+
+#endif // __BATCH_INPUT_H__
@@ -1,5 +1,5 @@
 /**
- * crc_16.c - Simple/Naive CRC-16 implementation
+ * crc_16.c - Table driven CRC-16 implementation
  *
  * Written 2014, David Imhoff <dimhoff.devel@gmail.com>
  *
@@ -29,6 +29,39 @@
 #include "crc_16.h"
 #include <stdbool.h>
 
+#include "crc_16_tables.h"
+
+static const uint16_t (*lookup_table(uint16_t polynomial, bool reflected))[256]
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(crc_16_tables)/sizeof(crc_16_tables[0]); i++) {
+		if (crc_16_tables[i].polynomial == polynomial) {
+			if (reflected) {
+				return crc_16_tables[i].reflected;
+			} else {
+				return crc_16_tables[i].normal;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static inline uint8_t reverse_byte(uint8_t b)
+{
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+
+	return b;
+}
+
+static inline uint16_t reverse_16(uint16_t x)
+{
+	return (reverse_byte(x & 0xff) << 8) | reverse_byte(x >> 8);
+}
+
 uint16_t crc_16(uint16_t crc, uint8_t b, uint16_t polynomial)
 {
 	uint8_t i=8;
@@ -49,3 +82,71 @@ uint16_t crc_16(uint16_t crc, uint8_t b, uint16_t polynomial)
       
 	return crc;
 }
+
+uint16_t crc_16_update(uint16_t crc, const uint8_t *buf, size_t len,
+			uint16_t polynomial)
+{
+	const uint16_t (*t)[256];
+
+	t = lookup_table(polynomial, false);
+	if (t == NULL) {
+		while (len--) {
+			crc = crc_16(crc, *buf++, polynomial);
+		}
+		return crc;
+	}
+
+	// The CRC state is absorbed by the first two bytes of every slice
+	while (len >= CRC_16_SLICES) {
+		crc = t[7][buf[0] ^ (crc >> 8)] ^
+			t[6][buf[1] ^ (crc & 0xff)] ^
+			t[5][buf[2]] ^
+			t[4][buf[3]] ^
+			t[3][buf[4]] ^
+			t[2][buf[5]] ^
+			t[1][buf[6]] ^
+			t[0][buf[7]];
+		buf += CRC_16_SLICES;
+		len -= CRC_16_SLICES;
+	}
+
+	while (len--) {
+		crc = (crc << 8) ^ t[0][(crc >> 8) ^ *buf++];
+	}
+
+	return crc;
+}
+
+uint16_t crc_16_update_reflected(uint16_t crc, const uint8_t *buf, size_t len,
+			uint16_t polynomial)
+{
+	const uint16_t (*t)[256];
+
+	t = lookup_table(polynomial, true);
+	if (t == NULL) {
+		crc = reverse_16(crc);
+		while (len--) {
+			crc = crc_16(crc, reverse_byte(*buf++), polynomial);
+		}
+		return reverse_16(crc);
+	}
+
+	while (len >= CRC_16_SLICES) {
+		crc = t[7][buf[0] ^ (crc & 0xff)] ^
+			t[6][buf[1] ^ (crc >> 8)] ^
+			t[5][buf[2]] ^
+			t[4][buf[3]] ^
+			t[3][buf[4]] ^
+			t[2][buf[5]] ^
+			t[1][buf[6]] ^
+			t[0][buf[7]];
+		buf += CRC_16_SLICES;
+		len -= CRC_16_SLICES;
+	}
+
+	while (len--) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *buf++) & 0xff];
+	}
+
+	return crc;
+}
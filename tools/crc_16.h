@@ -1,5 +1,5 @@
 /**
- * crc_16.h - Simple/Naive CRC-16 implementation
+ * crc_16.h - Table driven CRC-16 implementation
  *
  * Written 2014, David Imhoff <dimhoff.devel@gmail.com>
  *
@@ -30,6 +30,17 @@
 #define __CRC_16_H__
 
 #include <stdint.h>
+#include <stddef.h>
+
+// Polynomials according to AN625
+// IEC-16:       X16+X14+X12+X11+X9+X8+X7+X4+X+1
+// Baicheva-16:  X16+X15+X12+X7+X6+X4+X3+1
+// CRC-16 (IBM): X16+X15+X2+1
+// CCIT-16:      X16+X12+X5+1
+#define POLY_IEC_16	(0x5B93)
+#define POLY_BAICHEVA	(0x90D9)
+#define POLY_CRC_16	(0x8005)
+#define POLY_CCITT_16	(0x1021)
 
 /**
  * Calculate next CRC-16 state
@@ -47,4 +58,39 @@
  */
 uint16_t crc_16(uint16_t crc, uint8_t b, uint16_t polynomial);
 
+/**
+ * Calculate CRC-16 over a buffer
+ *
+ * Same result as calling crc_16() for every byte in the buffer. For the
+ * POLY_* polynomials lookup tables are used, processing 8 bytes per iteration.
+ * Other polynomials fall back to the bit-wise implementation.
+ *
+ * @param crc		Current CRC state
+ * @param buf		Data to calculate CRC on
+ * @param len		Length of 'buf' in bytes
+ * @param polynomial	The polynomial to use
+ *
+ * @returns	New CRC state/Final CRC value
+ */
+uint16_t crc_16_update(uint16_t crc, const uint8_t *buf, size_t len,
+			uint16_t polynomial);
+
+/**
+ * Calculate reflected CRC-16 over a buffer
+ *
+ * Calculates the CRC LSB first, ie. with all input bytes and the CRC register
+ * bit reversed. The result is equal to reversing the bit order of every input
+ * byte, calling crc_16_update(), and reversing the 16-bit result. But without
+ * any actual bit reversal.
+ *
+ * @param crc		Current CRC state, bit reversed
+ * @param buf		Data to calculate CRC on
+ * @param len		Length of 'buf' in bytes
+ * @param polynomial	The polynomial to use, in normal (not reversed) form
+ *
+ * @returns	New CRC state/Final CRC value, bit reversed
+ */
+uint16_t crc_16_update_reflected(uint16_t crc, const uint8_t *buf, size_t len,
+			uint16_t polynomial);
+
 #endif // __CRC_16_H__
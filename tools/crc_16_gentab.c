@@ -0,0 +1,180 @@
+/**
+ * crc_16_gentab.c - Generate CRC-16 lookup tables for crc_16.c
+ *
+ * Written 2014, David Imhoff <dimhoff.devel@gmail.com>
+ *
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "crc_16.h"
+
+#define SLICES 8
+
+static const uint16_t polynomials[] = {
+	POLY_IEC_16,
+	POLY_BAICHEVA,
+	POLY_CRC_16,
+	POLY_CCITT_16,
+};
+
+static uint16_t reverse_16(uint16_t x)
+{
+	uint16_t r = 0;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		r = (r << 1) | (x & 1);
+		x >>= 1;
+	}
+
+	return r;
+}
+
+/**
+ * Generate slice tables
+ *
+ * tab[0][b] is the CRC of the single byte 'b', tab[k][b] the CRC of byte 'b'
+ * followed by k zero bytes.
+ */
+static void gen_table(uint16_t tab[SLICES][256], uint16_t polynomial,
+			bool reflected)
+{
+	uint16_t rpoly = reverse_16(polynomial);
+	int b;
+	int i;
+	int k;
+
+	for (b = 0; b < 256; b++) {
+		uint16_t crc;
+
+		if (reflected) {
+			crc = b;
+			for (i = 0; i < 8; i++) {
+				if (crc & 1) {
+					crc = (crc >> 1) ^ rpoly;
+				} else {
+					crc = crc >> 1;
+				}
+			}
+		} else {
+			crc = b << 8;
+			for (i = 0; i < 8; i++) {
+				if (crc & 0x8000) {
+					crc = (crc << 1) ^ polynomial;
+				} else {
+					crc = crc << 1;
+				}
+			}
+		}
+		tab[0][b] = crc;
+	}
+
+	for (k = 1; k < SLICES; k++) {
+		for (b = 0; b < 256; b++) {
+			uint16_t prev = tab[k - 1][b];
+
+			if (reflected) {
+				tab[k][b] = (prev >> 8) ^ tab[0][prev & 0xff];
+			} else {
+				tab[k][b] = (prev << 8) ^ tab[0][prev >> 8];
+			}
+		}
+	}
+}
+
+static void print_table(FILE *fp, uint16_t tab[SLICES][256],
+			uint16_t polynomial, bool reflected)
+{
+	int b;
+	int k;
+
+	fprintf(fp, "static const uint16_t crc_16_tab_%04x%s[%d][256] = {\n",
+			polynomial, reflected ? "_ref" : "", SLICES);
+	for (k = 0; k < SLICES; k++) {
+		fprintf(fp, "\t{");
+		for (b = 0; b < 256; b++) {
+			if (b % 8 == 0) {
+				fprintf(fp, "\n\t\t");
+			} else {
+				fputc(' ', fp);
+			}
+			fprintf(fp, "0x%04x,", tab[k][b]);
+		}
+		fprintf(fp, "\n\t},\n");
+	}
+	fprintf(fp, "};\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static uint16_t tab[SLICES][256];
+	FILE *fp;
+	size_t i;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <output_file>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if ((fp = fopen(argv[1], "w")) == NULL) {
+		perror("Failed to open output file");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(fp, "// Generated by crc_16_gentab, do not edit\n");
+	fprintf(fp, "#ifndef __CRC_16_TABLES_H__\n");
+	fprintf(fp, "#define __CRC_16_TABLES_H__\n\n");
+	fprintf(fp, "#include <stdint.h>\n\n");
+	fprintf(fp, "#define CRC_16_SLICES %d\n\n", SLICES);
+
+	for (i = 0; i < sizeof(polynomials)/sizeof(polynomials[0]); i++) {
+		gen_table(tab, polynomials[i], false);
+		print_table(fp, tab, polynomials[i], false);
+		gen_table(tab, polynomials[i], true);
+		print_table(fp, tab, polynomials[i], true);
+	}
+
+	fprintf(fp, "static const struct {\n"
+			"\tuint16_t polynomial;\n"
+			"\tconst uint16_t (*normal)[256];\n"
+			"\tconst uint16_t (*reflected)[256];\n"
+			"} crc_16_tables[] = {\n");
+	for (i = 0; i < sizeof(polynomials)/sizeof(polynomials[0]); i++) {
+		fprintf(fp, "\t{ 0x%04x, crc_16_tab_%04x, crc_16_tab_%04x_ref },\n",
+				polynomials[i], polynomials[i], polynomials[i]);
+	}
+	fprintf(fp, "};\n\n");
+	fprintf(fp, "#endif // __CRC_16_TABLES_H__\n");
+
+	if (fclose(fp) != 0) {
+		perror("Failed to write output file");
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
@@ -1,5 +1,5 @@
 /**
- * pn9.c - Simple/Naive PN9 pseudo random bit string generator implementation
+ * pn9.c - PN9 pseudo random bit string generator and data whitening
  *
  * Written 2014, David Imhoff <dimhoff.devel@gmail.com>
  *
@@ -28,6 +28,15 @@
  */
 #include "pn9.h"
 
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * Whitening mask; one period of PN9 bytes as used by pn9_whiten()
+ */
+static uint8_t whiten_mask[PN9_PERIOD];
+static bool whiten_mask_valid = false;
+
 void pn9_next(uint16_t *last)
 {
 	uint16_t retval;
@@ -45,3 +54,67 @@ uint16_t pn9_next_byte(uint16_t state)
 	return state;
 }
 
+static inline uint8_t reverse_byte(uint8_t b)
+{
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+
+	return b;
+}
+
+static void init_whiten_mask()
+{
+	uint16_t state = PN9_INITIALIZER;
+	size_t i;
+
+	// PN9 repeats every 511 bits, so also every 511 bytes
+	for (i = 0; i < PN9_PERIOD; i++) {
+		state = pn9_next_byte(state);
+		whiten_mask[i] = reverse_byte(state >> 1);
+	}
+
+	whiten_mask_valid = true;
+}
+
+static void xor_buf(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	uint64_t a;
+	uint64_t b;
+
+	while (len >= sizeof(uint64_t)) {
+		memcpy(&a, dst, sizeof(a));
+		memcpy(&b, src, sizeof(b));
+		a ^= b;
+		memcpy(dst, &a, sizeof(a));
+
+		dst += sizeof(uint64_t);
+		src += sizeof(uint64_t);
+		len -= sizeof(uint64_t);
+	}
+
+	while (len--) {
+		*dst++ ^= *src++;
+	}
+}
+
+void pn9_whiten(uint8_t *buf, size_t len)
+{
+	size_t chunk;
+
+	if (!whiten_mask_valid) {
+		init_whiten_mask();
+	}
+
+	while (len > 0) {
+		chunk = len;
+		if (chunk > PN9_PERIOD) {
+			chunk = PN9_PERIOD;
+		}
+
+		xor_buf(buf, whiten_mask, chunk);
+
+		buf += chunk;
+		len -= chunk;
+	}
+}
@@ -1,5 +1,5 @@
 /**
- * pn9.h - Simple/Naive PN9 pseudo random bit string generator implementation
+ * pn9.h - PN9 pseudo random bit string generator and data whitening
  *
  * Written 2014, David Imhoff <dimhoff.devel@gmail.com>
  *
@@ -30,9 +30,15 @@
 #define __PN9_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define PN9_INITIALIZER (0x1ff)
 
+/**
+ * Period of PN9 sequence in bits, and in bytes
+ */
+#define PN9_PERIOD (511)
+
 /**
  * Get next byte in PRNG sequence
  *
@@ -42,4 +48,18 @@
  */
 uint16_t pn9_next_byte(uint16_t state);
 
+/**
+ * Apply Si443x data whitening to buffer
+ *
+ * XOR the buffer with the PN9 sequence, starting from PN9_INITIALIZER, in
+ * the bit order used by the Si443x. This gives the same result as XOR-ing
+ * every byte with reverse_byte(state >> 1) for consecutive states returned by
+ * pn9_next_byte(). The sequence is calculated once and then applied a 64-bit
+ * word at a time.
+ *
+ * @param buf	Data to whiten, modified in place
+ * @param len	Length of 'buf' in bytes
+ */
+void pn9_whiten(uint8_t *buf, size_t len);
+
 #endif // __PN9_H__
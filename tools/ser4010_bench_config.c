@@ -0,0 +1,194 @@
+/**
+ * ser4010_bench_config.c - Measure radio configuration computation speed
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "ser4010.h"
+#include "si4010_tables.h"
+
+#define FREQ_MIN_MHZ	27.0
+#define FREQ_MAX_MHZ	960.0
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Computes radio configurations for a frequency sweep, once per\n"
+		"frequency using ser4010_calc_config() and once using the batch\n"
+		"ser4010_calc_configs(), and reports the time per configuration.\n"
+		"The FSK deviation settings are verified against a linear search\n"
+		"of the calculator table. No device is needed.\n"
+		"\n"
+		"Options:\n"
+		" -n <count>	Number of frequencies (default: 100000)\n"
+		" -r <rounds>	Number of rounds to average (default: 10)\n"
+		" -h		Print this help message\n"
+		, name);
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1e9 +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Reference FSK deviation lookup, linear search for the closest shift
+ */
+static uint8_t ref_fdev(float freq_mhz, float fdev_khz)
+{
+	float wanted_shift = (fdev_khz * 2000.0 / freq_mhz);
+	float min_diff = INFINITY;
+	uint8_t best = 0;
+	size_t i;
+
+	for (i = 0; i <= FDEV_MAX; i++) {
+		float diff = fabsf(wanted_shift - ppm_shift[i]);
+		if (diff < min_diff) {
+			min_diff = diff;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *endp;
+	unsigned long cnt = 100000;
+	unsigned long rounds = 10;
+	float *freqs;
+	struct ser4010_radio_config *cfgs;
+	struct timespec start;
+	double single_ns = 0;
+	double batch_ns = 0;
+	unsigned long mismatch = 0;
+	unsigned long r;
+	size_t i;
+	int ret;
+
+	while ((opt = getopt(argc, argv, "n:r:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			cnt = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || cnt == 0) {
+				fprintf(stderr, "Invalid count\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			rounds = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || rounds == 0) {
+				fprintf(stderr, "Invalid number of rounds\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	freqs = malloc(cnt * sizeof(freqs[0]));
+	cfgs = malloc(cnt * sizeof(cfgs[0]));
+	if (freqs == NULL || cfgs == NULL) {
+		perror("malloc() failed");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < cnt; i++) {
+		freqs[i] = FREQ_MIN_MHZ +
+			(FREQ_MAX_MHZ - FREQ_MIN_MHZ) * i / cnt;
+	}
+
+	for (r = 0; r < rounds; r++) {
+		// Vary data rate and deviation, to hit all table rows
+		double rate = 0.5 + 60.0 * r / rounds;
+		float fdev = 5 + 95.0 * r / rounds;
+		enum Ser4010Encoding enc = (r % 2) ? bEnc_Manchester_c :
+							bEnc_NoneNrz_c;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < cnt; i++) {
+			ret = ser4010_calc_config(&cfgs[i], freqs[i], fdev,
+					ODS_MODULATION_TYPE_FSK, enc,
+					rate, 8);
+			if (ret != 0) {
+				fprintf(stderr, "ser4010_calc_config() "
+						"failed: %d\n", ret);
+				exit(EXIT_FAILURE);
+			}
+		}
+		single_ns += elapsed_ns(&start);
+
+		for (i = 0; i < cnt; i++) {
+			if (cfgs[i].fdev != ref_fdev(freqs[i], fdev)) {
+				mismatch++;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = ser4010_calc_configs(cfgs, freqs, cnt, fdev,
+					ODS_MODULATION_TYPE_FSK, enc,
+					rate, 8);
+		batch_ns += elapsed_ns(&start);
+		if (ret != 0) {
+			fprintf(stderr, "ser4010_calc_configs() failed: %d\n",
+					ret);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("%lu configurations, %lu rounds\n", cnt, rounds);
+	printf("single: %8.1f ns/config\n", single_ns / (cnt * rounds));
+	printf("batch:  %8.1f ns/config\n", batch_ns / (cnt * rounds));
+	printf("fdev mismatches: %lu\n", mismatch);
+
+	free(freqs);
+	free(cfgs);
+
+	return (mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,274 @@
+/**
+ * ser4010_bench_crc.c - Verify and measure the table driven CRC-16
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "crc_16.h"
+
+// Maximum buffer length of the random slice-by-8 checks
+#define CHECK_MAX_LEN	300
+
+// Not in the lookup tables, exercises the bit-wise fallback
+#define POLY_OTHER	(0x1234)
+
+static const uint16_t polynomials[] = {
+	POLY_IEC_16, POLY_BAICHEVA, POLY_CRC_16, POLY_CCITT_16, POLY_OTHER
+};
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Compares crc_16_update() and crc_16_update_reflected() with the\n"
+		"bit-wise crc_16() for every CRC state and input byte, and for\n"
+		"random buffers, using all AN625 polynomials. Then reports the\n"
+		"throughput of both implementations.\n"
+		"\n"
+		"Options:\n"
+		" -n <bytes>	Buffer size of throughput test (default: 250)\n"
+		" -r <rounds>	Number of rounds to average (default: 20000)\n"
+		" -h		Print this help message\n"
+		, name);
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1e9 +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+static uint8_t reverse_byte(uint8_t b)
+{
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+
+	return b;
+}
+
+static uint16_t reverse_16(uint16_t x)
+{
+	return (reverse_byte(x & 0xff) << 8) | reverse_byte(x >> 8);
+}
+
+/**
+ * Reference CRC, bit-wise as ser4010_si443x used to calculate it
+ */
+static uint16_t ref_crc(uint16_t crc, const uint8_t *buf, size_t len,
+			uint16_t polynomial, bool reflected)
+{
+	size_t i;
+
+	if (reflected) {
+		crc = reverse_16(crc);
+	}
+	for (i = 0; i < len; i++) {
+		crc = crc_16(crc, reflected ? reverse_byte(buf[i]) : buf[i],
+				polynomial);
+	}
+	if (reflected) {
+		crc = reverse_16(crc);
+	}
+
+	return crc;
+}
+
+/**
+ * Compare with reference for every CRC state and input byte
+ *
+ * @returns	Number of mismatches
+ */
+static unsigned long check_exhaustive(uint16_t polynomial)
+{
+	unsigned long mismatch = 0;
+	unsigned int crc;
+	unsigned int b;
+	uint8_t c;
+
+	for (crc = 0; crc <= 0xffff; crc++) {
+		for (b = 0; b <= 0xff; b++) {
+			c = b;
+			if (crc_16_update(crc, &c, 1, polynomial) !=
+					crc_16(crc, c, polynomial)) {
+				mismatch++;
+			}
+			if (crc_16_update_reflected(crc, &c, 1, polynomial) !=
+					ref_crc(crc, &c, 1, polynomial, true)) {
+				mismatch++;
+			}
+		}
+	}
+
+	return mismatch;
+}
+
+/**
+ * Compare with reference for random buffers of every length
+ *
+ * Covers the slice-by-8 loop and the byte-wise tail.
+ *
+ * @returns	Number of mismatches
+ */
+static unsigned long check_buffers(uint16_t polynomial)
+{
+	uint8_t buf[CHECK_MAX_LEN];
+	unsigned long mismatch = 0;
+	unsigned int round;
+	uint16_t init;
+	size_t len;
+	size_t i;
+
+	for (round = 0; round < 20; round++) {
+		for (i = 0; i < sizeof(buf); i++) {
+			buf[i] = random();
+		}
+		for (len = 0; len <= sizeof(buf); len++) {
+			init = (round == 0) ? 0 : random();
+			if (crc_16_update(init, buf, len, polynomial) !=
+			    ref_crc(init, buf, len, polynomial, false)) {
+				mismatch++;
+			}
+			if (crc_16_update_reflected(init, buf, len,
+						polynomial) !=
+			    ref_crc(init, buf, len, polynomial, true)) {
+				mismatch++;
+			}
+		}
+	}
+
+	return mismatch;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *endp;
+	unsigned long len = 250;
+	unsigned long rounds = 20000;
+	unsigned long mismatch = 0;
+	unsigned long m;
+	uint8_t *buf;
+	struct timespec start;
+	double bitwise_ns, table_ns, refl_bitwise_ns, refl_table_ns;
+	volatile uint16_t sink = 0;
+	unsigned long r;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "n:r:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			len = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || len == 0) {
+				fprintf(stderr, "Invalid buffer size\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			rounds = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || rounds == 0) {
+				fprintf(stderr, "Invalid number of rounds\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	srandom(1);
+	for (i = 0; i < sizeof(polynomials) / sizeof(polynomials[0]); i++) {
+		m = check_exhaustive(polynomials[i]);
+		m += check_buffers(polynomials[i]);
+		printf("polynomial 0x%04x: %lu mismatches\n", polynomials[i],
+				m);
+		mismatch += m;
+	}
+
+	buf = malloc(len);
+	if (buf == NULL) {
+		perror("malloc() failed");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < len; i++) {
+		buf[i] = random();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		sink ^= ref_crc(0, buf, len, POLY_CRC_16, false);
+	}
+	bitwise_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		sink ^= crc_16_update(0, buf, len, POLY_CRC_16);
+	}
+	table_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		sink ^= ref_crc(0, buf, len, POLY_CRC_16, true);
+	}
+	refl_bitwise_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		sink ^= crc_16_update_reflected(0, buf, len, POLY_CRC_16);
+	}
+	refl_table_ns = elapsed_ns(&start);
+
+	printf("%lu bytes, %lu rounds\n", len, rounds);
+	printf("bit-wise:            %8.2f ns/byte\n",
+			bitwise_ns / (len * rounds));
+	printf("table:               %8.2f ns/byte\n",
+			table_ns / (len * rounds));
+	printf("bit-wise, reflected: %8.2f ns/byte\n",
+			refl_bitwise_ns / (len * rounds));
+	printf("table, reflected:    %8.2f ns/byte\n",
+			refl_table_ns / (len * rounds));
+
+	free(buf);
+
+	return (mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
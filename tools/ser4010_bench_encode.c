@@ -0,0 +1,332 @@
+/**
+ * ser4010_bench_encode.c - Verify and measure the frame bit packing library
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "ser4010_encode.h"
+
+// Payload sizes and group widths of the KAKU and Somfy RTS frames
+#define KAKU_DATA_LEN		4
+#define KAKU_PAYLOAD_LEN	32
+#define KAKU_GROUP_WIDTH	6
+#define RTS_DATA_LEN		7
+#define RTS_PAYLOAD_LEN		14
+#define RTS_GROUP_WIDTH		7
+
+#define KAKU_MARK 0x21
+#define KAKU_SPACE 0x05
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Compares the ser4010_encode packer with the hand written encoders\n"
+		"the tools used before: KAKU PWM, Somfy RTS Manchester, the\n"
+		"ser4010_si443x bit reversal and the ser4010_pulse carrier frame.\n"
+		"Random payloads are encoded with both, and must be byte\n"
+		"identical. Then reports the throughput of both implementations.\n"
+		"\n"
+		"Options:\n"
+		" -n <count>	Number of random payloads (default: 100000)\n"
+		" -h		Print this help message\n"
+		, name);
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1e9 +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Old KAKU PWM encoder of ser4010_kaku, one bit per frame byte
+ */
+static uint8_t *encode_kaku(uint8_t *enc_data, uint8_t b)
+{
+	int i;
+
+	i=8;
+	while (i > 0) {
+		if (b & 0x80) {
+			*enc_data = KAKU_MARK;
+		} else {
+			*enc_data = KAKU_SPACE;
+		}
+		b <<= 1;
+
+		enc_data++;
+		i--;
+	}
+
+	return enc_data;
+}
+
+/**
+ * Old Manchester encoder of ser4010_rts, half a byte per frame byte
+ */
+static uint8_t *encode_rts(uint8_t *enc_data, uint8_t b)
+{
+	uint8_t i;
+
+	i=8;
+	while (i > 0) {
+		*enc_data = (*enc_data >> 2) & 0x3f;
+		if (b & 0x80) {
+			*enc_data |= 0x80;
+		} else {
+			*enc_data |= 0x40;
+		}
+		b <<= 1;
+
+		if (i == 5) {
+			enc_data++;
+		}
+		i--;
+	}
+
+	return (enc_data+1);
+}
+
+/**
+ * Old bit reversal of ser4010_si443x
+ */
+static uint8_t reverse_byte(uint8_t b)
+{
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+
+	return b;
+}
+
+static void old_kaku(uint8_t *frame, const uint8_t *data)
+{
+	uint8_t *p = frame;
+	size_t i;
+
+	for (i = 0; i < KAKU_DATA_LEN; i++) {
+		p = encode_kaku(p, data[i]);
+	}
+}
+
+static void new_kaku(uint8_t *frame, const uint8_t *data,
+			const struct ser4010_symbol_map *map)
+{
+	struct ser4010_packer packer;
+
+	ser4010_packer_init(&packer, frame, KAKU_PAYLOAD_LEN,
+				KAKU_GROUP_WIDTH);
+	ser4010_pack_bytes(&packer, map, data, KAKU_DATA_LEN);
+	ser4010_packer_finish(&packer, NULL);
+}
+
+static void old_rts(uint8_t *frame, const uint8_t *data)
+{
+	uint8_t *p = frame;
+	size_t i;
+
+	memset(frame, 0, RTS_PAYLOAD_LEN);
+	for (i = 0; i < RTS_DATA_LEN; i++) {
+		p = encode_rts(p, data[i]);
+	}
+}
+
+static void new_rts(uint8_t *frame, const uint8_t *data,
+			const struct ser4010_symbol_map *map)
+{
+	struct ser4010_packer packer;
+
+	ser4010_packer_init(&packer, frame, RTS_PAYLOAD_LEN, RTS_GROUP_WIDTH);
+	ser4010_pack_bytes(&packer, map, data, RTS_DATA_LEN);
+	ser4010_packer_finish(&packer, NULL);
+}
+
+/**
+ * Check the carrier frame of ser4010_pulse, formerly the constant { 0xff }
+ *
+ * @returns	Number of mismatches
+ */
+static unsigned long check_pulse(void)
+{
+	struct ser4010_packer packer;
+	uint8_t frame[1];
+
+	ser4010_packer_init(&packer, frame, sizeof(frame), 7);
+	ser4010_pack_symbols(&packer, 0xff, 8);
+	if (ser4010_packer_finish(&packer, NULL) != 0 || frame[0] != 0xff) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Check bit reversal of every byte value
+ *
+ * @returns	Number of mismatches
+ */
+static unsigned long check_reverse(void)
+{
+	unsigned long mismatch = 0;
+	unsigned int b;
+	uint8_t c;
+
+	for (b = 0; b <= 0xff; b++) {
+		c = b;
+		ser4010_reverse_bytes(&c, 1);
+		if (c != reverse_byte(b)) {
+			mismatch++;
+		}
+	}
+
+	return mismatch;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *endp;
+	unsigned long cnt = 100000;
+	unsigned long kaku_mismatch = 0;
+	unsigned long rts_mismatch = 0;
+	unsigned long other_mismatch;
+	struct ser4010_symbol_map kaku_map;
+	struct ser4010_symbol_map rts_map;
+	uint8_t (*data)[RTS_DATA_LEN];
+	uint8_t a[RTS_PAYLOAD_LEN + KAKU_PAYLOAD_LEN];
+	uint8_t b[RTS_PAYLOAD_LEN + KAKU_PAYLOAD_LEN];
+	struct timespec start;
+	double old_kaku_ns, new_kaku_ns, old_rts_ns, new_rts_ns;
+	volatile uint8_t sink = 0;
+	size_t i;
+	size_t j;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			cnt = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || cnt == 0) {
+				fprintf(stderr, "Invalid count\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	ser4010_symbol_map_init(&kaku_map, KAKU_GROUP_WIDTH + 1,
+				SER4010_KAKU_ZERO, SER4010_KAKU_ONE);
+	ser4010_symbol_map_init(&rts_map, 2,
+				SER4010_MANCHESTER_ZERO, SER4010_MANCHESTER_ONE);
+
+	data = malloc(cnt * sizeof(data[0]));
+	if (data == NULL) {
+		perror("malloc() failed");
+		exit(EXIT_FAILURE);
+	}
+	srandom(1);
+	for (i = 0; i < cnt; i++) {
+		for (j = 0; j < RTS_DATA_LEN; j++) {
+			data[i][j] = random();
+		}
+	}
+
+	for (i = 0; i < cnt; i++) {
+		old_kaku(a, data[i]);
+		new_kaku(b, data[i], &kaku_map);
+		if (memcmp(a, b, KAKU_PAYLOAD_LEN) != 0) {
+			kaku_mismatch++;
+		}
+
+		old_rts(a, data[i]);
+		new_rts(b, data[i], &rts_map);
+		if (memcmp(a, b, RTS_PAYLOAD_LEN) != 0) {
+			rts_mismatch++;
+		}
+	}
+	other_mismatch = check_reverse() + check_pulse();
+
+	printf("%lu payloads\n", cnt);
+	printf("KAKU mismatches: %lu\n", kaku_mismatch);
+	printf("RTS mismatches: %lu\n", rts_mismatch);
+	printf("bit reversal and pulse mismatches: %lu\n", other_mismatch);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		old_kaku(a, data[i]);
+		sink ^= a[i % KAKU_PAYLOAD_LEN];
+	}
+	old_kaku_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		new_kaku(a, data[i], &kaku_map);
+		sink ^= a[i % KAKU_PAYLOAD_LEN];
+	}
+	new_kaku_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		old_rts(a, data[i]);
+		sink ^= a[i % RTS_PAYLOAD_LEN];
+	}
+	old_rts_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		new_rts(a, data[i], &rts_map);
+		sink ^= a[i % RTS_PAYLOAD_LEN];
+	}
+	new_rts_ns = elapsed_ns(&start);
+
+	printf("KAKU old: %8.1f ns/frame\n", old_kaku_ns / cnt);
+	printf("KAKU new: %8.1f ns/frame\n", new_kaku_ns / cnt);
+	printf("RTS old:  %8.1f ns/frame\n", old_rts_ns / cnt);
+	printf("RTS new:  %8.1f ns/frame\n", new_rts_ns / cnt);
+
+	free(data);
+
+	return (kaku_mismatch == 0 && rts_mismatch == 0 &&
+			other_mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
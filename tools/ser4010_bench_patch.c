@@ -0,0 +1,242 @@
+/**
+ * ser4010_bench_patch.c - Measure wire bytes saved by frame patching
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "serco.h"
+#include "ser4010.h"
+#include "ser4010_kaku_proto.h"
+#include "ser4010_rts.h"
+
+#define REMOTE_CNT	8	// Number of different remotes to simulate
+#define BITS_PER_BYTE	10	// Start, 8 data and stop bit at 9600 baud
+
+enum protocol { KAKU, SOMFY };
+
+struct result {
+	unsigned long tx_bytes;
+	unsigned long rx_bytes;
+	double elapsed_ms;
+};
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Uploads a series of KAKU and Somfy frames, once using full frame\n"
+		"loads, and once using frame patching, and reports the bytes\n"
+		"transferred over the serial port. Frames are only uploaded, not\n"
+		"sent. Use ser4010_emu to run without hardware.\n"
+		"\n"
+		"Options:\n"
+		" -d <path>	Path to serial device file\n"
+		" -n <count>	Number of frames per protocol (default: 100)\n"
+		" -h		Print this help message\n"
+		, name);
+}
+
+/**
+ * Encode the i'th frame of the simulated command sequence
+ *
+ * Commands are pseudo random, but the same for both upload modes.
+ */
+static size_t encode_frame(enum protocol proto, unsigned int i,
+				uint8_t *frame)
+{
+	static const uint32_t addrs[REMOTE_CNT] = {
+		0x0123456, 0x1a2b3c4, 0x2fedcba, 0x3000001,
+		0x0abcdef, 0x1234567, 0x2468ace, 0x3579bdf
+	};
+	static const uint8_t ctrls[3] = { 1, 2, 4 };	// My, Up, Down
+	unsigned int r = (i * 2654435761u) >> 8;
+	unsigned int remote = r % REMOTE_CNT;
+
+	if (proto == KAKU) {
+		uint32_t addr = addrs[remote] & 0x3ffffff;
+		unsigned int unit = (r >> 4) & 0xf;
+		uint8_t data[4];
+
+		data[0] = addr >> 18;
+		data[1] = addr >> 10;
+		data[2] = addr >> 2;
+		data[3] = ((addr << 6) & 0xc0) | ((r >> 8) & 0x10) | unit;
+
+		return ser4010_kaku_encode(data, frame);
+	} else {
+		uint8_t data[7];
+		uint16_t seq = 100 + i;	// Rolling codes of all remotes advance
+
+		ser4010_rts_build_frame(data, seq, addrs[remote] & 0xffffff,
+					seq, ctrls[(r >> 4) % 3]);
+
+		return ser4010_rts_encode(data, frame);
+	}
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+		(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static int run(struct serco *sdev, enum protocol proto, bool patch,
+		unsigned int cnt, struct result *res)
+{
+	uint8_t frame[SER4010_KAKU_FRAME_SIZE + SER4010_RTS_FRAME_SIZE];
+	struct timespec start;
+	unsigned long tx_bytes = sdev->stats.tx_bytes;
+	unsigned long rx_bytes = sdev->stats.rx_bytes;
+	unsigned int i;
+	size_t len;
+	int ret;
+
+	// Start both modes with an unknown device frame
+	sdev->frame_len = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < cnt; i++) {
+		len = encode_frame(proto, i, frame);
+
+		if (patch) {
+			ret = ser4010_load_frame_diff(sdev, frame, len);
+		} else {
+			ret = ser4010_load_frame(sdev, frame, len);
+		}
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+	}
+
+	res->elapsed_ms = elapsed_ms(&start);
+	res->tx_bytes = sdev->stats.tx_bytes - tx_bytes;
+	res->rx_bytes = sdev->stats.rx_bytes - rx_bytes;
+
+	return STATUS_OK;
+}
+
+static void print_result(const char *name, const char *mode,
+				const struct result *res, unsigned int cnt)
+{
+	unsigned long bytes = res->tx_bytes + res->rx_bytes;
+
+	printf("%-6s %-6s %10lu %10lu %10.1f %12.1f %10.1f\n",
+			name, mode, res->tx_bytes, res->rx_bytes,
+			(double) res->tx_bytes / cnt,
+			bytes * BITS_PER_BYTE * 1000.0 / 9600,
+			res->elapsed_ms);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *endp;
+	char *dev_path;
+	unsigned int cnt = 100;
+	struct serco sdev;
+	struct result full, patch;
+	int ret;
+
+	dev_path = strdup(DEFAULT_SERIAL_DEV);
+
+	while ((opt = getopt(argc, argv, "d:n:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			free(dev_path);
+			dev_path = strdup(optarg);
+			break;
+		case 'n':
+			cnt = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || cnt == 0) {
+				fprintf(stderr, "Invalid frame count\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (serco_open(&sdev, dev_path) != 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%-6s %-6s %10s %10s %10s %12s %10s\n", "proto", "mode",
+			"tx bytes", "rx bytes", "tx/frame", "9600bd (ms)",
+			"real (ms)");
+
+	ret = ser4010_kaku_init(&sdev);
+	if (ret == STATUS_OK) {
+		ret = run(&sdev, KAKU, false, cnt, &full);
+	}
+	if (ret == STATUS_OK) {
+		ret = run(&sdev, KAKU, true, cnt, &patch);
+	}
+	if (ret == STATUS_OK) {
+		print_result("KAKU", "full", &full, cnt);
+		print_result("KAKU", "patch", &patch, cnt);
+		ret = ser4010_rts_init(&sdev);
+	}
+	if (ret == STATUS_OK) {
+		ret = run(&sdev, SOMFY, false, cnt, &full);
+	}
+	if (ret == STATUS_OK) {
+		ret = run(&sdev, SOMFY, true, cnt, &patch);
+	}
+	if (ret == STATUS_OK) {
+		print_result("Somfy", "full", &full, cnt);
+		print_result("Somfy", "patch", &patch, cnt);
+	}
+
+	serco_close(&sdev);
+
+	if (ret != STATUS_OK) {
+		fprintf(stderr, "Benchmark failed: %d\n", ret);
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * ser4010_bench_pn9.c - Verify and measure the precomputed PN9 whitening
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "pn9.h"
+
+// Checked buffer lengths, covers three wraps of the whitening mask
+#define CHECK_MAX_LEN	(3 * PN9_PERIOD + 16)
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Compares pn9_whiten() with whitening by the PN9 LFSR, as\n"
+		"ser4010_si443x used to do it, for every buffer length up to three\n"
+		"PN9 periods. Also checks the LFSR really repeats after %d bytes.\n"
+		"Then reports the throughput of both implementations.\n"
+		"\n"
+		"Options:\n"
+		" -n <bytes>	Buffer size of throughput test (default: 250)\n"
+		" -r <rounds>	Number of rounds to average (default: 100000)\n"
+		" -h		Print this help message\n"
+		, name, PN9_PERIOD);
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1e9 +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+static uint8_t reverse_byte(uint8_t b)
+{
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+
+	return b;
+}
+
+/**
+ * Reference whitening, stepping the LFSR for every byte
+ */
+static void ref_whiten(uint8_t *buf, size_t len)
+{
+	uint16_t state = PN9_INITIALIZER;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		state = pn9_next_byte(state);
+		buf[i] ^= reverse_byte(state >> 1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *endp;
+	unsigned long len = 250;
+	unsigned long rounds = 100000;
+	unsigned long mismatch = 0;
+	static uint8_t data[CHECK_MAX_LEN];
+	static uint8_t a[CHECK_MAX_LEN];
+	static uint8_t b[CHECK_MAX_LEN];
+	uint8_t *buf;
+	uint16_t state;
+	struct timespec start;
+	double lfsr_ns, mask_ns;
+	unsigned long r;
+	size_t n;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "n:r:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			len = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || len == 0) {
+				fprintf(stderr, "Invalid buffer size\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			rounds = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || rounds == 0) {
+				fprintf(stderr, "Invalid number of rounds\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// The mask is one period long, so the LFSR must be back at its
+	// initial state after a period
+	state = PN9_INITIALIZER;
+	for (i = 0; i < PN9_PERIOD; i++) {
+		state = pn9_next_byte(state);
+	}
+	if (state != PN9_INITIALIZER) {
+		printf("PN9 state after %d bytes: 0x%03x\n", PN9_PERIOD, state);
+		mismatch++;
+	}
+
+	srandom(1);
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = random();
+	}
+	for (n = 0; n <= sizeof(data); n++) {
+		memcpy(a, data, n);
+		memcpy(b, data, n);
+		ref_whiten(a, n);
+		pn9_whiten(b, n);
+		if (memcmp(a, b, n) != 0) {
+			mismatch++;
+		}
+	}
+	printf("%d buffer lengths: %lu mismatches\n", CHECK_MAX_LEN + 1,
+			mismatch);
+
+	buf = malloc(len);
+	if (buf == NULL) {
+		perror("malloc() failed");
+		exit(EXIT_FAILURE);
+	}
+	memset(buf, 0, len);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		ref_whiten(buf, len);
+	}
+	lfsr_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		pn9_whiten(buf, len);
+	}
+	mask_ns = elapsed_ns(&start);
+
+	printf("%lu bytes, %lu rounds\n", len, rounds);
+	printf("LFSR: %8.2f ns/byte\n", lfsr_ns / (len * rounds));
+	printf("mask: %8.2f ns/byte\n", mask_ns / (len * rounds));
+
+	free(buf);
+
+	return (mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
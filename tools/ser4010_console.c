@@ -33,6 +33,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <ctype.h>
@@ -41,11 +42,17 @@
 
 #include "serco.h"
 #include "ser4010.h"
+#include "ser4010_profile.h"
 #include "dehexify.h"
+#include "str_to_args.h"
 
 #define ARRAY_SIZE(a) (sizeof(a)/sizeof((a)[0]))
 #define UNUSED(x) (void)(x)
 
+// Oldest firmware revision supported. libser4010 falls back to older commands
+// for firmware before SER4010_DEV_REV.
+#define MIN_DEV_REV 3
+
 const char *modulation_type_to_str(int type)
 {
 	static const char *strings[3] = {
@@ -69,60 +76,6 @@ const char *encoding_to_str(int enc)
 	return strings[enc];
 }
 
-/**
- * Split string into arguments on spaces
- *
- * Splits a string into arguments. The original string will be modified by
- * overwriting found separators with '\0'. The start locations of the argument
- * strings are returned in the argv array. The 'argv' array is preallocated by
- * the caller and should be big enough to contain 'max_args' entries.
- *
- * Empty fields are ignored.
- *
- * Note this Currently doesn't support any quoting.
- *
- * @param cmd_str	String to split. This string is modified!
- * @param argv		Pointer to array of pointers to place pointers of found
- *                      arguments in.
- * @param max_args	Max. number of entries the 'argv' array can hold.
- *
- * @returns		Amount of arguments found. If equal to max_args then
- * 			the last argument contains the rest including spaces.
- */
-size_t str_to_args(char *cmd_str, char **argv, size_t max_args)
-{
-	size_t args_found = 0;
-
-	while (cmd_str[0] != '\0') {
-		// Strip trailing spaces
-		while (isspace(cmd_str[0])) {
-			cmd_str++;
-		}
-
-		if (cmd_str[0] == '\0') break;
-
-		// Add argument to argv
-		argv[args_found] = cmd_str;
-		args_found++;
-
-		// if args_found == max_args, then don't terminate argument but
-		// return remainder of cmd_str as last arg.
-		if (args_found == max_args) break;
-
-		// Find end of arg, and terminate with '\0'
-		while (cmd_str[0] != '\0' && ! isspace(cmd_str[0])) {
-			cmd_str++;
-		}
-
-		if (cmd_str[0] == '\0') break;
-
-		cmd_str[0] = '\0';
-		cmd_str++;
-	}
-
-	return args_found;
-}
-
 void usage(const char *name)
 {
 	fprintf(stderr,
@@ -130,6 +83,8 @@ void usage(const char *name)
 		"\n"
 		"Options:\n"
 		" -d <path>	Path to serial device file\n"
+		" -r <ms>	Reconnect if the device is lost, waiting at most\n"
+		"		ms for it to return\n"
 		" -h		Print this help message\n"
 		, name);
 }
@@ -520,6 +475,104 @@ void cmd_send(struct serco *sdev, size_t argc, char **argv)
 	}
 }
 
+void cmd_send_at(struct serco *sdev, size_t argc, char **argv)
+{
+	int err;
+	char *endptr;
+	unsigned long slot_ms;
+	unsigned int send_cnt = 1;
+	unsigned int rounds = 1;
+	unsigned int i;
+	struct ser4010_dev_config cfg;
+	unsigned long frame_us;
+	struct timespec now, when;
+	uint64_t slot_ns, now_ns;
+	struct ser4010_send_timing timing;
+
+	if (argc < 2 || argc > 4) {
+		printf("Command takes one to three arguments\n");
+		return;
+	}
+	slot_ms = strtoul(argv[1], &endptr, 0);
+	if (*endptr != '\0' || slot_ms == 0) {
+		printf("Argument 1 must be a positive integer number\n");
+		return;
+	}
+	if (argc > 2) {
+		send_cnt = strtoul(argv[2], &endptr, 0);
+		if (*endptr != '\0' || send_cnt == 0 || send_cnt >= 0x100) {
+			printf("Send count out-of-range(1-255)\n");
+			return;
+		}
+	}
+	if (argc > 3) {
+		rounds = strtoul(argv[3], &endptr, 0);
+		if (*endptr != '\0') {
+			printf("Argument 3 must be a integer number\n");
+			return;
+		}
+	}
+
+	if (sdev->frame_len < 0) {
+		printf("Frame content unknown, load a frame first\n");
+		return;
+	}
+	err = ser4010_get_all(sdev, &cfg);
+	if (err != STATUS_OK) {
+		fprintf(stderr, "Failed to get configuration: %d\n", err);
+		return;
+	}
+	frame_us = ser4010_frame_duration_us(&cfg.ods, cfg.enc,
+						sdev->frame_len);
+
+	slot_ns = slot_ms * 1000000ULL;
+	for (i = 0; i < rounds; i++) {
+		// Start of the slot after next, so there is time to calibrate
+		clock_gettime(CLOCK_REALTIME, &now);
+		now_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+		now_ns = (now_ns / slot_ns + 2) * slot_ns;
+		when.tv_sec = now_ns / 1000000000ULL;
+		when.tv_nsec = now_ns % 1000000000ULL;
+
+		err = ser4010_send_at(sdev, &when, send_cnt, frame_us, &timing);
+		if (err != STATUS_OK) {
+			fprintf(stderr, "ser4010_send_at() Failed: %d\n", err);
+			return;
+		}
+		printf("%lld.%06ld: error %+.3f ms, latency %.3f ms, "
+				"jitter %.3f ms\n",
+				(long long) when.tv_sec, when.tv_nsec / 1000,
+				timing.error_us / 1000.0,
+				timing.latency_us / 1000.0,
+				timing.jitter_us / 1000.0);
+	}
+}
+
+void cmd_profile(struct serco *sdev, size_t argc, char **argv)
+{
+	int err;
+	struct ser4010_profile_cache cache;
+
+	if (argc != 2) {
+		printf("Command takes one argument\n");
+		return;
+	}
+
+	if (ser4010_profile_open(&cache, NULL) != 0) {
+		perror("Failed to open profile cache");
+		return;
+	}
+
+	err = ser4010_apply_profile(sdev, &cache, argv[1]);
+	if (err == EINVAL) {
+		printf("No profile named '%s'\n", argv[1]);
+	} else if (err != STATUS_OK) {
+		fprintf(stderr, "ser4010_apply_profile() Failed: %d\n", err);
+	}
+
+	ser4010_profile_close(&cache);
+}
+
 void cmd_config(struct serco *sdev, size_t argc, char **argv)
 {
 	int err;
@@ -531,6 +584,7 @@ void cmd_config(struct serco *sdev, size_t argc, char **argv)
 	enum Ser4010Encoding encoding;
 	double data_rate_kbps;
 	int bits_per_byte;
+	struct ser4010_radio_config cfg;
 
 	if (argc != 7) {
 		printf("Command takes 7 arguments\n");
@@ -609,14 +663,18 @@ void cmd_config(struct serco *sdev, size_t argc, char **argv)
 		return;
 	}
 
-	err = ser4010_config(sdev, freq_mhz, fdev_khz, modulation, encoding,
-			data_rate_kbps, bits_per_byte);
+	err = ser4010_calc_config(&cfg, freq_mhz, fdev_khz, modulation,
+			encoding, data_rate_kbps, bits_per_byte);
+	if (err == STATUS_OK) {
+		err = ser4010_apply_config(sdev, &cfg);
+	}
 	if (err != STATUS_OK) {
-		fprintf(stderr, "ser4010_send() Failed: %d\n", err);
+		fprintf(stderr, "ser4010_config() Failed: %d\n", err);
 		return;
 	}
 
-	// TODO: maybe read back what is actually configured? This doesn't have to match the requested parameters...
+	printf("Symbol rate: %.4f ksym/s (error %+.3f%%)\n",
+			cfg.sym_rate_ksym_sec, cfg.rate_error * 100);
 }
 
 void cmd_ping(struct serco *sdev, size_t argc, char **argv)
@@ -642,32 +700,41 @@ void cmd_info(struct serco *sdev, size_t argc, char **argv)
 	UNUSED(argc);
 	UNUSED(argv);
 	int err;
-	uint16_t dev_type;
-	uint16_t dev_rev;
-
-	err = ser4010_get_dev_type(sdev, &dev_type);
-	if (err) {
-		fprintf(stderr, "Failed to obtain device type: err %d\n", err);
-		return;
-	}
+	struct ser4010_dev_config cfg;
 
-	err = ser4010_get_dev_rev(sdev, &dev_rev);
+	err = ser4010_get_all(sdev, &cfg);
 	if (err) {
-		fprintf(stderr, "Failed to obtain device revision: err %d\n", err);
+		fprintf(stderr, "Failed to obtain device info: err %d\n", err);
 		return;
 	}
 
-	printf("Device type: 0x%04x\n", dev_type);
-	if (dev_type != SER4010_DEV_TYPE) {
+	printf("Device type: 0x%04x\n", cfg.dev_type);
+	if (cfg.dev_type != SER4010_DEV_TYPE) {
 		printf("ERROR: Device is not a Ser4010 device!\n");
 	}
 
-	printf("Device revision: 0x%04x\n", dev_rev);
-	if (dev_rev != SER4010_DEV_REV) {
+	printf("Device revision: 0x%04x\n", cfg.dev_rev);
+	if (cfg.dev_rev != SER4010_DEV_REV) {
 		printf("Warning: Revision mismatch with compiled tool\n");
 	}
 }
 
+void cmd_stats(struct serco *sdev, size_t argc, char **argv)
+{
+	struct serco_stats stats;
+
+	if (argc == 2 && strcasecmp(argv[1], "reset") == 0) {
+		serco_reset_stats(sdev);
+		return;
+	} else if (argc != 1) {
+		printf("Usage: stats [reset]\n");
+		return;
+	}
+
+	serco_get_stats(sdev, &stats);
+	serco_stats_print(stdout, &stats);
+}
+
 void cmd_help(struct serco *sdev, size_t argc, char **argv)
 {
 	UNUSED(sdev);
@@ -684,6 +751,9 @@ void cmd_help(struct serco *sdev, size_t argc, char **argv)
 " config <freq_MHz> <fdev_kHz> <OOK|FSK> <encoding> <rate_kbps> <bits_per_byte>\n"
 "   High level device configuration interface\n"
 "\n"
+" profile <name>\n"
+"   Configure device with a radio profile, see ser4010_profile.\n"
+"\n"
 " pa <fAlpha> <fBeta> <bLevel> <bMaxDrv> <wNominalCap>\n"
 "   Configure the Power Amplifier.\n"
 "   If no parameters supplied current settings are printed.\n"
@@ -714,9 +784,17 @@ void cmd_help(struct serco *sdev, size_t argc, char **argv)
 " send [N]\n"
 "   Transmit one, or if provided N, frame(s).\n"
 "\n"
+" send_at <slot_ms> [N] [rounds]\n"
+"   Transmit one, or N, frame(s) at the start of a wall clock time slot, and\n"
+"   print the predicted timing error. Repeated for the given number of\n"
+"   rounds.\n"
+"\n"
 " ping\n"
 "   Test if device is responding.\n"
 "\n"
+" stats [reset]\n"
+"   Print or clear communication statistics.\n"
+"\n"
 " help <command>\n"
 "   Print this help message.\n"
 		);
@@ -729,9 +807,17 @@ void cmd_help(struct serco *sdev, size_t argc, char **argv)
 	} else if (strcasecmp(argv[1], "encoding") == 0) {
 	} else if (strcasecmp(argv[1], "frame") == 0) {
 	} else if (strcasecmp(argv[1], "send") == 0) {
+	} else if (strcasecmp(argv[1], "send_at") == 0) {
+		printf("The latency of the device is compensated for, and "
+				"calibrated every\nround. The first round is "
+				"less accurate.\n");
 	} else if (strcasecmp(argv[1], "ping") == 0) {
 		printf("Sends a No-operation command to device and checks "
 				"response.\n");
+	} else if (strcasecmp(argv[1], "stats") == 0) {
+		printf("Prints bytes and frames transferred, errors, and the "
+				"response\nlatency per command since the start "
+				"of the console, or the last\n'stats reset'.\n");
 	} else {
 		printf("No help available for that command.\n");
 	}
@@ -740,10 +826,11 @@ void cmd_help(struct serco *sdev, size_t argc, char **argv)
 int check_device(struct serco *sdev)
 {
 	int err;
-	uint16_t dev_type;
-	uint16_t dev_rev;
+	struct ser4010_dev_config cfg;
 
-	err = serco_send_command(sdev, CMD_NOP, NULL, 0, NULL, 0);
+	// Also checks communication and reads the configuration, so later
+	// partial configuration updates are a single round trip
+	err = ser4010_get_all(sdev, &cfg);
 	if (err != STATUS_OK) {
 		printf("Unable to communicate with device");
 		if (err > 0) {
@@ -754,23 +841,12 @@ int check_device(struct serco *sdev)
 		return 1;
 	}
 
-	err = ser4010_get_dev_type(sdev, &dev_type);
-	if (err) {
-		fprintf(stderr, "Failed to obtain device type: err %d\n", err);
+	if (cfg.dev_type != SER4010_DEV_TYPE) {
+		fprintf(stderr, "Incorrect device type: %d\n", cfg.dev_type);
 		return 1;
 	}
-	if (dev_type != SER4010_DEV_TYPE) {
-		fprintf(stderr, "Incorrect device type: %d\n", dev_type);
-		return 1;
-	}
-
-	err = ser4010_get_dev_rev(sdev, &dev_rev);
-	if (err) {
-		fprintf(stderr, "Failed to obtain device revision: err %d\n", err);
-		return 1;
-	}
-	if (dev_rev != SER4010_DEV_REV) {
-		fprintf(stderr, "Incorrect device revision: %d\n", dev_rev);
+	if (cfg.dev_rev < MIN_DEV_REV) {
+		fprintf(stderr, "Unsupported device revision: %d\n", cfg.dev_rev);
 		return 1;
 	}
 
@@ -782,6 +858,7 @@ int main(int argc, char *argv[])
 	int opt;
 
 	char *dev_path;
+	unsigned int reconnect_ms = 0;
 
 	struct serco sdev;
 
@@ -793,12 +870,15 @@ int main(int argc, char *argv[])
 	// Default device path
 	dev_path = strdup(DEFAULT_SERIAL_DEV);
 
-	while ((opt = getopt(argc, argv, "d:h")) != -1) {
+	while ((opt = getopt(argc, argv, "d:r:h")) != -1) {
 		switch (opt) {
 		case 'd':
 			free(dev_path);
 			dev_path = strdup(optarg);
 			break;
+		case 'r':
+			reconnect_ms = strtoul(optarg, NULL, 0);
+			break;
 		case 'h':
 			usage(argv[0]);
 			exit(EXIT_SUCCESS);
@@ -817,6 +897,7 @@ int main(int argc, char *argv[])
 	if (check_device(&sdev) != 0) {
 		exit(EXIT_FAILURE);
 	}
+	ser4010_set_reconnect(&sdev, reconnect_ms);
 
 	printf("Connected to device %s\n", dev_path);
 
@@ -850,6 +931,8 @@ int main(int argc, char *argv[])
 			cmd_config(&sdev, line_argc, line_argv);
 		} else if (strcasecmp(line_argv[0], "ping") == 0) {
 			cmd_ping(&sdev, line_argc, line_argv);
+		} else if (strcasecmp(line_argv[0], "profile") == 0) {
+			cmd_profile(&sdev, line_argc, line_argv);
 		} else if (strcasecmp(line_argv[0], "pa") == 0) {
 			cmd_pa(&sdev, line_argc, line_argv);
 		} else if (strcasecmp(line_argv[0], "ods") == 0) {
@@ -864,6 +947,10 @@ int main(int argc, char *argv[])
 			cmd_frame(&sdev, line_argc, line_argv);
 		} else if (strcasecmp(line_argv[0], "send") == 0) {
 			cmd_send(&sdev, line_argc, line_argv);
+		} else if (strcasecmp(line_argv[0], "send_at") == 0) {
+			cmd_send_at(&sdev, line_argc, line_argv);
+		} else if (strcasecmp(line_argv[0], "stats") == 0) {
+			cmd_stats(&sdev, line_argc, line_argv);
 		} else {
 			printf("Unknown command\n");
 		}
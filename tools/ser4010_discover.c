@@ -0,0 +1,140 @@
+/**
+ * ser4010_discover.c - List SER4010 modules on serial ports
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "serco_defines.h"
+#include "ser4010_discover.h"
+
+#define MAX_MODULES	16
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] [port...]\n"
+		"\n"
+		"List SER4010 modules. Without ports, all USB serial ports are\n"
+		"probed. Ports are probed in parallel, and only if not found in\n"
+		"the discovery cache. Ports in use by other tools are skipped.\n"
+		"\n"
+		"Options:\n"
+		" -c <path>	Discovery cache file (default: %s)\n"
+		" -f		Probe all ports and update the cache\n"
+		" -n		Don't read or write the cache\n"
+		" -t <ms>	Time-out per probe command (default: %d)\n"
+		" -p		Only print the path of the first module, eg. for\n"
+		"		'ser4010_dump -d $(%s -p)'\n"
+		" -h		Print this help message\n"
+		"\n"
+		"Output has one module per line: path, USB serial number, device\n"
+		"revision, and whether the result came from the cache.\n"
+		, name, ser4010_discover_default_path(),
+		SER4010_DISCOVER_TIMEOUT_MS, name);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	const char *cache_path = NULL;
+	unsigned int timeout_ms = SER4010_DISCOVER_TIMEOUT_MS;
+	unsigned int flags = 0;
+	bool path_only = false;
+	struct ser4010_module mods[MAX_MODULES];
+	int cnt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "c:fnt:ph")) != -1) {
+		switch (opt) {
+		case 'c':
+			cache_path = optarg;
+			break;
+		case 'f':
+			flags |= SER4010_DISCOVER_REFRESH;
+			break;
+		case 'n':
+			flags |= SER4010_DISCOVER_NO_CACHE;
+			break;
+		case 't':
+			timeout_ms = strtoul(optarg, NULL, 0);
+			if (timeout_ms == 0) {
+				fprintf(stderr, "Invalid time-out\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'p':
+			path_only = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	cnt = ser4010_discover(mods, MAX_MODULES,
+			(optind < argc) ? (const char * const *) &argv[optind] : NULL,
+			cache_path, timeout_ms, flags);
+	if (cnt < 0) {
+		perror("ser4010_discover() failed");
+		exit(EXIT_FAILURE);
+	}
+	if (cnt == 0) {
+		fprintf(stderr, "No SER4010 modules found\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (path_only) {
+		printf("%s\n", mods[0].path);
+		return 0;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		printf("%s\t%s\t0x%04x%s\n", mods[i].path,
+				(mods[i].serial[0] != '\0') ? mods[i].serial : "-",
+				mods[i].dev_rev,
+				mods[i].cached ? "\t(cached)" : "");
+		if (mods[i].dev_rev != SER4010_DEV_REV) {
+			fprintf(stderr, "Warning: %s has firmware revision %u, "
+					"tools expect %u\n", mods[i].path,
+					mods[i].dev_rev, SER4010_DEV_REV);
+		}
+	}
+
+	return 0;
+}
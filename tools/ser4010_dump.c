@@ -47,6 +47,7 @@ void usage(const char *name)
 		"\n"
 		"Options:\n"
 		" -d <path>	Path to serial device file\n"
+		" -s		Print communication statistics\n"
 		" -h		Print this help message\n"
 		, name);
 }
@@ -81,22 +82,21 @@ int main(int argc, char *argv[])
 	struct serco sdev;
 	int ret;
 	int retval = EXIT_SUCCESS;
+	bool print_stats = false;
 
-	uint16_t dev_type;
-	uint16_t dev_rev;
-	tOds_Setup ods_data;
-	tPa_Setup pa_data;
-	enum Ser4010Encoding enc;
-	float freq;
-	uint8_t fdev;
+	struct ser4010_dev_config cfg;
+	struct serco_stats stats;
 
 	dev_path = DEFAULT_SERIAL_DEV;
 
-	while ((opt = getopt(argc, argv, "d:h")) != -1) {
+	while ((opt = getopt(argc, argv, "d:sh")) != -1) {
 		switch (opt) {
 		case 'd':
 			dev_path = optarg;
 			break;
+		case 's':
+			print_stats = true;
+			break;
 		case 'h':
 			usage(argv[0]);
 			exit(EXIT_SUCCESS);
@@ -117,21 +117,10 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	ret = ser4010_get_dev_type(&sdev, &dev_type);
-	if (ret != STATUS_OK) {
-		if (ret > 0) {
-			fprintf(stderr, "ser4010_get_dev_type(): "
-				"Result status indicates error 0x%.2x\n",
-				ret);
-		}
-		retval = EXIT_FAILURE;
-		goto bad;
-	}
-
-	ret = ser4010_get_dev_rev(&sdev, &dev_rev);
+	ret = ser4010_get_all(&sdev, &cfg);
 	if (ret != STATUS_OK) {
 		if (ret > 0) {
-			fprintf(stderr, "ser4010_get_dev_rev(): "
+			fprintf(stderr, "ser4010_get_all(): "
 				"Result status indicates error 0x%.2x\n",
 				ret);
 		}
@@ -139,85 +128,46 @@ int main(int argc, char *argv[])
 		goto bad;
 	}
 
-	ret = ser4010_get_ods(&sdev, &ods_data);
-	if (ret != STATUS_OK) {
-		if (ret > 0) {
-			fprintf(stderr, "Result status indicates error 0x%.2x\n", ret);
-		}
-		retval = EXIT_FAILURE;
-		goto bad;
-	}
-
-	ret = ser4010_get_pa(&sdev, &pa_data);
-	if (ret != STATUS_OK) {
-		if (ret > 0) {
-			fprintf(stderr, "Result status indicates error 0x%.2x\n", ret);
-		}
-		retval = EXIT_FAILURE;
-		goto bad;
-	}
-
-	ret = ser4010_get_enc(&sdev, &enc);
-	if (ret != STATUS_OK) {
-		if (ret > 0) {
-			fprintf(stderr, "ser4010_get_enc(): "
-				"Result status indicates error 0x%.2x\n", ret);
-		}
-		retval = EXIT_FAILURE;
-		goto bad;
-	}
-
-	ret = ser4010_get_freq(&sdev, &freq);
-	if (ret != STATUS_OK) {
-		if (ret > 0) {
-			fprintf(stderr, "Result status indicates error 0x%.2x\n", ret);
-		}
-		retval = EXIT_FAILURE;
-		goto bad;
-	}
-
-	ret = ser4010_get_fdev(&sdev, &fdev);
-	if (ret != STATUS_OK) {
-		if (ret > 0) {
-			fprintf(stderr, "Result status indicates error 0x%.2x\n", ret);
-		}
-		retval = EXIT_FAILURE;
-		goto bad;
-	}
-
 	printf("Device Info:\n");
 	printf("------------\n");
-	printf("Device Type: 0x%04hx\n", dev_type);
-	printf("Device Revision: %hu\n", dev_rev);
+	printf("Device Type: 0x%04hx\n", cfg.dev_type);
+	printf("Device Revision: %hu\n", cfg.dev_rev);
 	printf("\n");
 	printf("ODS settings:\n");
 	printf("------------\n");
-	printf("bModulationType: %s (%u)\n", modulation_type_to_str(ods_data.bModulationType), ods_data.bModulationType);
-	printf("bClkDiv: %u\n", ods_data.bClkDiv);
-	printf("bEdgeRate: %u\n", ods_data.bEdgeRate);
-	printf("bGroupWidth: %u\n", ods_data.bGroupWidth);
-	printf("wBitRate: %u\n", ods_data.wBitRate);
-	printf("bLcWarmInt: %u\n", ods_data.bLcWarmInt);
-	printf("bDivWarmInt: %u\n", ods_data.bDivWarmInt);
-	printf("bPaWarmInt: %u\n", ods_data.bPaWarmInt);
+	printf("bModulationType: %s (%u)\n", modulation_type_to_str(cfg.ods.bModulationType), cfg.ods.bModulationType);
+	printf("bClkDiv: %u\n", cfg.ods.bClkDiv);
+	printf("bEdgeRate: %u\n", cfg.ods.bEdgeRate);
+	printf("bGroupWidth: %u\n", cfg.ods.bGroupWidth);
+	printf("wBitRate: %u\n", cfg.ods.wBitRate);
+	printf("bLcWarmInt: %u\n", cfg.ods.bLcWarmInt);
+	printf("bDivWarmInt: %u\n", cfg.ods.bDivWarmInt);
+	printf("bPaWarmInt: %u\n", cfg.ods.bPaWarmInt);
 	printf("\n");
 	printf("PA settings:\n");
 	printf("------------\n");
-	printf("fAlpha: %f\n", pa_data.fAlpha);
-	printf("fBeta: %f\n", pa_data.fBeta);
-	printf("bLevel: %u\n", pa_data.bLevel);
-	printf("bMaxDrv: %u\n", pa_data.bMaxDrv);
-	printf("wNominalCap: %u\n", pa_data.wNominalCap);
+	printf("fAlpha: %f\n", cfg.pa.fAlpha);
+	printf("fBeta: %f\n", cfg.pa.fBeta);
+	printf("bLevel: %u\n", cfg.pa.bLevel);
+	printf("bMaxDrv: %u\n", cfg.pa.bMaxDrv);
+	printf("wNominalCap: %u\n", cfg.pa.wNominalCap);
 	printf("\n");
 	printf("Encoder settings:\n");
 	printf("------------\n");
-	printf("Encoding: %s (%u)\n", encoding_to_str(enc), enc);
+	printf("Encoding: %s (%u)\n", encoding_to_str(cfg.enc), cfg.enc);
 	printf("\n");
 	printf("Freq settings:\n");
 	printf("------------\n");
-	printf("frequency: %f\n", freq);
-	printf("freq. deviation: %u\n", fdev);
+	printf("frequency: %f\n", cfg.freq);
+	printf("freq. deviation: %u\n", cfg.fdev);
 bad:
+	if (print_stats) {
+		printf("\n");
+		printf("Communication statistics:\n");
+		printf("------------\n");
+		serco_get_stats(&sdev, &stats);
+		serco_stats_print(stdout, &stats);
+	}
 	serco_close(&sdev);
 	return retval;
 }
@@ -0,0 +1,1081 @@
+/**
+ * ser4010_emu.c - Emulate a SER4010 device on a pseudo terminal
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <endian.h>
+
+#include "serco_defines.h"
+
+#define FIFO_USABLE	3	// Firmware RX FIFO has 4 bytes, 3 usable
+#define MAX_FRAME_SIZE	256
+#define IN_BUF_SIZE	4096
+#define BYTE_US		(10 * 1000000.0 / 9600)	// Serial byte time
+#define TX_SETUP_US	10000	// Tuning etc. before transmitting
+#define TX_RETUNE_US	2000	// Tuning between frequencies of a sweep
+
+/**
+ * Emulated device state
+ *
+ * Configuration is stored in the same byte order as on the device, so it can
+ * be returned as is.
+ */
+struct emu {
+	int fd;			// PTY master
+	int slave_fd;		// Kept open so master doesn't see hangups
+	bool verbose;
+	double time_scale;	// Multiplier for emulated RF time, 0 = instant
+	uint16_t dev_rev;
+
+	uint8_t ods[9];
+	uint8_t pa[12];
+	uint8_t freq[4];
+	uint8_t fdev;
+	uint8_t enc;
+	uint8_t frame[MAX_FRAME_SIZE];
+	unsigned int frame_len;
+
+	// Unprocessed received bytes
+	uint8_t in[IN_BUF_SIZE];
+	size_t in_len;
+
+	// Command frame parser state
+	uint8_t cmd[256];
+	unsigned int cmd_len;
+	bool stuff_first;
+	bool comm_error;
+	bool has_crc;		// Frame ended with CRC end-of-frame marker
+	uint8_t last_id;
+	struct timespec rx_time;	// Time bytes were last received
+
+	// Result of commands without response, see CMD_SYNC
+	uint8_t sync_status;
+	uint8_t sync_id;
+	uint16_t sync_cnt;
+
+	// Fault injection, every n'th response. 0 is disabled.
+	unsigned long corrupt_every;
+	unsigned long dup_every;
+	unsigned long flip_every;
+	unsigned long responses;
+	unsigned long frames;
+
+	// Statistics
+	unsigned long rx_bytes;
+	unsigned long tx_bytes;
+	unsigned long dropped_bytes;
+	unsigned long commands;
+	unsigned long rf_frames;
+	unsigned long crc_errors;
+};
+
+static volatile sig_atomic_t terminate = 0;
+
+static void sig_handler(int sig)
+{
+	(void) sig;
+	terminate = 1;
+}
+
+static void emu_init_state(struct emu *emu)
+{
+	const uint8_t ods[9] = { 0, 5, 0, 7, 2416 >> 8, 2416 & 0xff, 8, 5, 4 };
+	const uint8_t pa[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 60, 0, 0x01, 0x00 };
+	union {
+		float f;
+		uint32_t i;
+	} freq;
+
+	memcpy(emu->ods, ods, sizeof(ods));
+	memcpy(emu->pa, pa, sizeof(pa));
+	freq.f = 433.9e6;
+	freq.i = htobe32(freq.i);
+	memcpy(emu->freq, &freq.i, sizeof(emu->freq));
+	emu->fdev = 104;
+	emu->enc = 0;
+	emu->frame_len = 0;
+}
+
+/**
+ * Duration of sending the loaded frame once in microseconds
+ */
+static double frame_duration_us(const struct emu *emu)
+{
+	unsigned int clk_div = (emu->ods[1] & 0x7) + 1;
+	unsigned int width = (emu->ods[3] & 0x7) + 1;
+	unsigned int bit_rate = ((emu->ods[4] << 8) | emu->ods[5]) & 0x7fff;
+	double bit_us = bit_rate * clk_div / 24.0;
+	double symbols = (double) emu->frame_len * width;
+
+	if (emu->enc == 1) {
+		symbols *= 2;		// Manchester
+	} else if (emu->enc == 2) {
+		symbols = symbols * 5 / 4;	// 4b5b
+	}
+
+	return symbols * bit_us;
+}
+
+/**
+ * Read available bytes from the PTY
+ *
+ * @param timeout	Max. time to wait for data, NULL is infinite
+ * @param max_bytes	Max. number of bytes to keep, the rest is dropped
+ *
+ * @returns	Number of bytes read, or -1 on error
+ */
+static ssize_t emu_read(struct emu *emu, const struct timespec *timeout,
+			size_t max_bytes)
+{
+	struct pollfd pfd;
+	uint8_t buf[IN_BUF_SIZE];
+	ssize_t ret;
+	size_t keep;
+
+	pfd.fd = emu->fd;
+	pfd.events = POLLIN;
+	ret = ppoll(&pfd, 1, timeout, NULL);
+	if (ret <= 0) {
+		return (ret < 0 && errno != EINTR) ? -1 : 0;
+	}
+
+	ret = read(emu->fd, buf, sizeof(buf));
+	if (ret < 0) {
+		// EIO happens when no client has the slave open
+		return (errno == EINTR || errno == EAGAIN || errno == EIO) ? 0 : -1;
+	}
+	emu->rx_bytes += ret;
+	clock_gettime(CLOCK_MONOTONIC, &emu->rx_time);
+
+	keep = ret;
+	if (keep > max_bytes) {
+		keep = max_bytes;
+	}
+	if (keep > sizeof(emu->in) - emu->in_len) {
+		keep = sizeof(emu->in) - emu->in_len;
+	}
+	memcpy(&emu->in[emu->in_len], buf, keep);
+	emu->in_len += keep;
+
+	if (keep < (size_t) ret) {
+		emu->dropped_bytes += ret - keep;
+		if (emu->verbose) {
+			fprintf(stderr, "RX FIFO overflow, dropped %zu bytes\n",
+					ret - keep);
+		}
+	}
+
+	return ret;
+}
+
+static void emu_write(struct emu *emu, const uint8_t *buf, size_t len)
+{
+	size_t wlen = 0;
+	ssize_t ret;
+	double wire_us = len * BYTE_US * emu->time_scale;
+	struct timespec ts;
+
+	// The firmware busy waits while sending, so nothing is received
+	ts.tv_sec = wire_us / 1000000;
+	ts.tv_nsec = (wire_us - ts.tv_sec * 1000000.0) * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR && !terminate)
+		;
+
+	while (wlen < len) {
+		ret = write(emu->fd, &buf[wlen], len - wlen);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("write() failed");
+			return;
+		}
+		wlen += ret;
+	}
+	emu->tx_bytes += len;
+}
+
+/**
+ * Compute the time remaining until a CLOCK_MONOTONIC time
+ *
+ * @returns	true if the time lies in the future
+ */
+static bool time_until(const struct timespec *end, struct timespec *remaining)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	remaining->tv_sec = end->tv_sec - now.tv_sec;
+	remaining->tv_nsec = end->tv_nsec - now.tv_nsec;
+	if (remaining->tv_nsec < 0) {
+		remaining->tv_sec--;
+		remaining->tv_nsec += 1000000000L;
+	}
+
+	return remaining->tv_sec > 0 ||
+		(remaining->tv_sec == 0 && remaining->tv_nsec > 0);
+}
+
+static void timespec_add_us(struct timespec *ts, double us)
+{
+	ts->tv_sec += (time_t) (us / 1000000);
+	ts->tv_nsec += (long) ((us - (time_t) (us / 1000000) * 1000000.0) * 1000);
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * Spend time without running the command parser
+ *
+ * Bytes received in the meantime only fill the small firmware RX FIFO.
+ * Anything beyond that is dropped. The emulator may be scheduled late, so
+ * bytes found after end are left to the command parser, since they may have
+ * arrived after the firmware would have been done.
+ *
+ * @param end	CLOCK_MONOTONIC time the firmware would be done
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int emu_busy(struct emu *emu, const struct timespec *end)
+{
+	const struct timespec no_wait = { 0, 0 };
+	struct timespec remaining;
+	struct pollfd pfd;
+	int ret;
+
+	while (!terminate) {
+		size_t fifo_free = (emu->in_len < FIFO_USABLE) ?
+					FIFO_USABLE - emu->in_len : 0;
+
+		if (!time_until(end, &remaining)) {
+			break;
+		}
+
+		pfd.fd = emu->fd;
+		pfd.events = POLLIN;
+		ret = ppoll(&pfd, 1, &remaining, NULL);
+		if (ret < 0 && errno != EINTR) {
+			return -1;
+		}
+		if (ret <= 0 || !time_until(end, &remaining)) {
+			continue;
+		}
+
+		if (emu_read(emu, &no_wait, fifo_free) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Emulate RF transmission of loaded frame
+ *
+ * While transmitting, bytes received on the serial port only fill the small
+ * firmware RX FIFO. Anything beyond that is dropped.
+ *
+ * @param max_cnt	Number of frames to send
+ * @param stop_on_rx	Stop when a byte is received, like CMD_RF_SEND_START
+ *
+ * @returns	Number of frames sent
+ */
+static unsigned int emu_transmit(struct emu *emu, unsigned int max_cnt,
+				bool stop_on_rx)
+{
+	double frame_us = frame_duration_us(emu) * emu->time_scale;
+	unsigned int cnt = 0;
+	struct timespec end;
+
+	// The firmware starts right after receiving the command
+	end = emu->rx_time;
+	timespec_add_us(&end, TX_SETUP_US * emu->time_scale);
+	if (emu_busy(emu, &end) < 0) {
+		return 0;
+	}
+	if (emu->verbose) {
+		struct timespec mono, real;
+		long long first_ns;
+
+		// Wall clock time of the first bit, for checking scheduling
+		clock_gettime(CLOCK_MONOTONIC, &mono);
+		clock_gettime(CLOCK_REALTIME, &real);
+		first_ns = real.tv_sec * 1000000000LL + real.tv_nsec -
+			((mono.tv_sec - end.tv_sec) * 1000000000LL +
+			 (mono.tv_nsec - end.tv_nsec));
+		fprintf(stderr, "First bit at %lld.%06lld\n",
+				first_ns / 1000000000LL,
+				(first_ns % 1000000000LL) / 1000);
+	}
+
+	while (cnt < max_cnt && !terminate) {
+		if (stop_on_rx && emu->in_len > 0) {
+			break;
+		}
+
+		timespec_add_us(&end, frame_us);
+		if (emu_busy(emu, &end) < 0) {
+			return cnt;
+		}
+
+		cnt++;
+		emu->rf_frames++;
+	}
+
+	if (emu->verbose) {
+		fprintf(stderr, "Sent %u frames of %u bytes, %.1f ms each\n",
+				cnt, emu->frame_len, frame_duration_us(emu) / 1000);
+	}
+
+	return cnt;
+}
+
+/**
+ * Convert big-endian float, as used for frequencies
+ */
+static float befloat(const uint8_t *buf)
+{
+	union {
+		float f;
+		uint32_t i;
+	} v;
+
+	memcpy(&v.i, buf, sizeof(v.i));
+	v.i = be32toh(v.i);
+
+	return v.f;
+}
+
+/**
+ * Emulate CMD_RF_SWEEP
+ *
+ * @param freqs	Range or list of big-endian frequencies
+ * @param hops	Number of frequencies in list
+ *
+ * @returns	Number of frequencies completed
+ */
+static unsigned int emu_sweep(struct emu *emu, uint8_t mode,
+				const uint8_t *freqs, unsigned int hops,
+				uint8_t dwell)
+{
+	double frame_us = frame_duration_us(emu) * emu->time_scale;
+	float start = 0, stop = 0, step = 0;
+	float freq;
+	unsigned int cnt = 0;
+	struct timespec end;
+
+	if (mode == SWEEP_MODE_RANGE) {
+		start = befloat(&freqs[0]);
+		stop = befloat(&freqs[4]);
+		step = befloat(&freqs[8]);
+	}
+
+	end = emu->rx_time;
+	while (cnt < 0xffff && !terminate && emu->in_len == 0) {
+		if (mode == SWEEP_MODE_RANGE) {
+			freq = start + cnt * step;
+			if (freq >= stop) {
+				break;
+			}
+		} else {
+			if (cnt == hops) {
+				break;
+			}
+			freq = befloat(&freqs[cnt * 4]);
+		}
+
+		timespec_add_us(&end, ((cnt == 0) ? TX_SETUP_US : TX_RETUNE_US) *
+					emu->time_scale + dwell * frame_us);
+		if (emu_busy(emu, &end) < 0) {
+			break;
+		}
+		if (emu->verbose) {
+			fprintf(stderr, "Sent %u frames at %.0f Hz\n", dwell, freq);
+		}
+
+		cnt++;
+		emu->rf_frames += dwell;
+	}
+
+	return cnt;
+}
+
+static bool check_send_cookie(const uint8_t *payload)
+{
+	return (payload[0] == SEND_COOKIE_0 && payload[1] == SEND_COOKIE_1 &&
+		payload[2] == SEND_COOKIE_2 && payload[3] == SEND_COOKIE_3);
+}
+
+/**
+ * Set configuration item, checking the length like the firmware does
+ */
+static uint8_t set_item(uint8_t *item, size_t item_len,
+			const uint8_t *payload, size_t len)
+{
+	if (len != item_len) {
+		return STATUS_INVALID_FRAME_LEN;
+	}
+	memcpy(item, payload, len);
+
+	return STATUS_OK;
+}
+
+/**
+ * Execute a command
+ *
+ * @returns	Response status
+ */
+static uint8_t emu_execute(struct emu *emu, const uint8_t *cmd, size_t cmd_len,
+				uint8_t *res, size_t *res_len)
+{
+	const uint8_t *payload = &cmd[CMD_PAYLOAD];
+	size_t len = cmd_len - CMD_PAYLOAD;
+	unsigned int cnt;
+
+	*res_len = 0;
+
+	switch (cmd[CMD_OPCODE]) {
+	case CMD_NOP:
+		return STATUS_OK;
+	case CMD_DEV_TYPE:
+		res[0] = SER4010_DEV_TYPE >> 8;
+		res[1] = SER4010_DEV_TYPE & 0xff;
+		*res_len = 2;
+		return STATUS_OK;
+	case CMD_SYNC:
+		if (emu->dev_rev < 7) {
+			break;
+		}
+		res[SYNC_STATUS] = emu->sync_status;
+		res[SYNC_ID] = emu->sync_id;
+		res[SYNC_CNT] = emu->sync_cnt >> 8;
+		res[SYNC_CNT + 1] = emu->sync_cnt & 0xff;
+		*res_len = SYNC_RES_LEN;
+		emu->sync_status = STATUS_OK;
+		emu->sync_id = 0;
+		emu->sync_cnt = 0;
+		return STATUS_OK;
+	case CMD_DEV_REV:
+		res[0] = emu->dev_rev >> 8;
+		res[1] = emu->dev_rev & 0xff;
+		*res_len = 2;
+		return STATUS_OK;
+	case CMD_GET_ALL:
+		if (emu->dev_rev < 8) {
+			break;
+		}
+		res[ALL_DEV_TYPE] = SER4010_DEV_TYPE >> 8;
+		res[ALL_DEV_TYPE + 1] = SER4010_DEV_TYPE & 0xff;
+		res[ALL_DEV_REV] = emu->dev_rev >> 8;
+		res[ALL_DEV_REV + 1] = emu->dev_rev & 0xff;
+		res[ALL_CFG + CFG_VERSION] = CFG_BLOCK_VERSION;
+		res[ALL_CFG + CFG_LEN] = CFG_BLOCK_LEN;
+		memcpy(&res[ALL_CFG + CFG_ODS], emu->ods, sizeof(emu->ods));
+		memcpy(&res[ALL_CFG + CFG_PA], emu->pa, sizeof(emu->pa));
+		memcpy(&res[ALL_CFG + CFG_FREQ], emu->freq, sizeof(emu->freq));
+		res[ALL_CFG + CFG_FDEV] = emu->fdev;
+		res[ALL_CFG + CFG_ENC] = emu->enc;
+		*res_len = ALL_RES_LEN;
+		return STATUS_OK;
+	case CMD_SET_ALL:
+		if (emu->dev_rev < 8) {
+			break;
+		}
+		if (len != CFG_BLOCK_LEN) {
+			return STATUS_INVALID_FRAME_LEN;
+		} else if (payload[CFG_VERSION] != CFG_BLOCK_VERSION ||
+				payload[CFG_LEN] != CFG_BLOCK_LEN ||
+				payload[CFG_ENC] > 2) {
+			return STATUS_INVALID_ARGUMENT;
+		}
+		memcpy(emu->ods, &payload[CFG_ODS], sizeof(emu->ods));
+		memcpy(emu->pa, &payload[CFG_PA], sizeof(emu->pa));
+		memcpy(emu->freq, &payload[CFG_FREQ], sizeof(emu->freq));
+		emu->fdev = payload[CFG_FDEV];
+		emu->enc = payload[CFG_ENC];
+		return STATUS_OK;
+	case CMD_GET_ODS:
+		memcpy(res, emu->ods, sizeof(emu->ods));
+		*res_len = sizeof(emu->ods);
+		return STATUS_OK;
+	case CMD_SET_ODS:
+		return set_item(emu->ods, sizeof(emu->ods), payload, len);
+	case CMD_GET_PA:
+		memcpy(res, emu->pa, sizeof(emu->pa));
+		*res_len = sizeof(emu->pa);
+		return STATUS_OK;
+	case CMD_SET_PA:
+		return set_item(emu->pa, sizeof(emu->pa), payload, len);
+	case CMD_GET_FREQ:
+		memcpy(res, emu->freq, sizeof(emu->freq));
+		*res_len = sizeof(emu->freq);
+		return STATUS_OK;
+	case CMD_SET_FREQ:
+		return set_item(emu->freq, sizeof(emu->freq), payload, len);
+	case CMD_GET_FDEV:
+		res[0] = emu->fdev;
+		*res_len = 1;
+		return STATUS_OK;
+	case CMD_SET_FDEV:
+		return set_item(&emu->fdev, 1, payload, len);
+	case CMD_GET_ENC:
+		res[0] = emu->enc;
+		*res_len = 1;
+		return STATUS_OK;
+	case CMD_SET_ENC:
+		if (len != 1) {
+			return STATUS_INVALID_FRAME_LEN;
+		} else if (payload[0] > 2) {
+			return STATUS_INVALID_ARGUMENT;
+		}
+		emu->enc = payload[0];
+		return STATUS_OK;
+	case CMD_LOAD_FRAME:
+		emu->frame_len = len;
+		memcpy(emu->frame, payload, len);
+		return STATUS_OK;
+	case CMD_APPEND_FRAME:
+		if (MAX_FRAME_SIZE - emu->frame_len < len) {
+			return STATUS_TOO_MUCH_DATA;
+		}
+		memcpy(&emu->frame[emu->frame_len], payload, len);
+		emu->frame_len += len;
+		return STATUS_OK;
+	case CMD_PATCH_FRAME:
+		if (emu->dev_rev < 5) {
+			break;
+		}
+		if (len < 1) {
+			return STATUS_INVALID_FRAME_LEN;
+		} else if (payload[0] + (len - 1) > emu->frame_len) {
+			return STATUS_INVALID_ARGUMENT;
+		}
+		memcpy(&emu->frame[payload[0]], &payload[1], len - 1);
+		return STATUS_OK;
+	case CMD_RF_SEND:
+		if (len != 5) {
+			return STATUS_INVALID_FRAME_LEN;
+		} else if (!check_send_cookie(payload)) {
+			return STATUS_INVALID_SEND_COOKIE;
+		}
+		emu_transmit(emu, payload[4], false);
+		return STATUS_OK;
+	case CMD_RF_SEND_START:
+		if (emu->dev_rev < 4) {
+			break;
+		}
+		if (len != 6) {
+			return STATUS_INVALID_FRAME_LEN;
+		} else if (!check_send_cookie(payload)) {
+			return STATUS_INVALID_SEND_COOKIE;
+		}
+		cnt = (payload[4] << 8) | payload[5];
+		if (cnt == 0) {
+			return STATUS_INVALID_ARGUMENT;
+		}
+		cnt = emu_transmit(emu, cnt, true);
+		res[0] = cnt >> 8;
+		res[1] = cnt & 0xff;
+		*res_len = 2;
+		return STATUS_OK;
+	case CMD_RF_SWEEP:
+		if (emu->dev_rev < 9) {
+			break;
+		}
+		if (len < SWEEP_FREQS + 4) {
+			return STATUS_INVALID_FRAME_LEN;
+		} else if (!check_send_cookie(payload)) {
+			return STATUS_INVALID_SEND_COOKIE;
+		}
+		len -= SWEEP_FREQS;
+		if (payload[SWEEP_MODE] == SWEEP_MODE_RANGE) {
+			if (len != 12) {
+				return STATUS_INVALID_FRAME_LEN;
+			} else if (!(befloat(&payload[SWEEP_FREQS + 8]) > 0)) {
+				return STATUS_INVALID_ARGUMENT;
+			}
+		} else if (payload[SWEEP_MODE] == SWEEP_MODE_LIST) {
+			if (len % 4 != 0 || len > SWEEP_MAX_HOPS * 4) {
+				return STATUS_INVALID_FRAME_LEN;
+			}
+		} else {
+			return STATUS_INVALID_ARGUMENT;
+		}
+		if (payload[SWEEP_DWELL] == 0) {
+			return STATUS_INVALID_ARGUMENT;
+		}
+		cnt = emu_sweep(emu, payload[SWEEP_MODE], &payload[SWEEP_FREQS],
+				len / 4, payload[SWEEP_DWELL]);
+		res[0] = cnt >> 8;
+		res[1] = cnt & 0xff;
+		*res_len = SWEEP_RES_LEN;
+		return STATUS_OK;
+	}
+
+	return STATUS_UNKNOWN_CMD;
+}
+
+/**
+ * Calculate next CRC-8 state, bit-wise like the firmware
+ */
+static uint8_t crc8(uint8_t crc, uint8_t b)
+{
+	int i;
+
+	crc ^= b;
+	for (i = 0; i < 8; i++) {
+		if (crc & 0x80) {
+			crc = (crc << 1) ^ CRC8_POLY;
+		} else {
+			crc <<= 1;
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * Flip a bit in the n'th frame, if enabled
+ *
+ * The bit position is derived from the frame count, so runs are repeatable.
+ */
+static void flip_bit(struct emu *emu, uint8_t *frame, size_t len,
+			const char *what)
+{
+	size_t pos;
+
+	emu->frames++;
+	if (emu->flip_every == 0 || emu->frames % emu->flip_every != 0 ||
+	    len == 0) {
+		return;
+	}
+
+	pos = (emu->frames * 7) % len;
+	frame[pos] ^= 1 << (emu->frames % 8);
+	if (emu->verbose) {
+		fprintf(stderr, "Flipped bit %lu of %s byte %zu\n",
+				emu->frames % 8, what, pos);
+	}
+}
+
+static void emu_respond(struct emu *emu, uint8_t id, uint8_t status,
+			const uint8_t *res, size_t res_len, bool crc)
+{
+	uint8_t frame[2 + 256 + 1];
+	size_t frame_len = 0;
+	uint8_t buf[2 * sizeof(frame) + 2];
+	size_t len = 0;
+	size_t i;
+
+	frame[frame_len++] = id;
+	frame[frame_len++] = status;
+	memcpy(&frame[frame_len], res, res_len);
+	frame_len += res_len;
+	if (crc) {
+		uint8_t fcs = 0;
+
+		for (i = 0; i < frame_len; i++) {
+			fcs = crc8(fcs, frame[i]);
+		}
+		frame[frame_len++] = fcs;
+	}
+
+	// Line noise happens after the CRC is calculated
+	flip_bit(emu, frame, frame_len, "response");
+
+	for (i = 0; i < frame_len; i++) {
+		if (frame[i] == STUFF_BYTE1) {
+			buf[len++] = STUFF_BYTE1;
+		}
+		buf[len++] = frame[i];
+	}
+	buf[len++] = STUFF_BYTE1;
+	buf[len++] = crc ? STUFF_BYTE2_CRC : STUFF_BYTE2;
+
+	emu->responses++;
+	if (emu->corrupt_every && emu->responses % emu->corrupt_every == 0) {
+		// Invalid stuffing sequence, like a bit error on the line
+		buf[0] = STUFF_BYTE1;
+		buf[1] = 0x00;
+		if (emu->verbose) {
+			fprintf(stderr, "Corrupted response id=%.2x\n", id);
+		}
+	}
+
+	emu_write(emu, buf, len);
+
+	if (emu->dup_every && emu->responses % emu->dup_every == 0) {
+		if (emu->verbose) {
+			fprintf(stderr, "Duplicated response id=%.2x\n", id);
+		}
+		emu_write(emu, buf, len);
+	}
+}
+
+/**
+ * Account result of a command without response, for CMD_SYNC
+ */
+static void emu_sync_result(struct emu *emu, uint8_t id, uint8_t status)
+{
+	emu->sync_cnt++;
+	if (status != STATUS_OK && emu->sync_status == STATUS_OK) {
+		emu->sync_status = status;
+		emu->sync_id = id;
+	}
+}
+
+/**
+ * Handle a complete command frame
+ */
+static void emu_handle_frame(struct emu *emu)
+{
+	uint8_t res[256];
+	size_t res_len = 0;
+	uint8_t status;
+	uint8_t fcs;
+	unsigned int i;
+
+	bool no_res = false;
+
+	flip_bit(emu, emu->cmd, emu->cmd_len, "command");
+
+	fcs = 0;
+	if (emu->has_crc) {
+		// CRC over data and trailer is zero
+		for (i = 0; i < emu->cmd_len; i++) {
+			fcs = crc8(fcs, emu->cmd[i]);
+		}
+		if (emu->cmd_len > 0) {
+			emu->cmd_len--;
+		}
+	}
+	if (emu->dev_rev >= 7 && emu->cmd_len >= 2 &&
+	    (emu->cmd[CMD_OPCODE] & CMD_FLAG_NO_RESPONSE)) {
+		no_res = true;
+		emu->cmd[CMD_OPCODE] &= ~CMD_FLAG_NO_RESPONSE;
+	}
+	if (fcs != 0) {
+		emu->crc_errors++;
+		if (emu->verbose) {
+			fprintf(stderr, "CMD id=%.2x CRC error\n",
+					emu->cmd[CMD_ID]);
+		}
+		if (no_res) {
+			emu_sync_result(emu, emu->cmd[CMD_ID],
+					STATUS_CRC_ERROR);
+		} else {
+			emu_respond(emu, emu->cmd[CMD_ID], STATUS_CRC_ERROR,
+					NULL, 0, true);
+		}
+		return;
+	}
+
+	if (emu->cmd_len == 0) {
+		// Firmware before rev. 4 responds to empty frames with the
+		// ID of the previous command.
+		if (emu->dev_rev < 4) {
+			emu_respond(emu, emu->last_id,
+					STATUS_INVALID_FRAME_LEN, NULL, 0, false);
+		}
+		return;
+	}
+
+	emu->last_id = emu->cmd[CMD_ID];
+	emu->commands++;
+
+	if (emu->cmd_len < 2) {
+		status = STATUS_INVALID_FRAME_LEN;
+	} else {
+		status = emu_execute(emu, emu->cmd, emu->cmd_len, res,
+					&res_len);
+	}
+
+	if (emu->verbose) {
+		fprintf(stderr, "CMD id=%.2x opcode=%u len=%u -> status=0x%.2x%s\n",
+				emu->cmd[CMD_ID],
+				(emu->cmd_len > 1) ? emu->cmd[CMD_OPCODE] : 0,
+				emu->cmd_len, status,
+				no_res ? " (no response)" : "");
+	}
+
+	if (no_res) {
+		emu_sync_result(emu, emu->cmd[CMD_ID], status);
+		return;
+	}
+
+	emu_respond(emu, emu->cmd[CMD_ID], status, res, res_len,
+			emu->has_crc);
+}
+
+/**
+ * Process received bytes
+ *
+ * Removes byte stuffing and handles complete frames, like the firmware main
+ * loop.
+ */
+static void emu_process(struct emu *emu)
+{
+	uint8_t c;
+
+	while (emu->in_len > 0 && !terminate) {
+		c = emu->in[0];
+		emu->in_len--;
+		memmove(emu->in, &emu->in[1], emu->in_len);
+
+		if (emu->stuff_first) {
+			emu->stuff_first = false;
+			if (c == STUFF_BYTE2 ||
+			    (c == STUFF_BYTE2_CRC && emu->dev_rev >= 6)) {
+				emu->has_crc = (c == STUFF_BYTE2_CRC);
+				if (!emu->comm_error) {
+					emu_handle_frame(emu);
+				}
+				emu->cmd_len = 0;
+				emu->comm_error = false;
+				continue;
+			} else if (c != STUFF_BYTE1) {
+				emu->comm_error = true;
+				continue;
+			}
+		} else if (c == STUFF_BYTE1) {
+			emu->stuff_first = true;
+			continue;
+		}
+		if (emu->comm_error) {
+			continue;
+		}
+		if (emu->cmd_len >= sizeof(emu->cmd)) {
+			emu->comm_error = true;
+			continue;
+		}
+
+		emu->cmd[emu->cmd_len++] = c;
+	}
+}
+
+static int emu_open_pty(struct emu *emu, const char *link_path)
+{
+	struct termios tio;
+	const char *slave_path;
+
+	emu->fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (emu->fd == -1) {
+		perror("posix_openpt() failed");
+		return -1;
+	}
+	if (grantpt(emu->fd) != 0 || unlockpt(emu->fd) != 0) {
+		perror("Failed to unlock PTY");
+		return -1;
+	}
+	slave_path = ptsname(emu->fd);
+	if (slave_path == NULL) {
+		perror("ptsname() failed");
+		return -1;
+	}
+
+	// Keep the slave open, and in raw mode until a client configures it
+	emu->slave_fd = open(slave_path, O_RDWR | O_NOCTTY);
+	if (emu->slave_fd == -1) {
+		perror(slave_path);
+		return -1;
+	}
+	if (tcgetattr(emu->slave_fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(emu->slave_fd, TCSANOW, &tio);
+	}
+
+	if (link_path != NULL) {
+		unlink(link_path);
+		if (symlink(slave_path, link_path) != 0) {
+			perror("Failed to create symlink");
+			return -1;
+		}
+		printf("%s -> %s\n", link_path, slave_path);
+	} else {
+		printf("%s\n", slave_path);
+	}
+	fflush(stdout);
+
+	return 0;
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Emulate a SER4010 device on a pseudo terminal. The path of the\n"
+		"terminal is printed on stdout, and can be used as device path for\n"
+		"the other tools.\n"
+		"\n"
+		"Options:\n"
+		" -l <path>	Create symlink to the terminal at path\n"
+		" -r <rev>	Firmware revision to emulate (default: %u)\n"
+		" -t <factor>	Time scale of RF transmissions and serial\n"
+		"		responses, 0 is instant\n"
+		"		(default: 1)\n"
+		" -g <count>	Receive count bytes of garbage before the first\n"
+		"		command, like boot messages on a Raspberry Pi\n"
+		" -e <n>	Corrupt every n'th response\n"
+		" -u <n>	Send every n'th response twice\n"
+		" -f <n>	Flip a bit in every n'th command and response\n"
+		" -v		Log commands to stderr\n"
+		" -h		Print this help message\n"
+		, name, SER4010_DEV_REV);
+}
+
+int main(int argc, char *argv[])
+{
+	struct emu emu;
+	struct sigaction sa;
+	char *link_path = NULL;
+	char *endp;
+	int opt;
+	unsigned long garbage = 0;
+
+	memset(&emu, 0, sizeof(emu));
+	emu.time_scale = 1;
+	emu.dev_rev = SER4010_DEV_REV;
+	emu_init_state(&emu);
+
+	while ((opt = getopt(argc, argv, "l:r:t:g:e:u:f:vh")) != -1) {
+		switch (opt) {
+		case 'l':
+			link_path = optarg;
+			break;
+		case 'r':
+			emu.dev_rev = strtoul(optarg, &endp, 0);
+			if (*endp != '\0') {
+				fprintf(stderr, "Unparsable revision\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 't':
+			emu.time_scale = strtod(optarg, &endp);
+			if (*endp != '\0' || emu.time_scale < 0) {
+				fprintf(stderr, "Invalid time scale\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'g':
+			garbage = strtoul(optarg, &endp, 0);
+			if (*endp != '\0' || garbage > sizeof(emu.in)) {
+				fprintf(stderr, "Invalid garbage count\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'e':
+			emu.corrupt_every = strtoul(optarg, &endp, 0);
+			if (*endp != '\0') {
+				fprintf(stderr, "Invalid corruption interval\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'u':
+			emu.dup_every = strtoul(optarg, &endp, 0);
+			if (*endp != '\0') {
+				fprintf(stderr, "Invalid duplication interval\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'f':
+			emu.flip_every = strtoul(optarg, &endp, 0);
+			if (*endp != '\0') {
+				fprintf(stderr, "Invalid bit flip interval\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'v':
+			emu.verbose = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (emu_open_pty(&emu, link_path) != 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	if (garbage > 0) {
+		static const char boot_msg[] = "Uncompressing Linux... done, "
+						"booting the kernel.\r\n";
+		for (emu.in_len = 0; emu.in_len < garbage; emu.in_len++) {
+			emu.in[emu.in_len] =
+				boot_msg[emu.in_len % (sizeof(boot_msg) - 1)];
+		}
+		emu_process(&emu);
+	}
+
+	while (!terminate) {
+		if (emu_read(&emu, NULL, sizeof(emu.in)) < 0) {
+			perror("read() failed");
+			break;
+		}
+		emu_process(&emu);
+	}
+
+	fprintf(stderr, "commands: %lu, rx bytes: %lu, tx bytes: %lu, "
+			"dropped bytes: %lu, RF frames: %lu, CRC errors: %lu\n",
+			emu.commands, emu.rx_bytes, emu.tx_bytes,
+			emu.dropped_bytes, emu.rf_frames, emu.crc_errors);
+
+	if (link_path != NULL) {
+		unlink(link_path);
+	}
+	close(emu.slave_fd);
+	close(emu.fd);
+
+	return 0;
+}
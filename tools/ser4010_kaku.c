@@ -33,195 +33,290 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 
 #include "serco.h"
 #include "ser4010.h"
+#include "ser4010_kaku_proto.h"
+#include "batch_input.h"
+#include "str_to_args.h"
+#include "ser4010_burst.h"
+#include "ser4010_group.h"
 
-#define wKaku_BitRate_c		(1100)	// Rate at which bits are serialized, KaKu = 275 us
-					// Bit width in seconds = (bit_rate*(ods_ck_div+1))/24MHz
-#define bKaku_GroupWidth_c	(6)	// Amount of bits minus 1 encoded per byte in frame array
-					// One Kaku symbols encode to 7 bits.
-#define bKaku_MaxFrameSize_c	(35+4)	// length of frame buffer in bytes
-#define bKaku_PreambleSize_c	(2)	// offset of payload in frame buffer in bytes
-// Array which holds the frame bits
-// WARNING: LSB shifted out first!!!!!
-uint8_t abKaku_FrameArray[bKaku_MaxFrameSize_c] = {
-		0x20, 0x00, // Start Bit
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x01, // Stop bit ( actually needs 32-6 more symbol times...)
-
-//TODO: temporary added the 32-6 extra symbol inter frame gap, but should be 
-//done with timer so that we don't wast energy of keeping the transmitter enabled.
-		0x00, 0x00, 0x00, 0x00
-};
-
-#define KAKU_MARK 0x21
-#define KAKU_SPACE 0x05
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof((a)[0]))
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] <address> <unit> <on|off> [<address> <unit> <on|off>...]\n"
+		"       %s [options] -b <path>\n"
+		"\n"
+		"Options:\n"
+		" -d <path>	Path to serial device file, repeat to use multiple\n"
+		"		modules\n"
+		" -b <path>	Read commands from file, FIFO or stdin('-')\n"
+		" -h		Print this help message\n"
+		"\n"
+		"Arguments:\n"
+		"address: The hexadecimal address of the remote\n"
+		"unit: The unit number(0-15) of a multi channel remote\n"
+		"on|off: the action to perform\n"
+		"\n"
+		"If multiple commands are given, their frames are uploaded and sent\n"
+		"together.\n"
+		"\n"
+		"In batch mode every input line contains the arguments of one\n"
+		"command. The serial port is kept open between commands. For\n"
+		"every command a line with the input line number, 'OK' or 'ERR'\n"
+		"followed by the error code, and the latency in milliseconds is\n"
+		"written to stdout. A FIFO is reopened when all writers close it.\n"
+		"\n"
+		"With multiple devices every command is sent by one of the modules,\n"
+		"preferring the least busy one, and failing over to the next when a\n"
+		"module stops responding. Module utilisation is printed on exit.\n"
+		, name, name);
+}
 
 /**
- * Perform KAKU PWM encoding on data
- *
- * Takes one byte and encodes it using the KAKU PWM encoding. One bit is
- * encoded into one byte. Only 7 bits in the output bytes are used, so
- * the SI4010 bGroupWidth must be 6.
+ * Parse command arguments into KAKU frame data
  *
- * @param enc_data	pointer to the next byte to write in the transmit data
- *			buffer
- * @param b		Byte to encode
+ * @param argc		Number of arguments, must be 3
+ * @param argv		Address, unit and on/off arguments
+ * @param kaku_data	Buffer to return 4-bytes frame data in
  *
- * @returns	Updated pointer to the next byte to write in the transmit data
- *		buffer
+ * @returns	0 on success, -EINVAL on failure
  */
-static uint8_t *encode_kaku(uint8_t *enc_data, uint8_t b) 
+int parse_command(int argc, char *argv[], uint8_t kaku_data[4])
 {
-	//NOTE: expects bGroupWidth to be set to 6 (eg. 7 symbols per byte)
-	int i;
+	enum { ButtonOn, ButtonOff } button;
+	char *tmp;
+	uint32_t addr;
+	int unit;
 
-	i=8;
-	while (i > 0) {
-		if (b & 0x80) {
-			*enc_data = KAKU_MARK;
-		} else {
-			*enc_data = KAKU_SPACE;
-		}
-		b <<= 1;
+	if (argc != 3) {
+		fprintf(stderr, "Incorrect amount of arguments\n");
+		return -EINVAL;
+	}
+
+	addr = strtol(argv[0], &tmp, 16);
+	if (*tmp != '\0') {
+		fprintf(stderr, "Unparsable characters in address argument\n");
+		return -EINVAL;
+	}
 
-		enc_data++;
-		i--;
+	unit = strtol(argv[1], &tmp, 0);
+	if (*tmp != '\0') {
+		fprintf(stderr, "Unparsable characters in unit argument\n");
+		return -EINVAL;
+	}
+	if (unit > 0xf || unit < 0) {
+		fprintf(stderr, "Unit number out of range(0-15)\n");
+		return -EINVAL;
 	}
 
-	return enc_data;
+	if (strcmp(argv[2], "on") == 0) {
+		button = ButtonOn;
+	} else if (strcmp(argv[2], "off") == 0) {
+		button = ButtonOff;
+	} else {
+		fprintf(stderr, "Unknown direction argument\n");
+		return -EINVAL;
+	}
+
+	// encode KAKU frame data
+	kaku_data[0] = addr >> 18;
+	kaku_data[1] = addr >> 10;
+	kaku_data[2] = addr >> 2;
+	kaku_data[3] = (addr << 6) & 0xc0;
+	if (button == ButtonOn) {
+		kaku_data[3] |= 0x10;
+	} else {
+		kaku_data[3] &= ~0x10;
+	}
+	kaku_data[3] = (kaku_data[3] & 0xF0) | (unit & 0x0F);
+
+	return 0;
 }
 
 /**
- * Init RF module for KAKU usage
+ * Send multiple commands in bursts
+ *
+ * The frames of as many commands as fit in the device frame buffer are
+ * uploaded at once, and sent together.
  *
- * Set up the SI4010 for sending KAKU frames. This must be called
- * before ser4010_kaku_send() can be used.
+ * @param argc		Number of arguments, a multiple of 3
+ * @param argv		Address, unit and on/off arguments of every command
  *
- * @param sdev		Serial Communication handle
+ * @returns	STATUS_OK on success, status code on device error, -1 on
+ *		communication error
  */
-int ser4010_kaku_init(struct serco *sdev)
+int send_burst(struct serco *sdev, int argc, char *argv[])
 {
+	struct ser4010_burst burst;
+	uint8_t kaku_data[4];
+	uint8_t frame[SER4010_KAKU_FRAME_SIZE];
+	size_t len;
+	unsigned int saved;
+	unsigned int total_saved = 0;
+	unsigned int bursts = 0;
+	int i;
 	int ret;
-	tOds_Setup rOdsSetup;
-	tPa_Setup rPaSetup;
-	float fFreq;
-
-	// Setup the PA.
-	// In tests with RFM60S module I didn't find much influence of the
-	// fAlpha/fBeta or wNominalCap parameters on the output levels.
-	// See chapter 12 'Power Amplifier' of Si4010-C2 datasheet.
-	rPaSetup.fAlpha      = 0;	// Disable radiate power adjustment
-	rPaSetup.fBeta       = 0;
-	rPaSetup.bLevel      = 127;	// = max. output power
-	rPaSetup.bMaxDrv     = 1;	// Enable output power boost
-	rPaSetup.wNominalCap = 256;	// = half way the range
-
-	// Setup the ODS 
-	rOdsSetup.bModulationType = 0;  // Use OOK
-	rOdsSetup.bClkDiv         = 5;
-	rOdsSetup.bEdgeRate       = 0;
-	rOdsSetup.bGroupWidth     = bKaku_GroupWidth_c;
-	rOdsSetup.wBitRate        = wKaku_BitRate_c;	// Bit width in seconds = (ods_datarate*(ods_ck_div+1))/24MHz
-	rOdsSetup.bLcWarmInt      = 8;
-	rOdsSetup.bDivWarmInt     = 5;
-	rOdsSetup.bPaWarmInt      = 4;
-
-	fFreq = 433.9e6;
-
-	ret = ser4010_set_ods(sdev, &rOdsSetup);
-	if (ret != STATUS_OK) {
-		return ret;
+
+	ser4010_burst_init(&burst);
+	for (i = 0; i <= argc; i += 3) {
+		if (i < argc) {
+			parse_command(3, &argv[i], kaku_data);
+			len = ser4010_kaku_encode(kaku_data, frame);
+
+			if (ser4010_burst_add(&burst, frame, len) == 0) {
+				continue;
+			}
+		}
+
+		ret = ser4010_burst_send(sdev, &burst, SER4010_KAKU_REPEATS,
+						&saved);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+		bursts++;
+		total_saved += saved;
+
+		ser4010_burst_init(&burst);
+		if (i < argc) {
+			ser4010_burst_add(&burst, frame, len);
+		}
 	}
 
-	ret = ser4010_set_pa(sdev, &rPaSetup);
-	if (ret != STATUS_OK) {
-		return ret;
+	printf("Sent %d frames in %u bursts, saved %u round trips\n",
+			argc / 3, bursts, total_saved);
+
+	return STATUS_OK;
+}
+
+/**
+ * Send command on a single module, or on a module of the group if not NULL
+ */
+int send_command(struct serco *sdev, struct ser4010_group *group,
+			uint8_t kaku_data[4])
+{
+	static struct ser4010_group_profile profile;
+	static bool profile_valid = false;
+	uint8_t frame[SER4010_KAKU_FRAME_SIZE];
+	struct ser4010_group_job job;
+
+	if (group == NULL) {
+		return ser4010_kaku_send(sdev, kaku_data);
 	}
 
-	ret = ser4010_set_freq(sdev, fFreq);
-	if (ret != STATUS_OK) {
-		return ret;
+	if (!profile_valid) {
+		ser4010_kaku_profile(&profile);
+		profile_valid = true;
 	}
 
-	return STATUS_OK;
+	job.profile = &profile;
+	job.frame = frame;
+	job.frame_len = ser4010_kaku_encode(kaku_data, frame);
+	job.cnt = SER4010_KAKU_REPEATS;
+
+	return ser4010_group_send(group, &job);
+}
+
+/**
+ * Print utilisation of group modules to stderr
+ */
+void print_group_stats(struct ser4010_group *group)
+{
+	struct ser4010_group_stats stats[SER4010_GROUP_MAX_MODULES];
+	size_t cnt;
+	size_t i;
+
+	cnt = ser4010_group_get_stats(group, stats, ARRAY_SIZE(stats));
+	for (i = 0; i < cnt; i++) {
+		fprintf(stderr, "%s: %s, %u jobs, %u reconfigs, %u failures, "
+				"%u unknown, %.1f%% busy\n", stats[i].path,
+				stats[i].alive ? "alive" : "dead",
+				stats[i].jobs, stats[i].reconfigs,
+				stats[i].failures, stats[i].unknown,
+				stats[i].utilisation * 100);
+	}
 }
 
 /**
- * Send a frame using KAKU
+ * Process commands from batch input until end of input
  *
- * This function encodes the data in 'payload' according to the KAKU protocol,
- * pre-/appends the preamble/Inter-frame gap, and sends out the frame 4 times
- * using OOK modulation on 433.9 MHz.
+ * @param group		Group to send on, or NULL to use sdev
  *
- * @param sdev		Serial Communication handle
- * @param data		The 4-bytes frame data
+ * @returns	0 if all commands succeeded, else -1
  */
-int ser4010_kaku_send(struct serco *sdev, uint8_t data[4])
+int run_batch(struct serco *sdev, struct ser4010_group *group,
+		const char *batch_path)
 {
+	struct batch_input in;
+	struct timespec start;
+	char line[256];
+	char *line_argv[4];
+	int line_argc;
+	uint8_t kaku_data[4];
+	int retval = 0;
 	int ret;
-  	uint8_t *pbFrameHead;		// Pointer to frame Head 
 
-	pbFrameHead = &abKaku_FrameArray[bKaku_PreambleSize_c];
-	pbFrameHead = encode_kaku(pbFrameHead, data[0]);
-	pbFrameHead = encode_kaku(pbFrameHead, data[1]);
-	pbFrameHead = encode_kaku(pbFrameHead, data[2]);
-	pbFrameHead = encode_kaku(pbFrameHead, data[3]);
-
-	ret = ser4010_load_frame(sdev, abKaku_FrameArray, bKaku_MaxFrameSize_c);
-	if (ret != STATUS_OK) {
-		return ret;
+	if (batch_open(&in, batch_path) != 0) {
+		return -1;
 	}
 
-	ret = ser4010_send(sdev, 4);
-	if (ret != STATUS_OK) {
-		return ret;
+	while (batch_read_line(&in, line, sizeof(line)) != NULL) {
+		line_argc = str_to_args(line, line_argv, ARRAY_SIZE(line_argv));
+		if (line_argc == 0 || line_argv[0][0] == '#') {
+			// Ignore empty lines and comments
+			continue;
+		}
+
+		batch_timer_start(&start);
+
+		ret = parse_command(line_argc, line_argv, kaku_data);
+		if (ret == 0) {
+			ret = send_command(sdev, group, kaku_data);
+		}
+		if (ret != STATUS_OK) {
+			retval = -1;
+		}
+
+		batch_report(&in, ret, &start);
 	}
 
-	return STATUS_OK;
-}
+	batch_close(&in);
 
-void usage(const char *name)
-{
-	fprintf(stderr,
-		"usage: %s [options] <address> <unit> <on|off>\n"
-		"\n"
-		"Options:\n"
-		" -d <path>	Path to serial device file\n"
-		" -h		Print this help message\n"
-		"\n"
-		"Arguments:\n"
-		"address: The hexadecimal address of the remote\n"
-		"unit: The unit number(0-15) of a multi channel remote\n"
-		"on|off: the action to perform\n"
-		, name);
+	return retval;
 }
 
 int main(int argc, char *argv[])
 {
 	int opt;
-	char *dev_path;
+	const char *dev_paths[SER4010_GROUP_MAX_MODULES];
+	size_t dev_cnt = 0;
+	char *batch_path = NULL;
 	struct serco sdev;
+	struct ser4010_group group;
+	struct ser4010_group *groupp = NULL;
 	unsigned char kaku_data[4];
-	enum { ButtonOn, ButtonOff } button;
-	char *tmp;
-	uint32_t addr;
-	int unit;
-	int ret;
-
-	dev_path = strdup(DEFAULT_SERIAL_DEV);
+	bool burst = false;
+	int ret = STATUS_OK;
+	int i;
 
-	while ((opt = getopt(argc, argv, "d:h")) != -1) {
+	while ((opt = getopt(argc, argv, "d:b:h")) != -1) {
 		switch (opt) {
 		case 'd':
-			free(dev_path);
-			dev_path = strdup(optarg);
+			if (dev_cnt >= ARRAY_SIZE(dev_paths)) {
+				fprintf(stderr, "Too many devices, max. %d\n",
+						SER4010_GROUP_MAX_MODULES);
+				exit(EXIT_FAILURE);
+			}
+			dev_paths[dev_cnt++] = optarg;
+			break;
+		case 'b':
+			batch_path = optarg;
 			break;
 		case 'h':
 			usage(argv[0]);
@@ -232,42 +327,61 @@ int main(int argc, char *argv[])
 			exit(EXIT_FAILURE);
 		}
 	}
+	if (dev_cnt == 0) {
+		dev_paths[dev_cnt++] = DEFAULT_SERIAL_DEV;
+	}
 	
-	if (argc - optind != 3) {
-		fprintf(stderr, "Incorrect amount of arguments\n");
+	if (batch_path != NULL) {
+		if (argc - optind != 0) {
+			fprintf(stderr, "No arguments allowed in batch mode\n");
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	} else if (argc - optind > 3 && (argc - optind) % 3 == 0) {
+		// Validate all commands before sending any of them
+		for (i = optind; i < argc; i += 3) {
+			if (parse_command(3, &argv[i], kaku_data) != 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		burst = true;
+	} else if (parse_command(argc - optind, &argv[optind], kaku_data) != 0) {
 		usage(argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
-	addr = strtol(argv[optind], &tmp, 16);
-	if (*tmp != '\0') {
-		fprintf(stderr, "Unparsable characters in address argument\n");
-		exit(EXIT_FAILURE);
-	}
-	optind++;
+	if (dev_cnt > 1) {
+		// Modules are configured on their first command
+		if (ser4010_group_open(&group, dev_paths, dev_cnt) != 0) {
+			fprintf(stderr, "Unable to open any device\n");
+			exit(EXIT_FAILURE);
+		}
+		groupp = &group;
 
-	unit = strtol(argv[optind], &tmp, 0);
-	if (*tmp != '\0') {
-		fprintf(stderr, "Unparsable characters in unit argument\n");
-		exit(EXIT_FAILURE);
-	}
-	if (unit > 0xf || unit < 0) {
-		fprintf(stderr, "Unit number out of range(0-15)\n");
-		exit(EXIT_FAILURE);
-	}
-	optind++;
+		if (batch_path != NULL) {
+			ret = run_batch(NULL, groupp, batch_path);
+		} else {
+			for (i = optind; i < argc && ret == STATUS_OK; i += 3) {
+				parse_command(3, &argv[i], kaku_data);
+				ret = send_command(NULL, groupp, kaku_data);
+			}
+		}
 
-	if (strcmp(argv[optind], "on") == 0) {
-		button = ButtonOn;
-	} else if (strcmp(argv[optind], "off") == 0) {
-		button = ButtonOff;
-	} else {
-		fprintf(stderr, "Unknown direction argument\n");
-		exit(EXIT_FAILURE);
+		print_group_stats(groupp);
+		ser4010_group_close(groupp);
+		if (ret == SER4010_GROUP_SEND_UNKNOWN) {
+			fprintf(stderr, "Communication failed, command may have been sent\n");
+			exit(EXIT_FAILURE);
+		} else if (ret != STATUS_OK) {
+			fprintf(stderr, "Failed sending command: %d\n", ret);
+			exit(EXIT_FAILURE);
+		}
+		return 0;
 	}
 
 	// open/init SER4010
-	if (serco_open(&sdev, dev_path) != 0) {
+	if (serco_open(&sdev, dev_paths[0]) != 0) {
 		exit(EXIT_FAILURE);
 	}
 
@@ -284,20 +398,21 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	// encode KAKU frame data
-	kaku_data[0] = addr >> 18;
-	kaku_data[1] = addr >> 10;
-	kaku_data[2] = addr >> 2;
-	kaku_data[3] = (addr << 6) & 0xc0;
-	if (button == ButtonOn) {
-		kaku_data[3] |= 0x10;
-	} else {
-		kaku_data[3] &= ~0x10;
+	if (batch_path != NULL) {
+		ret = run_batch(&sdev, NULL, batch_path);
+		serco_close(&sdev);
+		if (ret != 0) {
+			exit(EXIT_FAILURE);
+		}
+		return 0;
 	}
-	kaku_data[3] = (kaku_data[3] & 0xF0) | (unit & 0x0F);
 
 	// send frame
-	ret = ser4010_kaku_send(&sdev, kaku_data);
+	if (burst) {
+		ret = send_burst(&sdev, argc - optind, &argv[optind]);
+	} else {
+		ret = ser4010_kaku_send(&sdev, kaku_data);
+	}
 
 	serco_close(&sdev);
 
@@ -0,0 +1,146 @@
+/**
+ * ser4010_kaku_proto.c - KAKU protocol encoding
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "serco.h"
+#include "ser4010.h"
+#include "ser4010_encode.h"
+#include "ser4010_group.h"
+#include "ser4010_kaku_proto.h"
+
+#include <string.h>
+
+#define wKaku_BitRate_c		(1100)	// Rate at which bits are serialized, KaKu = 275 us
+					// Bit width in seconds = (bit_rate*(ods_ck_div+1))/24MHz
+#define bKaku_GroupWidth_c	(6)	// Amount of bits minus 1 encoded per byte in frame array
+					// One Kaku symbols encode to 7 bits.
+#define bKaku_MaxFrameSize_c	SER4010_KAKU_FRAME_SIZE	// length of frame buffer in bytes
+#define bKaku_PreambleSize_c	(2)	// offset of payload in frame buffer in bytes
+#define bKaku_PayloadSize_c	(32)	// length of payload in frame buffer in bytes
+// Array which holds the frame bits
+// WARNING: LSB shifted out first!!!!!
+static uint8_t abKaku_FrameArray[bKaku_MaxFrameSize_c] = {
+		0x20, 0x00, // Start Bit
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x01, // Stop bit ( actually needs 32-6 more symbol times...)
+
+//TODO: temporary added the 32-6 extra symbol inter frame gap, but should be 
+//done with timer so that we don't wast energy of keeping the transmitter enabled.
+		0x00, 0x00, 0x00, 0x00
+};
+
+// Byte to KAKU PWM symbol lookup table. One bit is encoded into 7 symbols,
+// so exactly one frame byte when bGroupWidth is 6.
+static struct ser4010_symbol_map kaku_map;
+
+void ser4010_kaku_profile(struct ser4010_group_profile *profile)
+{
+	tOds_Setup *rOdsSetup = &profile->ods;
+	tPa_Setup *rPaSetup = &profile->pa;
+
+	// Setup the PA.
+	// In tests with RFM60S module I didn't find much influence of the
+	// fAlpha/fBeta or wNominalCap parameters on the output levels.
+	// See chapter 12 'Power Amplifier' of Si4010-C2 datasheet.
+	rPaSetup->fAlpha      = 0;	// Disable radiate power adjustment
+	rPaSetup->fBeta       = 0;
+	rPaSetup->bLevel      = 127;	// = max. output power
+	rPaSetup->bMaxDrv     = 1;	// Enable output power boost
+	rPaSetup->wNominalCap = 256;	// = half way the range
+
+	// Setup the ODS 
+	rOdsSetup->bModulationType = 0;  // Use OOK
+	rOdsSetup->bClkDiv         = 5;
+	rOdsSetup->bEdgeRate       = 0;
+	rOdsSetup->bGroupWidth     = bKaku_GroupWidth_c;
+	rOdsSetup->wBitRate        = wKaku_BitRate_c;	// Bit width in seconds = (ods_datarate*(ods_ck_div+1))/24MHz
+	rOdsSetup->bLcWarmInt      = 8;
+	rOdsSetup->bDivWarmInt     = 5;
+	rOdsSetup->bPaWarmInt      = 4;
+
+	profile->freq = 433.9e6;
+	profile->fdev = 0;	// Not used for OOK
+	profile->enc = bEnc_NoneNrz_c;
+
+	ser4010_symbol_map_init(&kaku_map, bKaku_GroupWidth_c + 1,
+				SER4010_KAKU_ZERO, SER4010_KAKU_ONE);
+}
+
+int ser4010_kaku_init(struct serco *sdev)
+{
+	struct ser4010_group_profile profile;
+	struct ser4010_dev_config cfg;
+
+	ser4010_kaku_profile(&profile);
+
+	cfg.ods = profile.ods;
+	cfg.pa = profile.pa;
+	cfg.freq = profile.freq;
+
+	return ser4010_set_fields(sdev, &cfg,
+			SER4010_CFG_ODS | SER4010_CFG_PA | SER4010_CFG_FREQ);
+}
+
+size_t ser4010_kaku_encode(uint8_t data[4], uint8_t frame[SER4010_KAKU_FRAME_SIZE])
+{
+	struct ser4010_packer packer;
+
+	ser4010_packer_init(&packer,
+				&abKaku_FrameArray[bKaku_PreambleSize_c],
+				bKaku_PayloadSize_c, bKaku_GroupWidth_c);
+	ser4010_pack_bytes(&packer, &kaku_map, data, 4);
+	ser4010_packer_finish(&packer, NULL);
+
+	memcpy(frame, abKaku_FrameArray, bKaku_MaxFrameSize_c);
+
+	return bKaku_MaxFrameSize_c;
+}
+
+int ser4010_kaku_send(struct serco *sdev, uint8_t data[4])
+{
+	int ret;
+	uint8_t frame[SER4010_KAKU_FRAME_SIZE];
+	size_t len;
+
+	len = ser4010_kaku_encode(data, frame);
+
+	// Only the payload changes between frames
+	ret = ser4010_load_frame_diff(sdev, frame, len);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	ret = ser4010_send(sdev, SER4010_KAKU_REPEATS);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	return STATUS_OK;
+}
@@ -0,0 +1,88 @@
+/**
+ * ser4010_kaku_proto.h - KAKU protocol encoding
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SER4010_KAKU_PROTO_H__
+#define __SER4010_KAKU_PROTO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SER4010_KAKU_FRAME_SIZE		(35+4)	// Encoded frame size in bytes
+#define SER4010_KAKU_REPEATS		4	// Number of times a frame is sent
+
+struct ser4010_group_profile;
+
+/**
+ * Get radio configuration for KAKU
+ *
+ * Fills in the configuration ser4010_kaku_init() applies, for sending KAKU
+ * frames with the ser4010_group API. Also prepares ser4010_kaku_encode(), so
+ * ser4010_kaku_init() isn't needed when only groups are used.
+ *
+ * @param profile	Structure to return configuration in
+ */
+void ser4010_kaku_profile(struct ser4010_group_profile *profile);
+
+/**
+ * Init RF module for KAKU usage
+ *
+ * Set up the SI4010 for sending KAKU frames. This must be called
+ * before ser4010_kaku_send() can be used.
+ *
+ * @param sdev		Serial Communication handle
+ */
+int ser4010_kaku_init(struct serco *sdev);
+
+/**
+ * Send a frame using KAKU
+ *
+ * This function encodes the data in 'payload' according to the KAKU protocol,
+ * pre-/appends the preamble/Inter-frame gap, and sends out the frame 4 times
+ * using OOK modulation on 433.9 MHz.
+ *
+ * @param sdev		Serial Communication handle
+ * @param data		The 4-bytes frame data
+ */
+int ser4010_kaku_send(struct serco *sdev, uint8_t data[4]);
+
+/**
+ * Encode a frame using KAKU
+ *
+ * This function encodes the data in 'payload' according to the KAKU protocol,
+ * and pre-/appends the preamble/Inter-frame gap. The result can be sent as
+ * is, or be combined with other frames using the ser4010_burst API.
+ * ser4010_kaku_init() must have been called before.
+ *
+ * @param data		The 4-bytes frame data
+ * @param frame		Buffer to return the encoded frame in
+ *
+ * @returns		Length of encoded frame in bytes
+ */
+size_t ser4010_kaku_encode(uint8_t data[4], uint8_t frame[SER4010_KAKU_FRAME_SIZE]);
+
+#endif // __SER4010_KAKU_PROTO_H__
@@ -0,0 +1,408 @@
+/**
+ * ser4010_profile.c - Build and inspect the radio profile cache
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "serco.h"
+#include "ser4010.h"
+#include "ser4010_profile.h"
+#include "str_to_args.h"
+
+#define MAX_PROFILES	1024
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] [profile...]\n"
+		"\n"
+		"Build, list or apply compiled radio profiles. Without -b or -a\n"
+		"the profiles in the cache are listed, or shown in detail if\n"
+		"their names are given.\n"
+		"\n"
+		"Options:\n"
+		" -c <path>	Profile cache file (default: %s)\n"
+		" -b <path>	Build cache from profile definitions, '-' for stdin\n"
+		" -a <name>	Configure device with profile\n"
+		" -d <path>	Path to serial device file, for -a\n"
+		" -h		Print this help message\n"
+		"\n"
+		"Profile definitions have one profile per line:\n"
+		"  <name> <freq_MHz> <fdev_kHz> <OOK|FSK> <none|manchester|4b5b>\n"
+		"    <rate_kbps> <bits_per_byte> [<pa_level> [<max_drv> [<nominal_cap>]]]\n"
+		"Empty lines and lines starting with '#' are ignored. Without\n"
+		"pa_level the Power Amplifier configuration is left unchanged.\n"
+		, name, ser4010_profile_default_path());
+}
+
+static bool parse_float(const char *str, float *val)
+{
+	char *endp;
+
+	*val = strtof(str, &endp);
+
+	return (endp != str && *endp == '\0');
+}
+
+static bool parse_ulong(const char *str, unsigned long max,
+			unsigned long *val)
+{
+	char *endp;
+
+	*val = strtoul(str, &endp, 0);
+
+	return (endp != str && *endp == '\0' && *val <= max);
+}
+
+/**
+ * Parse and compile a profile definition line
+ *
+ * @returns	0 on success, 1 on syntax error, else see
+ *		ser4010_profile_compile()
+ */
+static int parse_profile(struct ser4010_profile *profile, char *line)
+{
+	char *argv[12];
+	size_t argc;
+	float freq_mhz, fdev_khz, rate_kbps;
+	int modulation;
+	enum Ser4010Encoding encoding;
+	unsigned long bits_per_byte;
+	unsigned long val;
+	tPa_Setup pa;
+	bool has_pa = false;
+
+	argc = str_to_args(line, argv, sizeof(argv) / sizeof(argv[0]));
+	if (argc < 7 || argc > 10) {
+		return 1;
+	}
+
+	if (!parse_float(argv[1], &freq_mhz) ||
+			!parse_float(argv[2], &fdev_khz) ||
+			!parse_float(argv[5], &rate_kbps) ||
+			!parse_ulong(argv[6], 8, &bits_per_byte)) {
+		return 1;
+	}
+
+	if (strcasecmp(argv[3], "OOK") == 0) {
+		modulation = ODS_MODULATION_TYPE_OOK;
+	} else if (strcasecmp(argv[3], "FSK") == 0) {
+		modulation = ODS_MODULATION_TYPE_FSK;
+	} else {
+		return 1;
+	}
+
+	if (strcasecmp(argv[4], "none") == 0) {
+		encoding = bEnc_NoneNrz_c;
+	} else if (strcasecmp(argv[4], "manchester") == 0) {
+		encoding = bEnc_Manchester_c;
+	} else if (strcasecmp(argv[4], "4b5b") == 0) {
+		encoding = bEnc_4b5b_c;
+	} else {
+		return 1;
+	}
+
+	// Same defaults as the firmware
+	pa.fAlpha = 0;
+	pa.fBeta = 0;
+	pa.bLevel = 60;
+	pa.bMaxDrv = 0;
+	pa.wNominalCap = 256;
+	if (argc > 7) {
+		if (!parse_ulong(argv[7], 0x7f, &val)) {
+			return 1;
+		}
+		pa.bLevel = val;
+		has_pa = true;
+	}
+	if (argc > 8) {
+		if (!parse_ulong(argv[8], 1, &val)) {
+			return 1;
+		}
+		pa.bMaxDrv = val;
+	}
+	if (argc > 9) {
+		if (!parse_ulong(argv[9], 0x1ff, &val)) {
+			return 1;
+		}
+		pa.wNominalCap = val;
+	}
+
+	return ser4010_profile_compile(profile, argv[0], freq_mhz, fdev_khz,
+					modulation, encoding, rate_kbps,
+					bits_per_byte, has_pa ? &pa : NULL);
+}
+
+static int build(const char *cache_path, const char *src_path)
+{
+	static struct ser4010_profile profiles[MAX_PROFILES];
+	size_t cnt = 0;
+	char line[256];
+	unsigned long line_nr = 0;
+	FILE *fp;
+	char *p;
+	int ret;
+
+	if (strcmp(src_path, "-") == 0) {
+		fp = stdin;
+	} else if ((fp = fopen(src_path, "r")) == NULL) {
+		perror(src_path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line_nr++;
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if (*p == '#' || *p == '\n' || *p == '\0') {
+			continue;
+		}
+
+		if (cnt == MAX_PROFILES) {
+			fprintf(stderr, "%s:%lu: Too many profiles\n",
+					src_path, line_nr);
+			goto bad;
+		}
+
+		ret = parse_profile(&profiles[cnt], p);
+		if (ret == 1) {
+			fprintf(stderr, "%s:%lu: Syntax error\n",
+					src_path, line_nr);
+			goto bad;
+		} else if (ret != 0) {
+			fprintf(stderr, "%s:%lu: Invalid profile: %s\n",
+					src_path, line_nr, strerror(ret));
+			goto bad;
+		}
+		cnt++;
+	}
+	if (ferror(fp)) {
+		perror(src_path);
+		goto bad;
+	}
+	if (fp != stdin) {
+		fclose(fp);
+	}
+
+	if (ser4010_profile_write(cache_path, profiles, cnt) != 0) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "Duplicate profile names\n");
+		} else {
+			perror(cache_path);
+		}
+		return -1;
+	}
+
+	printf("Compiled %zu profiles into %s\n", cnt, cache_path);
+
+	return 0;
+bad:
+	if (fp != stdin) {
+		fclose(fp);
+	}
+	return -1;
+}
+
+static const char *encoding_to_str(uint8_t enc)
+{
+	switch (enc) {
+	case bEnc_NoneNrz_c:
+		return "none";
+	case bEnc_Manchester_c:
+		return "manchester";
+	case bEnc_4b5b_c:
+		return "4b5b";
+	}
+
+	return "?";
+}
+
+static void print_summary(const struct ser4010_profile *profile)
+{
+	printf("%-20s %9.3f MHz  %s %-10s %8.3f kbps (%+.3f%%)\n",
+			profile->name, profile->freq_mhz,
+			profile->modulation == ODS_MODULATION_TYPE_FSK ?
+				"FSK" : "OOK",
+			encoding_to_str(profile->enc), profile->rate_kbps,
+			profile->rate_error * 100);
+}
+
+static void print_details(const struct ser4010_profile *profile)
+{
+	tOds_Setup ods;
+	tPa_Setup pa;
+
+	ser4010_profile_get_ods(profile, &ods);
+
+	printf("Profile: %s\n", profile->name);
+	printf("  Frequency: %.6f MHz\n", profile->freq_mhz);
+	if (profile->modulation == ODS_MODULATION_TYPE_FSK) {
+		printf("  Modulation: FSK, %.3f kHz deviation (fdev %u)\n",
+				profile->fdev_khz, profile->fdev);
+	} else {
+		printf("  Modulation: OOK\n");
+	}
+	printf("  Encoding: %s, %u bits per byte\n",
+			encoding_to_str(profile->enc), profile->bits_per_byte);
+	printf("  Data rate: %.3f kbps\n", profile->rate_kbps);
+	printf("  Symbol rate: %.4f ksym/s (error %+.3f%%)\n",
+			profile->sym_rate_ksym_sec, profile->rate_error * 100);
+	printf("  ODS: bClkDiv %u, bEdgeRate %u, bGroupWidth %u, "
+			"wBitRate %u,\n"
+			"       bLcWarmInt %u, bDivWarmInt %u, bPaWarmInt %u\n",
+			ods.bClkDiv, ods.bEdgeRate, ods.bGroupWidth,
+			ods.wBitRate, ods.bLcWarmInt, ods.bDivWarmInt,
+			ods.bPaWarmInt);
+	if (profile->flags & SER4010_PROFILE_PA) {
+		ser4010_profile_get_pa(profile, &pa);
+		printf("  PA: bLevel %u, bMaxDrv %u, wNominalCap %u, "
+				"fAlpha %g, fBeta %g\n",
+				pa.bLevel, pa.bMaxDrv, pa.wNominalCap,
+				pa.fAlpha, pa.fBeta);
+	} else {
+		printf("  PA: unchanged\n");
+	}
+}
+
+static int apply(const struct ser4010_profile_cache *cache,
+			const char *dev_path, const char *name)
+{
+	struct serco sdev;
+	int ret;
+
+	if (serco_open(&sdev, dev_path) != 0) {
+		return -1;
+	}
+
+	ret = ser4010_apply_profile(&sdev, cache, name);
+	serco_close(&sdev);
+	if (ret == EINVAL) {
+		fprintf(stderr, "No profile named '%s'\n", name);
+		return -1;
+	} else if (ret != STATUS_OK) {
+		fprintf(stderr, "ser4010_apply_profile() Failed: %d\n", ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	const char *cache_path;
+	const char *src_path = NULL;
+	const char *apply_name = NULL;
+	char *dev_path;
+	struct ser4010_profile_cache cache;
+	const struct ser4010_profile *profile;
+	uint32_t i;
+	int ret = 0;
+
+	cache_path = ser4010_profile_default_path();
+	dev_path = strdup(DEFAULT_SERIAL_DEV);
+
+	while ((opt = getopt(argc, argv, "c:b:a:d:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			cache_path = optarg;
+			break;
+		case 'b':
+			src_path = optarg;
+			break;
+		case 'a':
+			apply_name = optarg;
+			break;
+		case 'd':
+			free(dev_path);
+			dev_path = strdup(optarg);
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (src_path != NULL) {
+		if (build(cache_path, src_path) != 0) {
+			exit(EXIT_FAILURE);
+		}
+		if (apply_name == NULL && optind == argc) {
+			exit(EXIT_SUCCESS);
+		}
+	}
+
+	if (ser4010_profile_open(&cache, cache_path) != 0) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "%s: Not a profile cache of this "
+					"version, rebuild it\n", cache_path);
+		} else {
+			perror(cache_path);
+		}
+		exit(EXIT_FAILURE);
+	}
+
+	if (apply_name != NULL) {
+		if (apply(&cache, dev_path, apply_name) != 0) {
+			ret = 1;
+		}
+	} else if (optind < argc) {
+		for (; optind < argc; optind++) {
+			profile = ser4010_profile_find(&cache, argv[optind]);
+			if (profile == NULL) {
+				fprintf(stderr, "No profile named '%s'\n",
+						argv[optind]);
+				ret = 1;
+				continue;
+			}
+			print_details(profile);
+		}
+	} else {
+		for (i = 0; i < cache.hdr->count; i++) {
+			print_summary(&cache.profiles[i]);
+		}
+	}
+
+	ser4010_profile_close(&cache);
+	free(dev_path);
+
+	return ret;
+}
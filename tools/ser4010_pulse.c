@@ -38,6 +38,7 @@
 
 #include "serco.h"
 #include "ser4010.h"
+#include "ser4010_encode.h"
 
 void usage(const char *name)
 {
@@ -69,12 +70,14 @@ int main(int argc, char *argv[])
 	tOds_Setup rOdsSetup;
 	tPa_Setup rPaSetup;
 	float fFreq;
+	struct ser4010_dev_config cfg;
 
 	struct serco sdev;
 
 	// Array which holds the frame bits
 	// WARNING: LSB shifted out first!!!!!
-	uint8_t frame_buf[1] = { 0xff };
+	uint8_t frame_buf[1];
+	struct ser4010_packer packer;
 
 	// Default the PA values.
 	rPaSetup.fAlpha      = 0;
@@ -160,26 +163,24 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	// A single frame byte of carrier
+	ser4010_packer_init(&packer, frame_buf, sizeof(frame_buf),
+				rOdsSetup.bGroupWidth);
+	ser4010_pack_symbols(&packer, 0xff, rOdsSetup.bGroupWidth + 1);
+	ser4010_packer_finish(&packer, NULL);
+
 	// open/init SER4010
 	if (serco_open(&sdev, dev_path) != 0) {
 		exit(EXIT_FAILURE);
 	}
 
-	ret = ser4010_set_ods(&sdev, &rOdsSetup);
-	if (ret != STATUS_OK) {
-		fprintf(stderr, "ser4010_set_ods() Failed: %d", ret);
-		exit(EXIT_FAILURE);
-	}
-
-	ret = ser4010_set_pa(&sdev, &rPaSetup);
-	if (ret != STATUS_OK) {
-		fprintf(stderr, "ser4010_set_pa() Failed: %d", ret);
-		exit(EXIT_FAILURE);
-	}
-
-	ret = ser4010_set_freq(&sdev, fFreq);
+	cfg.ods = rOdsSetup;
+	cfg.pa = rPaSetup;
+	cfg.freq = fFreq;
+	ret = ser4010_set_fields(&sdev, &cfg,
+			SER4010_CFG_ODS | SER4010_CFG_PA | SER4010_CFG_FREQ);
 	if (ret != STATUS_OK) {
-		fprintf(stderr, "ser4010_set_freq() Failed: %d", ret);
+		fprintf(stderr, "ser4010_set_fields() Failed: %d", ret);
 		exit(EXIT_FAILURE);
 	}
 
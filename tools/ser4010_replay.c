@@ -0,0 +1,255 @@
+/**
+ * ser4010_replay.c - Replay captured mark/space pulse timings
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "serco.h"
+#include "ser4010.h"
+#include "ser4010_pulse_compile.h"
+
+#define MAX_PULSES 1024
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] [pulse...]\n"
+		"\n"
+		"Options:\n"
+		" -d <path>	Path to serial device file\n"
+		" -f <freq>	Frequency in Hz (default: 433.92 MHz)\n"
+		" -t <percent>	Max. timing error per pulse (default: 10)\n"
+		" -n		Only compile and print report, don't send\n"
+		" -h		Print this help message\n"
+		"\n"
+		"Arguments:\n"
+		"pulse: Pulse durations in microseconds, alternating mark and\n"
+		"       space, starting with a mark. If no pulses are given, or\n"
+		"       pulse is '-', they are read from stdin separated by\n"
+		"       white space or commas. The sign of a duration is ignored.\n"
+		, name);
+}
+
+/**
+ * Parse pulse durations from string
+ *
+ * @returns	Updated number of pulses, or -1 on error
+ */
+static int parse_pulses(const char *str, unsigned int *pulses, int cnt)
+{
+	const char *p = str;
+	char *endp;
+	long val;
+
+	while (*p != '\0') {
+		if (isspace(*p) || *p == ',') {
+			p++;
+			continue;
+		}
+
+		val = strtol(p, &endp, 10);
+		if (endp == p) {
+			fprintf(stderr, "Unparsable pulse duration: %s\n", p);
+			return -1;
+		}
+		if (val < 0) {
+			val = -val;
+		}
+		if (val == 0 || val > 1000000) {
+			fprintf(stderr, "Pulse duration out of range\n");
+			return -1;
+		}
+		if (cnt >= MAX_PULSES) {
+			fprintf(stderr, "Too many pulses, max. %d\n",
+					MAX_PULSES);
+			return -1;
+		}
+		pulses[cnt++] = val;
+		p = endp;
+	}
+
+	return cnt;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	int opt;
+	char *endp;
+
+	char *dev_path;
+	float fFreq = 433.92e6;
+	double tolerance = 0.1;
+	bool dry_run = false;
+
+	unsigned int pulses[MAX_PULSES];
+	int pulse_cnt = 0;
+	static struct ser4010_pulse_frame frame;
+
+	struct serco sdev;
+
+	// Default device path
+	dev_path = strdup(DEFAULT_SERIAL_DEV);
+
+	while ((opt = getopt(argc, argv, "d:f:t:nh")) != -1) {
+		switch (opt) {
+		case 'd':
+			free(dev_path);
+			dev_path = strdup(optarg);
+			break;
+		case 'f':
+			fFreq = strtof(optarg, &endp);
+			if (*endp != '\0' || fFreq < 27 * 1000 * 1000 ||
+					fFreq >= 960 * 1000 * 1000) {
+				fprintf(stderr, "Frequency out of range\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 't':
+			tolerance = strtod(optarg, &endp) / 100;
+			if (*endp != '\0' || tolerance <= 0 ||
+					tolerance >= 1) {
+				fprintf(stderr, "Tolerance out of range "
+						"(0 < tolerance < 100)\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'n':
+			dry_run = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Read pulse list
+	if (argc - optind == 0 ||
+			(argc - optind == 1 && strcmp(argv[optind], "-") == 0))
+	{
+		char token[32];
+		size_t len = 0;
+		int c;
+
+		// Read token wise, so numbers can't get split over buffers
+		do {
+			c = getchar();
+			if (c != EOF && !isspace(c) && c != ',') {
+				if (len >= sizeof(token) - 1) {
+					fprintf(stderr, "Unparsable pulse "
+							"duration\n");
+					exit(EXIT_FAILURE);
+				}
+				token[len++] = c;
+			} else if (len > 0) {
+				token[len] = '\0';
+				len = 0;
+				pulse_cnt = parse_pulses(token, pulses,
+							pulse_cnt);
+				if (pulse_cnt < 0) {
+					exit(EXIT_FAILURE);
+				}
+			}
+		} while (c != EOF);
+	} else {
+		for (; optind < argc; optind++) {
+			pulse_cnt = parse_pulses(argv[optind], pulses,
+							pulse_cnt);
+			if (pulse_cnt < 0) {
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	if (pulse_cnt == 0) {
+		fprintf(stderr, "No pulses given\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Compile
+	ret = ser4010_pulse_compile(pulses, pulse_cnt, tolerance, &frame);
+	if (ret != 0) {
+		fprintf(stderr, "Unable to compile pulses: %s\n",
+				strerror(ret));
+		exit(EXIT_FAILURE);
+	}
+
+	printf("Symbol period: %.3f us (bClkDiv: %u, wBitRate: %u)\n",
+			frame.symbol_us, frame.ods.bClkDiv,
+			frame.ods.wBitRate);
+	printf("Timing error: max. %.1f %%, RMS %.1f us\n",
+			frame.max_error * 100, frame.rms_error_us);
+	printf("Symbols: %zu, repeats: %u, uploads: %zu\n",
+			frame.symbol_cnt, frame.repeats,
+			(frame.chunk_cnt > 1) ?
+				frame.chunk_cnt * frame.repeats : 1);
+	printf("Uploaded frame bytes: %zu\n", frame.upload_bytes);
+
+	if (dry_run) {
+		exit(EXIT_SUCCESS);
+	}
+
+	// open/init SER4010
+	if (serco_open(&sdev, dev_path) != 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	ret = ser4010_set_freq(&sdev, fFreq);
+	if (ret == STATUS_OK) {
+		ret = ser4010_set_enc(&sdev, bEnc_NoneNrz_c);
+	}
+	if (ret == STATUS_OK) {
+		ret = ser4010_pulse_send(&sdev, &frame);
+	}
+
+	serco_close(&sdev);
+
+	if (ret != STATUS_OK) {
+		if (ret > 0) {
+			fprintf(stderr, "Result status indicates error 0x%.2x\n", ret);
+		} else if (ret == -1) {
+			perror("Failed sending command");
+		} else {
+			fprintf(stderr, "Failed sending command: %d\n", ret);
+		}
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
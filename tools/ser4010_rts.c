@@ -28,14 +28,18 @@
  */
 #include "serco.h"
 #include "ser4010.h"
+#include "ser4010_encode.h"
+#include "ser4010_rts.h"
 
 #include <stdbool.h>
+#include <string.h>
 
 #define wRts_BitRate_c	(2416)	// Rate at which bits are serialized, Rts = 604 us
 					// Bit width in seconds = (bit_rate*(ods_ck_div+1))/24MHz
 #define bRts_GroupWidth_c	(7)	// Amount of bits minus 1 encoded per byte in frame array
-#define bRts_MaxFrameSize_c	(23)	// length of frame buffer in bytes
+#define bRts_MaxFrameSize_c	SER4010_RTS_FRAME_SIZE	// length of frame buffer in bytes
 #define bRts_PreambleSize_c	(9)	// offset of payload in frame buffer in bytes
+#define bRts_PayloadSize_c	(14)	// length of payload in frame buffer in bytes
 // Array which holds the frame bits
 // WARNING: LSB shifted out first!!!!!
 uint8_t abRts_FrameArray[bRts_MaxFrameSize_c] = {
@@ -45,105 +49,113 @@ uint8_t abRts_FrameArray[bRts_MaxFrameSize_c] = {
 		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00  // payload
 };
 
-/**
- * Manchester encode data
- *
- * @param enc_data	pointer to the next byte to write in the transmit data
- *			buffer
- * @param b		Byte to encode
- *
- * @returns	Updated pointer to the next byte to write in the transmit data
- *		buffer
- */
-static uint8_t *encode_rts(uint8_t *enc_data, uint8_t b) 
-{
-	uint8_t i;
-
-	i=8;
-	while (i > 0) {
-		*enc_data = (*enc_data >> 2) & 0x3f;
-		if (b & 0x80) {
-			*enc_data |= 0x80;
-		} else {
-			*enc_data |= 0x40;
-		}
-		b <<= 1;
-
-		if (i == 5) {
-			enc_data++;
-		}
-		i--;
-	}
+// Byte to Manchester symbol lookup table
+static struct ser4010_symbol_map rts_map;
 
-	return (enc_data+1);
-}
+// ODS configuration set by ser4010_rts_init(), for the frame air time
+static tOds_Setup rts_ods;
 
 int ser4010_rts_init(struct serco *sdev)
 {
-	int ret;
-	tOds_Setup rOdsSetup;
-	tPa_Setup rPaSetup;
-	float fFreq;
+	struct ser4010_dev_config cfg;
 
 	// Setup the PA.
 	// Zero out Alpha and Beta here. They have to do with the antenna.
 	// Chose a nice high PA Level. This value, along with the nominal cap
 	// come from the CAL SPREADSHEET 
-	rPaSetup.fAlpha      = 0;
-	rPaSetup.fBeta       = 0;
-	rPaSetup.bLevel      = 60;
-	rPaSetup.wNominalCap = 256;
-	rPaSetup.bMaxDrv     = 0;
+	cfg.pa.fAlpha      = 0;
+	cfg.pa.fBeta       = 0;
+	cfg.pa.bLevel      = 60;
+	cfg.pa.wNominalCap = 256;
+	cfg.pa.bMaxDrv     = 0;
 
 	// Setup the ODS 
-	rOdsSetup.bModulationType = 0;  // Use OOK
-	rOdsSetup.bClkDiv         = 5;
-	rOdsSetup.bEdgeRate       = 0;
-	rOdsSetup.bGroupWidth     = bRts_GroupWidth_c;
-	rOdsSetup.wBitRate        = wRts_BitRate_c;	// Bit width in seconds = (ods_datarate*(ods_ck_div+1))/24MHz
-	rOdsSetup.bLcWarmInt      = 8;
-	rOdsSetup.bDivWarmInt     = 5;
-	rOdsSetup.bPaWarmInt      = 4;
-
-	fFreq = 433.46e6;
-
-	ret = ser4010_set_ods(sdev, &rOdsSetup);
-	if (ret != STATUS_OK) {
-		return ret;
-	}
+	cfg.ods.bModulationType = 0;  // Use OOK
+	cfg.ods.bClkDiv         = 5;
+	cfg.ods.bEdgeRate       = 0;
+	cfg.ods.bGroupWidth     = bRts_GroupWidth_c;
+	cfg.ods.wBitRate        = wRts_BitRate_c;	// Bit width in seconds = (ods_datarate*(ods_ck_div+1))/24MHz
+	cfg.ods.bLcWarmInt      = 8;
+	cfg.ods.bDivWarmInt     = 5;
+	cfg.ods.bPaWarmInt      = 4;
 
-	ret = ser4010_set_pa(sdev, &rPaSetup);
-	if (ret != STATUS_OK) {
-		return ret;
+	cfg.freq = 433.46e6;
+
+	rts_ods = cfg.ods;
+
+	ser4010_symbol_map_init(&rts_map, 2,
+				SER4010_MANCHESTER_ZERO, SER4010_MANCHESTER_ONE);
+
+	return ser4010_set_fields(sdev, &cfg,
+			SER4010_CFG_ODS | SER4010_CFG_PA | SER4010_CFG_FREQ);
+}
+
+static uint8_t rts_calc_checksum(uint8_t frame[7])
+{
+	int checksum=0;
+	int i;
+
+	for (i=0; i < 7; i++) {
+		checksum ^= frame[i] & 0xf;
+		checksum ^= (frame[i] >> 4) & 0xf;
 	}
 
-	ret = ser4010_set_freq(sdev, fFreq);
-	if (ret != STATUS_OK) {
-		return ret;
+	return (checksum & 0xf);
+}
+
+void ser4010_rts_build_frame(uint8_t frame[7], uint8_t key, uint32_t addr,
+				uint16_t seq, uint8_t ctrl)
+{
+	int i;
+
+	frame[0] = 0xa0 | (key & 0xf);
+	frame[1] = (ctrl & 0xf) << 4;
+	frame[2] = (seq & 0xFF00) >> 8;
+	frame[3] = seq & 0xFF;
+	frame[4] = addr & 0xFF;
+	frame[5] = (addr & 0xFF00) >> 8;
+	frame[6] = (addr & 0xFF0000) >> 16;
+
+	// calculate checksum
+	frame[1] |= rts_calc_checksum(frame);
+
+	// encrypt
+	for (i=1; i < 7; i++) {
+		frame[i] = frame[i] ^ frame[i-1];
 	}
+}
 
-	return STATUS_OK;
+size_t ser4010_rts_encode(uint8_t data[7], uint8_t frame[SER4010_RTS_FRAME_SIZE])
+{
+	struct ser4010_packer packer;
+
+	ser4010_packer_init(&packer, &abRts_FrameArray[bRts_PreambleSize_c],
+				bRts_PayloadSize_c, bRts_GroupWidth_c);
+	ser4010_pack_bytes(&packer, &rts_map, data, 7);
+	ser4010_packer_finish(&packer, NULL);
+
+	memcpy(frame, abRts_FrameArray, bRts_MaxFrameSize_c);
+
+	return bRts_MaxFrameSize_c;
 }
 
 int ser4010_rts_send(struct serco *sdev, uint8_t data[7], bool long_press)
 {
 	int ret;
-  	uint8_t *pbFrameHead;		// Pointer to frame Head 
+	uint8_t frame[SER4010_RTS_FRAME_SIZE];
+	size_t len;
 	int frame_cnt;
-	int i;
 
 	if (long_press) {
-		frame_cnt = 200;
+		frame_cnt = SER4010_RTS_LONG_REPEATS;
 	} else {
-		frame_cnt = 4;
+		frame_cnt = SER4010_RTS_REPEATS;
 	}
 
-	pbFrameHead = &abRts_FrameArray[bRts_PreambleSize_c];
-	for (i = 0; i < 7; i++) {
-		pbFrameHead = encode_rts(pbFrameHead, data[i]);
-	}
+	len = ser4010_rts_encode(data, frame);
 
-	ret = ser4010_load_frame(sdev, abRts_FrameArray, bRts_MaxFrameSize_c);
+	// Only the payload changes between frames
+	ret = ser4010_load_frame_diff(sdev, frame, len);
 	if (ret != STATUS_OK) {
 		return ret;
 	}
@@ -155,3 +167,30 @@ int ser4010_rts_send(struct serco *sdev, uint8_t data[7], bool long_press)
 
 	return STATUS_OK;
 }
+
+int ser4010_rts_send_for(struct serco *sdev, uint8_t data[7],
+				unsigned int duration_ms)
+{
+	int ret;
+	uint8_t frame[SER4010_RTS_FRAME_SIZE];
+	size_t len;
+	unsigned long frame_us;
+	unsigned long max_cnt;
+
+	len = ser4010_rts_encode(data, frame);
+
+	ret = ser4010_load_frame_diff(sdev, frame, len);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	// Watchdog at twice the requested duration. The Manchester symbols are
+	// already in the frame, so the device doesn't encode.
+	frame_us = ser4010_frame_duration_us(&rts_ods, bEnc_NoneNrz_c, len);
+	max_cnt = 2 * (duration_ms * 1000UL / frame_us) + 1;
+	if (max_cnt > 0xffff) {
+		max_cnt = 0xffff;
+	}
+
+	return ser4010_send_for(sdev, duration_ms, max_cnt, NULL);
+}
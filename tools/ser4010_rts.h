@@ -31,6 +31,11 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#define SER4010_RTS_FRAME_SIZE		23	// Encoded frame size in bytes
+#define SER4010_RTS_REPEATS		4	// Frame count of normal press
+#define SER4010_RTS_LONG_REPEATS	200	// Frame count of long press
 
 /**
  * Init RF module for Somfy RTS usage
@@ -56,4 +61,48 @@ int ser4010_rts_init(struct serco *sdev);
  */
 int ser4010_rts_send(struct serco *sdev, uint8_t data[7], bool long_press);
 
+/**
+ * Send a RTS frame for a certain duration
+ *
+ * Repeats the frame for exactly 'duration_ms' milliseconds, rounded up to a
+ * whole frame, instead of a fixed number of frames. Use this to generate a
+ * long press of a certain length. Requires firmware revision 4 or newer.
+ *
+ * @param sdev		Serial Communication handle
+ * @param data		The 7-bytes frame data
+ * @param duration_ms	Time to send in milliseconds
+ */
+int ser4010_rts_send_for(struct serco *sdev, uint8_t data[7],
+				unsigned int duration_ms);
+
+/**
+ * Build frame data of a RTS command
+ *
+ * Fills in the key, control, rolling code and address, and adds the checksum
+ * and obfuscation.
+ *
+ * @param frame		Buffer to return the 7-bytes frame data in
+ * @param key		Key byte, only the low nibble is used
+ * @param addr		24-bit address of the remote
+ * @param seq		Rolling code
+ * @param ctrl		Control button bits: 1=My, 2=Up, 4=Down, 8=Prog
+ */
+void ser4010_rts_build_frame(uint8_t frame[7], uint8_t key, uint32_t addr,
+				uint16_t seq, uint8_t ctrl);
+
+/**
+ * Encode a RTS frame
+ *
+ * Manchester encodes the data in 'payload' and pre-/appends the
+ * preamble/Inter-frame gap. The result can be sent as is, or be combined
+ * with other frames using the ser4010_burst API. ser4010_rts_init() must
+ * have been called before.
+ *
+ * @param data		The 7-bytes frame data
+ * @param frame		Buffer to return the encoded frame in
+ *
+ * @returns		Length of encoded frame in bytes
+ */
+size_t ser4010_rts_encode(uint8_t data[7], uint8_t frame[SER4010_RTS_FRAME_SIZE]);
+
 #endif // __SER4010_RTS_H__
@@ -49,31 +49,10 @@
 #include "dehexify.h"
 #include "serco.h"
 #include "ser4010.h"
+#include "ser4010_encode.h"
 #include "crc_16.h"
 #include "pn9.h"
 
-/**
- * Reverse bit order in a byte
- */
-static inline uint8_t reverse_byte(uint8_t b)
-{
-	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
-	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
-	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
-
-	return b;
-}
-
-// Polynomials according to AN625
-// IEC-16:       X16+X14+X12+X11+X9+X8+X7+X4+X+1
-// Baicheva-16:  X16+X15+X12+X7+X6+X4+X3+1
-// CRC-16 (IBM): X16+X15+X2+1
-// CCIT-16:      X16+X12+X5+1
-#define POLY_IEC_16	(0x5B93)
-#define POLY_BAICHEVA	(0x90D9)
-#define POLY_CRC_16	(0x8005)
-#define POLY_CCITT_16	(0x1021)
-
 enum CrcType {
 	CCITT,
 	CRC_16,
@@ -186,7 +165,7 @@ int ser4010_si443x_send(struct serco *sdev,
 
 	// CRC
 	if (cfg->crc_enabled) {
-		uint16_t crc = 0;
+		uint16_t crc;
 		uint16_t polynomial = 0;
 		uint8_t *p;
 
@@ -213,32 +192,24 @@ int ser4010_si443x_send(struct serco *sdev,
 			p = pkt_start;
 		}
 
-		while (p < bp) {
-			uint8_t b = *p;
-			if (cfg->lsb_first) {
-				b = reverse_byte(b);
-			}
-			crc = crc_16(crc, b, polynomial);
-			p++;
-		}
 		if (cfg->lsb_first) {
-			crc = (reverse_byte(crc >> 8) << 8) | reverse_byte(crc & 0xff);
+			// The reflected CRC equals the CRC calculated over
+			// the bit reversed input bytes with the result bit
+			// reversed, so the byte order flips.
+			crc = crc_16_update_reflected(0, p, bp - p, polynomial);
+			bp[0] = crc & 0xff;
+			bp[1] = crc >> 8;
+		} else {
+			crc = crc_16_update(0, p, bp - p, polynomial);
+			bp[0] = crc >> 8;
+			bp[1] = crc & 0xff;
 		}
-
-		bp[0] = crc >> 8;
-		bp[1] = crc & 0xff;
 		bp += 2;
 	}
 
 	// Data Whitening
 	if (cfg->whitening_enabled) {
-		uint16_t pn9 = PN9_INITIALIZER;
-		uint8_t *p;
-
-		for (p = pkt_start; p < bp; p++) {
-			pn9 = pn9_next_byte(pn9);
-			*p ^= reverse_byte(pn9>>1);
-		}
+		pn9_whiten(pkt_start, bp - pkt_start);
 	}
 
 	// Manchester Encoding
@@ -248,12 +219,12 @@ int ser4010_si443x_send(struct serco *sdev,
 	}
 
 	// LSB first
-	if (! cfg->lsb_first || manchester_invert) {
+	if (! cfg->lsb_first) { // Si4010 does LSB first by default.
+		ser4010_reverse_bytes(buf, bp - buf);
+	}
+	if (manchester_invert) {
 		uint8_t *p;
 		for (p = buf; p < bp; p++) {
-			if (! cfg->lsb_first) { // Si4010 does LSB first by default.
-				*p = reverse_byte(*p);
-			}
 			*p ^= manchester_invert;
 		}
 	}
@@ -34,18 +34,34 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 
 #include "dehexify.h"
 #include "serco.h"
 #include "ser4010_rts.h"
+#include "batch_input.h"
+#include "str_to_args.h"
+#include "somfy_store.h"
+#include "ser4010_burst.h"
+
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof((a)[0]))
 
 /**
  * Send long button press or normal button press
  */
 bool long_press = false;
 
+/**
+ * Duration of button press in milliseconds, 0 for default
+ */
+unsigned int press_ms = 0;
+
+/**
+ * Rolling code store, NULL if not used
+ */
+struct somfy_store *store = NULL;
+
 typedef enum {
 	CONTROL_MY	= 0x1,
 	CONTROL_UP	= 0x2,
@@ -58,10 +74,19 @@ void usage(char *my_name) {
 	fprintf(stderr, "\t%s [Options..] -r raw_frame\n", my_name);
 	fprintf(stderr, "\t%s [Options..] up|down|my|prog key address sequence\n", my_name);
 	fprintf(stderr, "\t%s [Options..] up|down|my|prog state_file\n", my_name);
+	fprintf(stderr, "\t%s [Options..] -s store up|down|my|prog address...\n", my_name);
+	fprintf(stderr, "\t%s [Options..] -s store -I state_file...\n", my_name);
+	fprintf(stderr, "\t%s [Options..] -s store -L\n", my_name);
+	fprintf(stderr, "\t%s [Options..] -b batch_file\n", my_name);
 	fprintf(stderr, "\n"
 			"Options:\n"
 			" -d <path>  Serial device path\n"
 			" -l         Generate long button press\n"
+			" -t <ms>    Press button for exact duration in milliseconds\n"
+			" -b <path>  Read commands from file, FIFO or stdin('-')\n"
+			" -s <path>  Use rolling code store, created if it doesn't exist\n"
+			" -I         Import state files into rolling code store\n"
+			" -L         List remotes in rolling code store\n"
 			" -h         Display this help message\n"
 		);
 	fprintf(stderr, "\n"
@@ -76,6 +101,17 @@ void usage(char *my_name) {
 			" AAAAAA = Address in Hexadecimal.\n"
 			" RRRR = Rolling code in Hexadecimal.\n"
 			"State files are automatically updated to the next sequence and key after use.\n");
+	fprintf(stderr, "\n"
+			"A rolling code store holds the state of many remotes in a single file,\n"
+			"indexed by address. It can safely be used by concurrent processes, and\n"
+			"never reuses a rolling code after a crash or power loss. If multiple\n"
+			"addresses are given, their frames are uploaded and sent together.\n");
+	fprintf(stderr, "\n"
+			"In batch mode every line contains the arguments of one command, or\n"
+			"'raw' followed by raw frame data. The serial port is kept open between\n"
+			"commands. For every command the line number, 'OK' or 'ERR' followed by\n"
+			"the error code, and the latency in milliseconds is written to stdout.\n"
+			"A FIFO is reopened when all writers close it.\n");
 
 }
 
@@ -165,19 +201,6 @@ bad:
 	return retval;
 }
 
-uint8_t somfy_calc_checksum(uint8_t frame[7])
-{
-	int checksum=0;
-	int i;
-
-	for (i=0; i < 7; i++) {
-		checksum ^= frame[i] & 0xf;
-		checksum ^= (frame[i] >> 4) & 0xf;
-	}
-
-	return (checksum & 0xf);
-}
-
 int send_somfy_raw(struct serco *dev, uint8_t data[7])
 {
 #ifdef SOMFY_DEBUG
@@ -188,77 +211,396 @@ int send_somfy_raw(struct serco *dev, uint8_t data[7])
 	putchar('\n');
 #endif
 
+	if (press_ms != 0) {
+		return ser4010_rts_send_for(dev, data, press_ms);
+	}
+
 	return ser4010_rts_send(dev, data, long_press);
 }
 
 int send_somfy_command(struct serco *dev, uint8_t key, uint32_t addr, uint16_t seq, somfy_control_t ctrl)
 {
 	unsigned char frame[7];
+
+	ser4010_rts_build_frame(frame, key, addr, seq, ctrl);
+
+	return send_somfy_raw(dev, frame);
+}
+
+/**
+ * Check if all arguments are addresses
+ *
+ * @returns	true if every argument is a 6 digit hexadecimal string
+ */
+bool all_addresses(int argc, char **argv)
+{
 	int i;
 
-	frame[0] = 0xa0 | (key & 0xf);
-	switch (ctrl) {
-	case CONTROL_MY:
-		frame[1] = 1 << 4;
-		break;
-	case CONTROL_UP:
-		frame[1] = 2 << 4;
-		break;
-	case CONTROL_DOWN:
-		frame[1] = 4 << 4;
-		break;
-	case CONTROL_PROG:
-		frame[1] = 8 << 4;
-		break;
-	default:
-		assert(0);
-	}
-	frame[2] = (seq & 0xFF00) >> 8;
-	frame[3] = seq & 0xFF;
-	frame[4] = addr & 0xFF;
-	frame[5] = (addr & 0xFF00) >> 8;
-	frame[6] = (addr & 0xFF0000) >> 16;
-
-	// calculate checksum
-	frame[1] |= somfy_calc_checksum(frame);
-
-	// encrypt
-	for (i=1; i < 7; i++) {
-		frame[i] = frame[i] ^ frame[i-1];
+	for (i = 0; i < argc; i++) {
+		if (strlen(argv[i]) != 6 ||
+				strspn(argv[i], "0123456789abcdefABCDEF") != 6) {
+			return false;
+		}
 	}
 
-	return send_somfy_raw(dev, frame);
+	return true;
 }
 
-int main(int argc, char **argv)
+/**
+ * Send command to multiple remotes from store in bursts
+ *
+ * The frames of as many remotes as fit in the device frame buffer are
+ * uploaded at once, and sent together.
+ *
+ * @param argc	Number of addresses
+ * @param argv	Hexadecimal addresses of remotes in store
+ *
+ * @returns	STATUS_OK on success, status code on device error, -1 on
+ *		communication error, or -EINVAL/-EIO on argument/store error.
+ */
+int send_somfy_burst(struct serco *dev, somfy_control_t ctrl, int argc, char **argv)
 {
-	struct serco dev;
+	struct ser4010_burst burst;
+	uint8_t data[7];
+	uint8_t frame[SER4010_RTS_FRAME_SIZE];
+	size_t len;
+	uint8_t key;
+	uint32_t addr;
+	uint16_t seq;
+	unsigned int saved;
+	unsigned int total_saved = 0;
+	unsigned int bursts = 0;
+	char *sp;
 	int ret;
+	int i;
 
-	int opt;
-	enum { RAW, NORMAL } mode = NORMAL;
-	char *dev_path = NULL;
-	char *state_file_path = NULL;
+	// Check all addresses before consuming any rolling codes
+	for (i = 0; i < argc; i++) {
+		addr = strtol(argv[i], &sp, 16);
+		if (*sp != '\0' || strlen(argv[i]) != 6) {
+			fprintf(stderr, "address must be a hexadecimal 3 byte string(eg. 001122)\n");
+			return -EINVAL;
+		}
+		if (somfy_store_get(store, addr, &key, &seq) != 0) {
+			fprintf(stderr, "address %.6x not in state store\n", addr);
+			return -EINVAL;
+		}
+	}
+
+	ser4010_burst_init(&burst);
+	for (i = 0; i <= argc; i++) {
+		if (i < argc) {
+			addr = strtol(argv[i], NULL, 16);
+			if (somfy_store_next(store, addr, &key, &seq) != 0) {
+				return -EIO;
+			}
+			ser4010_rts_build_frame(data, key, addr, seq, ctrl);
+			len = ser4010_rts_encode(data, frame);
+
+			if (ser4010_burst_add(&burst, frame, len) == 0) {
+				continue;
+			}
+		}
+
+		ret = ser4010_burst_send(dev, &burst, SER4010_RTS_REPEATS,
+						&saved);
+		if (ret != STATUS_OK) {
+			return ret;
+		}
+		bursts++;
+		total_saved += saved;
+
+		ser4010_burst_init(&burst);
+		if (i < argc) {
+			ser4010_burst_add(&burst, frame, len);
+		}
+	}
 
-	somfy_control_t ctrl = CONTROL_MY;
+	printf("Sent %d frames in %u bursts, saved %u round trips\n",
+			argc, bursts, total_saved);
+
+	return STATUS_OK;
+}
+
+struct somfy_cmd {
+	enum { RAW, NORMAL } mode;
+	somfy_control_t ctrl;
 	uint8_t key;
 	uint32_t addr;
 	uint16_t seq;
-
+	const char *state_file_path;	// NULL if key/addr/seq given directly
+	bool use_store;			// Get key/seq of addr from store
 	uint8_t raw_data[7];
+};
+
+/**
+ * Parse command arguments
+ *
+ * The state file path in 'cmd' points into the 'argv' strings.
+ *
+ * @param argc	Number of arguments
+ * @param argv	Arguments, without options
+ * @param raw	Parse argument as raw frame data
+ * @param cmd	Pointer to command structure to fill
+ *
+ * @returns	0 on success, -EINVAL on failure
+ */
+int parse_command(int argc, char **argv, bool raw, struct somfy_cmd *cmd)
+{
+	char *sp;
+
+	memset(cmd, 0, sizeof(*cmd));
+
+	if (raw) {
+		cmd->mode = RAW;
+		if (argc != 1) {
+			fprintf(stderr, "Incorrect amount of arguments\n");
+			return -EINVAL;
+		}
+		if (strlen(argv[0]) != 14 ||
+				dehexify(argv[0], 7, cmd->raw_data) != 0) {
+			fprintf(stderr, "data must be a hexadecimal 56-bit/7 byte(eg. 11223344556677)\n");
+			return -EINVAL;
+		}
+
+		return 0;
+	}
+
+	cmd->mode = NORMAL;
+	if (argc != 2 && argc != 4) {
+		fprintf(stderr, "Incorrect amount of arguments\n");
+		return -EINVAL;
+	}
+
+	if (strcmp(argv[0], "down") == 0) {
+		cmd->ctrl = CONTROL_DOWN;
+	} else if (strcmp(argv[0], "up") == 0) {
+		cmd->ctrl = CONTROL_UP;
+	} else if (strcmp(argv[0], "my") == 0) {
+		cmd->ctrl = CONTROL_MY;
+	} else if (strcmp(argv[0], "prog") == 0) {
+		cmd->ctrl = CONTROL_PROG;
+	} else {
+		fprintf(stderr, "illegal control name\n");
+		return -EINVAL;
+	}
+
+	if (argc == 2 && store != NULL) {
+		cmd->use_store = true;
+		cmd->addr = strtol(argv[1], &sp, 16);
+		if (*sp != '\0' || strlen(argv[1]) != 6) {
+			fprintf(stderr, "address must be a hexadecimal 3 byte string(eg. 001122)\n");
+			return -EINVAL;
+		}
+		return 0;
+	}
+
+	if (argc == 2) {
+		cmd->state_file_path = argv[1];
+		return 0;
+	}
+
+	cmd->key = strtol(argv[1], &sp, 16);
+	if (*sp != '\0' || strlen(argv[1]) != 2) {
+		fprintf(stderr, "key must be a hexadecimal 1 byte string(eg. 01)\n");
+		return -EINVAL;
+	}
+
+	cmd->addr = strtol(argv[2], &sp, 16);
+	if (*sp != '\0' || strlen(argv[2]) != 6) {
+		fprintf(stderr, "address must be a hexadecimal 3 byte string(eg. 001122)\n");
+		return -EINVAL;
+	}
+
+	cmd->seq = strtol(argv[3], &sp, 0);
+	if (*sp != '\0') {
+		fprintf(stderr, "illegal sequence format\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Send command and update state file
+ *
+ * @returns	STATUS_OK on success, status code on device error, -1 on
+ *		communication error, or -EIO on state file error.
+ */
+int run_command(struct serco *dev, struct somfy_cmd *cmd)
+{
+	int ret;
+
+	if (cmd->mode == RAW) {
+		return send_somfy_raw(dev, cmd->raw_data);
+	}
+
+	if (cmd->use_store) {
+		// Rolling code is consumed before sending, so a crash can
+		// never cause it to be reused.
+		if (somfy_store_next(store, cmd->addr, &cmd->key,
+					&cmd->seq) != 0) {
+			return -EIO;
+		}
+	} else if (cmd->state_file_path != NULL) {
+		if (read_state_file(cmd->state_file_path, &cmd->key,
+					&cmd->addr, &cmd->seq) != 0) {
+			return -EIO;
+		}
+	}
+
+	ret = send_somfy_command(dev, cmd->key, cmd->addr, cmd->seq, cmd->ctrl);
+	if (ret != STATUS_OK) {
+		return ret;
+	}
+
+	if (cmd->state_file_path != NULL) {
+		cmd->key = 0xa0 | ((cmd->key + 1) & 0xf);
+		cmd->seq++;
+		if (write_state_file(cmd->state_file_path, cmd->key,
+					cmd->addr, cmd->seq) != 0) {
+			return -EIO;
+		}
+	}
+
+	return STATUS_OK;
+}
+
+/**
+ * Process commands from batch input until end of input
+ *
+ * Every line contains the arguments of one command. Lines starting with
+ * 'raw' contain raw frame data.
+ *
+ * @returns	0 if all commands succeeded, else -1
+ */
+int run_batch(struct serco *dev, const char *batch_path)
+{
+	struct batch_input in;
+	struct timespec start;
+	struct somfy_cmd cmd;
+	char line[1024];
+	char *line_argv[6];
+	int line_argc;
+	int retval = 0;
+	int ret;
+
+	if (batch_open(&in, batch_path) != 0) {
+		return -1;
+	}
+
+	while (batch_read_line(&in, line, sizeof(line)) != NULL) {
+		line_argc = str_to_args(line, line_argv, ARRAY_SIZE(line_argv));
+		if (line_argc == 0 || line_argv[0][0] == '#') {
+			// Ignore empty lines and comments
+			continue;
+		}
+
+		batch_timer_start(&start);
+
+		if (strcmp(line_argv[0], "raw") == 0) {
+			ret = parse_command(line_argc - 1, &line_argv[1], true,
+						&cmd);
+		} else {
+			ret = parse_command(line_argc, line_argv, false, &cmd);
+		}
+		if (ret == 0) {
+			ret = run_command(dev, &cmd);
+		}
+		if (ret != STATUS_OK) {
+			retval = -1;
+		}
+
+		batch_report(&in, ret, &start);
+	}
+
+	batch_close(&in);
+
+	return retval;
+}
+
+/**
+ * Import state files into store
+ *
+ * @returns	0 on success, -1 if one or more files failed to import
+ */
+int import_state_files(int argc, char **argv)
+{
+	uint8_t key;
+	uint32_t addr;
+	uint16_t seq;
+	int retval = 0;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (read_state_file(argv[i], &key, &addr, &seq) != 0 ||
+				somfy_store_add(store, addr, key, seq) != 0) {
+			fprintf(stderr, "Failed to import '%s'\n", argv[i]);
+			retval = -1;
+		}
+	}
+
+	return retval;
+}
+
+int print_store_entry(uint32_t addr, uint8_t key, uint16_t seq, void *arg)
+{
+	(void) arg;
+
+	printf("%.2x %.6x %.4x\n", key, addr, seq);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct serco dev;
+	int ret;
+
+	int opt;
+	bool raw = false;
+	char *dev_path = NULL;
+	char *batch_path = NULL;
+	char *store_path = NULL;
+	enum { SEND, IMPORT, LIST } action = SEND;
+	struct somfy_store store_buf;
+	char **burst_argv = NULL;
+	int burst_argc = 0;
+
+	struct somfy_cmd cmd;
+	char *sp;
 
 	int retval = 1;
 
 	dev_path = DEFAULT_SERIAL_DEV;
 
-	while ((opt = getopt(argc, argv, "rld:h")) != -1) {
+	while ((opt = getopt(argc, argv, "rlt:b:s:ILd:h")) != -1) {
 		switch (opt) {
 		case 'r':
-			mode = RAW;
+			raw = true;
 			break;
 		case 'l':
 			long_press = true;
 			break;
+		case 't':
+			press_ms = strtoul(optarg, &sp, 0);
+			if (*sp != '\0' || press_ms == 0) {
+				fprintf(stderr, "illegal press duration\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'b':
+			batch_path = optarg;
+			break;
+		case 's':
+			store_path = optarg;
+			break;
+		case 'I':
+			action = IMPORT;
+			break;
+		case 'L':
+			action = LIST;
+			break;
 		case 'd':
 			dev_path = optarg;
 			break;
@@ -272,78 +614,49 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (mode == RAW) {
-		if (argc - optind != 1) {
-			usage(argv[0]);
-			exit(1);
-		}
-		if (strlen(argv[optind]) != 14) {
-			fprintf(stderr, "data must be a hexadecimal 56-bit/7 byte(eg. 11223344556677)\n");
+	if (store_path != NULL) {
+		if (somfy_store_open(&store_buf, store_path) != 0) {
 			exit(1);
 		}
+		store = &store_buf;
+	} else if (action != SEND) {
+		fprintf(stderr, "-I and -L require a store (-s)\n");
+		exit(1);
+	}
 
-		if (dehexify(argv[optind], 7, raw_data) != 0) {
-			fprintf(stderr, "data must be a hexadecimal 56-bit/7 byte(eg. 11223344556677)\n");
-			exit(1);
+	if (action == IMPORT) {
+		if (import_state_files(argc - optind, &argv[optind]) == 0) {
+			retval = 0;
 		}
+		goto bad1;
+	} else if (action == LIST) {
+		somfy_store_foreach(store, print_store_entry, NULL);
+		retval = 0;
+		goto bad1;
+	}
 
-	} else {
-		char *sp;
-
-		if (argc - optind != 2 && argc - optind != 4) {
+	if (batch_path != NULL) {
+		if (argc - optind != 0 || raw) {
 			usage(argv[0]);
-			exit(1);
-		}
-
-		if (strcmp(argv[optind], "down") == 0) {
-			ctrl = CONTROL_DOWN;
-		} else if (strcmp(argv[optind], "up") == 0) {
-			ctrl = CONTROL_UP;
-		} else if (strcmp(argv[optind], "my") == 0) {
-			ctrl = CONTROL_MY;
-		} else if (strcmp(argv[optind], "prog") == 0) {
-			ctrl = CONTROL_PROG;
-		} else {
-			fprintf(stderr, "illegal control name\n");
-			usage(argv[0]);
-			exit(1);
+			goto bad1;
 		}
-		optind++;
-
-		if (argc - optind == 1) {
-			state_file_path = strdup(argv[optind]);
-			optind++;
-		} else {
-			key = strtol(argv[optind], &sp, 16);
-			if (*sp != '\0' || strlen(argv[optind]) != 2) {
-				fprintf(stderr, "key must be a hexadecimal 1 byte string(eg. 01)\n");
-				usage(argv[0]);
-				exit(1);
-			}
-			optind++;
-
-			addr = strtol(argv[optind], &sp, 16);
-			if (*sp != '\0' || strlen(argv[optind]) != 6) {
-				fprintf(stderr, "address must be a hexadecimal 3 byte string(eg. 001122)\n");
-				usage(argv[0]);
-				exit(1);
-			}
-			optind++;
-
-			seq = strtol(argv[optind], &sp, 0);
-			if (*sp != '\0') {
-				fprintf(stderr, "illegal sequence format\n");
-				usage(argv[0]);
-				exit(1);
-			}
-			optind++;
+	} else if (store != NULL && !raw && argc - optind > 2 &&
+			all_addresses(argc - optind - 1, &argv[optind + 1])) {
+		// Multiple addresses, send in bursts
+		if (long_press || press_ms != 0) {
+			fprintf(stderr, "long press not supported for multiple addresses\n");
+			goto bad1;
 		}
-	}
-
-	if (state_file_path != NULL) {
-		if (read_state_file(state_file_path, &key, &addr, &seq) != 0) {
+		if (parse_command(2, &argv[optind], raw, &cmd) != 0) {
+			usage(argv[0]);
 			goto bad1;
 		}
+		cmd.use_store = false;
+		burst_argc = argc - optind - 1;
+		burst_argv = &argv[optind + 1];
+	} else if (parse_command(argc - optind, &argv[optind], raw, &cmd) != 0) {
+		usage(argv[0]);
+		goto bad1;
 	}
 
 	if (serco_open(&dev, dev_path) != 0) {
@@ -363,10 +676,19 @@ int main(int argc, char **argv)
 		goto bad1;
 	}
 
-	if (mode == RAW) {
-		ret = send_somfy_raw(&dev, raw_data);
+	if (batch_path != NULL) {
+		ret = run_batch(&dev, batch_path);
+		serco_close(&dev);
+		if (ret == 0) {
+			retval = 0;
+		}
+		goto bad1;
+	}
+
+	if (burst_argv != NULL) {
+		ret = send_somfy_burst(&dev, cmd.ctrl, burst_argc, burst_argv);
 	} else {
-		ret = send_somfy_command(&dev, key, addr, seq, ctrl);
+		ret = run_command(&dev, &cmd);
 	}
 
 	serco_close(&dev);
@@ -376,27 +698,18 @@ int main(int argc, char **argv)
 			fprintf(stderr, "Result status indicates error 0x%.2x\n", ret);
 		} else if (ret == -1) {
 			perror("Failed sending command");
-		} else {
+		} else if (ret != -EIO) {
 			fprintf(stderr, "Failed sending command: %d\n", ret);
 		}
 		goto bad1;
 	}
 
-	if (state_file_path != NULL) {
-		key = 0xa0 | ((key + 1) & 0xf);
-		seq++;
-		if (write_state_file(state_file_path, key, addr, seq) != 0) {
-			goto bad1;
-		}
-	}
-
 	retval = 0;
 
 bad1:
-	if (state_file_path != NULL) {
-		free(state_file_path);
+	if (store != NULL) {
+		somfy_store_close(store);
 	}
 
 	return retval;
 }
-
@@ -29,10 +29,12 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <getopt.h>
 
@@ -43,13 +45,148 @@ void usage(const char *name)
 {
 	fprintf(stderr,
 		"usage: %s [options] <start_hz> <end_hz> <step>\n"
+		"       %s [options] -l <freq_hz>[,<freq_hz>...]\n"
 		"\n"
 		"Options:\n"
 		" -d <path>	Path to serial device file\n"
+		" -l <list>	Send on comma separated list of frequencies, max. %d\n"
+		" -n <count>	Number of pulses per frequency (default: 1)\n"
+		" -p		Step on the host, one command per frequency. Used\n"
+		"		automatically for firmware before revision 9.\n"
+		" -r		Wait for the response of every command, with -p\n"
 		" -h		Print this help message\n"
 		"\n"
 		"WARNING: Only use for testing purposes in a controlled environment.\n"
-		, name);
+		, name, name, SWEEP_MAX_HOPS);
+}
+
+static bool freq_in_range(float freq)
+{
+	return (freq >= 27 * 1000 * 1000 && freq < 960 * 1000 * 1000);
+}
+
+/**
+ * Sweep by sending a SET_FREQ and RF_SEND for every frequency
+ *
+ * @param freqs	List of 'len' frequencies, or NULL to use start + i * step
+ */
+static int sweep_host(struct serco *sdev, const float *freqs, float start,
+			float step, size_t len, unsigned int dwell,
+			unsigned long frame_us, bool wait_response)
+{
+	float freq;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < len; i++) {
+		freq = (freqs != NULL) ? freqs[i] : start + i * step;
+		printf("Sending at %f\n", freq);
+		if (wait_response) {
+			ret = ser4010_set_freq(sdev, freq);
+		} else {
+			// Errors are reported by a later sync point
+			ret = ser4010_set_freq_nr(sdev, freq);
+		}
+		if (ret != STATUS_OK) {
+			fprintf(stderr, "ser4010_set_freq() Failed: %d\n", ret);
+			return ret;
+		}
+
+		if (wait_response) {
+			ret = ser4010_send(sdev, dwell);
+		} else {
+			ret = ser4010_send_nr(sdev, dwell, frame_us);
+		}
+		if (ret != STATUS_OK) {
+			fprintf(stderr, "ser4010_send() Failed: %d\n", ret);
+			return ret;
+		}
+	}
+
+	ret = serco_sync(sdev);
+	if (ret != STATUS_OK) {
+		fprintf(stderr, "Sending failed: %d\n", ret);
+	}
+
+	return ret;
+}
+
+/**
+ * Sweep on the device, in parts that fit in the command time-out
+ *
+ * @returns	0 on success, STATUS_UNKNOWN_CMD if the firmware is too old,
+ *		else an error occurred
+ */
+static int sweep_device(struct serco *sdev, float start, float step,
+			size_t len, unsigned int dwell, unsigned long frame_us)
+{
+	unsigned long part_len;
+	unsigned int cnt;
+	float part_start;
+	size_t i;
+	int ret;
+
+	part_len = (SER4010_SWEEP_MAX_US - SER4010_TX_SETUP_US) /
+			(dwell * frame_us + SER4010_TX_RETUNE_US);
+	if (part_len == 0) {
+		fprintf(stderr, "Frame too long to sweep on device\n");
+		return ERANGE;
+	}
+
+	for (i = 0; i < len; i += part_len) {
+		if (part_len > len - i) {
+			part_len = len - i;
+		}
+		part_start = start + i * step;
+		printf("Sending at %f - %f\n", part_start,
+				part_start + (part_len - 1) * step);
+
+		// Stop halfway the last step, so rounding can't add a step
+		ret = ser4010_send_sweep(sdev, part_start,
+					part_start + (part_len - 0.5) * step,
+					step, dwell, frame_us, &cnt);
+		if (ret != STATUS_OK) {
+			if (ret != STATUS_UNKNOWN_CMD) {
+				fprintf(stderr, "ser4010_send_sweep() Failed: %d\n",
+						ret);
+			}
+			return ret;
+		}
+		if (cnt != part_len) {
+			fprintf(stderr, "Sweep stopped after %u of %lu "
+					"frequencies\n", cnt, part_len);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Parse comma separated frequency list
+ *
+ * @returns	Number of frequencies, or 0 on error
+ */
+static size_t parse_list(char *arg, float *freqs, size_t max_len)
+{
+	char *tok;
+	char *endptr;
+	size_t len = 0;
+
+	for (tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		if (len == max_len) {
+			fprintf(stderr, "Too many frequencies in list\n");
+			return 0;
+		}
+		freqs[len] = strtof(tok, &endptr);
+		if (*endptr != '\0' || !freq_in_range(freqs[len])) {
+			fprintf(stderr, "Invalid frequency in list: %s\n", tok);
+			return 0;
+		}
+		len++;
+	}
+
+	return len;
 }
 
 int main(int argc, char *argv[])
@@ -58,11 +195,20 @@ int main(int argc, char *argv[])
 	int opt;
 
 	char *dev_path;
-	float freq;
+	char *list_arg = NULL;
+	float freq = 0;
 	float end_freq;
-	float step;
+	float step = 0;
+	float freqs[SWEEP_MAX_HOPS];
+	size_t len;
+	unsigned int dwell = 1;
 
 	struct serco sdev;
+	struct ser4010_dev_config cfg;
+	unsigned long frame_us;
+	bool host_steps = false;
+	bool wait_response = false;
+	struct timespec start, end;
 
 	// Array which holds the frame bits
 	// WARNING: LSB shifted out first!!!!!
@@ -72,12 +218,28 @@ int main(int argc, char *argv[])
 	// Default device path
 	dev_path = strdup(DEFAULT_SERIAL_DEV);
 
-	while ((opt = getopt(argc, argv, "d:h")) != -1) {
+	while ((opt = getopt(argc, argv, "d:l:n:prh")) != -1) {
 		switch (opt) {
 		case 'd':
 			free(dev_path);
 			dev_path = strdup(optarg);
 			break;
+		case 'l':
+			list_arg = optarg;
+			break;
+		case 'n':
+			dwell = strtoul(optarg, NULL, 0);
+			if (dwell < 1 || dwell > 255) {
+				fprintf(stderr, "Pulse count out of range\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'p':
+			host_steps = true;
+			break;
+		case 'r':
+			wait_response = true;
+			break;
 		case 'h':
 			usage(argv[0]);
 			exit(EXIT_SUCCESS);
@@ -88,25 +250,40 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (argc - optind != 3) {
-		fprintf(stderr, "Incorrect number of arguments\n");
-		exit(EXIT_FAILURE);
-	}
+	if (list_arg != NULL) {
+		if (argc - optind != 0) {
+			fprintf(stderr, "Incorrect number of arguments\n");
+			exit(EXIT_FAILURE);
+		}
+		len = parse_list(list_arg, freqs, SWEEP_MAX_HOPS);
+		if (len == 0) {
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		if (argc - optind != 3) {
+			fprintf(stderr, "Incorrect number of arguments\n");
+			exit(EXIT_FAILURE);
+		}
 
-	freq = strtof(argv[optind], NULL);
-	if (freq < 27 * 1000 * 1000 || freq >= 960 * 1000 * 1000) {
-		fprintf(stderr, "Start frequency out of range\n");
-		exit(EXIT_FAILURE);
-	}
-	end_freq = strtof(argv[optind + 1], NULL);
-	if (end_freq < 27 * 1000 * 1000 || end_freq >= 960 * 1000 * 1000) {
-		fprintf(stderr, "End frequency out of range\n");
-		exit(EXIT_FAILURE);
-	}
-	step = strtof(argv[optind + 2], NULL);
-	if (step < 0 || step > 960 * 1000 * 1000) {
-		fprintf(stderr, "Frequency step out of range\n");
-		exit(EXIT_FAILURE);
+		freq = strtof(argv[optind], NULL);
+		if (!freq_in_range(freq)) {
+			fprintf(stderr, "Start frequency out of range\n");
+			exit(EXIT_FAILURE);
+		}
+		end_freq = strtof(argv[optind + 1], NULL);
+		if (!freq_in_range(end_freq)) {
+			fprintf(stderr, "End frequency out of range\n");
+			exit(EXIT_FAILURE);
+		}
+		step = strtof(argv[optind + 2], NULL);
+		if (step <= 0 || step > 960 * 1000 * 1000) {
+			fprintf(stderr, "Frequency step out of range\n");
+			exit(EXIT_FAILURE);
+		}
+
+		// Same frequencies as the device computes
+		for (len = 0; freq + len * step < end_freq; len++)
+			;
 	}
 
 	// open/init SER4010
@@ -121,22 +298,43 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	while (freq < end_freq) {
-		printf("Sending at %f\n", freq);
-		ret = ser4010_set_freq(&sdev, freq);
-		if (ret != STATUS_OK) {
-			fprintf(stderr, "ser4010_set_freq() Failed: %d", ret);
-			exit(EXIT_FAILURE);
-		}
+	// Needed to know how long the device is busy sending
+	if ((ret = ser4010_get_all(&sdev, &cfg)) != STATUS_OK) {
+		fprintf(stderr, "Failed to read configuration: %d", ret);
+		exit(EXIT_FAILURE);
+	}
+	frame_us = ser4010_frame_duration_us(&cfg.ods, cfg.enc,
+						sizeof(frame_buf));
 
-		ret = ser4010_send(&sdev, 1);
-		if (ret != STATUS_OK) {
-			fprintf(stderr, "ser4010_send() Failed: %d", ret);
-			exit(EXIT_FAILURE);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = STATUS_UNKNOWN_CMD;
+	if (!host_steps) {
+		if (list_arg != NULL) {
+			ret = ser4010_send_hops(&sdev, freqs, len, dwell,
+						frame_us, NULL);
+			if (ret != STATUS_OK && ret != STATUS_UNKNOWN_CMD) {
+				fprintf(stderr, "ser4010_send_hops() Failed: %d\n",
+						ret);
+			}
+		} else if (len > 0) {
+			ret = sweep_device(&sdev, freq, step, len, dwell,
+						frame_us);
 		}
-
-		freq += step;
 	}
+	if (ret == STATUS_UNKNOWN_CMD) {
+		// Firmware before rev. 9
+		ret = sweep_host(&sdev, (list_arg != NULL) ? freqs : NULL,
+					freq, step, len, dwell, frame_us,
+					wait_response);
+	}
+	if (ret != STATUS_OK) {
+		exit(EXIT_FAILURE);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	fprintf(stderr, "Swept %zu frequencies in %.1f ms\n", len,
+			(end.tv_sec - start.tv_sec) * 1000.0 +
+			(end.tv_nsec - start.tv_nsec) / 1000000.0);
 
 	serco_close(&sdev);
 
@@ -0,0 +1,685 @@
+/**
+ * ser4010_trace.c - Decode and replay serial traffic captures
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "serco.h"
+#include "serco_trace.h"
+
+#define MAX_FRAME_LEN 600
+#define DEFAULT_SLACK_MS 1000
+
+struct decoder {
+	uint8_t buf[MAX_FRAME_LEN];
+	size_t len;
+	bool stuff_first;
+	bool comm_error;
+};
+
+struct pending {
+	bool valid;
+	uint8_t opcode;
+	uint64_t time_us;
+};
+
+struct op_stats {
+	unsigned long cnt;	// Commands sent
+	unsigned long nr_cnt;	// Commands sent without response
+	unsigned long res_cnt;	// Responses received
+	unsigned long err_cnt;	// Responses with error status
+	unsigned long lost_cnt;	// Commands that weren't responded to
+	uint64_t min_us;
+	uint64_t max_us;
+	uint64_t sum_us;
+};
+
+struct analysis {
+	bool verbose;
+	bool hexdump;
+	struct decoder tx;
+	struct decoder rx;
+	struct pending pending[256];
+	struct op_stats ops[128];
+	unsigned long tx_bytes;
+	unsigned long rx_bytes;
+	unsigned long markers;		// Empty frames, e.g. CMD_RF_SEND stop
+	unsigned long bad_frames;	// Stuffing or CRC errors
+	unsigned long unmatched;	// Responses to unknown frame IDs
+	unsigned long flushes;
+	unsigned int sessions;
+	uint64_t duration_us;		// Sum of session durations
+};
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] <trace file>\n"
+		"\n"
+		"Decodes a capture of serial traffic into frames, and reports the\n"
+		"response latency per opcode. Captures are made by setting the\n"
+		"SER4010_CAPTURE environment variable to a file name when running\n"
+		"any SER4010 tool.\n"
+		"\n"
+		"With -r the capture is replayed against a device, or ser4010_emu.\n"
+		"Commands are sent at their recorded times, but never before the\n"
+		"responses preceding them in the capture were received. With -f\n"
+		"commands without response are not paced, so the device may\n"
+		"drop them.\n"
+		"\n"
+		"Options:\n"
+		" -s		Only print summary\n"
+		" -x		Hex dump frame contents\n"
+		" -r		Replay capture\n"
+		" -d <path>	Path to serial device file to replay to\n"
+		" -f		Replay as fast as responses allow\n"
+		" -w <ms>	Max. delay of replayed responses (default: %d)\n"
+		" -o <path>	Capture replayed traffic to file\n"
+		" -h		Print this help message\n"
+		, name, DEFAULT_SLACK_MS);
+}
+
+static uint8_t crc8(const uint8_t *buf, size_t len)
+{
+	uint8_t crc = 0;
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ CRC8_POLY : crc << 1;
+		}
+	}
+
+	return crc;
+}
+
+static const char *op_name(uint8_t opcode)
+{
+	static char unknown[8];
+	const char *name = serco_op_name(opcode);
+
+	if (name == NULL) {
+		snprintf(unknown, sizeof(unknown), "OP_%u", opcode & 0x7f);
+		name = unknown;
+	}
+
+	return name;
+}
+
+static const char *status_name(uint8_t status)
+{
+	static char unknown[16];
+
+	switch (status) {
+	case STATUS_OK:			return "OK";
+	case STATUS_UNKNOWN_CMD:	return "UNKNOWN_CMD";
+	case STATUS_LOGIC_ERROR:	return "LOGIC_ERROR";
+	case STATUS_CRC_ERROR:		return "CRC_ERROR";
+	case STATUS_INVALID_FRAME_LEN:	return "INVALID_FRAME_LEN";
+	case STATUS_INVALID_ARGUMENT:	return "INVALID_ARGUMENT";
+	case STATUS_INVALID_SEND_COOKIE: return "INVALID_SEND_COOKIE";
+	case STATUS_TOO_MUCH_DATA:	return "TOO_MUCH_DATA";
+	}
+	snprintf(unknown, sizeof(unknown), "STATUS_0x%02x", status);
+
+	return unknown;
+}
+
+static void print_time(uint64_t time_us)
+{
+	printf("%12.3f ", time_us / 1000.0);
+}
+
+static void print_hex(const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		printf(" %02x", buf[i]);
+	}
+}
+
+/**
+ * Responses are no longer expected, e.g. after a flush
+ */
+static void expire_pending(struct analysis *an)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++) {
+		if (an->pending[i].valid) {
+			an->ops[an->pending[i].opcode & 0x7f].lost_cnt++;
+			an->pending[i].valid = false;
+		}
+	}
+}
+
+static void handle_frame(struct analysis *an, bool tx, uint64_t time_us,
+				const uint8_t *buf, size_t len, bool crc)
+{
+	struct pending *p;
+	struct op_stats *os;
+	bool matched;
+	uint64_t lat = 0;
+
+	if (crc) {
+		if (len < 1 || crc8(buf, len) != 0) {
+			an->bad_frames++;
+			if (an->verbose) {
+				print_time(time_us);
+				printf("%s CRC error\n", tx ? "TX" : "RX");
+			}
+			return;
+		}
+		len--;
+	}
+
+	if (len == 0) {
+		an->markers++;
+		if (an->verbose) {
+			print_time(time_us);
+			printf("%s end-of-frame marker\n", tx ? "TX" : "RX");
+		}
+		return;
+	}
+	if (len < 2) {
+		an->bad_frames++;
+		if (an->verbose) {
+			print_time(time_us);
+			printf("%s short frame\n", tx ? "TX" : "RX");
+		}
+		return;
+	}
+
+	if (tx) {
+		os = &an->ops[buf[CMD_OPCODE] & 0x7f];
+		os->cnt++;
+		p = &an->pending[buf[CMD_ID]];
+		if (p->valid) {
+			an->ops[p->opcode & 0x7f].lost_cnt++;
+			p->valid = false;
+		}
+		if (buf[CMD_OPCODE] & CMD_FLAG_NO_RESPONSE) {
+			os->nr_cnt++;
+		} else {
+			p->valid = true;
+			p->opcode = buf[CMD_OPCODE];
+			p->time_us = time_us;
+		}
+
+		if (an->verbose) {
+			print_time(time_us);
+			printf("TX %02x %-16s len=%-3zu%s%s", buf[CMD_ID],
+				op_name(buf[CMD_OPCODE]), len - CMD_PAYLOAD,
+				crc ? " crc" : "",
+				(buf[CMD_OPCODE] & CMD_FLAG_NO_RESPONSE) ?
+					" no-response" : "");
+		}
+	} else {
+		p = &an->pending[buf[RES_ID]];
+		matched = p->valid;
+		if (matched) {
+			p->valid = false;
+			lat = time_us - p->time_us;
+			os = &an->ops[p->opcode & 0x7f];
+			if (os->res_cnt == 0 || lat < os->min_us) {
+				os->min_us = lat;
+			}
+			if (lat > os->max_us) {
+				os->max_us = lat;
+			}
+			os->sum_us += lat;
+			os->res_cnt++;
+			if (buf[RES_STATUS] != STATUS_OK) {
+				os->err_cnt++;
+			}
+		} else {
+			an->unmatched++;
+		}
+
+		if (an->verbose) {
+			print_time(time_us);
+			printf("RX %02x %-16s len=%-3zu%s", buf[RES_ID],
+				status_name(buf[RES_STATUS]),
+				len - RES_PAYLOAD, crc ? " crc" : "");
+			if (matched) {
+				printf(" %.3f ms", lat / 1000.0);
+			} else {
+				printf(" unmatched");
+			}
+		}
+	}
+
+	if (an->verbose) {
+		if (an->hexdump) {
+			print_hex(&buf[2], len - 2);
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * Feed bytes of one direction into the frame decoder
+ */
+static void decode(struct analysis *an, bool tx, uint64_t time_us,
+			const uint8_t *buf, size_t len)
+{
+	struct decoder *d = tx ? &an->tx : &an->rx;
+	uint8_t c;
+
+	while (len--) {
+		c = *buf++;
+
+		if (d->stuff_first) {
+			d->stuff_first = false;
+
+			if (c == STUFF_BYTE2 || c == STUFF_BYTE2_CRC) {
+				if (d->comm_error) {
+					an->bad_frames++;
+					if (an->verbose) {
+						print_time(time_us);
+						printf("%s stuffing error, "
+							"%zu bytes dropped\n",
+							tx ? "TX" : "RX", d->len);
+					}
+				} else {
+					handle_frame(an, tx, time_us, d->buf,
+						d->len, c == STUFF_BYTE2_CRC);
+				}
+				d->len = 0;
+				d->comm_error = false;
+				continue;
+			} else if (c != STUFF_BYTE1) {
+				d->comm_error = true;
+			}
+		} else if (c == STUFF_BYTE1) {
+			d->stuff_first = true;
+			continue;
+		}
+
+		if (d->len < MAX_FRAME_LEN) {
+			d->buf[d->len++] = c;
+		} else {
+			d->comm_error = true;
+		}
+	}
+}
+
+/**
+ * Drop partially received frames, e.g. after a flush
+ */
+static void decoder_reset(struct decoder *d)
+{
+	d->len = 0;
+	d->stuff_first = false;
+	d->comm_error = false;
+}
+
+static void analyze_record(struct analysis *an, const struct serco_trace_rec *rec,
+				uint64_t *session_us)
+{
+	char date[32];
+	struct tm tm;
+
+	switch (rec->type) {
+	case SERCO_TRACE_OPEN:
+		an->duration_us += *session_us;
+		*session_us = 0;
+		expire_pending(an);
+		decoder_reset(&an->tx);
+		decoder_reset(&an->rx);
+		an->sessions++;
+		if (an->verbose) {
+			localtime_r(&rec->start.tv_sec, &tm);
+			strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+			printf("# Session %u, started %s.%06ld\n",
+				an->sessions, date, rec->start.tv_nsec / 1000);
+		}
+		break;
+	case SERCO_TRACE_TX:
+		an->tx_bytes += rec->len;
+		decode(an, true, rec->time_us, rec->data, rec->len);
+		break;
+	case SERCO_TRACE_RX:
+		an->rx_bytes += rec->len;
+		decode(an, false, rec->time_us, rec->data, rec->len);
+		break;
+	case SERCO_TRACE_FLUSH:
+		an->flushes++;
+		expire_pending(an);
+		decoder_reset(&an->tx);
+		decoder_reset(&an->rx);
+		if (an->verbose) {
+			print_time(rec->time_us);
+			printf("-- flush\n");
+		}
+		break;
+	}
+	*session_us = rec->time_us;
+}
+
+static void print_summary(struct analysis *an)
+{
+	struct op_stats *os;
+	unsigned int op;
+
+	printf("\n%u session(s), %.3f s, %lu bytes sent, %lu bytes received\n",
+		an->sessions, an->duration_us / 1000000.0,
+		an->tx_bytes, an->rx_bytes);
+	printf("%lu flushes, %lu end-of-frame markers, %lu bad frames, "
+		"%lu unmatched responses\n\n",
+		an->flushes, an->markers, an->bad_frames, an->unmatched);
+
+	printf("%-16s %8s %8s %8s %8s %10s %10s %10s\n", "opcode", "sent",
+		"no-resp", "errors", "lost", "min (ms)", "avg (ms)",
+		"max (ms)");
+	for (op = 0; op < 128; op++) {
+		os = &an->ops[op];
+		if (os->cnt == 0 && os->res_cnt == 0) {
+			continue;
+		}
+		printf("%-16s %8lu %8lu %8lu %8lu", op_name(op), os->cnt,
+			os->nr_cnt, os->err_cnt, os->lost_cnt);
+		if (os->res_cnt > 0) {
+			printf(" %10.3f %10.3f %10.3f\n",
+				os->min_us / 1000.0,
+				os->sum_us / 1000.0 / os->res_cnt,
+				os->max_us / 1000.0);
+		} else {
+			printf(" %10s %10s %10s\n", "-", "-", "-");
+		}
+	}
+}
+
+static int analyze(const char *path, bool verbose, bool hexdump)
+{
+	struct serco_trace tr;
+	struct serco_trace_rec rec;
+	struct analysis *an;
+	uint64_t session_us = 0;
+	int ret;
+
+	if (serco_trace_open(&tr, path) != 0) {
+		perror(path);
+		return -1;
+	}
+
+	an = calloc(1, sizeof(*an));
+	if (an == NULL) {
+		perror("calloc() failed");
+		serco_trace_close(&tr);
+		return -1;
+	}
+	an->verbose = verbose;
+	an->hexdump = hexdump;
+
+	while ((ret = serco_trace_read(&tr, &rec)) == 1) {
+		analyze_record(an, &rec, &session_us);
+	}
+	if (ret < 0) {
+		// A capture of a killed program may end in a partial record
+		fprintf(stderr, "%s: %s, decoding stopped\n", path,
+			(errno == EINVAL) ? "Invalid or truncated capture" :
+				strerror(errno));
+	}
+	an->duration_us += session_us;
+	expire_pending(an);
+
+	print_summary(an);
+
+	free(an);
+	serco_trace_close(&tr);
+
+	return 0;
+}
+
+static void timespec_add_us(struct timespec *ts, uint64_t us)
+{
+	ts->tv_sec += us / 1000000;
+	ts->tv_nsec += (us % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static double ms_between(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000.0 +
+		(b->tv_nsec - a->tv_nsec) / 1000000.0;
+}
+
+/**
+ * Replay the transmitted data of a capture, and compare the responses
+ */
+static int replay(const char *path, const char *dev_path, bool fast,
+			unsigned long slack_ms, const char *out_path)
+{
+	struct serco_trace tr;
+	struct serco_trace_rec rec;
+	struct serco sdev;
+	struct timespec base, start, now, at, deadline;
+	uint8_t buf[SERCO_TRACE_MAX_DATA];
+	unsigned long tx_bytes = 0;
+	unsigned long rx_bytes = 0;
+	unsigned long rx_missing = 0;
+	unsigned long rx_mismatch = 0;
+	unsigned long rx_late = 0;
+	double lag, max_lag = 0, sum_lag = 0;
+	uint64_t recorded_us = 0;
+	uint64_t session_us = 0;
+	ssize_t rlen;
+	size_t i;
+	int ret;
+
+	if (serco_trace_open(&tr, path) != 0) {
+		perror(path);
+		return -1;
+	}
+	if (serco_open_raw(&sdev, dev_path) != 0) {
+		serco_trace_close(&tr);
+		return -1;
+	}
+	if (out_path != NULL && serco_capture_start(&sdev, out_path) != 0) {
+		perror(out_path);
+		serco_close(&sdev);
+		serco_trace_close(&tr);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	base = start;
+	while ((ret = serco_trace_read(&tr, &rec)) == 1) {
+		// Time the record would have in the replay
+		at = base;
+		timespec_add_us(&at, rec.time_us);
+
+		switch (rec.type) {
+		case SERCO_TRACE_OPEN:
+			recorded_us += session_us;
+			clock_gettime(CLOCK_MONOTONIC, &base);
+			// fall-through
+		case SERCO_TRACE_FLUSH:
+			tcflush(sdev.fd, TCIOFLUSH);
+			sdev.rbuf_pos = 0;
+			sdev.rbuf_len = 0;
+			break;
+		case SERCO_TRACE_TX:
+			if (!fast) {
+				while (clock_nanosleep(CLOCK_MONOTONIC,
+						TIMER_ABSTIME, &at, NULL) == EINTR)
+					;
+			}
+			if (serco_write(&sdev, rec.data, rec.len) != 0) {
+				ret = -1;
+				goto done;
+			}
+			tx_bytes += rec.len;
+			break;
+		case SERCO_TRACE_RX:
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			deadline = fast ? now : at;
+			timespec_add_us(&deadline, slack_ms * 1000);
+			rlen = serco_read(&sdev, buf, rec.len, &deadline);
+			if (rlen < 0) {
+				perror("read() failed");
+				ret = -1;
+				goto done;
+			}
+			rx_bytes += rlen;
+			rx_missing += rec.len - rlen;
+			for (i = 0; i < (size_t) rlen; i++) {
+				if (buf[i] != rec.data[i]) {
+					rx_mismatch++;
+				}
+			}
+
+			if (!fast && rlen > 0) {
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				lag = ms_between(&at, &now);
+				if (lag > max_lag) {
+					max_lag = lag;
+				}
+				if (lag > 0) {
+					sum_lag += lag;
+					rx_late++;
+				}
+			}
+			break;
+		}
+		session_us = rec.time_us;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s, replay stopped\n", path,
+			(errno == EINVAL) ? "Invalid or truncated capture" :
+				strerror(errno));
+	}
+	recorded_us += session_us;
+	ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	printf("Replayed %lu bytes in %.3f s (recorded: %.3f s)\n",
+		tx_bytes, ms_between(&start, &now) / 1000, recorded_us / 1000000.0);
+	printf("Received %lu bytes, %lu missing, %lu differ\n",
+		rx_bytes, rx_missing, rx_mismatch);
+	if (!fast) {
+		printf("Receive lag: avg %.3f ms, max %.3f ms over %lu late reads\n",
+			rx_late ? sum_lag / rx_late : 0.0, max_lag, rx_late);
+	}
+	if (rx_missing != 0 || rx_mismatch != 0) {
+		ret = 1;
+	}
+done:
+	serco_close(&sdev);
+	serco_trace_close(&tr);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *endp;
+	char *dev_path;
+	char *out_path = NULL;
+	bool verbose = true;
+	bool hexdump = false;
+	bool do_replay = false;
+	bool fast = false;
+	unsigned long slack_ms = DEFAULT_SLACK_MS;
+	int ret;
+
+	dev_path = strdup(DEFAULT_SERIAL_DEV);
+
+	while ((opt = getopt(argc, argv, "sxrd:fw:o:h")) != -1) {
+		switch (opt) {
+		case 's':
+			verbose = false;
+			break;
+		case 'x':
+			hexdump = true;
+			break;
+		case 'r':
+			do_replay = true;
+			break;
+		case 'd':
+			free(dev_path);
+			dev_path = strdup(optarg);
+			break;
+		case 'f':
+			fast = true;
+			break;
+		case 'w':
+			slack_ms = strtoul(optarg, &endp, 0);
+			if (*endp != '\0') {
+				fprintf(stderr, "Invalid response delay\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		default: /* '?' */
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (do_replay) {
+		ret = replay(argv[optind], dev_path, fast, slack_ms, out_path);
+	} else {
+		ret = analyze(argv[optind], verbose, hexdump);
+	}
+
+	free(dev_path);
+
+	if (ret < 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	return ret;
+}
@@ -0,0 +1,499 @@
+/**
+ * somfy_store.c - Memory mapped rolling code store for Somfy remotes
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "somfy_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BOOT_ID_PATH	"/proc/sys/kernel/random/boot_id"
+
+#define REC_OFFSET(store, rec) \
+	((off_t) ((uint8_t *) (rec) - (uint8_t *) (store)->map))
+
+/**
+ * Lock or unlock byte range of store file
+ *
+ * Uses POSIX advisory record locks, so concurrent processes updating
+ * different remotes don't block each other.
+ *
+ * @param type	F_RDLCK, F_WRLCK or F_UNLCK
+ */
+static int lock_range(int fd, short type, off_t start, off_t len)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = len;
+
+	while (fcntl(fd, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR) {
+			perror("Failed to lock state store");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int lock_rec(struct somfy_store *store, struct somfy_store_rec *rec,
+			short type)
+{
+	return lock_range(store->fd, type, REC_OFFSET(store, rec),
+				sizeof(*rec));
+}
+
+/**
+ * Synchronously write memory range to disk
+ */
+static int sync_range(const void *addr, size_t len)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) addr & ~(page_size - 1);
+	uintptr_t end = (uintptr_t) addr + len;
+
+	if (msync((void *) start, end - start, MS_SYNC) != 0) {
+		perror("Failed to sync state store");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void read_boot_id(char boot_id[40])
+{
+	FILE *fp;
+
+	memset(boot_id, 0, 40);
+	if ((fp = fopen(BOOT_ID_PATH, "r")) == NULL) {
+		return;
+	}
+	if (fgets(boot_id, 40, fp) == NULL) {
+		memset(boot_id, 0, 40);
+	}
+	fclose(fp);
+}
+
+static uint32_t addr_hash(uint32_t addr, uint32_t capacity)
+{
+	return (addr * 2654435761u) % capacity;
+}
+
+/**
+ * Find record of address
+ *
+ * @param empty	If not NULL, return first free record in probe sequence
+ *		here when address is not found.
+ *
+ * @returns	Record, or NULL if not found
+ */
+static struct somfy_store_rec *find_rec(struct somfy_store *store,
+					uint32_t addr,
+					struct somfy_store_rec **empty)
+{
+	uint32_t capacity = store->hdr->capacity;
+	uint32_t idx = addr_hash(addr, capacity);
+	uint32_t i;
+
+	if (empty != NULL) {
+		*empty = NULL;
+	}
+
+	for (i = 0; i < capacity; i++) {
+		struct somfy_store_rec *rec = &store->recs[idx];
+		uint32_t val = __atomic_load_n(&rec->addr, __ATOMIC_ACQUIRE);
+
+		if ((val & SOMFY_STORE_REC_USED) == 0) {
+			if (empty != NULL) {
+				*empty = rec;
+			}
+			return NULL;
+		}
+		if ((val & SOMFY_STORE_ADDR_MASK) == addr) {
+			return rec;
+		}
+
+		idx++;
+		if (idx == capacity) {
+			idx = 0;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Initialize a new, empty, store file
+ *
+ * Must be called with the header lock held.
+ */
+static int init_file(int fd)
+{
+	struct somfy_store_hdr hdr;
+	size_t size;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SOMFY_STORE_MAGIC, sizeof(SOMFY_STORE_MAGIC));
+	hdr.version = SOMFY_STORE_VERSION;
+	hdr.capacity = SOMFY_STORE_DEFAULT_CAPACITY;
+	hdr.batch = SOMFY_STORE_DEFAULT_BATCH;
+	read_boot_id(hdr.boot_id);
+
+	size = sizeof(hdr) + hdr.capacity * sizeof(struct somfy_store_rec);
+	if (ftruncate(fd, size) != 0) {
+		perror("Failed to resize state store");
+		return -1;
+	}
+	if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		perror("Failed to write state store header");
+		return -1;
+	}
+	if (fsync(fd) != 0) {
+		perror("Failed to sync state store");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Recover rolling codes after unclean shutdown
+ *
+ * If the store was last used during another boot, rolling codes that were
+ * handed out may not have reached the disk. Skip all reserved codes in that
+ * case, Somfy receivers accept a forward jump of the rolling code.
+ *
+ * Must be called with the header lock held.
+ */
+static int recover(struct somfy_store *store)
+{
+	char boot_id[40];
+	uint32_t i;
+
+	read_boot_id(boot_id);
+	if (memcmp(boot_id, store->hdr->boot_id, sizeof(boot_id)) == 0) {
+		return 0;
+	}
+
+	// Wait for all record locks to be released
+	if (lock_range(store->fd, F_WRLCK, sizeof(struct somfy_store_hdr),
+				0) != 0) {
+		return -1;
+	}
+
+	for (i = 0; i < store->hdr->capacity; i++) {
+		struct somfy_store_rec *rec = &store->recs[i];
+
+		if ((rec->addr & SOMFY_STORE_REC_USED) &&
+				rec->seq < rec->reserved) {
+			rec->seq = rec->reserved;
+		}
+	}
+	if (sync_range(store->recs,
+			store->hdr->capacity * sizeof(*store->recs)) != 0) {
+		goto bad;
+	}
+
+	memcpy(store->hdr->boot_id, boot_id, sizeof(boot_id));
+	if (sync_range(store->hdr, sizeof(*store->hdr)) != 0) {
+		goto bad;
+	}
+
+	lock_range(store->fd, F_UNLCK, sizeof(struct somfy_store_hdr), 0);
+	return 0;
+bad:
+	lock_range(store->fd, F_UNLCK, sizeof(struct somfy_store_hdr), 0);
+	return -1;
+}
+
+/**
+ * Open state store
+ *
+ * The store file is created if it doesn't exist yet.
+ *
+ * @param store	Store handle to initialize
+ * @param path	Path to store file
+ *
+ * @returns	0 on success, -1 on failure
+ */
+int somfy_store_open(struct somfy_store *store, const char *path)
+{
+	struct somfy_store_hdr hdr;
+	struct stat st;
+
+	memset(store, 0, sizeof(*store));
+	store->map = MAP_FAILED;
+
+	store->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (store->fd == -1) {
+		perror("Failed to open state store");
+		return -1;
+	}
+
+	if (lock_range(store->fd, F_WRLCK, 0,
+				sizeof(struct somfy_store_hdr)) != 0) {
+		goto bad;
+	}
+
+	if (fstat(store->fd, &st) != 0) {
+		perror("Failed to stat state store");
+		goto bad;
+	}
+	if (st.st_size == 0) {
+		if (init_file(store->fd) != 0) {
+			goto bad;
+		}
+	}
+
+	if (pread(store->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+			memcmp(hdr.magic, SOMFY_STORE_MAGIC,
+				sizeof(SOMFY_STORE_MAGIC)) != 0) {
+		fprintf(stderr, "state store illegal format\n");
+		goto bad;
+	}
+	if (hdr.version != SOMFY_STORE_VERSION) {
+		fprintf(stderr, "state store version %u not supported\n",
+				hdr.version);
+		goto bad;
+	}
+
+	store->map_size = sizeof(hdr) +
+				hdr.capacity * sizeof(struct somfy_store_rec);
+	if (fstat(store->fd, &st) != 0 ||
+			(size_t) st.st_size < store->map_size) {
+		fprintf(stderr, "state store truncated\n");
+		goto bad;
+	}
+
+	store->map = mmap(NULL, store->map_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, store->fd, 0);
+	if (store->map == MAP_FAILED) {
+		perror("Failed to map state store");
+		goto bad;
+	}
+	store->hdr = (struct somfy_store_hdr *) store->map;
+	store->recs = (struct somfy_store_rec *) (store->hdr + 1);
+
+	if (recover(store) != 0) {
+		goto bad;
+	}
+
+	lock_range(store->fd, F_UNLCK, 0, sizeof(struct somfy_store_hdr));
+
+	return 0;
+bad:
+	somfy_store_close(store);
+	return -1;
+}
+
+/**
+ * Close state store
+ *
+ * Rolling codes handed out are not synced to disk, this is left to the
+ * kernel. This is safe, since after a reboot all reserved codes are skipped.
+ */
+void somfy_store_close(struct somfy_store *store)
+{
+	if (store->map != MAP_FAILED && store->map != NULL) {
+		munmap(store->map, store->map_size);
+	}
+	store->map = NULL;
+	if (store->fd != -1) {
+		close(store->fd);	// Also releases all locks
+	}
+	store->fd = -1;
+}
+
+/**
+ * Add remote to store
+ *
+ * @param addr	Address of remote
+ * @param key	Next key byte to use
+ * @param seq	Next rolling code to use
+ *
+ * @returns	0 on success, -1 on failure
+ */
+int somfy_store_add(struct somfy_store *store, uint32_t addr, uint8_t key,
+			uint16_t seq)
+{
+	struct somfy_store_rec *rec;
+	int retval = -1;
+
+	addr &= SOMFY_STORE_ADDR_MASK;
+
+	if (lock_range(store->fd, F_WRLCK, 0,
+				sizeof(struct somfy_store_hdr)) != 0) {
+		return -1;
+	}
+
+	if (find_rec(store, addr, &rec) != NULL) {
+		fprintf(stderr, "address %.6x already in state store\n", addr);
+		goto bad;
+	}
+	if (rec == NULL) {
+		fprintf(stderr, "state store full\n");
+		goto bad;
+	}
+
+	rec->seq = seq;
+	rec->reserved = seq;
+	rec->key_off = (key - seq) & 0xf;
+	if (sync_range(rec, sizeof(*rec)) != 0) {
+		goto bad;
+	}
+
+	// Publish record only after its content is on disk
+	__atomic_store_n(&rec->addr, addr | SOMFY_STORE_REC_USED,
+				__ATOMIC_RELEASE);
+	if (sync_range(rec, sizeof(*rec)) != 0) {
+		goto bad;
+	}
+
+	retval = 0;
+bad:
+	lock_range(store->fd, F_UNLCK, 0, sizeof(struct somfy_store_hdr));
+	return retval;
+}
+
+/**
+ * Get next key and rolling code of remote, and advance to the following one
+ *
+ * The returned rolling code is never handed out again, also not after a
+ * crash or power loss, so it should be used right away. Rolling codes are
+ * reserved in batches; only reserving a new batch requires a disk sync.
+ *
+ * @param addr	Address of remote
+ * @param key	Pointer to variable to return key in
+ * @param seq	Pointer to variable to return rolling code in
+ *
+ * @returns	0 on success, -1 on failure
+ */
+int somfy_store_next(struct somfy_store *store, uint32_t addr, uint8_t *key,
+			uint16_t *seq)
+{
+	struct somfy_store_rec *rec;
+	uint32_t cur;
+	int retval = -1;
+
+	addr &= SOMFY_STORE_ADDR_MASK;
+
+	rec = find_rec(store, addr, NULL);
+	if (rec == NULL) {
+		fprintf(stderr, "address %.6x not in state store\n", addr);
+		return -1;
+	}
+
+	if (lock_rec(store, rec, F_WRLCK) != 0) {
+		return -1;
+	}
+
+	cur = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+	if (cur >= rec->reserved) {
+		rec->reserved = cur + store->hdr->batch;
+		if (sync_range(&rec->reserved, sizeof(rec->reserved)) != 0) {
+			goto bad;
+		}
+	}
+	__atomic_store_n(&rec->seq, cur + 1, __ATOMIC_RELEASE);
+
+	*key = 0xa0 | ((rec->key_off + cur) & 0xf);
+	*seq = cur & 0xffff;
+
+	retval = 0;
+bad:
+	lock_rec(store, rec, F_UNLCK);
+	return retval;
+}
+
+/**
+ * Get next key and rolling code of remote, without advancing
+ *
+ * @returns	0 on success, -1 if address not in store
+ */
+int somfy_store_get(struct somfy_store *store, uint32_t addr, uint8_t *key,
+			uint16_t *seq)
+{
+	struct somfy_store_rec *rec;
+	uint32_t cur;
+
+	rec = find_rec(store, addr & SOMFY_STORE_ADDR_MASK, NULL);
+	if (rec == NULL) {
+		return -1;
+	}
+
+	cur = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+	*key = 0xa0 | ((rec->key_off + cur) & 0xf);
+	*seq = cur & 0xffff;
+
+	return 0;
+}
+
+/**
+ * Call function for every remote in store
+ *
+ * Iteration stops when the callback returns non-zero.
+ *
+ * @returns	0, or the non-zero return value of the callback
+ */
+int somfy_store_foreach(struct somfy_store *store,
+			int (*cb)(uint32_t addr, uint8_t key, uint16_t seq,
+				void *arg),
+			void *arg)
+{
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < store->hdr->capacity; i++) {
+		struct somfy_store_rec *rec = &store->recs[i];
+		uint32_t val = __atomic_load_n(&rec->addr, __ATOMIC_ACQUIRE);
+		uint32_t cur;
+
+		if ((val & SOMFY_STORE_REC_USED) == 0) {
+			continue;
+		}
+
+		cur = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		ret = cb(val & SOMFY_STORE_ADDR_MASK,
+				0xa0 | ((rec->key_off + cur) & 0xf),
+				cur & 0xffff, arg);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
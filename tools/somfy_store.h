@@ -0,0 +1,96 @@
+/**
+ * somfy_store.h - Memory mapped rolling code store for Somfy remotes
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SOMFY_STORE_H__
+#define __SOMFY_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SOMFY_STORE_MAGIC		"SOMFYST"
+#define SOMFY_STORE_VERSION		1
+#define SOMFY_STORE_DEFAULT_CAPACITY	1024	// Max. number of remotes
+#define SOMFY_STORE_DEFAULT_BATCH	16	// Rolling codes reserved per sync
+
+#define SOMFY_STORE_REC_USED		0x80000000	// Record in use flag
+#define SOMFY_STORE_ADDR_MASK		0x00ffffff
+
+/**
+ * Store file header
+ *
+ * The header area is also used as lock for adding records and recovery.
+ */
+struct somfy_store_hdr {
+	char magic[8];		// SOMFY_STORE_MAGIC
+	uint32_t version;	// SOMFY_STORE_VERSION
+	uint32_t capacity;	// Number of records in file
+	uint32_t batch;		// Number of rolling codes to reserve at once
+	uint32_t _pad;
+	char boot_id[40];	// Boot ID of system that last opened the store
+};
+
+/**
+ * Store record of a single remote
+ *
+ * The rolling code counter 'seq' is updated atomically in the shared mapping
+ * without syncing it to disk. Only 'reserved' is synced, before any code
+ * beyond it is handed out. After a power loss all codes below 'reserved' are
+ * considered used.
+ */
+struct somfy_store_rec {
+	uint32_t addr;		// Address | SOMFY_STORE_REC_USED
+	uint32_t seq;		// Next rolling code to use
+	uint32_t reserved;	// Rolling codes < reserved may be used unsynced
+	uint8_t key_off;	// Key nibble minus rolling code
+	uint8_t _pad[3];
+};
+
+struct somfy_store {
+	int fd;
+	void *map;
+	size_t map_size;
+	struct somfy_store_hdr *hdr;
+	struct somfy_store_rec *recs;
+};
+
+int somfy_store_open(struct somfy_store *store, const char *path);
+void somfy_store_close(struct somfy_store *store);
+
+int somfy_store_add(struct somfy_store *store, uint32_t addr, uint8_t key,
+			uint16_t seq);
+int somfy_store_next(struct somfy_store *store, uint32_t addr, uint8_t *key,
+			uint16_t *seq);
+int somfy_store_get(struct somfy_store *store, uint32_t addr, uint8_t *key,
+			uint16_t *seq);
+int somfy_store_foreach(struct somfy_store *store,
+			int (*cb)(uint32_t addr, uint8_t key, uint16_t seq,
+				void *arg),
+			void *arg);
+
+#endif // __SOMFY_STORE_H__
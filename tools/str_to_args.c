@@ -0,0 +1,85 @@
+/**
+ * str_to_args.c - Split command line string into arguments
+ *
+ * Copyright (c) 2015, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "str_to_args.h"
+
+#include <ctype.h>
+
+/**
+ * Split string into arguments on spaces
+ *
+ * Splits a string into arguments. The original string will be modified by
+ * overwriting found separators with '\0'. The start locations of the argument
+ * strings are returned in the argv array. The 'argv' array is preallocated by
+ * the caller and should be big enough to contain 'max_args' entries.
+ *
+ * Empty fields are ignored.
+ *
+ * Note this Currently doesn't support any quoting.
+ *
+ * @param cmd_str	String to split. This string is modified!
+ * @param argv		Pointer to array of pointers to place pointers of found
+ *                      arguments in.
+ * @param max_args	Max. number of entries the 'argv' array can hold.
+ *
+ * @returns		Amount of arguments found. If equal to max_args then
+ * 			the last argument contains the rest including spaces.
+ */
+size_t str_to_args(char *cmd_str, char **argv, size_t max_args)
+{
+	size_t args_found = 0;
+
+	while (cmd_str[0] != '\0') {
+		// Strip trailing spaces
+		while (isspace(cmd_str[0])) {
+			cmd_str++;
+		}
+
+		if (cmd_str[0] == '\0') break;
+
+		// Add argument to argv
+		argv[args_found] = cmd_str;
+		args_found++;
+
+		// if args_found == max_args, then don't terminate argument but
+		// return remainder of cmd_str as last arg.
+		if (args_found == max_args) break;
+
+		// Find end of arg, and terminate with '\0'
+		while (cmd_str[0] != '\0' && ! isspace(cmd_str[0])) {
+			cmd_str++;
+		}
+
+		if (cmd_str[0] == '\0') break;
+
+		cmd_str[0] = '\0';
+		cmd_str++;
+	}
+
+	return args_found;
+}
@@ -46,6 +46,7 @@ void usage(const char *name)
 		"Options:\n"
 		" -d <path>	Path to serial device file\n"
 		" -q		Suppress normal output\n"
+		" -v		Print communication statistics\n"
 		" -h		Print this help message\n"
 		, name);
 }
@@ -55,12 +56,14 @@ int main(int argc, char *argv[])
 	int opt;
 	char *dev_path;
 	struct serco sdev;
+	struct serco_stats stats;
 	int ret;
 	bool quiet = false;
+	bool verbose = false;
 
 	dev_path = strdup(DEFAULT_SERIAL_DEV);
 
-	while ((opt = getopt(argc, argv, "d:hq")) != -1) {
+	while ((opt = getopt(argc, argv, "d:hqv")) != -1) {
 		switch (opt) {
 		case 'd':
 			free(dev_path);
@@ -69,6 +72,9 @@ int main(int argc, char *argv[])
 		case 'q':
 			quiet = true;
 			break;
+		case 'v':
+			verbose = true;
+			break;
 		case 'h':
 			usage(argv[0]);
 			exit(EXIT_SUCCESS);
@@ -89,8 +95,19 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	if (verbose) {
+		printf("Open resync: %u attempt(s), %.1f ms\n",
+				sdev.resync_attempts, sdev.resync_us / 1000.0);
+	}
+
 	ret = serco_send_command(&sdev, CMD_NOP, NULL, 0, NULL, 0);
 
+	if (verbose) {
+		printf("CRC: %s\n", sdev.crc ? "enabled" : "disabled");
+		serco_get_stats(&sdev, &stats);
+		serco_stats_print(stdout, &stats);
+	}
+
 	serco_close(&sdev);
 
 	if (ret != STATUS_OK) {